@@ -0,0 +1,120 @@
+/**
+ * Benchmark of the file cache index, startup and lookups with a keyword
+ * filter, for a cache directory with many files.
+ *
+ * @file        file_cache_bench.c
+ * @ingroup     bench
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_file.h"
+#include "olm_file_cache.h"
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The number of keywords the files are spread over. */
+#define KEYWORDS 4
+/** The number of calls each lookup is timed over. */
+#define CALLS 1000
+
+static double
+now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * Fill a directory with files, spread round robin over the keywords, one
+ * second apart.
+ * @return 0 on success or -1 on failure.
+ */
+static int
+make_files(const char *dir, int files) {
+    char path[PATH_MAX];
+    int  fd;
+
+    for (int i = 0; i < files; ++i) {
+        sprintf(path, "%s/bench_kw%d_%d.txt", dir, i % KEYWORDS, 1000000 + i);
+        if ((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0
+            || write(fd, "olm", 3) != 3) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+    olm_file_cache_t *cache;
+    olm_file_t *      file;
+    char              dir[PATH_MAX], name[NAME_MAX];
+    uint32_t          len = 0;
+    double            t, startup;
+    int               files, r, found = 0;
+
+    if (argc != 3 || (files = atoi(argv[2])) <= 0) {
+        fprintf(stderr, "usage: %s <empty dir> <files>\n", argv[0]);
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/", argv[1]);
+
+    if (make_files(argv[1], files) != 0)
+        return 1;
+
+    t = now_us();
+    if ((r = olm_file_cache_new(dir, &cache)) != 0) {
+        fprintf(stderr, "olm_file_cache_new failed: %s\n", strerror(-r));
+        return 1;
+    }
+    startup = now_us() - t;
+    printf("%d files, %d keywords\n", files, KEYWORDS);
+    printf("  startup            %12.3f ms\n", startup / 1e3);
+
+    t = now_us();
+    for (int i = 0; i < CALLS; ++i)
+        len += olm_file_cache_len(cache, "kw1");
+    printf("  len(keyword)       %12.3f us\n", (now_us() - t) / CALLS);
+
+    len /= CALLS;
+    srand(1);
+    t = now_us();
+    for (int i = 0; i < CALLS; ++i) {
+        if (olm_file_cache_index(cache, rand() % len, "kw1", &file) == 0) {
+            olm_file_release(file);
+            ++found;
+        }
+    }
+    printf("  index(i, keyword)  %12.3f us\n", (now_us() - t) / CALLS);
+
+    t = now_us();
+    for (int i = 0; i < CALLS; ++i) {
+        int n = rand() % files;
+
+        sprintf(name, "bench_kw%d_%d.txt", n % KEYWORDS, 1000000 + n);
+        found += olm_file_cache_file_exist(cache, name);
+    }
+    printf("  file_exist         %12.3f us\n", (now_us() - t) / CALLS);
+
+    olm_file_cache_free(cache);
+
+    if (found != 2 * CALLS) {
+        fprintf(stderr, "%d of %d lookups found a file\n", found, 2 * CALLS);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * Benchmark of file cache reads while other threads add files, like an SDO
+ * client listing a cache while daemons write to it.
+ *
+ * @file        file_cache_contention.c
+ * @ingroup     bench
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_file.h"
+#include "olm_file_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The number of threads adding files. */
+#define ADDERS 3
+/** The number of keywords the files are spread over. */
+#define KEYWORDS 4
+/** The most entries one listing pass reads. */
+#define LISTING_MAX 2000
+/** The number of log2 buckets of the read latency histogram, in ns. */
+#define HIST_LEN 64
+
+/** A thread adding files to the cache until stopped. */
+typedef struct {
+    pthread_t         thread;
+    olm_file_cache_t *cache;
+    const char *      dir;
+    int               id;
+    uint32_t          adds;
+} adder_t;
+
+static atomic_bool stop;
+
+static uint64_t
+now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int
+write_file(const char *path) {
+    int fd;
+
+    if ((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644)) < 0)
+        return -1;
+    if (write(fd, "olm", 3) != 3) {
+        close(fd);
+        return -1;
+    }
+
+    return close(fd);
+}
+
+static void *
+adder(void *arg) {
+    adder_t *adder = arg;
+    char     path[PATH_MAX];
+
+    while (!atomic_load(&stop)) {
+        sprintf(path, "%s/bench_add%d_%u.txt", adder->dir, adder->id,
+                2000000 + adder->adds);
+        if (write_file(path) != 0
+            || olm_file_cache_add(adder->cache, path) != 0)
+            break;
+        ++adder->adds;
+    }
+
+    return NULL;
+}
+
+/** Add one read latency to the stats. */
+static void
+record(uint64_t ns, uint64_t *hist, uint64_t *total, uint64_t *max) {
+    ++hist[63 - __builtin_clzll(ns | 1)];
+    *total += ns;
+    if (ns > *max)
+        *max = ns;
+}
+
+int
+main(int argc, char *argv[]) {
+    static uint64_t         hist[HIST_LEN];
+    olm_file_cache_cursor_t cursor = OLM_FILE_CACHE_CURSOR_INITIALIZER;
+    olm_file_cache_t *      cache;
+    const olm_file_t *      file;
+    adder_t                 adders[ADDERS];
+    char                    dir[PATH_MAX], new_dir[PATH_MAX], path[PATH_MAX];
+    uint64_t                t, end, total = 0, max = 0, calls = 0, sum = 0;
+    uint32_t                len, adds = 0;
+    int                     files, seconds = 3, r;
+
+    if (argc < 3 || argc > 4 || (files = atoi(argv[2])) <= 0
+        || (argc == 4 && (seconds = atoi(argv[3])) <= 0)) {
+        fprintf(stderr, "usage: %s <empty dir> <files> [seconds]\n", argv[0]);
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/", argv[1]);
+    snprintf(new_dir, sizeof(new_dir), "%s.new", argv[1]);
+
+    if (mkdir(new_dir, 0755) != 0 && errno != EEXIST) {
+        perror(new_dir);
+        return 1;
+    }
+
+    for (int i = 0; i < files; ++i) {
+        sprintf(path, "%sbench_kw%d_%d.txt", dir, i % KEYWORDS, 1000000 + i);
+        if (write_file(path) != 0) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    if ((r = olm_file_cache_new(dir, &cache)) != 0) {
+        fprintf(stderr, "olm_file_cache_new failed: %s\n", strerror(-r));
+        return 1;
+    }
+
+    for (int i = 0; i < ADDERS; ++i) {
+        adders[i] = (adder_t){.cache = cache, .dir = new_dir, .id = i};
+        pthread_create(&adders[i].thread, NULL, adder, &adders[i]);
+    }
+
+    // SDO style listing passes, the length then seek and get for each entry
+    end = now_ns() + (uint64_t)seconds * 1000000000;
+    while (now_ns() < end) {
+        t   = now_ns();
+        len = olm_file_cache_len(cache, "kw1");
+        record(now_ns() - t, hist, &total, &max);
+        ++calls;
+
+        for (uint32_t i = 0; i < len && i < LISTING_MAX; ++i) {
+            t = now_ns();
+            if (olm_file_cache_cursor_seek(cache, &cursor, i, "kw1") == 0
+                && olm_file_cache_cursor_get(cache, &cursor, &file) == 0)
+                sum += file->size;
+            record(now_ns() - t, hist, &total, &max);
+            ++calls;
+        }
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < ADDERS; ++i) {
+        pthread_join(adders[i].thread, NULL);
+        adds += adders[i].adds;
+    }
+    olm_file_cache_cursor_reset(&cursor);
+
+    printf("%d files, %d adders, %d s\n", files, ADDERS, seconds);
+    printf("  reads              %12llu\n", (unsigned long long)calls);
+    printf("  read avg           %12.0f ns\n", (double)total / calls);
+    for (uint64_t k = 0, acc = 0; k < HIST_LEN; ++k) {
+        if ((acc += hist[k]) * 1000 >= calls * 999) {
+            printf("  read p99.9       < %12.1f us\n", (2ull << k) / 1e3);
+            break;
+        }
+    }
+    printf("  read max           %12.1f us\n", max / 1e3);
+    printf("  adds               %12u\n", adds);
+    printf("  cache len          %12u\n", olm_file_cache_len(cache, NULL));
+
+    olm_file_cache_free(cache);
+    return sum == 0; // the reads must have seen files
+}
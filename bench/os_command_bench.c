@@ -0,0 +1,188 @@
+/**
+ * Benchmark of os_command, the spawn rate and the reply read throughput, next
+ * to the popen() and fgetc() path it replaced.
+ *
+ * @file        os_command_bench.c
+ * @ingroup     bench
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "os_command.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** The max reply of both paths, the same as in os_command.c. */
+#define REPLY_LEN_MAX (1024 * 128)
+/** The reply size for the read benchmark, it fits in the reply ring. */
+#define READ_LEN 130000
+/** The CiA 301 executing status. */
+#define EXECUTING 0xFF
+
+/** How long one command took and the longest call in the loop for it. */
+typedef struct {
+    uint64_t total_us;
+    uint64_t longest_call_us;
+    uint32_t reply_len;
+} bench_run_t;
+
+static uint64_t
+now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * Run a command the way os_command did before, popen() and fgetc() to EOF,
+ * growing the reply buffer as it goes. Blocks for as long as the command
+ * runs, so the longest call is the whole run.
+ */
+static int
+popen_run(const char *command, bench_run_t *out) {
+    uint32_t len = 0, buf_len = 1024;
+    char *   buf, *temp;
+    FILE *   pipe;
+    int      c;
+
+    out->total_us = now_us();
+
+    if ((pipe = popen(command, "r")) == NULL)
+        return -1;
+    if ((buf = malloc(buf_len)) == NULL) {
+        pclose(pipe);
+        return -1;
+    }
+
+    while ((c = fgetc(pipe)) != EOF && len < REPLY_LEN_MAX) {
+        if (len == buf_len) {
+            if ((temp = realloc(buf, buf_len * 2)) == NULL)
+                break;
+            buf = temp;
+            buf_len *= 2;
+        }
+        buf[len++] = (char)c;
+    }
+
+    pclose(pipe);
+    free(buf);
+
+    out->total_us        = now_us() - out->total_us;
+    out->longest_call_us = out->total_us;
+    out->reply_len       = len;
+    return 0;
+}
+
+/**
+ * Run a command as the default os_command job, from a loop like the async
+ * thread's, timing each co_command_async() call.
+ */
+static int
+os_command_run(os_command_t *data, const char *command, bench_run_t *out) {
+    os_command_job_t *job = &data->jobs[0];
+    uint64_t          call;
+
+    free(job->command);
+    if ((job->command = strdup(command)) == NULL)
+        return -1;
+    job->command_len    = strlen(command) + 1;
+    job->reply_streamed = false;
+    job->status         = EXECUTING;
+    OD_OSCommand.status = EXECUTING;
+
+    out->total_us        = now_us();
+    out->longest_call_us = 0;
+    while (job->status == EXECUTING) {
+        call = now_us();
+        co_command_async(data);
+        call = now_us() - call;
+        if (call > out->longest_call_us)
+            out->longest_call_us = call;
+
+        if (job->status == EXECUTING)
+            os_command_wait(data, 100000);
+    }
+    out->total_us  = now_us() - out->total_us;
+    out->reply_len = job->reply_head - job->reply_tail;
+
+    return 0;
+}
+
+/**
+ * Run a command a number of times with one of the paths.
+ * @return The total time in microseconds or 0 on failure.
+ */
+static uint64_t
+bench(os_command_t *data, const char *command, int runs,
+      uint32_t reply_len, uint64_t *longest_call_us) {
+    bench_run_t run = {0};
+    uint64_t    total = 0;
+    int         r;
+
+    *longest_call_us = 0;
+    for (int i = 0; i < runs; ++i) {
+        if (data != NULL)
+            r = os_command_run(data, command, &run);
+        else
+            r = popen_run(command, &run);
+
+        if (r != 0 || run.reply_len != reply_len) {
+            fprintf(stderr, "\"%s\" failed, reply len %u\n", command,
+                    run.reply_len);
+            return 0;
+        }
+
+        total += run.total_us;
+        if (run.longest_call_us > *longest_call_us)
+            *longest_call_us = run.longest_call_us;
+    }
+
+    return total;
+}
+
+int
+main(int argc, char *argv[]) {
+    static os_command_t data = OS_COMMAND_DEFAULT;
+    const char *        names[] = {"popen", "os_command"};
+    char                read_command[64];
+    uint64_t            spawn_us, read_us, sleep_us, longest_us;
+    int                 spawns = 200, reads = 50;
+
+    if (argc > 1)
+        spawns = atoi(argv[1]);
+    if (argc > 2)
+        reads = atoi(argv[2]);
+    if (spawns <= 0 || reads <= 0) {
+        fprintf(stderr, "usage: %s [spawns] [reads]\n", argv[0]);
+        return 1;
+    }
+
+    sprintf(read_command, "head -c %d /dev/zero", READ_LEN);
+
+    printf("%-12s %16s %14s %22s\n", "path", "spawn (cmd/s)", "read (MB/s)",
+           "sleep 0.3 call (us)");
+
+    for (int i = 0; i < 2; ++i) {
+        os_command_t *path = i == 0 ? NULL : &data;
+
+        if ((spawn_us = bench(path, "true", spawns, 0, &longest_us)) == 0
+            || (read_us = bench(path, read_command, reads, READ_LEN,
+                                &longest_us))
+                   == 0
+            || bench(path, "sleep 0.3", 1, 0, &sleep_us) == 0)
+            return 1;
+
+        printf("%-12s %16.0f %14.1f %22llu\n", names[i],
+               spawns * 1e6 / spawn_us, (double)reads * READ_LEN / read_us,
+               (unsigned long long)sleep_us);
+    }
+
+    os_command_free(&data);
+    return 0;
+}
@@ -37,15 +37,15 @@ struct sCO_OD_RAM CO_OD_RAM = {
 /*1003*/ {0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
 /*1010*/ {0x0001L, 0x0001L, 0x0001L, 0x0001L},
 /*1011*/ {0x0001L, 0x0001L, 0x0001L, 0x0001L},
-/*1023*/ {0x3L, 0, 0x0L, 0},
+/*1023*/ {0xAL, 0, 0x0L, 0, 0x0L, 0x0000L, 0x0L, 0x0L, 0, 0x0000L, 0},
 /*2010*/ 0x00000000L,
 /*2011*/ 0x00000000L,
 /*2100*/ {0x0L, 0x0L, 0x0L, 0x0L, 0x0L, 0x0L, 0x0L, 0x0L, 0x0L, 0x0L},
 /*3000*/ {0x4L, 0, 0, 0, 0},
 /*3001*/ {0x1CL, 0, 0, 0, 0, 0x0000L, 0x0L, 0, 0x0L, 0x00, 0x0L, 0x0L, 0, 0, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0L, 0x0000L, 0x0000L, 0x0L, 0x0000L, 0x0000L, 0x0000L, 0x0L},
-/*3002*/ {0x9L, 0x0L, 0x0L, 0x0L, 0, 0x0000L, 0x0000L, 0, 0x0000L, 0},
-/*3003*/ {0x4L, 0, 0, 0, 0},
-/*3004*/ {0x3L, 0, 0, 0},
+/*3002*/ {0x14L, 0x0L, 0x0L, 0x0L, 0, 0x0000L, 0x0000L, 0, 0x0000L, 0, 0x00000000L, 0x00000000L, 0x0000L, 0x0L, 0x0L, 0x00000000L, 0, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
+/*3003*/ {0x1CL, 0, 0, 0, 0, 0x0000L, 0x0000L, 0x0L, 0x0L, 0x0000L, 0x0000L, 0x0000L, 0, 0x0000L, 0x0L, 0x0000L, 0x0L, 0x0L, 0x0000L, 0x00000000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
+/*3004*/ {0x14L, 0, 0, 0, 0x0000L, 0x0000L, 0x0L, 0x0L, 0x0000L, 0x0000L, 0, 0x0000L, 0, 0x0000L, 0, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L, 0x0000L},
 /*3005*/ {0x6L, 0x0L, 0x0L, 0x0L, 0x0L, 0, 0x0L},
 /*3006*/ 0x0L,
 /*3100*/ {0x5L, 0xFFL, 0x0L, 0, 0, 0},
@@ -90,7 +90,10 @@ struct sCO_OD_PERSIST_COMM CO_OD_PERSIST_COMM = {
 /*1017*/ 0x3E8,
 /*1019*/ 0x0L,
 /*1029*/ {0x0L, 0x0L},
-/*1200*/ {{0x3L, 0x80000000L, 0x80000000L, 0x1L}},
+/*1200*/ {{0x3L, 0x80000000L, 0x80000000L, 0x1L},
+/*1201*/ {0x3L, 0x80000000L, 0x80000000L, 0x1L},
+/*1202*/ {0x3L, 0x80000000L, 0x80000000L, 0x1L},
+/*1203*/ {0x3L, 0x80000000L, 0x80000000L, 0x1L}},
 /*1400*/ {{0x5L, 0x0181L, 0xFEL, 0x00},
 /*1401*/ {0x5L, 0x80000300L, 0xFEL, 0x00},
 /*1402*/ {0x5L, 0x80000400L, 0xFEL, 0x00},
@@ -186,11 +189,18 @@ struct sCO_OD_PERSIST_MFR CO_OD_PERSIST_MFR = {
            {(void*)&CO_OD_ROM.identity.serialNumber, 0x85, 0x4 },
 };
 
-/*0x1023*/ const CO_OD_entryRecord_t OD_record1023[4] = {
+/*0x1023*/ const CO_OD_entryRecord_t OD_record1023[11] = {
            {(void*)&CO_OD_RAM.OSCommand.highestSubIndexSupported, 0x06, 0x1 },
            {(void*)0, 0x0E, 0x0 },
            {(void*)&CO_OD_RAM.OSCommand.status, 0x06, 0x1 },
            {(void*)0, 0x06, 0x0 },
+           {(void*)&CO_OD_RAM.OSCommand.jobId, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.OSCommand.exitCode, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.OSCommand.jobsRunning, 0x06, 0x1 },
+           {(void*)&CO_OD_RAM.OSCommand.freeJob, 0x06, 0x1 },
+           {(void*)0, 0x06, 0x0 },
+           {(void*)&CO_OD_RAM.OSCommand.replyCursor, 0x86, 0x4 },
+           {(void*)0, 0x0A, 0x0 },
 };
 
 /*0x1200*/ const CO_OD_entryRecord_t OD_record1200[4] = {
@@ -200,6 +210,27 @@ struct sCO_OD_PERSIST_MFR CO_OD_PERSIST_MFR = {
            {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[0].nodeIDOfTheSDOClient, 0x0F, 0x1 },
 };
 
+/*0x1201*/ const CO_OD_entryRecord_t OD_record1201[4] = {
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[1].highestSubIndexSupported, 0x07, 0x1 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[1].COB_IDClientToServer, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[1].COB_IDServerToClient, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[1].nodeIDOfTheSDOClient, 0x0F, 0x1 },
+};
+
+/*0x1202*/ const CO_OD_entryRecord_t OD_record1202[4] = {
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[2].highestSubIndexSupported, 0x07, 0x1 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[2].COB_IDClientToServer, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[2].COB_IDServerToClient, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[2].nodeIDOfTheSDOClient, 0x0F, 0x1 },
+};
+
+/*0x1203*/ const CO_OD_entryRecord_t OD_record1203[4] = {
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[3].highestSubIndexSupported, 0x07, 0x1 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[3].COB_IDClientToServer, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[3].COB_IDServerToClient, 0xBF, 0x4 },
+           {(void*)&CO_OD_PERSIST_COMM.SDOServerParameter[3].nodeIDOfTheSDOClient, 0x0F, 0x1 },
+};
+
 /*0x1400*/ const CO_OD_entryRecord_t OD_record1400[4] = {
            {(void*)&CO_OD_PERSIST_COMM.RPDOCommunicationParameter[0].highestSubIndexSupported, 0x07, 0x1 },
            {(void*)&CO_OD_PERSIST_COMM.RPDOCommunicationParameter[0].COB_IDUsedByRPDO, 0x8F, 0x4 },
@@ -904,7 +935,7 @@ struct sCO_OD_PERSIST_MFR CO_OD_PERSIST_MFR = {
            {(void*)&CO_OD_RAM.systemInfo.rootParitionPercent, 0x26, 0x1 },
 };
 
-/*0x3002*/ const CO_OD_entryRecord_t OD_record3002[10] = {
+/*0x3002*/ const CO_OD_entryRecord_t OD_record3002[21] = {
            {(void*)&CO_OD_RAM.fileCaches.highestSubIndexSupported, 0x06, 0x1 },
            {(void*)&CO_OD_RAM.fileCaches.freadCacheLen, 0x26, 0x1 },
            {(void*)&CO_OD_RAM.fileCaches.fwriteCacheLen, 0x26, 0x1 },
@@ -915,21 +946,73 @@ struct sCO_OD_PERSIST_MFR CO_OD_PERSIST_MFR = {
            {(void*)0, 0x06, 0x0 },
            {(void*)&CO_OD_RAM.fileCaches.fileSize, 0x86, 0x4 },
            {(void*)0, 0x0A, 0x0 },
+           {(void*)&CO_OD_RAM.fileCaches.cacheBytes, 0x86, 0x8 },
+           {(void*)&CO_OD_RAM.fileCaches.maxBytes, 0x8E, 0x8 },
+           {(void*)&CO_OD_RAM.fileCaches.maxFiles, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fileCaches.keywordPriority, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fileCaches.evictionPolicy, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fileCaches.freeBytes, 0x86, 0x8 },
+           {(void*)0, 0x0A, 0x0 },
+           {(void*)&CO_OD_RAM.fileCaches.deleteBefore, 0x8A, 0x4 },
+           {(void*)&CO_OD_RAM.fileCaches.keepNewest, 0x8A, 0x4 },
+           {(void*)&CO_OD_RAM.fileCaches.windowStart, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fileCaches.windowEnd, 0x8E, 0x4 },
 };
 
-/*0x3003*/ const CO_OD_entryRecord_t OD_record3003[5] = {
+/*0x3003*/ const CO_OD_entryRecord_t OD_record3003[29] = {
            {(void*)&CO_OD_RAM.fread.highestSubIndexSupported, 0x06, 0x1 },
            {(void*)0, 0x0E, 0x0 },
            {(void*)0, 0x06, 0x0 },
            {(void*)0, 0x0A, 0x0 },
            {(void*)0, 0x0A, 0x0 },
-};
-
-/*0x3004*/ const CO_OD_entryRecord_t OD_record3004[4] = {
+           {(void*)&CO_OD_RAM.fread.offset, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fread.length, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.codec, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fread.codecLevel, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fread.rawBytes, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.wireBytes, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.crc32c, 0x86, 0x4 },
+           {(void*)0, 0x06, 0x0 },
+           {(void*)&CO_OD_RAM.fread.maxLatency, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.bulkControl, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fread.bulkCobId, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fread.bulkWindow, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fread.bulkBurst, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fread.bulkAck, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fread.bulkResend, 0x8A, 0x8 },
+           {(void*)&CO_OD_RAM.fread.bulkFramesSent, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.bulkFramesResent, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.rangeLength, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fread.bytesTotal, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.segments, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.rate, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.averageRate, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.idleTime, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fread.aborts, 0x86, 0x4 },
+};
+
+/*0x3004*/ const CO_OD_entryRecord_t OD_record3004[21] = {
            {(void*)&CO_OD_RAM.fwrite.highestSubIndexSupported, 0x06, 0x1 },
            {(void*)0, 0x0E, 0x0 },
            {(void*)0, 0x0A, 0x0 },
            {(void*)0, 0x0A, 0x0 },
+           {(void*)&CO_OD_RAM.fwrite.offset, 0x8E, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.length, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.codec, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fwrite.codecLevel, 0x0E, 0x1 },
+           {(void*)&CO_OD_RAM.fwrite.rawBytes, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.wireBytes, 0x86, 0x4 },
+           {(void*)0, 0x0E, 0x0 },
+           {(void*)&CO_OD_RAM.fwrite.deltaBlockLen, 0x8E, 0x4 },
+           {(void*)0, 0x06, 0x0 },
+           {(void*)&CO_OD_RAM.fwrite.crc32c, 0x86, 0x4 },
+           {(void*)0, 0x06, 0x0 },
+           {(void*)&CO_OD_RAM.fwrite.bytesTotal, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.segments, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.rate, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.averageRate, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.idleTime, 0x86, 0x4 },
+           {(void*)&CO_OD_RAM.fwrite.aborts, 0x86, 0x4 },
 };
 
 /*0x3005*/ const CO_OD_entryRecord_t OD_record3005[7] = {
@@ -973,9 +1056,12 @@ const CO_OD_entry_t CO_OD[CO_OD_NoOfElements] = {
 {0x1017, 0x00, 0x8F,  2, (void*)&CO_OD_PERSIST_COMM.producerHeartbeatTime},
 {0x1018, 0x04, 0x00,  0, (void*)&OD_record1018},
 {0x1019, 0x00, 0x0F,  1, (void*)&CO_OD_PERSIST_COMM.synchronousCounterOverflowValue},
-{0x1023, 0x03, 0x00,  0, (void*)&OD_record1023},
+{0x1023, 0x0A, 0x00,  0, (void*)&OD_record1023},
 {0x1029, 0x02, 0x0F,  1, (void*)&CO_OD_PERSIST_COMM.errorBehavior[0]},
 {0x1200, 0x03, 0x00,  0, (void*)&OD_record1200},
+{0x1201, 0x03, 0x00,  0, (void*)&OD_record1201},
+{0x1202, 0x03, 0x00,  0, (void*)&OD_record1202},
+{0x1203, 0x03, 0x00,  0, (void*)&OD_record1203},
 {0x1400, 0x03, 0x00,  0, (void*)&OD_record1400},
 {0x1401, 0x03, 0x00,  0, (void*)&OD_record1401},
 {0x1402, 0x03, 0x00,  0, (void*)&OD_record1402},
@@ -1047,9 +1133,9 @@ const CO_OD_entry_t CO_OD[CO_OD_NoOfElements] = {
 {0x2100, 0x00, 0x06, 10, (void*)&CO_OD_RAM.errorStatusBits},
 {0x3000, 0x04, 0x00,  0, (void*)&OD_record3000},
 {0x3001, 0x1C, 0x00,  0, (void*)&OD_record3001},
-{0x3002, 0x09, 0x00,  0, (void*)&OD_record3002},
-{0x3003, 0x04, 0x00,  0, (void*)&OD_record3003},
-{0x3004, 0x03, 0x00,  0, (void*)&OD_record3004},
+{0x3002, 0x14, 0x00,  0, (void*)&OD_record3002},
+{0x3003, 0x1C, 0x00,  0, (void*)&OD_record3003},
+{0x3004, 0x14, 0x00,  0, (void*)&OD_record3004},
 {0x3005, 0x06, 0x00,  0, (void*)&OD_record3005},
 {0x3006, 0x00, 0x0E,  1, (void*)&CO_OD_RAM.getLog},
 {0x3100, 0x05, 0x00,  0, (void*)&OD_record3100},
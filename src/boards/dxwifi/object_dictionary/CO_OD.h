@@ -62,7 +62,7 @@
   #define CO_NO_SYNC                     1   //Associated objects: 1005-1007
   #define CO_NO_EMERGENCY                1   //Associated objects: 1014, 1015
   #define CO_NO_TIME                     0   //Associated objects: 1012, 1013
-  #define CO_NO_SDO_SERVER               1   //Associated objects: 1200-127F
+  #define CO_NO_SDO_SERVER               4   //Associated objects: 1200-127F
   #define CO_NO_SDO_CLIENT               0   //Associated objects: 1280-12FF
   #define CO_NO_GFC                      0   //Associated objects: 1300
   #define CO_NO_SRDO                     0   //Associated objects: 1301-1341, 1381-13C0
@@ -77,7 +77,7 @@
 /*******************************************************************************
    OBJECT DICTIONARY
 *******************************************************************************/
-   #define CO_OD_NoOfElements             99
+   #define CO_OD_NoOfElements             102
 
 
 /*******************************************************************************
@@ -95,6 +95,13 @@
                DOMAIN         command;
                UNSIGNED8      status;
                DOMAIN         reply;
+               UNSIGNED8      jobId;
+               INTEGER32      exitCode;
+               UNSIGNED8      jobsRunning;
+               UNSIGNED8      freeJob;
+               DOMAIN         replyStream;
+               UNSIGNED32     replyCursor;
+               DOMAIN         cancel;
                }              OD_OSCommand_t;
 /*1025      */ typedef struct {
                UNSIGNED8      highestSubIndexSupported;
@@ -207,6 +214,17 @@
                DOMAIN         fileName;
                UNSIGNED32     fileSize;
                DOMAIN         deleteFile;
+               UNSIGNED64     cacheBytes;
+               UNSIGNED64     maxBytes;
+               UNSIGNED32     maxFiles;
+               UNSIGNED8      keywordPriority;
+               UNSIGNED8      evictionPolicy;
+               UNSIGNED64     freeBytes;
+               DOMAIN         deleteFiltered;
+               UNSIGNED32     deleteBefore;
+               UNSIGNED32     keepNewest;
+               UNSIGNED32     windowStart;
+               UNSIGNED32     windowEnd;
                }              OD_fileCaches_t;
 /*3003      */ typedef struct {
                UNSIGNED8      highestSubIndexSupported;
@@ -214,12 +232,53 @@
                DOMAIN         fileData;
                DOMAIN         reset;
                DOMAIN         deleteFile;
+               UNSIGNED32     offset;
+               UNSIGNED32     length;
+               UNSIGNED8      codec;
+               UNSIGNED8      codecLevel;
+               UNSIGNED32     rawBytes;
+               UNSIGNED32     wireBytes;
+               UNSIGNED32     crc32c;
+               DOMAIN         sha256;
+               UNSIGNED32     maxLatency;
+               UNSIGNED8      bulkControl;
+               UNSIGNED32     bulkCobId;
+               UNSIGNED8      bulkWindow;
+               UNSIGNED8      bulkBurst;
+               UNSIGNED32     bulkAck;
+               UNSIGNED64     bulkResend;
+               UNSIGNED32     bulkFramesSent;
+               UNSIGNED32     bulkFramesResent;
+               UNSIGNED32     rangeLength;
+               UNSIGNED32     bytesTotal;
+               UNSIGNED32     segments;
+               UNSIGNED32     rate;
+               UNSIGNED32     averageRate;
+               UNSIGNED32     idleTime;
+               UNSIGNED32     aborts;
                }              OD_fread_t;
 /*3004      */ typedef struct {
                UNSIGNED8      highestSubIndexSupported;
                DOMAIN         fileName;
                DOMAIN         fileData;
                DOMAIN         reset;
+               UNSIGNED32     offset;
+               UNSIGNED32     length;
+               UNSIGNED8      codec;
+               UNSIGNED8      codecLevel;
+               UNSIGNED32     rawBytes;
+               UNSIGNED32     wireBytes;
+               DOMAIN         deltaBase;
+               UNSIGNED32     deltaBlockLen;
+               DOMAIN         deltaSignatures;
+               UNSIGNED32     crc32c;
+               DOMAIN         sha256;
+               UNSIGNED32     bytesTotal;
+               UNSIGNED32     segments;
+               UNSIGNED32     rate;
+               UNSIGNED32     averageRate;
+               UNSIGNED32     idleTime;
+               UNSIGNED32     aborts;
                }              OD_fwrite_t;
 /*3005      */ typedef struct {
                UNSIGNED8      highestSubIndexSupported;
@@ -344,6 +403,13 @@
         #define OD_1023_1_OSCommand_command                         1
         #define OD_1023_2_OSCommand_status                          2
         #define OD_1023_3_OSCommand_reply                           3
+        #define OD_1023_4_OSCommand_jobId                           4
+        #define OD_1023_5_OSCommand_exitCode                        5
+        #define OD_1023_6_OSCommand_jobsRunning                     6
+        #define OD_1023_7_OSCommand_freeJob                         7
+        #define OD_1023_8_OSCommand_replyStream                     8
+        #define OD_1023_9_OSCommand_replyCursor                     9
+        #define OD_1023_10_OSCommand_cancel                         10
 
 /*1029 */
         #define OD_1029_errorBehavior                               0x1029
@@ -360,6 +426,30 @@
         #define OD_1200_2_SDOServerParameter_COB_IDServerToClient   2
         #define OD_1200_3_SDOServerParameter_nodeIDOfTheSDOClient   3
 
+/*1201 */
+        #define OD_1201_SDOServerParameter                          0x1201
+
+        #define OD_1201_0_SDOServerParameter_maxSubIndex            0
+        #define OD_1201_1_SDOServerParameter_COB_IDClientToServer   1
+        #define OD_1201_2_SDOServerParameter_COB_IDServerToClient   2
+        #define OD_1201_3_SDOServerParameter_nodeIDOfTheSDOClient   3
+
+/*1202 */
+        #define OD_1202_SDOServerParameter                          0x1202
+
+        #define OD_1202_0_SDOServerParameter_maxSubIndex            0
+        #define OD_1202_1_SDOServerParameter_COB_IDClientToServer   1
+        #define OD_1202_2_SDOServerParameter_COB_IDServerToClient   2
+        #define OD_1202_3_SDOServerParameter_nodeIDOfTheSDOClient   3
+
+/*1203 */
+        #define OD_1203_SDOServerParameter                          0x1203
+
+        #define OD_1203_0_SDOServerParameter_maxSubIndex            0
+        #define OD_1203_1_SDOServerParameter_COB_IDClientToServer   1
+        #define OD_1203_2_SDOServerParameter_COB_IDServerToClient   2
+        #define OD_1203_3_SDOServerParameter_nodeIDOfTheSDOClient   3
+
 /*1400 */
         #define OD_1400_RPDOCommunicationParameter                  0x1400
 
@@ -1156,6 +1246,17 @@
         #define OD_3002_7_fileCaches_fileName                       7
         #define OD_3002_8_fileCaches_fileSize                       8
         #define OD_3002_9_fileCaches_deleteFile                     9
+        #define OD_3002_10_fileCaches_cacheBytes                    10
+        #define OD_3002_11_fileCaches_maxBytes                      11
+        #define OD_3002_12_fileCaches_maxFiles                      12
+        #define OD_3002_13_fileCaches_keywordPriority               13
+        #define OD_3002_14_fileCaches_evictionPolicy                14
+        #define OD_3002_15_fileCaches_freeBytes                     15
+        #define OD_3002_16_fileCaches_deleteFiltered                16
+        #define OD_3002_17_fileCaches_deleteBefore                  17
+        #define OD_3002_18_fileCaches_keepNewest                    18
+        #define OD_3002_19_fileCaches_windowStart                   19
+        #define OD_3002_20_fileCaches_windowEnd                     20
 
 /*3003 */
         #define OD_3003_fread                                       0x3003
@@ -1165,6 +1266,30 @@
         #define OD_3003_2_fread_fileData                            2
         #define OD_3003_3_fread_reset                               3
         #define OD_3003_4_fread_deleteFile                          4
+        #define OD_3003_5_fread_offset                              5
+        #define OD_3003_6_fread_length                              6
+        #define OD_3003_7_fread_codec                               7
+        #define OD_3003_8_fread_codecLevel                          8
+        #define OD_3003_9_fread_rawBytes                            9
+        #define OD_3003_10_fread_wireBytes                          10
+        #define OD_3003_11_fread_crc32c                             11
+        #define OD_3003_12_fread_sha256                             12
+        #define OD_3003_13_fread_maxLatency                         13
+        #define OD_3003_14_fread_bulkControl                        14
+        #define OD_3003_15_fread_bulkCobId                          15
+        #define OD_3003_16_fread_bulkWindow                         16
+        #define OD_3003_17_fread_bulkBurst                          17
+        #define OD_3003_18_fread_bulkAck                            18
+        #define OD_3003_19_fread_bulkResend                         19
+        #define OD_3003_20_fread_bulkFramesSent                     20
+        #define OD_3003_21_fread_bulkFramesResent                   21
+        #define OD_3003_22_fread_rangeLength                        22
+        #define OD_3003_23_fread_bytesTotal                         23
+        #define OD_3003_24_fread_segments                           24
+        #define OD_3003_25_fread_rate                               25
+        #define OD_3003_26_fread_averageRate                        26
+        #define OD_3003_27_fread_idleTime                           27
+        #define OD_3003_28_fread_aborts                             28
 
 /*3004 */
         #define OD_3004_fwrite                                      0x3004
@@ -1173,6 +1298,23 @@
         #define OD_3004_1_fwrite_fileName                           1
         #define OD_3004_2_fwrite_fileData                           2
         #define OD_3004_3_fwrite_reset                              3
+        #define OD_3004_4_fwrite_offset                             4
+        #define OD_3004_5_fwrite_length                             5
+        #define OD_3004_6_fwrite_codec                              6
+        #define OD_3004_7_fwrite_codecLevel                         7
+        #define OD_3004_8_fwrite_rawBytes                           8
+        #define OD_3004_9_fwrite_wireBytes                          9
+        #define OD_3004_10_fwrite_deltaBase                         10
+        #define OD_3004_11_fwrite_deltaBlockLen                     11
+        #define OD_3004_12_fwrite_deltaSignatures                   12
+        #define OD_3004_13_fwrite_crc32c                            13
+        #define OD_3004_14_fwrite_sha256                            14
+        #define OD_3004_15_fwrite_bytesTotal                        15
+        #define OD_3004_16_fwrite_segments                          16
+        #define OD_3004_17_fwrite_rate                              17
+        #define OD_3004_18_fwrite_averageRate                       18
+        #define OD_3004_19_fwrite_idleTime                          19
+        #define OD_3004_20_fwrite_aborts                            20
 
 /*3005 */
         #define OD_3005_appManager                                  0x3005
@@ -1266,7 +1408,7 @@ struct sCO_OD_PERSIST_COMM{
 /*1017      */ UNSIGNED16     producerHeartbeatTime;
 /*1019      */ UNSIGNED8      synchronousCounterOverflowValue;
 /*1029      */ UNSIGNED8       errorBehavior[2];
-/*1200      */ OD_SDOServerParameter_t SDOServerParameter[1];
+/*1200      */ OD_SDOServerParameter_t SDOServerParameter[4];
 /*1400      */ OD_RPDOCommunicationParameter_t RPDOCommunicationParameter[16];
 /*1600      */ OD_RPDOMappingParameter_t RPDOMappingParameter[16];
 /*1800      */ OD_TPDOCommunicationParameter_t TPDOCommunicationParameter[16];
@@ -0,0 +1,46 @@
+/**
+ * CRC-32C (Castagnoli) checksum.
+ *
+ * @file        crc32c.c
+ * @ingroup     crc32c
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "crc32c.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Reversed CRC-32C polynomial. */
+#define CRC32C_POLY 0x82F63B78U
+
+static uint32_t       crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void
+crc32c_table_init(void) {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+
+        for (int j = 0; j < 8; ++j)
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1U)));
+
+        crc32c_table[i] = crc;
+    }
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *ptr = data;
+
+    pthread_once(&crc32c_table_once, crc32c_table_init);
+
+    crc = ~crc;
+    while (len--)
+        crc = crc32c_table[(crc ^ *ptr++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
@@ -0,0 +1,34 @@
+/**
+ * CRC-32C (Castagnoli) checksum.
+ *
+ * @file        crc32c.h
+ * @ingroup     crc32c
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The starting value for a new CRC-32C. */
+#define CRC32C_INIT 0
+
+/**
+ * @brief Add data to a CRC-32C. Can be called repeatedly to checksum data in
+ * chunks.
+ *
+ * @param crc The CRC so far or CRC32C_INIT for a new CRC.
+ * @param data The data to add.
+ * @param len The length of the data.
+ *
+ * @return The updated CRC.
+ */
+uint32_t
+crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif /* CRC32C_H */
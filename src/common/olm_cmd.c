@@ -0,0 +1,126 @@
+/**
+ * Running shell commands without blocking on them.
+ *
+ * @file        olm_cmd.c
+ * @ingroup     olm_cmd
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#define _GNU_SOURCE
+#include "olm_cmd.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+int
+olm_cmd_spawn(olm_cmd_t *cmd, const char *command) {
+    posix_spawn_file_actions_t actions;
+    char *argv[] = {"/bin/sh", "-c", (char *)command, NULL};
+    int   fds[2];
+    int   r;
+
+    if (cmd == NULL || command == NULL || cmd->pid >= 0)
+        return -EINVAL;
+
+    // both ends are closed in the child, but stdout dup'ed from the write end
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -errno;
+
+    if ((r = posix_spawn_file_actions_init(&actions)) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -r;
+    }
+
+    if ((r = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                              "/dev/null", O_RDONLY, 0))
+            == 0
+        && (r = posix_spawn_file_actions_adddup2(&actions, fds[1],
+                                                 STDOUT_FILENO))
+               == 0)
+        r = posix_spawn(&cmd->pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if (r != 0) {
+        cmd->pid = -1;
+        close(fds[0]);
+        return -r;
+    }
+
+    // only the read end, so the command's writes still block when it is full
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    cmd->fd     = fds[0];
+    cmd->status = 0;
+    return 0;
+}
+
+ssize_t
+olm_cmd_read(olm_cmd_t *cmd, void *buf, size_t len) {
+    ssize_t n;
+
+    if (cmd == NULL || cmd->fd < 0)
+        return -EINVAL;
+
+    while ((n = read(cmd->fd, buf, len)) < 0 && errno == EINTR)
+        ;
+
+    if (n < 0)
+        return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+
+    if (n == 0 && len != 0) { // the end, the command closed its stdout
+        close(cmd->fd);
+        cmd->fd = -1;
+    }
+
+    return n;
+}
+
+int
+olm_cmd_reap(olm_cmd_t *cmd) {
+    pid_t pid;
+
+    if (cmd == NULL || cmd->pid < 0)
+        return -EINVAL;
+
+    while ((pid = waitpid(cmd->pid, &cmd->status, WNOHANG)) < 0
+           && errno == EINTR)
+        ;
+
+    if (pid < 0)
+        return -errno;
+    if (pid == 0)
+        return 0;
+
+    cmd->pid = -1;
+    return 1;
+}
+
+void
+olm_cmd_kill(olm_cmd_t *cmd) {
+    if (cmd == NULL)
+        return;
+
+    if (cmd->pid >= 0) {
+        kill(cmd->pid, SIGKILL);
+        while (waitpid(cmd->pid, &cmd->status, 0) < 0 && errno == EINTR)
+            ;
+        cmd->pid = -1;
+    }
+
+    if (cmd->fd >= 0) {
+        close(cmd->fd);
+        cmd->fd = -1;
+    }
+}
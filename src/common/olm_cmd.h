@@ -0,0 +1,80 @@
+/**
+ * Running shell commands without blocking on them.
+ *
+ * @file        olm_cmd.h
+ * @ingroup     olm_cmd
+ *
+ * A command is spawned with posix_spawn as "/bin/sh -c <command>", with its
+ * stdout on a pipe. The read end of the pipe is non-blocking, so it can be
+ * added to an epoll set and read as the output comes, and the command is
+ * reaped without waiting once it is done.
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_CMD_H
+#define OLM_CMD_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/** A running command. */
+typedef struct {
+    /** The process id, -1 if none or once reaped. */
+    pid_t pid;
+    /** The non-blocking read end of stdout, -1 if none or after its end. */
+    int fd;
+    /** The wait status, once reaped. */
+    int status;
+} olm_cmd_t;
+
+#define OLM_CMD_INITIALIZER                                                    \
+    { .pid = -1, .fd = -1, .status = 0, }
+
+/**
+ * @brief Spawn a command. Its stdin is /dev/null and its stderr is OLM's.
+ *
+ * @param cmd The command object, must not be running.
+ * @param command The shell command.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_cmd_spawn(olm_cmd_t *cmd, const char *command);
+
+/**
+ * @brief Read the output of a command, never waiting for it.
+ *
+ * @param cmd The command.
+ * @param buf The buffer for the output.
+ * @param len The size of the buffer.
+ *
+ * @return The number of bytes read, 0 at the end of the output (the fd is
+ * closed then), -EAGAIN if there is no output yet, or other negative errno on
+ * failure.
+ */
+ssize_t
+olm_cmd_read(olm_cmd_t *cmd, void *buf, size_t len);
+
+/**
+ * @brief Reap a command if it has exited, never waiting for it.
+ *
+ * @param cmd The command.
+ *
+ * @return 1 if it exited (the wait status is in cmd->status), 0 if it is
+ * still running, or negative errno on failure.
+ */
+int
+olm_cmd_reap(olm_cmd_t *cmd);
+
+/**
+ * @brief Kill a command if it is still running, reap it and close its fd.
+ *
+ * @param cmd The command.
+ */
+void
+olm_cmd_kill(olm_cmd_t *cmd);
+
+#endif /* OLM_CMD_H */
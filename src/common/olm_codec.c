@@ -0,0 +1,361 @@
+/**
+ * Streaming compression codecs for file transfers.
+ *
+ * @file        olm_codec.c
+ * @ingroup     olm_codec
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_codec.h"
+#include <errno.h>
+#include <lz4frame.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define ZSTD_STATIC_LINKING_ONLY // for ZSTD_getCParams()
+#include <zstd.h>
+
+/**
+ * The most input given to lz4 at once. lz4 can only compress into a buffer
+ * big enough for the worst case, so this bounds the staging buffer.
+ */
+#define LZ4_CHUNK_LEN 4096
+/**
+ * The largest zstd window, as a log2, for both compressing and decompressing.
+ * Frames with a larger window are rejected, as the window is allocated by
+ * the decoder and a client could ask for up to 2 GiB.
+ */
+#define ZSTD_WINDOW_LOG_MAX 20
+/**
+ * The largest zstd match finder tables, as a log2 of their entries. The high
+ * levels use 2^24+ entry tables, this keeps every level under about 5 MiB.
+ */
+#define ZSTD_TABLE_LOG_MAX 18
+
+struct olm_codec_t {
+    /** The codec. */
+    olm_codec_type_t type;
+    /** True if compressing. */
+    bool compress;
+    /** True once the stream is finished, other than the staged output. */
+    bool ended;
+    /** The codec's context. */
+    union {
+        LZ4F_cctx *  lz4c;
+        LZ4F_dctx *  lz4d;
+        ZSTD_CCtx *  zstdc;
+        ZSTD_DCtx *  zstdd;
+        void *       none;
+    } ctx;
+    /** lz4 compression preferences. */
+    LZ4F_preferences_t prefs;
+    /** True once the lz4 frame header was made. */
+    bool started;
+    /** Output made but not given to the caller yet, lz4 compression only. */
+    uint8_t *stage;
+    /** The size of the staging buffer. */
+    size_t stage_size;
+    /** The start of the output in the staging buffer. */
+    size_t stage_pos;
+    /** The end of the output in the staging buffer. */
+    size_t stage_len;
+};
+
+/**
+ * Set the level of a zstd compression context, with its window and tables
+ * capped, so the memory it uses is bounded at every level.
+ * @param cctx The context.
+ * @param level The level, 0 for the default.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_codec_zstd_bound(ZSTD_CCtx *cctx, uint8_t level) {
+    ZSTD_compressionParameters cp;
+
+    cp = ZSTD_getCParams(level == 0 ? ZSTD_CLEVEL_DEFAULT : level, 0, 0);
+    if (cp.windowLog > ZSTD_WINDOW_LOG_MAX)
+        cp.windowLog = ZSTD_WINDOW_LOG_MAX;
+    if (cp.hashLog > ZSTD_TABLE_LOG_MAX)
+        cp.hashLog = ZSTD_TABLE_LOG_MAX;
+    if (cp.chainLog > ZSTD_TABLE_LOG_MAX)
+        cp.chainLog = ZSTD_TABLE_LOG_MAX;
+
+    if ((level != 0
+         && ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                                level)))
+        || ZSTD_isError(
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, cp.windowLog))
+        || ZSTD_isError(
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_hashLog, cp.hashLog))
+        || ZSTD_isError(
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_chainLog, cp.chainLog)))
+        return -EINVAL;
+
+    return 0;
+}
+
+int
+olm_codec_new(olm_codec_type_t type, uint8_t level, bool compress,
+              olm_codec_t **out) {
+    olm_codec_t *codec;
+    int          r = 0;
+
+    if (out == NULL || type > OLM_CODEC_MAX || level > OLM_CODEC_LEVEL_MAX)
+        return -EINVAL;
+
+    if ((codec = calloc(1, sizeof(olm_codec_t))) == NULL)
+        return -ENOMEM;
+
+    codec->type     = type;
+    codec->compress = compress;
+
+    switch (type) {
+    case OLM_CODEC_NONE:
+        break;
+
+    case OLM_CODEC_LZ4:
+        if (compress) {
+            codec->prefs.compressionLevel = level;
+            codec->stage_size
+                = LZ4F_compressBound(LZ4_CHUNK_LEN, &codec->prefs);
+            if (codec->stage_size < LZ4F_HEADER_SIZE_MAX)
+                codec->stage_size = LZ4F_HEADER_SIZE_MAX;
+
+            if ((codec->stage = malloc(codec->stage_size)) == NULL)
+                r = -ENOMEM;
+            else if (LZ4F_isError(
+                         LZ4F_createCompressionContext(&codec->ctx.lz4c,
+                                                       LZ4F_VERSION)))
+                r = -ENOMEM;
+        } else if (LZ4F_isError(LZ4F_createDecompressionContext(
+                       &codec->ctx.lz4d, LZ4F_VERSION))) {
+            r = -ENOMEM;
+        }
+        break;
+
+    case OLM_CODEC_ZSTD:
+        if (compress) {
+            if ((codec->ctx.zstdc = ZSTD_createCCtx()) == NULL)
+                r = -ENOMEM;
+            else
+                r = olm_codec_zstd_bound(codec->ctx.zstdc, level);
+        } else if ((codec->ctx.zstdd = ZSTD_createDCtx()) == NULL) {
+            r = -ENOMEM;
+        } else if (ZSTD_isError(ZSTD_DCtx_setParameter(codec->ctx.zstdd,
+                                                       ZSTD_d_windowLogMax,
+                                                       ZSTD_WINDOW_LOG_MAX))) {
+            r = -EINVAL;
+        }
+        break;
+    }
+
+    if (r == 0)
+        *out = codec;
+    else
+        olm_codec_free(codec);
+
+    return r;
+}
+
+void
+olm_codec_free(olm_codec_t *codec) {
+    if (codec == NULL)
+        return;
+
+    switch (codec->type) {
+    case OLM_CODEC_NONE:
+        break;
+
+    case OLM_CODEC_LZ4:
+        if (codec->compress)
+            LZ4F_freeCompressionContext(codec->ctx.lz4c);
+        else
+            LZ4F_freeDecompressionContext(codec->ctx.lz4d);
+        break;
+
+    case OLM_CODEC_ZSTD:
+        if (codec->compress)
+            ZSTD_freeCCtx(codec->ctx.zstdc);
+        else
+            ZSTD_freeDCtx(codec->ctx.zstdd);
+        break;
+    }
+
+    free(codec->stage);
+    free(codec);
+}
+
+/**
+ * Pass data through as is.
+ * @return 1 if finished, 0 if not.
+ */
+static int
+olm_codec_run_none(const void *in, size_t *in_len, void *out, size_t *out_len,
+                   bool end) {
+    size_t len = *in_len < *out_len ? *in_len : *out_len;
+
+    memcpy(out, in, len);
+    *out_len = len;
+
+    if (end && len == *in_len) {
+        *in_len = len;
+        return 1;
+    }
+
+    *in_len = len;
+    return 0;
+}
+
+/**
+ * Compress with lz4. The lz4 frame API can only compress into a buffer big
+ * enough for the worst case, so the output is staged and handed out as the
+ * caller has room for it.
+ * @return 1 if finished, 0 if not, or negative errno on failure.
+ */
+static int
+olm_codec_run_lz4c(olm_codec_t *codec, const uint8_t *in, size_t *in_len,
+                   uint8_t *out, size_t *out_len, bool end) {
+    size_t used = 0, written = 0, len;
+
+    while (written < *out_len) {
+        if (codec->stage_pos < codec->stage_len) { // hand out staged output
+            len = codec->stage_len - codec->stage_pos;
+            if (len > *out_len - written)
+                len = *out_len - written;
+
+            memcpy(&out[written], &codec->stage[codec->stage_pos], len);
+            codec->stage_pos += len;
+            written += len;
+            continue;
+        }
+
+        codec->stage_pos = 0;
+        codec->stage_len = 0;
+
+        if (!codec->started) {
+            len = LZ4F_compressBegin(codec->ctx.lz4c, codec->stage,
+                                     codec->stage_size, &codec->prefs);
+            codec->started = true;
+        } else if (used < *in_len) {
+            size_t chunk = *in_len - used;
+
+            if (chunk > LZ4_CHUNK_LEN)
+                chunk = LZ4_CHUNK_LEN;
+
+            len = LZ4F_compressUpdate(codec->ctx.lz4c, codec->stage,
+                                      codec->stage_size, &in[used], chunk,
+                                      NULL);
+            used += chunk;
+        } else if (end && !codec->ended) {
+            len = LZ4F_compressEnd(codec->ctx.lz4c, codec->stage,
+                                   codec->stage_size, NULL);
+            codec->ended = true;
+        } else {
+            break; // needs more input
+        }
+
+        if (LZ4F_isError(len))
+            return -EINVAL;
+        codec->stage_len = len;
+    }
+
+    *in_len  = used;
+    *out_len = written;
+    return codec->ended && codec->stage_pos == codec->stage_len;
+}
+
+/**
+ * Decompress with lz4.
+ * @return 1 if finished, 0 if not, or negative errno on failure.
+ */
+static int
+olm_codec_run_lz4d(olm_codec_t *codec, const uint8_t *in, size_t *in_len,
+                   uint8_t *out, size_t *out_len) {
+    size_t used = 0, written = 0, src, dst, hint;
+
+    while (!codec->ended && written < *out_len) {
+        src  = *in_len - used;
+        dst  = *out_len - written;
+        hint = LZ4F_decompress(codec->ctx.lz4d, &out[written], &dst, &in[used],
+                               &src, NULL);
+        if (LZ4F_isError(hint))
+            return -EINVAL;
+
+        used += src;
+        written += dst;
+
+        if (hint == 0)
+            codec->ended = true; // end of the frame
+        else if (src == 0 && dst == 0)
+            break; // needs more input
+    }
+
+    *in_len  = used;
+    *out_len = written;
+    return codec->ended;
+}
+
+/**
+ * Compress or decompress with zstd.
+ * @return 1 if finished, 0 if not, or negative errno on failure.
+ */
+static int
+olm_codec_run_zstd(olm_codec_t *codec, const void *in, size_t *in_len,
+                   void *out, size_t *out_len, bool end) {
+    ZSTD_inBuffer  inb  = {.src = in, .size = *in_len, .pos = 0};
+    ZSTD_outBuffer outb = {.dst = out, .size = *out_len, .pos = 0};
+    size_t         r    = 0;
+
+    if (codec->compress) {
+        // with end, this is 0 once all the input is used and flushed
+        r = ZSTD_compressStream2(codec->ctx.zstdc, &outb, &inb,
+                                 end ? ZSTD_e_end : ZSTD_e_continue);
+        if (!ZSTD_isError(r) && end && r == 0 && inb.pos == inb.size)
+            codec->ended = true;
+    } else {
+        while (!codec->ended && outb.pos < outb.size) {
+            size_t in_pos = inb.pos, out_pos = outb.pos;
+
+            r = ZSTD_decompressStream(codec->ctx.zstdd, &outb, &inb);
+            if (ZSTD_isError(r))
+                break;
+            if (r == 0)
+                codec->ended = true; // end of the frame
+            else if (inb.pos == in_pos && outb.pos == out_pos)
+                break; // needs more input
+        }
+    }
+
+    if (ZSTD_isError(r))
+        return -EINVAL;
+
+    *in_len  = inb.pos;
+    *out_len = outb.pos;
+    return codec->ended;
+}
+
+int
+olm_codec_run(olm_codec_t *codec, const void *in, size_t *in_len, void *out,
+              size_t *out_len, bool end) {
+    if (codec == NULL || in_len == NULL || out_len == NULL
+        || (in == NULL && *in_len != 0) || (out == NULL && *out_len != 0))
+        return -EINVAL;
+
+    switch (codec->type) {
+    case OLM_CODEC_LZ4:
+        if (codec->compress)
+            return olm_codec_run_lz4c(codec, in, in_len, out, out_len, end);
+        return olm_codec_run_lz4d(codec, in, in_len, out, out_len);
+
+    case OLM_CODEC_ZSTD:
+        return olm_codec_run_zstd(codec, in, in_len, out, out_len, end);
+
+    default:
+        return olm_codec_run_none(in, in_len, out, out_len, end);
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * Streaming compression codecs for file transfers.
+ *
+ * @file        olm_codec.h
+ * @ingroup     olm_codec
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_CODEC_H
+#define OLM_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The codecs. */
+typedef enum {
+    /** No compression, data is passed through as is. */
+    OLM_CODEC_NONE = 0,
+    /** The lz4 frame format. */
+    OLM_CODEC_LZ4 = 1,
+    /** The zstd frame format. */
+    OLM_CODEC_ZSTD = 2,
+} olm_codec_type_t;
+
+/** The highest codec value. */
+#define OLM_CODEC_MAX OLM_CODEC_ZSTD
+
+/**
+ * The highest compression level, 0 is the codec's default level. zstd's
+ * ultra levels (20 to 22) need windows larger than OLM allows.
+ */
+#define OLM_CODEC_LEVEL_MAX 19
+
+/** A compression or decompression stream. */
+typedef struct olm_codec_t olm_codec_t;
+
+/**
+ * @brief Make a new compression or decompression stream. The memory used is
+ * bounded, at most about 5 MiB at any level, and does not depend on how much
+ * data goes through it. zstd frames with a window over 1 MiB are rejected.
+ *
+ * @param type The codec.
+ * @param level The compression level, 0 for the codec's default. Not used
+ * for decompression.
+ * @param compress True to compress, false to decompress.
+ * @param out The new stream.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_codec_new(olm_codec_type_t type, uint8_t level, bool compress,
+              olm_codec_t **out);
+
+/**
+ * @brief Free a stream.
+ *
+ * @param codec The stream, can be NULL.
+ */
+void
+olm_codec_free(olm_codec_t *codec);
+
+/**
+ * @brief Run data through a stream. Not all of the input may be used and
+ * the output may not be filled, call again with the rest of the input.
+ *
+ * @param codec The stream.
+ * @param in The input data.
+ * @param in_len In: the length of the input. Out: the bytes used.
+ * @param out The output buffer.
+ * @param out_len In: the size of the output buffer. Out: the bytes written.
+ * @param end True if there is no input after this, so the stream can be
+ * finished. Not used for decompression, the frame says where it ends.
+ *
+ * @return 1 if the stream is finished and all of its output was written, 0
+ * if more calls are needed, or negative errno on failure.
+ */
+int
+olm_codec_run(olm_codec_t *codec, const void *in, size_t *in_len, void *out,
+              size_t *out_len, bool end);
+
+#endif /* OLM_CODEC_H */
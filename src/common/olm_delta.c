@@ -0,0 +1,294 @@
+/**
+ * Block level delta transfers, like rsync.
+ *
+ * @file        olm_delta.c
+ * @ingroup     olm_delta
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_delta.h"
+#include "crc32c.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** Length of the signatures header, the block length and base length. */
+#define SIGNATURE_HEADER_LEN 8
+/** Length of the signature of one block, the weak and strong checksums. */
+#define SIGNATURE_BLOCK_LEN 8
+/** Length of the longest instruction, without literal data. */
+#define INSTRUCTION_LEN_MAX 9
+
+struct olm_delta_t {
+    /** The base file. */
+    int fd;
+    /** The length of the base file. */
+    uint32_t base_len;
+    /** The block length. */
+    uint32_t block_len;
+    /** The CRC-32C of the new file so far. */
+    uint32_t crc;
+    /** The instruction being read. */
+    uint8_t instruction[INSTRUCTION_LEN_MAX];
+    /** The bytes of the instruction read so far. */
+    size_t instruction_len;
+    /** The offset in the base of the rest of the current copy. */
+    uint32_t copy_pos;
+    /** Bytes left in the current copy. */
+    uint32_t copy_left;
+    /** Bytes left in the current literal. */
+    uint32_t literal_left;
+    /** True once the end instruction was read. */
+    bool ended;
+};
+
+static uint32_t
+get_le32(const uint8_t *data) {
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8
+           | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static void
+set_le32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+uint32_t
+olm_delta_weak(const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    uint32_t       a = 0, b = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        a += bytes[i];
+        b += (uint32_t)(len - i) * bytes[i];
+    }
+
+    return (a & 0xFFFF) + ((b & 0xFFFF) << 16);
+}
+
+uint32_t
+olm_delta_signature_len(uint32_t base_len, uint32_t block_len) {
+    uint32_t blocks = base_len / block_len + (base_len % block_len != 0);
+
+    return SIGNATURE_HEADER_LEN + blocks * SIGNATURE_BLOCK_LEN;
+}
+
+int
+olm_delta_signature(int fd, uint32_t base_len, uint32_t block_len,
+                    uint32_t offset, uint8_t *out, uint32_t len) {
+    uint8_t  entry[SIGNATURE_BLOCK_LEN];
+    uint8_t *block;
+    uint32_t pos = offset, end = offset + len, block_n, n, skip;
+    ssize_t  r;
+
+    if (block_len < OLM_DELTA_BLOCK_LEN_MIN
+        || block_len > OLM_DELTA_BLOCK_LEN_MAX || out == NULL
+        || end < offset || end > olm_delta_signature_len(base_len, block_len))
+        return -EINVAL;
+
+    for (; pos < end && pos < SIGNATURE_HEADER_LEN; ++pos) { // header
+        set_le32(entry, block_len);
+        set_le32(&entry[4], base_len);
+        out[pos - offset] = entry[pos];
+    }
+
+    if (pos == end)
+        return 0;
+
+    if ((block = malloc(block_len)) == NULL)
+        return -ENOMEM;
+
+    while (pos < end) { // one block at a time
+        block_n = (pos - SIGNATURE_HEADER_LEN) / SIGNATURE_BLOCK_LEN;
+        skip    = (pos - SIGNATURE_HEADER_LEN) % SIGNATURE_BLOCK_LEN;
+        n       = base_len - block_n * block_len;
+        if (n > block_len)
+            n = block_len;
+
+        if ((r = pread(fd, block, n, (off_t)block_n * block_len))
+            != (ssize_t)n) {
+            free(block);
+            return r < 0 ? -errno : -EIO;
+        }
+
+        set_le32(entry, olm_delta_weak(block, n));
+        set_le32(&entry[4], crc32c(CRC32C_INIT, block, n));
+
+        n = SIGNATURE_BLOCK_LEN - skip;
+        if (n > end - pos)
+            n = end - pos;
+        memcpy(&out[pos - offset], &entry[skip], n);
+        pos += n;
+    }
+
+    free(block);
+    return 0;
+}
+
+int
+olm_delta_new(int fd, uint32_t base_len, uint32_t block_len, uint32_t crc,
+              olm_delta_t **out) {
+    olm_delta_t *delta;
+
+    if (out == NULL || fd < 0 || block_len < OLM_DELTA_BLOCK_LEN_MIN
+        || block_len > OLM_DELTA_BLOCK_LEN_MAX)
+        return -EINVAL;
+
+    if ((delta = calloc(1, sizeof(olm_delta_t))) == NULL)
+        return -ENOMEM;
+
+    delta->fd        = fd;
+    delta->base_len  = base_len;
+    delta->block_len = block_len;
+    delta->crc       = crc;
+
+    *out = delta;
+    return 0;
+}
+
+void
+olm_delta_free(olm_delta_t *delta) {
+    free(delta);
+}
+
+/**
+ * Start the instruction that was read.
+ * @return 0 on success or -EBADMSG if the instruction is not valid.
+ */
+static int
+olm_delta_instruction(olm_delta_t *delta) {
+    uint32_t blocks = delta->base_len / delta->block_len
+                      + (delta->base_len % delta->block_len != 0);
+    uint32_t first, count;
+    uint64_t end;
+
+    switch (delta->instruction[0]) {
+    case OLM_DELTA_END:
+        if (get_le32(&delta->instruction[1]) != delta->crc)
+            return -EBADMSG;
+        delta->ended = true;
+        break;
+
+    case OLM_DELTA_COPY:
+        first = get_le32(&delta->instruction[1]);
+        count = get_le32(&delta->instruction[5]);
+        if (first > blocks || count > blocks - first)
+            return -EBADMSG; // past the end of the base
+
+        end = (uint64_t)(first + count) * delta->block_len;
+        if (end > delta->base_len)
+            end = delta->base_len; // last block can be short
+
+        delta->copy_pos  = first * delta->block_len;
+        delta->copy_left = count == 0 ? 0 : end - delta->copy_pos;
+        break;
+
+    case OLM_DELTA_LITERAL:
+        delta->literal_left = get_le32(&delta->instruction[1]);
+        break;
+
+    default:
+        return -EBADMSG;
+    }
+
+    delta->instruction_len = 0;
+    return 0;
+}
+
+/** Length of an instruction from its opcode, 0 if not known. */
+static size_t
+olm_delta_instruction_len(uint8_t opcode) {
+    switch (opcode) {
+    case OLM_DELTA_END:
+    case OLM_DELTA_LITERAL:
+        return 5;
+    case OLM_DELTA_COPY:
+        return 9;
+    default:
+        return 0;
+    }
+}
+
+int
+olm_delta_run(olm_delta_t *delta, const void *in, size_t *in_len, void *out,
+              size_t *out_len) {
+    const uint8_t *src  = in;
+    uint8_t *      dst  = out;
+    size_t         used = 0, written = 0, n;
+    ssize_t        r;
+    int            ret = 0;
+
+    if (delta == NULL || in_len == NULL || out_len == NULL
+        || (in == NULL && *in_len != 0) || (out == NULL && *out_len != 0))
+        return -EINVAL;
+
+    while (!delta->ended) {
+        if (delta->copy_left > 0) {
+            if ((n = *out_len - written) == 0)
+                break; // output full
+            if (n > delta->copy_left)
+                n = delta->copy_left;
+
+            if ((r = pread(delta->fd, &dst[written], n, delta->copy_pos))
+                != (ssize_t)n) {
+                ret = r < 0 ? -errno : -EIO;
+                break;
+            }
+
+            delta->crc = crc32c(delta->crc, &dst[written], n);
+            delta->copy_pos += n;
+            delta->copy_left -= n;
+            written += n;
+        } else if (delta->literal_left > 0) {
+            n = *in_len - used;
+            if (n > *out_len - written)
+                n = *out_len - written;
+            if (n > delta->literal_left)
+                n = delta->literal_left;
+            if (n == 0)
+                break; // needs more input or output
+
+            memcpy(&dst[written], &src[used], n);
+            delta->crc = crc32c(delta->crc, &dst[written], n);
+            delta->literal_left -= n;
+            used += n;
+            written += n;
+        } else {
+            if (used == *in_len)
+                break; // needs more input
+
+            delta->instruction[delta->instruction_len++] = src[used++];
+            n = olm_delta_instruction_len(delta->instruction[0]);
+            if (n == 0) {
+                ret = -EBADMSG; // unknown opcode
+                break;
+            }
+
+            if (delta->instruction_len == n
+                && (ret = olm_delta_instruction(delta)) < 0)
+                break;
+        }
+    }
+
+    *in_len  = used;
+    *out_len = written;
+
+    if (ret < 0)
+        return ret;
+    return delta->ended;
+}
+
+bool
+olm_delta_ended(const olm_delta_t *delta) {
+    return delta != NULL && delta->ended;
+}
@@ -0,0 +1,145 @@
+/**
+ * Block level delta transfers, like rsync.
+ *
+ * @file        olm_delta.h
+ * @ingroup     olm_delta
+ *
+ * The receiver of a file publishes signatures of the blocks of a base file it
+ * already has. The sender finds the blocks of the new file that match them,
+ * using the weak checksum as a rolling checksum, and only sends the rest as a
+ * delta.
+ *
+ * The signatures start with a header of the block length and the base file
+ * length, then have a weak and a strong checksum for each block, the last
+ * block may be short. All values are little endian uint32.
+ *
+ * The delta is a list of instructions, each a one byte opcode and uint32
+ * little endian arguments:
+ * - OLM_DELTA_COPY, first block, block count: copy blocks from the base.
+ * - OLM_DELTA_LITERAL, length, then the data: data not in the base.
+ * - OLM_DELTA_END, CRC-32C of the whole new file: must be last.
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_DELTA_H
+#define OLM_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The end of the delta, followed by the CRC-32C of the new file. */
+#define OLM_DELTA_END 0x00
+/** Copy blocks from the base, followed by the first block and block count. */
+#define OLM_DELTA_COPY 0x01
+/** Data not in the base, followed by its length and the data. */
+#define OLM_DELTA_LITERAL 0x02
+
+/** The smallest block length. */
+#define OLM_DELTA_BLOCK_LEN_MIN 64
+/** The largest block length. */
+#define OLM_DELTA_BLOCK_LEN_MAX 65536
+/** The default block length. */
+#define OLM_DELTA_BLOCK_LEN_DEFAULT 1024
+
+/** A delta being applied to a base file. */
+typedef struct olm_delta_t olm_delta_t;
+
+/**
+ * @brief The weak checksum of a block, the rsync rolling checksum. For bytes
+ * x[0] to x[n-1], a is the sum of x[i] and b is the sum of (n - i) * x[i],
+ * both mod 2^16, and the checksum is a + (b << 16).
+ *
+ * @param data The block.
+ * @param len The length of the block.
+ *
+ * @return The checksum.
+ */
+uint32_t
+olm_delta_weak(const void *data, size_t len);
+
+/**
+ * @brief Get the length of the signatures of a base file.
+ *
+ * @param base_len The length of the base file.
+ * @param block_len The block length.
+ *
+ * @return The length of the signatures in bytes.
+ */
+uint32_t
+olm_delta_signature_len(uint32_t base_len, uint32_t block_len);
+
+/**
+ * @brief Get part of the signatures of a base file. Only the blocks needed
+ * for that part are read, so the signatures can be sent a segment at a time.
+ *
+ * @param fd The base file.
+ * @param base_len The length of the base file.
+ * @param block_len The block length.
+ * @param offset The offset in the signatures to start at.
+ * @param out The buffer for the signatures.
+ * @param len The number of bytes to get.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_delta_signature(int fd, uint32_t base_len, uint32_t block_len,
+                    uint32_t offset, uint8_t *out, uint32_t len);
+
+/**
+ * @brief Start applying a delta to a base file.
+ *
+ * @param fd The base file, must stay open until the delta is freed.
+ * @param base_len The length of the base file.
+ * @param block_len The block length the signatures were made with.
+ * @param crc The CRC-32C of the new file before the data made by this delta,
+ * CRC32C_INIT when the delta makes the whole file.
+ * @param out The new delta.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_delta_new(int fd, uint32_t base_len, uint32_t block_len, uint32_t crc,
+              olm_delta_t **out);
+
+/**
+ * @brief Free a delta.
+ *
+ * @param delta The delta, can be NULL.
+ */
+void
+olm_delta_free(olm_delta_t *delta);
+
+/**
+ * @brief Run delta instructions, making the data of the new file. Not all of
+ * the input may be used and the output may not be filled, call again with
+ * the rest of the input.
+ *
+ * @param delta The delta.
+ * @param in The delta instructions.
+ * @param in_len In: the length of the input. Out: the bytes used.
+ * @param out The buffer for the data of the new file.
+ * @param out_len In: the size of the output buffer. Out: the bytes written.
+ *
+ * @return 1 if the end of the delta was reached and the CRC of the new file
+ * matches, 0 if more calls are needed, -EBADMSG if the delta is not valid or
+ * the CRC does not match, or other negative errno on failure.
+ */
+int
+olm_delta_run(olm_delta_t *delta, const void *in, size_t *in_len, void *out,
+              size_t *out_len);
+
+/**
+ * @brief Check if the end of a delta was reached.
+ *
+ * @param delta The delta.
+ *
+ * @return true if the end instruction was run and the CRC matched.
+ */
+bool
+olm_delta_ended(const olm_delta_t *delta);
+
+#endif /* OLM_DELTA_H */
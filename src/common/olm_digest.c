@@ -0,0 +1,163 @@
+/**
+ * Working out the digests of a file on a worker thread.
+ *
+ * @file        olm_digest.c
+ * @ingroup     olm_digest
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_digest.h"
+#include "crc32c.h"
+#include "sha256.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/** The length of each read of the file. */
+#define DIGEST_CHUNK_LEN 4096
+
+struct olm_digest_t {
+    /** The file, a duplicate of the one given. */
+    int fd;
+    /** Where the worker is in the file. */
+    uint32_t pos;
+    /** The length of the file to hash up to. */
+    uint32_t len;
+    /** The CRC-32C of the first pos bytes. */
+    uint32_t crc;
+    /** The SHA-256 of the first pos bytes. */
+    sha256_t sha;
+    /** Error reading the file, 0 if none. */
+    int err;
+    /** Set by the worker when it is done or failed. */
+    bool done;
+    /** Set to stop the worker. */
+    bool stop;
+    /** The worker thread. */
+    pthread_t thread;
+    /** Mutex for err, done and stop. */
+    pthread_mutex_t mutex;
+};
+
+/**
+ * Hash the file a chunk at a time, until the end or told to stop. Only the
+ * flags are under the lock, the digests are not read until done is set.
+ * @param arg The digest.
+ * @return Always NULL.
+ */
+static void *
+olm_digest_worker(void *arg) {
+    olm_digest_t *digest = arg;
+    uint8_t       buf[DIGEST_CHUNK_LEN];
+    bool          stop = false;
+    ssize_t       n;
+    int           r = 0;
+
+    while (!stop && digest->pos < digest->len) {
+        n = digest->len - digest->pos < sizeof(buf)
+                ? digest->len - digest->pos
+                : sizeof(buf);
+        n = pread(digest->fd, buf, n, digest->pos);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            r = n < 0 ? -errno : -EIO; // the file is shorter than it was
+            break;
+        }
+
+        digest->crc = crc32c(digest->crc, buf, n);
+        sha256_update(&digest->sha, buf, n);
+        digest->pos += n;
+
+        pthread_mutex_lock(&digest->mutex);
+        stop = digest->stop;
+        pthread_mutex_unlock(&digest->mutex);
+    }
+
+    pthread_mutex_lock(&digest->mutex);
+    digest->err  = r;
+    digest->done = true;
+    pthread_mutex_unlock(&digest->mutex);
+    return NULL;
+}
+
+int
+olm_digest_new(int fd, uint32_t pos, uint32_t len, uint32_t crc,
+               const sha256_t *sha, olm_digest_t **out) {
+    olm_digest_t *digest;
+    int           r;
+
+    if (fd < 0 || pos > len || sha == NULL || out == NULL)
+        return -EINVAL;
+
+    if ((digest = calloc(1, sizeof(olm_digest_t))) == NULL)
+        return -ENOMEM;
+
+    if ((digest->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        r = -errno;
+        free(digest);
+        return r;
+    }
+
+    digest->pos = pos;
+    digest->len = len;
+    digest->crc = crc;
+    digest->sha = *sha;
+    pthread_mutex_init(&digest->mutex, NULL);
+
+    if ((r = pthread_create(&digest->thread, NULL, olm_digest_worker, digest))
+        != 0) {
+        pthread_mutex_destroy(&digest->mutex);
+        close(digest->fd);
+        free(digest);
+        return -r;
+    }
+
+    *out = digest;
+    return 0;
+}
+
+void
+olm_digest_free(olm_digest_t *digest) {
+    if (digest == NULL)
+        return;
+
+    pthread_mutex_lock(&digest->mutex);
+    digest->stop = true;
+    pthread_mutex_unlock(&digest->mutex);
+    pthread_join(digest->thread, NULL);
+
+    pthread_mutex_destroy(&digest->mutex);
+    close(digest->fd);
+    free(digest);
+}
+
+int
+olm_digest_poll(olm_digest_t *digest, uint32_t *len, uint32_t *crc,
+                sha256_t *sha) {
+    int r;
+
+    if (digest == NULL || len == NULL || crc == NULL || sha == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&digest->mutex);
+    r = digest->done ? digest->err : -EAGAIN;
+    pthread_mutex_unlock(&digest->mutex);
+
+    if (r == 0) {
+        // the worker is done with them
+        *len = digest->len;
+        *crc = digest->crc;
+        *sha = digest->sha;
+    }
+
+    return r;
+}
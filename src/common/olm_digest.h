@@ -0,0 +1,69 @@
+/**
+ * Working out the digests of a file on a worker thread.
+ *
+ * @file        olm_digest.h
+ * @ingroup     olm_digest
+ *
+ * Hashing a whole file can take seconds, so the CAN thread starts it here and
+ * polls for the result instead of reading the file itself. The digests can
+ * carry on from ones made of the start of the file already, so the caller can
+ * keep adding to them after.
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_DIGEST_H
+#define OLM_DIGEST_H
+
+#include "sha256.h"
+#include <stdint.h>
+
+/** A file being hashed. */
+typedef struct olm_digest_t olm_digest_t;
+
+/**
+ * @brief Start hashing a file on a worker thread, from a position in it.
+ *
+ * @param fd The file, it is duplicated so it can be closed right after. It is
+ * read with pread, so its file offset is not used.
+ * @param pos Where to start hashing, the bytes before it are in crc and sha.
+ * @param len The length of the file to hash up to.
+ * @param crc The CRC-32C of the bytes before pos.
+ * @param sha The SHA-256 of the bytes before pos.
+ * @param out The new digest.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_digest_new(int fd, uint32_t pos, uint32_t len, uint32_t crc,
+               const sha256_t *sha, olm_digest_t **out);
+
+/**
+ * @brief Stop the worker and free a digest. Waits for the read the worker is
+ * in the middle of, if any.
+ *
+ * @param digest The digest, can be NULL.
+ */
+void
+olm_digest_free(olm_digest_t *digest);
+
+/**
+ * @brief Get the digests, if the worker is done. Never waits on the worker.
+ *
+ * @param digest The digest.
+ * @param len The length of the file hashed, the one given to
+ * olm_digest_new(), if done.
+ * @param crc The CRC-32C of the first len bytes of the file, if done.
+ * @param sha The SHA-256 of the first len bytes of the file, if done. Not
+ * finalized, so more data can be added to it.
+ *
+ * @return 0 on success, -EAGAIN if the worker is not done yet, or other
+ * negative errno if it failed to read the file.
+ */
+int
+olm_digest_poll(olm_digest_t *digest, uint32_t *len, uint32_t *crc,
+                sha256_t *sha);
+
+#endif /* OLM_DIGEST_H */
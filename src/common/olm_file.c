@@ -1,162 +1,172 @@
 #include "olm_file.h"
 #include "olm_file_cache.h"
+#include "olm_intern.h"
+#include "sha256.h"
 #include <asm-generic/errno-base.h>
 #include <errno.h>
 #include <libgen.h>
 #include <linux/limits.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 
-void
+static void
 olm_file_free(olm_file_t *out) {
     if (out == NULL)
         return;
 
-    if (out->name != NULL)
-        free(out->name);
+    olm_intern_release(out->board);
+    olm_intern_release(out->keyword);
+    olm_intern_release(out->extension);
+    free(out);
+}
 
-    if (out->board != NULL)
-        free(out->board);
+olm_file_t *
+olm_file_acquire(olm_file_t *file) {
+    if (file != NULL)
+        atomic_fetch_add_explicit(&file->refs, 1, memory_order_relaxed);
 
-    if (out->keyword != NULL)
-        free(out->keyword);
+    return file;
+}
 
-    if (out->extension != NULL)
-        free(out->extension);
+void
+olm_file_release(olm_file_t *file) {
+    if (file == NULL)
+        return;
 
-    free(out);
+    if (atomic_fetch_sub_explicit(&file->refs, 1, memory_order_acq_rel) == 1)
+        olm_file_free(file);
 }
 
 int
 olm_file_new(char *filepath, olm_file_t **out) {
-    char *      unix_time_str, *end;
-    char        filename[PATH_MAX];
-    olm_file_t *new_file    = NULL;
-    int         keyword_loc = 0, date_loc = 0, ext_loc = 0;
-    int         len, r = 0;
     struct stat st;
 
     if (filepath == NULL)
         return -EINVAL;
 
     // also test if the filepath is valid
-    if ((r = stat(filepath, &st)) != 0)
-        return r;
+    if (stat(filepath, &st) != 0)
+        return -errno;
 
-    strncpy(filename, basename(filepath), strlen(basename(filepath)) + 1);
+    return olm_file_from_name(basename(filepath), st.st_size, out);
+}
 
-    if (filename[0] == '_')
+int
+olm_filename_parse(const char *filename, olm_filename_t *out) {
+    uint32_t fields = 0, i;
+    bool     digits = true; // still in the leading digits of the unix time
+
+    if (filename == NULL || out == NULL || filename[0] == '_')
         return -EINVAL; // no board field
 
+    out->unix_time     = 0;
+    out->extension_loc = 0;
+
     // find all '_' locations and the start of the extension (the 1st '.')
-    for (size_t i = 0; i < strlen(filename); ++i) {
-        if (filename[i] == '_') { // find keyword and data locs
-            if (keyword_loc == 0) {
-                keyword_loc = i + 1; // add 1 to not include '_'
-            } else if (date_loc == 0) {
-                date_loc = i + 1; // add 1 to not include '_'
-            } else {
-                // both keyword and date have been found, there are extra '_'
-                r = -EINVAL;
-                break;
-            }
-        } else if (filename[i] == '.') { // find optional extension loc
-            ext_loc = i;
-            break; // found extension
-        }
+    for (i = 0; filename[i] != '\0'; ++i) {
+        if (out->extension_loc != 0)
+            continue; // only looking for the end now
+        else if (filename[i] == '.')
+            out->extension_loc = i; // found extension
+        else if (filename[i] == '_' && fields == 0) {
+            out->board_len   = i;
+            out->keyword_loc = i + 1; // add 1 to not include '_'
+            ++fields;
+        } else if (filename[i] == '_' && fields == 1) {
+            out->keyword_len = i - out->keyword_loc;
+            ++fields;
+        } else if (filename[i] == '_')
+            return -EINVAL; // both keyword and date were found, extra '_'
+        else if (fields == 2 && digits && filename[i] >= '0'
+                 && filename[i] <= '9')
+            out->unix_time = out->unix_time * 10 + (filename[i] - '0');
+        else if (fields == 2)
+            digits = false;
     }
 
-    if (keyword_loc == 0 || date_loc == 0 || r != 0)
-        return -EINVAL; // not all manitory '_' locs were found or invalid
-                        // filename
+    if (fields != 2)
+        return -EINVAL; // not all manitory '_' locs were found
 
-    if ((new_file = malloc(sizeof(olm_file_t))) == NULL)
-        goto olm_file_mem_error;
+    out->len = i;
+    return 0;
+}
 
-    new_file->size      = st.st_size;
-    new_file->name      = NULL;
-    new_file->board     = NULL;
-    new_file->keyword   = NULL;
-    new_file->extension = NULL;
+int
+olm_file_from_name(const char *filename, uint32_t size, olm_file_t **out) {
+    olm_filename_t fields;
+    olm_file_t *   new_file;
+
+    if (out == NULL || olm_filename_parse(filename, &fields) != 0)
+        return -EINVAL;
+
+    if ((new_file = malloc(sizeof(olm_file_t) + fields.len + 1)) == NULL)
+        return -ENOMEM;
 
-    // copy filename
-    if ((new_file->name = malloc(strlen(filename) + 1)) == NULL)
-        goto olm_file_mem_error;
-    strncpy(new_file->name, filename, strlen(filename) + 1);
-
-    // copy board name
-    len = keyword_loc;
-    if ((new_file->board = malloc(len)) == NULL)
-        goto olm_file_mem_error;
-    strncpy(new_file->board, filename, len);
-    new_file->board[len - 1] = '\0';
-
-    // copy get keyword
-    len = date_loc - keyword_loc;
-    if ((new_file->keyword = malloc(len)) == NULL)
-        goto olm_file_mem_error;
-    strncpy(new_file->keyword, &filename[keyword_loc], len);
-    new_file->keyword[len - 1] = '\0';
-
-    // copy unix time
-    len = (ext_loc == 0 ? (int)strlen(filename) + 1 : ext_loc) - date_loc + 1;
-    if ((unix_time_str = malloc(len)) == NULL)
-        goto olm_file_mem_error;
-    strncpy(unix_time_str, &filename[date_loc], len);
-    unix_time_str[len - 1] = '\0';
-    new_file->unix_time    = (uint32_t)strtol(unix_time_str, &end, 10);
-    free(unix_time_str);
-
-    // copy extension (if there is one)
-    if (ext_loc != 0) {
-        len = strlen(filename) - ext_loc + 2;
-        if ((new_file->extension = malloc(len)) == NULL)
-            goto olm_file_mem_error;
-        strncpy(new_file->extension, &filename[ext_loc], len);
-        new_file->extension[len - 1] = '\0';
+    memcpy(new_file->name, filename, fields.len + 1);
+    new_file->unix_time = fields.unix_time;
+    new_file->size      = size;
+    new_file->board     = olm_intern(filename, fields.board_len);
+    new_file->keyword   = olm_intern(&filename[fields.keyword_loc],
+                                   fields.keyword_len);
+    new_file->extension = NULL;
+    if (fields.extension_loc != 0)
+        new_file->extension = olm_intern(&filename[fields.extension_loc],
+                                         fields.len - fields.extension_loc);
+    atomic_init(&new_file->refs, 1);
+    atomic_init(&new_file->last_read, (unsigned)time(NULL));
+    atomic_init(&new_file->digest_state, OLM_FILE_DIGEST_NONE);
+
+    if (new_file->board == NULL || new_file->keyword == NULL
+        || (fields.extension_loc != 0 && new_file->extension == NULL)) {
+        olm_file_free(new_file);
+        return -ENOMEM;
     }
 
     *out = new_file;
-    return r;
+    return 0;
+}
+
+bool
+olm_file_digest_get(const olm_file_t *file, olm_file_digest_t *out) {
+    if (file == NULL || out == NULL
+        || atomic_load_explicit(&file->digest_state, memory_order_acquire)
+               != OLM_FILE_DIGEST_SET)
+        return false;
 
-olm_file_mem_error:
-    r = -ENOMEM;
-    olm_file_free(new_file);
-    return r;
+    *out = file->digest;
+    return true;
 }
 
 bool
-is_olm_file(char *filepath) {
-    int   keyword_loc = 0, date_loc = 0;
-    char *filename;
-    bool  r = true;
+olm_file_digest_set(olm_file_t *file, const olm_file_digest_t *digest) {
+    unsigned int state = OLM_FILE_DIGEST_NONE;
 
-    if (filepath == NULL)
+    if (file == NULL || digest == NULL)
+        return false;
+
+    // only one caller gets to write it, readers only see it once it is set
+    if (!atomic_compare_exchange_strong(&file->digest_state, &state,
+                                        OLM_FILE_DIGEST_BUSY))
         return false;
 
-    filename = basename(filepath);
+    file->digest = *digest;
+    atomic_store_explicit(&file->digest_state, OLM_FILE_DIGEST_SET,
+                          memory_order_release);
+    return true;
+}
 
-    // find all '_' locations and the start of the extension (the 1st '.')
-    for (size_t i = 0; i < strlen(filename); ++i) {
-        if (filename[i] == '_') { // find keyword and data locs
-            if (keyword_loc == 0) {
-                keyword_loc = i + 1; // add 1 to not include '_'
-            } else if (date_loc == 0) {
-                date_loc = i + 1; // add 1 to not include '_'
-            } else {
-                // both keyword and date have been found, there are extra '_'
-                r = false;
-                break;
-            }
-        }
-    }
+bool
+is_olm_file(char *filepath) {
+    olm_filename_t fields;
 
-    if (keyword_loc == 0 || date_loc == 0)
-        r = false;
+    if (filepath == NULL)
+        return false;
 
-    return r;
+    return olm_filename_parse(basename(filepath), &fields) == 0;
 }
@@ -1,6 +1,8 @@
 #ifndef OLM_FILE_H
 #define OLM_FILE_H
 
+#include "sha256.h"
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -8,25 +10,86 @@
 // example1: gps_update_1612726568.tar.xz
 // example2: star-tracker_test_1612726568
 
-/** The meta date in olm filename format. */
+/** The fields of a olm filename, as locations in the filename. */
+typedef struct {
+    /** The length of the board field, it starts at 0. */
+    uint32_t board_len;
+    /** Where the keyword field starts. */
+    uint32_t keyword_loc;
+    /** The length of the keyword field. */
+    uint32_t keyword_len;
+    /** The unix time field. */
+    uint32_t unix_time;
+    /** Where the extension starts (at its 1st '.'), 0 if there is none. */
+    uint32_t extension_loc;
+    /** The length of the filename. */
+    uint32_t len;
+} olm_filename_t;
+
+/** The digests of the contents of a file. */
+typedef struct {
+    /** The CRC-32C of the file. */
+    uint32_t crc32c;
+    /** The SHA-256 of the file. */
+    uint8_t sha256[SHA256_LEN];
+} olm_file_digest_t;
+
+/** States of the digest in a olm_file_t. */
+enum {
+    /** Not known yet. */
+    OLM_FILE_DIGEST_NONE = 0,
+    /** Being set, not readable yet. */
+    OLM_FILE_DIGEST_BUSY = 1,
+    /** Set and readable, it never changes after. */
+    OLM_FILE_DIGEST_SET = 2,
+};
+
+/**
+ * The meta date in olm filename format. Immutable once made (other than
+ * last_read and the digest, which can be set once), so it can be shared by
+ * refernce. Use olm_file_acquire() /
+ * olm_file_release() to hold on to one.
+ *
+ * Made in one allocation with the name. The board, keyword and extension are
+ * interned (see olm_intern.h), so files with the same keyword share one copy
+ * and keywords can be compared by pointer.
+ */
 typedef struct {
-    /** The full filename. */
-    char *name;
     /** The board the file was sent to or is from. */
-    char *board;
+    const char *board;
     /** The unique keyword. */
-    char *keyword;
+    const char *keyword;
+    /** The extension for the file, NULL if it has none. */
+    const char *extension;
     /** The unix time when the file was made. */
     uint32_t unix_time;
-    /** The extension for the file. */
-    char *extension;
     /** The size of the file. */
     uint32_t size;
+    /** The number of references held. */
+    atomic_uint refs;
+    /** Unix time the file was last read from the cache (or added to it). */
+    atomic_uint last_read;
+    /** The digests of the file, once digest_state is OLM_FILE_DIGEST_SET. */
+    olm_file_digest_t digest;
+    /** The state of the digest. */
+    atomic_uint digest_state;
+    /** The full filename. */
+    char name[];
 } olm_file_t;
 
+/**
+ * @brief Parse a filename in olm file format, in one pass.
+ * @param filename The filename, without a path.
+ * @param out The fields of the filename, if successful.
+ * @return 0 on success or -EINVAL if the filename is not in olm file format.
+ */
+int
+olm_filename_parse(const char *filename, olm_filename_t *out);
+
 /**
  * @brief A convience function for creating olm_file structf from a filename.
- * Must be freed with olm_file_free().
+ * The caller holds the only reference and must release it with
+ * olm_file_release().
  * @param The filename
  * @param out A pointer to a new olm_file struct if successful.
  * @return 0 on success or a negative errno on failure.
@@ -35,11 +98,51 @@ int
 olm_file_new(char *filename, olm_file_t **out);
 
 /**
- * @brief Free a olm_file_t struct. Will free the pointer.
- * @param file The olm_file struct to free.
+ * @brief Make a olm_file struct from a filename and a size already known,
+ * without touching the file itself. The caller holds the only reference and
+ * must release it with olm_file_release().
+ * @param filename The filename, without a path.
+ * @param size The size of the file.
+ * @param out A pointer to a new olm_file struct if successful.
+ * @return 0 on success or a negative errno on failure.
+ */
+int
+olm_file_from_name(const char *filename, uint32_t size, olm_file_t **out);
+
+/**
+ * @brief Take a reference to a olm_file_t struct. Does no allocations.
+ * @param file The olm_file struct.
+ * @return The olm_file struct.
+ */
+olm_file_t *
+olm_file_acquire(olm_file_t *file);
+
+/**
+ * @brief Drop a reference to a olm_file_t struct. It is freed when the last
+ * reference is dropped.
+ * @param file The olm_file struct, can be NULL.
  */
 void
-olm_file_free(olm_file_t *file);
+olm_file_release(olm_file_t *file);
+
+/**
+ * @brief Get the digests of a file, if they are known. Lock-free.
+ * @param file The olm_file struct.
+ * @param out The digests, if known.
+ * @return true if the digests are known.
+ */
+bool
+olm_file_digest_get(const olm_file_t *file, olm_file_digest_t *out);
+
+/**
+ * @brief Set the digests of a file. They can only be set once, as the
+ * contents of a file in a cache never change. Lock-free.
+ * @param file The olm_file struct.
+ * @param digest The digests.
+ * @return true if set by this call, false if they were already set.
+ */
+bool
+olm_file_digest_set(olm_file_t *file, const olm_file_digest_t *digest);
 
 /**
  * @brief Check if the filename follows olm_file format.
@@ -1,10 +1,14 @@
 #include "olm_file_cache.h"
 #include "olm_file.h"
+#include "olm_intern.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <linux/limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -12,328 +16,2118 @@
 #include <string.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <sys/syslog.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The starting number of slots for the file arrays. */
+#define FILES_SIZE_MIN 16
+
+/** The inotify events that change what is in a cache directory. */
+#define WATCH_MASK                                                             \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+/** Size of the buffer for reading inotify events. */
+#define WATCH_BUFFER_LEN 4096
+
+/** Suffix added to the cache dir path for the manifest path. */
+#define MANIFEST_SUFFIX ".manifest"
+
+/** Manifests with less records than this are never compacted. */
+#define MANIFEST_RECORDS_MIN 1024
+
+/** The most files the unlink worker takes off its queue at a time. */
+#define UNLINK_BATCH 32
 
 /*****************************************************************************/
 // structs
 
-/**
- * Recursively free olm file cache struct. Shoud be called under lock.
- * @param current Pointer to current item in link list.
- */
-static void
-olm_file_cache_free_rec(struct olm_file_index_t *current) {
-    if (current == NULL)
-        return;
-    else if (current->next != NULL)
-        olm_file_cache_free_rec(current->next);
+/** A keyword bucket in a snapshot. */
+struct olm_file_snap_keyword_t {
+    /** The keyword, borrowed from the first file in the bucket. */
+    const char *keyword;
+    /** The files with the keyword, order oldest to newest. */
+    olm_file_t **files;
+    /** The number of files with the keyword. */
+    uint32_t len;
+    /** The total size of the files with the keyword. */
+    uint64_t bytes;
+};
+
+/**
+ * A immutable copy of the index, made in one allocation. The files in it are
+ * not referenced, files removed from the index are only released after every
+ * snapshot that has them is freed.
+ */
+struct olm_file_cache_snap_t {
+    /** The cache generation the snapshot was made at. */
+    uint32_t generation;
+    /** The number of files. */
+    uint32_t len;
+    /** The total size of the files. */
+    uint64_t bytes;
+    /** All files, order oldest to newest. */
+    olm_file_t **files;
+    /** The keyword buckets, sorted by keyword. */
+    struct olm_file_snap_keyword_t *keywords;
+    /** The keyword buckets again, sorted by keyword pointer. */
+    struct olm_file_snap_keyword_t **interned;
+    /** The number of keyword buckets. */
+    uint32_t keywords_len;
+};
+
+/**
+ * Get the unix time field from a olm filename without making a olm_file_t.
+ * @param filename The olm filename.
+ * @param unix_time The unix time from the filename.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_filename_unix_time(const char *filename, uint32_t *unix_time) {
+    olm_filename_t fields;
+
+    if (olm_filename_parse(filename, &fields) != 0)
+        return -EINVAL;
+
+    *unix_time = fields.unix_time;
+    return 0;
+}
+
+/**
+ * Compare a olm file with a unix time and filename, in the order files are
+ * kept in the file arrays.
+ * @return Negative, zero, or positive like strcmp.
+ */
+static int
+olm_file_cmp(const olm_file_t *file, uint32_t unix_time,
+             const char *filename) {
+    if (file->unix_time < unix_time)
+        return -1;
+    else if (file->unix_time > unix_time)
+        return 1;
+
+    return strcmp(file->name, filename);
+}
+
+/**
+ * Binary search a sorted file array.
+ * @param files The file array.
+ * @param len The length of the file array.
+ * @param unix_time The unix time of the file to find.
+ * @param filename The name of the file to find.
+ * @param found Set to true if the file is in the array.
+ * @return The location of the file or where it should be inserted.
+ */
+static uint32_t
+olm_file_array_search(olm_file_t *const *files, uint32_t len,
+                      uint32_t unix_time, const char *filename, bool *found) {
+    uint32_t low = 0, high = len, mid;
+    int      r;
+
+    *found = false;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        r   = olm_file_cmp(files[mid], unix_time, filename);
+
+        if (r == 0) {
+            *found = true;
+            return mid;
+        } else if (r < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Insert a olm file into a file array, growing the array if needed.
+ * @param files Pointer to the file array.
+ * @param len Pointer to the length of the file array.
+ * @param size Pointer to the number of slots allocated for the file array.
+ * @param loc Where to insert the file.
+ * @param new_file The olm file to insert.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_array_insert(olm_file_t ***files, uint32_t *len, uint32_t *size,
+                      uint32_t loc, olm_file_t *new_file) {
+    olm_file_t **temp;
+    uint32_t     new_size;
+
+    if (*len == *size) { // grow array
+        new_size = *size == 0 ? FILES_SIZE_MIN : *size * 2;
+        if ((temp = realloc(*files, new_size * sizeof(olm_file_t *))) == NULL)
+            return -ENOMEM;
+
+        *files = temp;
+        *size  = new_size;
+    }
+
+    memmove(&(*files)[loc + 1], &(*files)[loc],
+            (*len - loc) * sizeof(olm_file_t *));
+    (*files)[loc] = new_file;
+    ++*len;
+
+    return 0;
+}
+
+/**
+ * Remove a olm file from a file array, does not free the olm file.
+ * @param files The file array.
+ * @param len Pointer to the length of the file array.
+ * @param loc Location of the file to remove.
+ */
+static void
+olm_file_array_erase(olm_file_t **files, uint32_t *len, uint32_t loc) {
+    memmove(&files[loc], &files[loc + 1],
+            (*len - loc - 1) * sizeof(olm_file_t *));
+    --*len;
+}
+
+/**
+ * Binary search the keyword buckets. Shoud be called under lock.
+ * @param in The file cache.
+ * @param keyword The keyword to find.
+ * @param found Set to true if the keyword has a bucket.
+ * @return The location of the bucket or where it should be inserted.
+ */
+static uint32_t
+olm_file_cache_keyword_search(olm_file_cache_t *in, const char *keyword,
+                              bool *found) {
+    uint32_t low = 0, high = in->keywords_len, mid;
+    int      r;
+
+    *found = false;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        // keywords from files are interned, so usually the same pointer
+        r = in->keywords[mid].keyword == keyword
+                ? 0
+                : strcmp(in->keywords[mid].keyword, keyword);
+
+        if (r == 0) {
+            *found = true;
+            return mid;
+        } else if (r < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Get the keyword bucket for a keyword. Shoud be called under lock.
+ * @param in The file cache.
+ * @param keyword The keyword.
+ * @return The bucket or NULL if there are no files with the keyword.
+ */
+static struct olm_file_keyword_t *
+olm_file_cache_keyword(olm_file_cache_t *in, const char *keyword) {
+    uint32_t loc;
+    bool     found;
+
+    loc = olm_file_cache_keyword_search(in, keyword, &found);
+
+    return found ? &in->keywords[loc] : NULL;
+}
+
+/**
+ * Binary search the keyword budgets. Shoud be called under lock.
+ * @param in The file cache.
+ * @param keyword The keyword to find.
+ * @param found Set to true if the keyword has a budget.
+ * @return The location of the budget or where it should be inserted.
+ */
+static uint32_t
+olm_file_cache_budget_search(olm_file_cache_t *in, const char *keyword,
+                             bool *found) {
+    uint32_t low = 0, high = in->budgets_len, mid;
+    int      r;
+
+    *found = false;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        r   = strcmp(in->budgets[mid].keyword, keyword);
+
+        if (r == 0) {
+            *found = true;
+            return mid;
+        } else if (r < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * Get the budget for a keyword. Shoud be called under lock.
+ * @param in The file cache.
+ * @param keyword The keyword.
+ * @return The budget or NULL if the keyword does not have one.
+ */
+static const struct olm_file_keyword_budget_t *
+olm_file_cache_keyword_budget(olm_file_cache_t *in, const char *keyword) {
+    uint32_t loc;
+    bool     found;
+
+    loc = olm_file_cache_budget_search(in, keyword, &found);
+
+    return found ? &in->budgets[loc] : NULL;
+}
+
+/**
+ * Get the keyword bucket for a keyword and make it if it does not exist.
+ * Shoud be called under lock.
+ * @param in The file cache.
+ * @param keyword The keyword.
+ * @return The bucket or NULL if out of memory.
+ */
+static struct olm_file_keyword_t *
+olm_file_cache_keyword_add(olm_file_cache_t *in, const char *keyword) {
+    struct olm_file_keyword_t *temp, *bucket;
+    uint32_t                   loc;
+    bool                       found;
+
+    loc = olm_file_cache_keyword_search(in, keyword, &found);
+    if (found)
+        return &in->keywords[loc];
+
+    temp = realloc(in->keywords,
+                   (in->keywords_len + 1) * sizeof(struct olm_file_keyword_t));
+    if (temp == NULL)
+        return NULL;
+    in->keywords = temp;
+
+    memmove(&in->keywords[loc + 1], &in->keywords[loc],
+            (in->keywords_len - loc) * sizeof(struct olm_file_keyword_t));
+    ++in->keywords_len;
+
+    bucket         = &in->keywords[loc];
+    bucket->files  = NULL;
+    bucket->len    = 0;
+    bucket->size   = 0;
+    bucket->bytes  = 0;
+    bucket->budget = olm_file_cache_keyword_budget(in, keyword);
+    if ((bucket->keyword = olm_intern(keyword, strlen(keyword))) == NULL) {
+        // undo
+        --in->keywords_len;
+        memmove(&in->keywords[loc], &in->keywords[loc + 1],
+                (in->keywords_len - loc) * sizeof(struct olm_file_keyword_t));
+        bucket = NULL;
+    }
+
+    return bucket;
+}
+
+/**
+ * Remove a keyword bucket. Shoud be called under lock.
+ * @param in The file cache.
+ * @param bucket The bucket to remove.
+ */
+static void
+olm_file_cache_keyword_remove(olm_file_cache_t *in,
+                              struct olm_file_keyword_t *bucket) {
+    uint32_t loc = bucket - in->keywords;
+
+    olm_intern_release(bucket->keyword);
+    free(bucket->files);
+    memmove(&in->keywords[loc], &in->keywords[loc + 1],
+            (in->keywords_len - loc - 1) * sizeof(struct olm_file_keyword_t));
+    --in->keywords_len;
+}
+
+/**
+ * Record a add or remove in the manifest and compact it, if it has a lot
+ * more records than files in the cache. Shoud be called under lock.
+ * @param in The file cache.
+ * @param added The file added, or NULL.
+ * @param removed The name of the file removed, or NULL.
+ */
+static void
+olm_file_cache_journal(olm_file_cache_t *in, const olm_file_t *added,
+                       const char *removed) {
+    if (in->manifest.fd < 0)
+        return; // not journaling, like while loading the manifest
+
+    if (added != NULL)
+        olm_file_manifest_add(&in->manifest, added);
+    else
+        olm_file_manifest_remove(&in->manifest, removed);
+
+    if (in->manifest.records > MANIFEST_RECORDS_MIN
+        && in->manifest.records / 2 > in->len)
+        olm_file_manifest_compact(&in->manifest, in->files, in->len, NULL);
+}
+
+/**
+ * Make sure a file array has room for more files.
+ * @param files Pointer to the file array.
+ * @param len The length of the file array.
+ * @param size Pointer to the number of slots allocated for the file array.
+ * @param count The number of files that will be added.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_array_reserve(olm_file_t ***files, uint32_t len, uint32_t *size,
+                       uint32_t count) {
+    olm_file_t **temp;
+    uint32_t     new_size;
+
+    if (len + count <= *size)
+        return 0;
+
+    new_size = *size == 0 ? FILES_SIZE_MIN : *size * 2;
+    if (new_size < len + count)
+        new_size = len + count;
+    if ((temp = realloc(*files, new_size * sizeof(*temp))) == NULL)
+        return -ENOMEM;
+
+    *files = temp;
+    *size  = new_size;
+    return 0;
+}
+
+/**
+ * Get the range of files with a unix time in a range from a sorted file
+ * array.
+ * @param files The file array.
+ * @param len The length of the file array.
+ * @param start The oldest unix time, inclusive.
+ * @param end The newest unix time, inclusive.
+ * @param low Set to the location of the first file in the range.
+ * @return The location after the last file in the range.
+ */
+static uint32_t
+olm_file_array_range(olm_file_t *const *files, uint32_t len, uint32_t start,
+                     uint32_t end, uint32_t *low) {
+    bool found;
+
+    // no filename sorts before every filename with the same unix time
+    *low = olm_file_array_search(files, len, start, "", &found);
+    if (end == UINT32_MAX)
+        return len;
+
+    return olm_file_array_search(files, len, end + 1, "", &found);
+}
+
+/**
+ * Make sure there is room to retire files, so removing them can not fail
+ * half way. Shoud be called under lock.
+ * @param in The file cache.
+ * @param count The number of files that will be retired.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_retire_reserve(olm_file_cache_t *in, uint32_t count) {
+    return olm_file_array_reserve(&in->retired, in->retired_len,
+                                  &in->retired_size, count);
+}
+
+/**
+ * Drop the index's reference to a file once no reader can see it. Shoud be
+ * called under lock, after olm_file_cache_retire_reserve().
+ * @param in The file cache.
+ * @param file The file removed from the index.
+ */
+static void
+olm_file_cache_retire(olm_file_cache_t *in, olm_file_t *file) {
+    in->retired[in->retired_len++] = file;
+}
+
+/**
+ * Add new olm file to the cache index or replace the olm file with the same
+ * name. Shoud be called under lock.
+ * @param in The file cache.
+ * @param new_file New olm file to add to the index. The cache takes ownership
+ * of it on success.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_insert(olm_file_cache_t *in, olm_file_t *new_file) {
+    struct olm_file_keyword_t *bucket;
+    uint32_t                   loc, kw_loc;
+    bool                       found, kw_found;
+    int                        r;
+
+    if (in == NULL || new_file == NULL)
+        return -EINVAL;
+
+    if ((bucket = olm_file_cache_keyword_add(in, new_file->keyword)) == NULL)
+        return -ENOMEM;
+
+    loc    = olm_file_array_search(in->files, in->len, new_file->unix_time,
+                                new_file->name, &found);
+    kw_loc = olm_file_array_search(bucket->files, bucket->len,
+                                   new_file->unix_time, new_file->name,
+                                   &kw_found);
+
+    if (found && (r = olm_file_cache_retire_reserve(in, 1)) != 0)
+        return r;
+
+    if (found) { // file was replaced, so update its meta data
+        in->bytes += (uint64_t)new_file->size - in->files[loc]->size;
+        bucket->bytes += (uint64_t)new_file->size - in->files[loc]->size;
+        olm_file_cache_retire(in, in->files[loc]);
+        in->files[loc]        = new_file;
+        bucket->files[kw_loc] = new_file;
+        ++in->generation;
+        olm_file_cache_journal(in, new_file, NULL);
+        return 0;
+    }
+
+    if ((r = olm_file_array_insert(&in->files, &in->len, &in->size, loc,
+                                   new_file))
+        != 0) {
+        if (bucket->len == 0)
+            olm_file_cache_keyword_remove(in, bucket);
+        return r;
+    }
+
+    if ((r = olm_file_array_insert(&bucket->files, &bucket->len, &bucket->size,
+                                   kw_loc, new_file))
+        != 0) { // undo
+        olm_file_array_erase(in->files, &in->len, loc);
+        if (bucket->len == 0)
+            olm_file_cache_keyword_remove(in, bucket);
+    } else {
+        in->bytes += new_file->size;
+        bucket->bytes += new_file->size;
+        ++in->generation;
+        olm_file_cache_journal(in, new_file, NULL);
+    }
+
+    return r;
+}
+
+/**
+ * Remove a olm file from the cache index and free it. Shoud be called under
+ * lock.
+ * @param in The file cache.
+ * @param filename The name of the file to remove.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_erase(olm_file_cache_t *in, const char *filename) {
+    struct olm_file_keyword_t *bucket;
+    olm_file_t *               file;
+    uint32_t                   unix_time, loc;
+    bool                       found;
+
+    if (olm_filename_unix_time(filename, &unix_time) != 0)
+        return -EINVAL;
+
+    loc = olm_file_array_search(in->files, in->len, unix_time, filename,
+                                &found);
+    if (!found)
+        return -EINVAL;
+
+    if (olm_file_cache_retire_reserve(in, 1) != 0)
+        return -ENOMEM;
+
+    file = in->files[loc];
+    olm_file_array_erase(in->files, &in->len, loc);
+    in->bytes -= file->size;
+
+    if ((bucket = olm_file_cache_keyword(in, file->keyword)) != NULL) {
+        loc = olm_file_array_search(bucket->files, bucket->len, unix_time,
+                                    filename, &found);
+        if (found) {
+            olm_file_array_erase(bucket->files, &bucket->len, loc);
+            bucket->bytes -= file->size;
+        }
+        if (bucket->len == 0)
+            olm_file_cache_keyword_remove(in, bucket);
+    }
+
+    ++in->generation;
+    olm_file_cache_journal(in, NULL, file->name);
+    olm_file_cache_retire(in, file);
+    return 0;
+}
+
+/**
+ * Remove a range of files from each keyword bucket, and those files from the
+ * file array, in one pass. The files are queued for the unlink worker. Shoud
+ * be called under lock.
+ * @param in The file cache.
+ * @param ranges For each keyword bucket, the location of the first file to
+ * remove and the location after the last one.
+ * @return The number of files removed or negative errno on failure.
+ */
+static int
+olm_file_cache_erase_ranges(olm_file_cache_t *in, uint32_t (*ranges)[2]) {
+    struct olm_file_keyword_t *bucket;
+    uint32_t *                 pos, total = 0, retired_len, len = 0, k;
+    bool                       found;
+    int                        r;
+
+    for (k = 0; k < in->keywords_len; ++k)
+        total += ranges[k][1] - ranges[k][0];
+    if (total == 0)
+        return 0;
+
+    if ((r = olm_file_cache_retire_reserve(in, total)) != 0
+        || (r = olm_file_array_reserve(&in->unlinks, in->unlinks_len,
+                                       &in->unlinks_size, total))
+               != 0)
+        return r;
+
+    // where each file of a bucket is in it, as the file array is walked
+    if ((pos = calloc(in->keywords_len, sizeof(*pos))) == NULL)
+        return -ENOMEM;
+
+    // the buckets keep the file array order, so the n-th file with a keyword
+    // in the file array is the n-th file in its bucket
+    retired_len = in->retired_len;
+    for (uint32_t i = 0; i < in->len; ++i) {
+        olm_file_t *file = in->files[i];
+
+        k = olm_file_cache_keyword_search(in, file->keyword, &found);
+        if (pos[k] >= ranges[k][0] && pos[k] < ranges[k][1]) {
+            in->bytes -= file->size;
+            olm_file_cache_retire(in, file);
+            in->unlinks[in->unlinks_len++] = olm_file_acquire(file);
+        } else {
+            in->files[len++] = file;
+        }
+        ++pos[k];
+    }
+    in->len = len;
+    free(pos);
+
+    // backwards, so removing a empty bucket does not move the ones left
+    for (k = in->keywords_len; k-- > 0;) {
+        bucket = &in->keywords[k];
+        for (uint32_t i = ranges[k][0]; i < ranges[k][1]; ++i)
+            bucket->bytes -= bucket->files[i]->size;
+        memmove(&bucket->files[ranges[k][0]], &bucket->files[ranges[k][1]],
+                (bucket->len - ranges[k][1]) * sizeof(*bucket->files));
+        bucket->len -= ranges[k][1] - ranges[k][0];
+        if (bucket->len == 0)
+            olm_file_cache_keyword_remove(in, bucket);
+    }
+
+    ++in->generation;
+    for (uint32_t i = retired_len; i < in->retired_len; ++i)
+        olm_file_cache_journal(in, NULL, in->retired[i]->name);
+
+    pthread_cond_signal(&in->unlink_cond);
+    return (int)total;
+}
+
+/**
+ * Wait for the unlink worker, if it is unlinking a file with a name. Shoud be
+ * called under lock.
+ * @param in The file cache.
+ * @param filename The name.
+ * @return True if it had to wait.
+ */
+static bool
+olm_file_cache_unlink_wait(olm_file_cache_t *in, const char *filename) {
+    bool waited = false;
+
+    for (uint32_t i = 0; i < in->unlinking_len; ++i) {
+        if (strcmp(in->unlinking[i]->name, filename) == 0) {
+            pthread_cond_wait(&in->unlinked_cond, &in->mutex);
+            waited = true;
+            i = -1; // it took others meanwhile, look again
+        }
+    }
+
+    return waited;
+}
+
+/**
+ * Drop a name from the files waiting to be unlinked, as the file under it is
+ * a new one. Shoud be called under lock.
+ * @param in The file cache.
+ * @param filename The name.
+ */
+static void
+olm_file_cache_unlink_drop(olm_file_cache_t *in, const char *filename) {
+    for (uint32_t i = 0; i < in->unlinks_len;) {
+        if (strcmp(in->unlinks[i]->name, filename) == 0) {
+            olm_file_release(in->unlinks[i]);
+            in->unlinks[i] = in->unlinks[--in->unlinks_len];
+        } else {
+            ++i;
+        }
+    }
+}
+
+/**
+ * Unlink files queued by bulk removes and evictions, off the threads that use
+ * the cache. A few files are taken off the queue at a time and unlinked
+ * outside the lock. A writer adding a file back under one of their names
+ * waits for them, and drops the name from the queue, so a new file is never
+ * unlinked.
+ * @param arg The file cache.
+ * @return Always NULL.
+ */
+static void *
+olm_file_cache_unlink_worker(void *arg) {
+    olm_file_cache_t *in = arg;
+    char              filepath[PATH_MAX];
+    olm_file_t *      files[UNLINK_BATCH];
+    uint32_t          len;
+
+    pthread_mutex_lock(&in->mutex);
+
+    while (!in->unlink_stop || in->unlinks_len > 0) {
+        if (in->unlinks_len == 0) {
+            pthread_cond_wait(&in->unlink_cond, &in->mutex);
+            continue;
+        }
+
+        // from the end of the queue, the order does not matter
+        len = in->unlinks_len < UNLINK_BATCH ? in->unlinks_len : UNLINK_BATCH;
+        in->unlinks_len -= len;
+        memcpy(files, &in->unlinks[in->unlinks_len], len * sizeof(*files));
+        in->unlinking     = files;
+        in->unlinking_len = len;
+        pthread_mutex_unlock(&in->mutex);
+
+        for (uint32_t i = 0; i < len; ++i) {
+            sprintf(filepath, "%s%s", in->dir, files[i]->name);
+            remove(filepath);
+        }
+
+        pthread_mutex_lock(&in->mutex);
+        for (uint32_t i = 0; i < len; ++i)
+            olm_file_release(files[i]);
+        in->unlinking     = NULL;
+        in->unlinking_len = 0;
+        pthread_cond_broadcast(&in->unlinked_cond);
+    }
+
+    pthread_mutex_unlock(&in->mutex);
+    return NULL;
+}
+
+/**
+ * Enter a read-side critical section and get the current snapshot. Never
+ * blocks. The snapshot and the files in it are valid until
+ * olm_file_cache_read_unlock().
+ * @param in The file cache.
+ * @param epoch Set to the reader count used, pass to
+ * olm_file_cache_read_unlock().
+ * @return The snapshot.
+ */
+static const struct olm_file_cache_snap_t *
+olm_file_cache_read_lock(olm_file_cache_t *in, unsigned int *epoch) {
+    *epoch = atomic_load(&in->epoch) & 1;
+    atomic_fetch_add(&in->readers[*epoch], 1);
+    return atomic_load(&in->snap);
+}
+
+/**
+ * Leave a read-side critical section.
+ * @param in The file cache.
+ * @param epoch The reader count from olm_file_cache_read_lock().
+ */
+static void
+olm_file_cache_read_unlock(olm_file_cache_t *in, unsigned int epoch) {
+    atomic_fetch_sub(&in->readers[epoch], 1);
+}
+
+/**
+ * Wait for every reader that could have seen the previous snapshot to be
+ * done. The epoch is flipped twice, as a reader that read the epoch just
+ * before a flip can count itself in the old parity after the wait on it.
+ * Shoud be called under lock.
+ * @param in The file cache.
+ */
+static void
+olm_file_cache_synchronize(olm_file_cache_t *in) {
+    unsigned int epoch;
+
+    for (int i = 0; i < 2; ++i) {
+        epoch = atomic_fetch_add(&in->epoch, 1) & 1;
+        while (atomic_load(&in->readers[epoch]) != 0)
+            sched_yield(); // readers never block, so this is short
+    }
+}
+
+/**
+ * Compare two snapshot keyword buckets by keyword pointer, for qsort.
+ */
+static int
+olm_file_snap_keyword_ptr_cmp(const void *a, const void *b) {
+    const struct olm_file_snap_keyword_t *const *l = a, *const *r = b;
+    uintptr_t lp = (uintptr_t)(*l)->keyword, rp = (uintptr_t)(*r)->keyword;
+
+    return (lp > rp) - (lp < rp);
+}
+
+/**
+ * Publish a new snapshot, if the index changed since the last one, then free
+ * the old snapshot and release the files retired since it was made. Shoud be
+ * called under lock.
+ * @param in The file cache.
+ * @return 0 on success or negative errno on failure. On failure readers keep
+ * using the old snapshot.
+ */
+static int
+olm_file_cache_publish(olm_file_cache_t *in) {
+    struct olm_file_cache_snap_t *  snap, *old;
+    struct olm_file_snap_keyword_t *keyword;
+    olm_file_t **                   files;
+    uint32_t                        keywords_len = 0;
+
+    old = atomic_load(&in->snap);
+    if (old != NULL && old->generation == in->generation)
+        return 0;
+
+    for (uint32_t i = 0; i < in->keywords_len; ++i) {
+        if (in->keywords[i].len > 0)
+            ++keywords_len;
+    }
+
+    // every file is in the file array and in one keyword bucket
+    snap = malloc(sizeof(*snap)
+                  + keywords_len * (sizeof(*keyword) + sizeof(keyword))
+                  + 2 * (size_t)in->len * sizeof(*files));
+    if (snap == NULL)
+        return -ENOMEM;
+
+    snap->generation   = in->generation;
+    snap->len          = in->len;
+    snap->bytes        = in->bytes;
+    snap->keywords     = (struct olm_file_snap_keyword_t *)&snap[1];
+    snap->interned
+        = (struct olm_file_snap_keyword_t **)&snap->keywords[keywords_len];
+    snap->keywords_len = keywords_len;
+    snap->files        = (olm_file_t **)&snap->interned[keywords_len];
+    if (in->len > 0)
+        memcpy(snap->files, in->files, in->len * sizeof(*files));
+
+    files   = &snap->files[in->len];
+    keyword = snap->keywords;
+    for (uint32_t i = 0; i < in->keywords_len; ++i) {
+        if (in->keywords[i].len == 0)
+            continue;
+
+        keyword->keyword = in->keywords[i].files[0]->keyword;
+        keyword->files   = files;
+        keyword->len     = in->keywords[i].len;
+        keyword->bytes   = in->keywords[i].bytes;
+        memcpy(files, in->keywords[i].files, keyword->len * sizeof(*files));
+        files += keyword->len;
+        snap->interned[keyword - snap->keywords] = keyword;
+        ++keyword;
+    }
+    qsort(snap->interned, keywords_len, sizeof(*snap->interned),
+          olm_file_snap_keyword_ptr_cmp);
+
+    atomic_store(&in->snap, snap);
+
+    if (old != NULL) {
+        olm_file_cache_synchronize(in);
+        free(old);
+    }
+
+    for (uint32_t i = 0; i < in->retired_len; ++i)
+        olm_file_release(in->retired[i]);
+    in->retired_len = 0;
+
+    return 0;
+}
+
+/**
+ * Get a keyword bucket from a snapshot. An interned keyword, like the
+ * fileCaches filter, is found by pointer; any other string by strcmp.
+ * @param snap The snapshot.
+ * @param keyword The keyword.
+ * @return The bucket or NULL if there are no files with the keyword.
+ */
+static const struct olm_file_snap_keyword_t *
+olm_file_snap_keyword(const struct olm_file_cache_snap_t *snap,
+                      const char *                        keyword) {
+    uint32_t low = 0, high = snap->keywords_len, mid;
+    int      r;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (snap->interned[mid]->keyword == keyword)
+            return snap->interned[mid];
+        else if ((uintptr_t)snap->interned[mid]->keyword < (uintptr_t)keyword)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    low  = 0;
+    high = snap->keywords_len;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        r   = strcmp(snap->keywords[mid].keyword, keyword);
+
+        if (r == 0)
+            return &snap->keywords[mid];
+        else if (r < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the file list for a keyword filter from a snapshot.
+ * @param snap The snapshot.
+ * @param keyword The keyword filter, NULL for no filter.
+ * @param len The length of the list.
+ * @return The list or NULL if there are no files for the filter.
+ */
+static olm_file_t *const *
+olm_file_snap_list(const struct olm_file_cache_snap_t *snap,
+                   const char *keyword, uint32_t *len) {
+    const struct olm_file_snap_keyword_t *bucket;
+
+    if (keyword == NULL) {
+        *len = snap->len;
+        return snap->files;
+    } else if ((bucket = olm_file_snap_keyword(snap, keyword)) != NULL) {
+        *len = bucket->len;
+        return bucket->files;
+    }
+
+    *len = 0;
+    return NULL;
+}
+
+/**
+ * Get the file list for a keyword filter and a time window from a snapshot.
+ * O(log n), as the lists are ordered by unix time.
+ * @param snap The snapshot.
+ * @param keyword The keyword filter, NULL for no filter.
+ * @param start The oldest unix time in the window, inclusive.
+ * @param end The newest unix time in the window, inclusive.
+ * @param len The length of the list.
+ * @return The list or NULL if there are no files for the filter.
+ */
+static olm_file_t *const *
+olm_file_snap_window(const struct olm_file_cache_snap_t *snap,
+                     const char *keyword, uint32_t start, uint32_t end,
+                     uint32_t *len) {
+    olm_file_t *const *files;
+    uint32_t           low;
+
+    files = olm_file_snap_list(snap, keyword, len);
+    if (*len == 0 || start > end) {
+        *len = 0;
+        return NULL;
+    }
+
+    *len = olm_file_array_range(files, *len, start, end, &low) - low;
+    return &files[low];
+}
+
+/**
+ * Check if a file count and total size are over a budget.
+ * @return true if over the budget.
+ */
+static bool
+olm_file_cache_over_budget(const olm_file_cache_budget_t *budget,
+                           uint32_t len, uint64_t bytes) {
+    return (budget->max_files != 0 && len > budget->max_files)
+           || (budget->max_bytes != 0 && bytes > budget->max_bytes);
+}
+
+/**
+ * Pick the file to evict from a file list. Shoud be called under lock.
+ * @param in The file cache.
+ * @param files The file list, order oldest to newest.
+ * @param len The length of the file list.
+ * @param keep The file that must not be evicted, can be NULL.
+ * @return The file to evict or NULL if there is none.
+ */
+static olm_file_t *
+olm_file_cache_pick(olm_file_cache_t *in, olm_file_t **files, uint32_t len,
+                    const olm_file_t *keep) {
+    olm_file_t *pick = NULL;
+
+    if (in->evict == OLM_FILE_CACHE_EVICT_LRU) { // O(n), but evictions are rare
+        for (uint32_t i = 0; i < len; ++i) {
+            if (files[i] != keep
+                && (pick == NULL
+                    || atomic_load(&files[i]->last_read)
+                           < atomic_load(&pick->last_read)))
+                pick = files[i];
+        }
+    } else { // oldest
+        for (uint32_t i = 0; i < len && pick == NULL; ++i) {
+            if (files[i] != keep)
+                pick = files[i];
+        }
+    }
+
+    return pick;
+}
+
+/**
+ * Pick the file to evict to get the whole cache under budget. Shoud be
+ * called under lock.
+ * @param in The file cache.
+ * @param keep The file that must not be evicted, can be NULL.
+ * @return The file to evict or NULL if there is none.
+ */
+static olm_file_t *
+olm_file_cache_pick_any(olm_file_cache_t *in, const olm_file_t *keep) {
+    struct olm_file_keyword_t *bucket, *lowest = NULL;
+    uint8_t                    priority, lowest_priority = 0;
+
+    if (in->evict != OLM_FILE_CACHE_EVICT_PRIORITY)
+        return olm_file_cache_pick(in, in->files, in->len, keep);
+
+    // lowest priority keyword, ties go to the one with the oldest file
+    for (uint32_t i = 0; i < in->keywords_len; ++i) {
+        bucket   = &in->keywords[i];
+        priority = bucket->budget != NULL ? bucket->budget->budget.priority : 0;
+
+        if (bucket->len == 0 || (bucket->len == 1 && bucket->files[0] == keep))
+            continue;
+
+        if (lowest == NULL || priority < lowest_priority
+            || (priority == lowest_priority
+                && olm_file_cmp(bucket->files[0], lowest->files[0]->unix_time,
+                                lowest->files[0]->name)
+                       < 0)) {
+            lowest          = bucket;
+            lowest_priority = priority;
+        }
+    }
+
+    return lowest != NULL
+               ? olm_file_cache_pick(in, lowest->files, lowest->len, keep)
+               : NULL;
+}
+
+/**
+ * Remove a file from the index and queue it for the unlink worker, so it is
+ * deleted outside the lock. Shoud be called under lock.
+ * @param in The file cache.
+ * @param file The file to evict.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_evict(olm_file_cache_t *in, olm_file_t *file) {
+    int r;
+
+    // room in the queue first, so a file is never unindexed but left on disk
+    r = olm_file_array_reserve(&in->unlinks, in->unlinks_len,
+                               &in->unlinks_size, 1);
+    if (r != 0 || (r = olm_file_cache_erase(in, file->name)) != 0)
+        return r; // file is kept, as it is still indexed
+
+    in->unlinks[in->unlinks_len++] = olm_file_acquire(file);
+    pthread_cond_signal(&in->unlink_cond);
+    ++in->evicted;
+    return 0;
+}
+
+/**
+ * Evict files until the cache and its keywords are in budget. Shoud be called
+ * under lock.
+ * @param in The file cache.
+ * @param keep The file just added, it is never evicted and only its keyword
+ * budget is checked. NULL to check all keyword budgets.
+ */
+static void
+olm_file_cache_enforce(olm_file_cache_t *in, const olm_file_t *keep) {
+    struct olm_file_keyword_t *bucket;
+    olm_file_t *               file;
+
+    if (in->evict == OLM_FILE_CACHE_EVICT_NONE)
+        return;
+
+    for (uint32_t i = 0, len; i < in->keywords_len;) {
+        bucket = &in->keywords[i];
+        len    = in->keywords_len;
+
+        if (keep == NULL || bucket->keyword == keep->keyword) {
+            while (bucket->budget != NULL
+                   && olm_file_cache_over_budget(&bucket->budget->budget,
+                                                 bucket->len, bucket->bytes)
+                   && (file = olm_file_cache_pick(in, bucket->files,
+                                                  bucket->len, keep))
+                          != NULL) {
+                if (olm_file_cache_evict(in, file) != 0)
+                    return;
+                if (in->keywords_len != len)
+                    break; // bucket was emptied and removed
+            }
+        }
+
+        if (in->keywords_len == len)
+            ++i;
+    }
+
+    while (olm_file_cache_over_budget(&in->budget, in->len, in->bytes)
+           && (file = olm_file_cache_pick_any(in, keep)) != NULL) {
+        if (olm_file_cache_evict(in, file) != 0)
+            return;
+    }
+}
+
+/**
+ * Add a file in the cache directory to the index, unless it is already
+ * indexed with the same size. Should not be called under lock.
+ * @param in The file cache.
+ * @param filename The name of the file in the cache directory.
+ * @param clean If true, invalid and empty files are deleted. Otherwise they
+ * are ignored, as daemons may still be writing them before renaming them to
+ * their final name.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_sync_add(olm_file_cache_t *in, const char *filename,
+                        bool clean) {
+    char        filepath[PATH_MAX];
+    olm_file_t *new_file;
+    uint32_t    loc;
+    bool        found;
+    int         r;
+
+    sprintf(filepath, "%s%s", in->dir, filename);
+    if ((r = olm_file_new(filepath, &new_file)) != 0) {
+        if (r == -ENOMEM)
+            return r;
+        if (clean) // invalid olm file, delete it
+            remove(filepath);
+        return 0;
+    }
+
+    if (new_file->size == 0) {
+        if (clean)
+            remove(filepath);
+        olm_file_release(new_file);
+        return 0;
+    }
+
+    pthread_mutex_lock(&in->mutex);
+
+    // a bulk remove may have queued the name, keep the file found on disk
+    if (olm_file_cache_unlink_wait(in, new_file->name)
+        && access(filepath, F_OK) != 0) { // it was the one unlinked
+        pthread_mutex_unlock(&in->mutex);
+        olm_file_release(new_file);
+        return 0;
+    }
+    olm_file_cache_unlink_drop(in, new_file->name);
+
+    loc = olm_file_array_search(in->files, in->len, new_file->unix_time,
+                                new_file->name, &found);
+    if (found && in->files[loc]->size == new_file->size) // already indexed
+        olm_file_release(new_file);
+    else if ((r = olm_file_cache_insert(in, new_file)) != 0)
+        olm_file_release(new_file);
+    else
+        olm_file_cache_enforce(in, new_file);
+
+    pthread_mutex_unlock(&in->mutex);
+    return r;
+}
+
+/** A file name found in the cache directory by olm_file_cache_rescan(). */
+struct olm_file_dirent_t {
+    char *   name;
+    uint32_t unix_time;
+    /** Set if the file is already in the index. */
+    bool indexed;
+};
+
+/** qsort() compare for olm_file_dirent_t, in the file array order. */
+static int
+olm_file_dirent_cmp(const void *a, const void *b) {
+    const struct olm_file_dirent_t *x = a, *y = b;
+
+    if (x->unix_time != y->unix_time)
+        return x->unix_time < y->unix_time ? -1 : 1;
+
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * Rescan the cache directory, dropping index entries whose file is gone and
+ * adding files that are not indexed yet. Only files not already indexed are
+ * stat'ed. Should not be called under lock.
+ * @param in The file cache.
+ * @param clean If true, invalid and empty files are deleted.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_file_cache_rescan(olm_file_cache_t *in, bool clean) {
+    struct olm_file_dirent_t *names = NULL, *temp;
+    struct dirent *           dir;
+    char                      filepath[PATH_MAX];
+    uint32_t                  len = 0, size = 0, i = 0, j = 0;
+    DIR *                     d;
+    int                       r = 0, cmp = 0;
+
+    if ((d = opendir(in->dir)) == NULL)
+        return -errno;
+
+    while ((dir = readdir(d)) != NULL) {
+        struct olm_file_dirent_t name;
+
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+            continue;
+
+        if (olm_filename_unix_time(dir->d_name, &name.unix_time) != 0) {
+            if (clean) { // invalid olm file, delete it
+                sprintf(filepath, "%s%s", in->dir, dir->d_name);
+                remove(filepath);
+            }
+            continue;
+        }
+        name.indexed = false;
+
+        if (len == size) {
+            size = size == 0 ? FILES_SIZE_MIN : size * 2;
+            if ((temp = realloc(names, size * sizeof(*names))) == NULL) {
+                r = -ENOMEM;
+                break;
+            }
+            names = temp;
+        }
+
+        if ((name.name = malloc(strlen(dir->d_name) + 1)) == NULL) {
+            r = -ENOMEM;
+            break;
+        }
+        strncpy(name.name, dir->d_name, strlen(dir->d_name) + 1);
+        names[len++] = name;
+    }
+    closedir(d);
+
+    if (r == 0) {
+        if (len > 0)
+            qsort(names, len, sizeof(*names), olm_file_dirent_cmp);
+
+        // drop index entries that are not in the directory
+        pthread_mutex_lock(&in->mutex);
+        while (i < in->len) {
+            while (j < len
+                   && (cmp = olm_file_cmp(in->files[i], names[j].unix_time,
+                                          names[j].name))
+                          > 0)
+                ++j;
+
+            if (j < len && cmp == 0) {
+                names[j].indexed = true;
+                ++i;
+                ++j;
+            } else if (olm_file_cache_erase(in, in->files[i]->name) != 0) {
+                r = -ENOMEM;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&in->mutex);
+
+        // add new files
+        for (j = 0; j < len && r != -ENOMEM; ++j) {
+            if (!names[j].indexed)
+                r = olm_file_cache_sync_add(in, names[j].name, clean);
+        }
+
+        pthread_mutex_lock(&in->mutex);
+        if (r != -ENOMEM)
+            r = olm_file_cache_publish(in);
+        pthread_mutex_unlock(&in->mutex);
+    }
+
+    for (j = 0; j < len; ++j)
+        free(names[j].name);
+    free(names);
+
+    return r == -ENOMEM ? r : 0;
+}
+
+/** olm_file_manifest_cb_t for loading the index from the manifest. */
+static int
+olm_file_cache_manifest_cb(void *arg, const char *filename, uint32_t size,
+                           bool add, const olm_file_digest_t *digest) {
+    olm_file_cache_t *in = arg;
+    olm_file_t *      new_file;
+    int               r;
+
+    if (!add) {
+        olm_file_cache_erase(in, filename);
+        return 0;
+    }
+
+    if ((r = olm_file_from_name(filename, size, &new_file)) != 0)
+        return r == -ENOMEM ? r : 0; // ignore invalid names
+
+    if (digest != NULL)
+        olm_file_digest_set(new_file, digest);
+
+    if ((r = olm_file_cache_insert(in, new_file)) != 0)
+        olm_file_release(new_file);
+
+    return r;
+}
+
+/*****************************************************************************/
+// public functions
+
+int
+olm_file_cache_new(char *dir_path, olm_file_cache_t **out) {
+    olm_file_cache_t *  new_cache;
+    olm_file_manifest_t     manifest = OLM_FILE_MANIFEST_INITIALIZER;
+    olm_file_cache_budget_t budget   = OLM_FILE_CACHE_BUDGET_INITIALIZER;
+    char                    manifest_path[PATH_MAX];
+    struct timespec         mark;
+    struct stat             st;
+    size_t                  dir_len;
+    int                     r = 0;
+
+    if (dir_path == NULL || dir_path[0] != '/')
+        return -EINVAL;
+
+    if ((new_cache = malloc(sizeof(olm_file_cache_t))) == NULL)
+        return -ENOMEM;
+
+    new_cache->dir          = NULL;
+    new_cache->files        = NULL;
+    new_cache->len          = 0;
+    new_cache->size         = 0;
+    new_cache->keywords     = NULL;
+    new_cache->keywords_len = 0;
+    new_cache->generation   = 0;
+    new_cache->watch_fd     = -1;
+    new_cache->manifest     = manifest;
+    new_cache->bytes        = 0;
+    new_cache->budget       = budget;
+    new_cache->budgets      = NULL;
+    new_cache->budgets_len  = 0;
+    new_cache->evict        = OLM_FILE_CACHE_EVICT_NONE;
+    new_cache->evicted      = 0;
+    new_cache->retired      = NULL;
+    new_cache->retired_len  = 0;
+    new_cache->retired_size = 0;
+    new_cache->unlinks        = NULL;
+    new_cache->unlinks_len    = 0;
+    new_cache->unlinks_size   = 0;
+    new_cache->unlinking      = NULL;
+    new_cache->unlinking_len  = 0;
+    new_cache->unlink_running = false;
+    new_cache->unlink_stop    = false;
+    atomic_init(&new_cache->snap, NULL);
+    atomic_init(&new_cache->epoch, 0);
+    atomic_init(&new_cache->readers[0], 0);
+    atomic_init(&new_cache->readers[1], 0);
+    pthread_mutex_init(&new_cache->mutex, NULL);
+    pthread_cond_init(&new_cache->unlink_cond, NULL);
+    pthread_cond_init(&new_cache->unlinked_cond, NULL);
+
+    // set dir name, always ending with a '/'
+    dir_len = strlen(dir_path);
+    if ((new_cache->dir = malloc(dir_len + 2)) == NULL) {
+        free(new_cache);
+        return -ENOMEM;
+    }
+    strncpy(new_cache->dir, dir_path, dir_len + 1);
+    if (dir_path[dir_len - 1] != '/') {
+        new_cache->dir[dir_len]     = '/';
+        new_cache->dir[dir_len + 1] = '\0';
+        ++dir_len;
+    }
+
+    // start watching before reading the dir, so nothing is missed in between
+    if ((new_cache->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0
+        && inotify_add_watch(new_cache->watch_fd, new_cache->dir, WATCH_MASK)
+               < 0) {
+        close(new_cache->watch_fd);
+        new_cache->watch_fd = -1;
+    }
+
+    // the dir mtime must be read before the dir, so any change after it is
+    // read will not match the mark
+    if (stat(new_cache->dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        olm_file_cache_free(new_cache);
+        return -ENOENT;
+    }
+
+    // manifest is the dir path without the trailing '/' plus the suffix
+    snprintf(manifest_path, sizeof(manifest_path), "%.*s" MANIFEST_SUFFIX,
+             (int)dir_len - 1, new_cache->dir);
+    r = olm_file_manifest_load(&new_cache->manifest, manifest_path,
+                               olm_file_cache_manifest_cb, new_cache, &mark);
+    if (r == -ENOMEM) {
+        olm_file_manifest_close(&new_cache->manifest);
+        olm_file_cache_free(new_cache);
+        return r;
+    }
+
+    if (mark.tv_sec != st.st_mtim.tv_sec
+        || mark.tv_nsec != st.st_mtim.tv_nsec) {
+        // dir changed since the manifest was marked, reconcile with it
+        if (new_cache->manifest.fd >= 0) { // compacted after, so don't journal
+            close(new_cache->manifest.fd);
+            new_cache->manifest.fd = -1;
+        }
+
+        if ((r = olm_file_cache_rescan(new_cache, true)) != 0) {
+            olm_file_manifest_close(&new_cache->manifest);
+            olm_file_cache_free(new_cache);
+            return r;
+        }
+
+        olm_file_manifest_compact(&new_cache->manifest, new_cache->files,
+                                  new_cache->len, &st.st_mtim);
+    } else if (new_cache->manifest.records > MANIFEST_RECORDS_MIN
+               && new_cache->manifest.records / 2 > new_cache->len) {
+        olm_file_manifest_compact(&new_cache->manifest, new_cache->files,
+                                  new_cache->len, &st.st_mtim);
+    }
+
+    if ((r = olm_file_cache_publish(new_cache)) != 0) { // the first snapshot
+        olm_file_cache_free(new_cache);
+        return r;
+    }
+
+    if ((r = pthread_create(&new_cache->unlink_thread, NULL,
+                            olm_file_cache_unlink_worker, new_cache))
+        != 0) {
+        olm_file_cache_free(new_cache);
+        return -r;
+    }
+    new_cache->unlink_running = true;
+
+    *out = new_cache;
+    return 0;
+}
+
+void
+olm_file_cache_free(olm_file_cache_t *in) {
+    if (in == NULL)
+        return;
+
+    // let the unlink worker finish its queue
+    if (in->unlink_running) {
+        pthread_mutex_lock(&in->mutex);
+        in->unlink_stop = true;
+        pthread_cond_signal(&in->unlink_cond);
+        pthread_mutex_unlock(&in->mutex);
+        pthread_join(in->unlink_thread, NULL);
+        in->unlink_running = false;
+    }
+
+    // save the index, marked with the dir mtime from before any pending
+    // changes are applied, so the next startup does not need to read the dir
+    if (in->manifest.path != NULL) {
+        struct stat st;
+
+        if (stat(in->dir, &st) == 0) {
+            if (in->watch_fd >= 0)
+                olm_file_cache_sync(in);
+            pthread_mutex_lock(&in->mutex);
+            olm_file_manifest_compact(&in->manifest, in->files, in->len,
+                                      in->watch_fd >= 0 ? &st.st_mtim : NULL);
+            pthread_mutex_unlock(&in->mutex);
+        }
+        olm_file_manifest_close(&in->manifest);
+    }
+
+    // don't care about locks with the data struct is being freed
+
+    if (in->watch_fd >= 0) {
+        close(in->watch_fd);
+        in->watch_fd = -1;
+    }
+
+    if (in->dir != NULL) {
+        free(in->dir);
+        in->dir = NULL;
+    }
+
+    for (uint32_t i = 0; i < in->keywords_len; ++i) {
+        olm_intern_release(in->keywords[i].keyword);
+        free(in->keywords[i].files);
+    }
+    free(in->keywords);
+    in->keywords = NULL;
+
+    for (uint32_t i = 0; i < in->budgets_len; ++i)
+        free(in->budgets[i].keyword);
+    free(in->budgets);
+    in->budgets = NULL;
+
+    for (uint32_t i = 0; i < in->len; ++i)
+        olm_file_release(in->files[i]);
+    free(in->files);
+    in->files = NULL;
+
+    free(atomic_load(&in->snap));
+    for (uint32_t i = 0; i < in->retired_len; ++i)
+        olm_file_release(in->retired[i]);
+    free(in->retired);
+    in->retired = NULL;
+
+    for (uint32_t i = 0; i < in->unlinks_len; ++i)
+        olm_file_release(in->unlinks[i]);
+    free(in->unlinks);
+    in->unlinks = NULL;
+
+    pthread_cond_destroy(&in->unlink_cond);
+    pthread_cond_destroy(&in->unlinked_cond);
+    pthread_mutex_destroy(&in->mutex);
+    free(in);
+}
+
+/**
+ * fsync() the cache directory, so a file just moved into it is durable.
+ * @param in The file cache.
+ */
+static void
+olm_file_cache_fsync_dir(olm_file_cache_t *in) {
+    int fd;
+
+    if ((fd = open(in->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+int
+olm_file_cache_add(olm_file_cache_t *in, char *filepath) {
+    return olm_file_cache_add_digest(in, filepath, NULL);
+}
+
+int
+olm_file_cache_add_digest(olm_file_cache_t *in, char *filepath,
+                          const olm_file_digest_t *digest) {
+    char        new_filepath[PATH_MAX];
+    olm_file_t *new_file = NULL;
+    int         r        = 0;
+
+    if ((r = olm_file_new(filepath, &new_file)) != 0)
+        return r;
+
+    if (digest != NULL) // before it is journaled, so the manifest has it
+        olm_file_digest_set(new_file, digest);
+
+    // move file, atomically, and make the move durable before indexing it,
+    // all under lock, so the unlink worker can't unlink it in between
+    sprintf(new_filepath, "%s%s", in->dir, basename(filepath));
+    pthread_mutex_lock(&in->mutex);
+    olm_file_cache_unlink_wait(in, new_file->name);
+    if ((r = rename(filepath, new_filepath)) == 0) {
+        olm_file_cache_unlink_drop(in, new_file->name); // it replaced them
+        olm_file_cache_fsync_dir(in);
+        if ((r = olm_file_cache_insert(in, new_file)) == 0) {
+            olm_file_cache_enforce(in, new_file);
+            // the index has it now, even if readers can't see it yet
+            new_file = NULL;
+            r        = olm_file_cache_publish(in);
+        }
+    }
+    pthread_mutex_unlock(&in->mutex);
 
-    olm_file_free(current->data);
-    free(current);
+    if (new_file != NULL && r != 0)
+        olm_file_release(new_file);
+
+    return r;
 }
 
-/**
- * Recursively insert a new olm file to link list. Shoud be called under lock.
- * @param current Pointer to current item in link list, cannot be NULL.
- * @param new Pointer to new olm file to add to link list.
- * @return 0 if already in list, 1 on successfully added, or negative errno on
- * failure.
- */
-static int
-olm_file_cache_insert_rec(struct olm_file_index_t **index,
-                          struct olm_file_index_t *new) {
-    struct olm_file_index_t *current = *index;
-    int                      r       = 1;
+int
+olm_file_cache_remove(olm_file_cache_t *in, const char *filename) {
+    char temp_path[PATH_MAX];
+    int  r;
 
-    if (new == NULL || new->data == NULL) { // invalid args
-        r = -EINVAL;
-    } else if (current == NULL) { // add to tail
-        *index    = new;
-        new->next = NULL; // just in case
-    } else if (strncmp(current->data->name, new->data->name,
-                       strlen(new->data->name) + 1)
-               == 0) { // file already in list
-        r = 0;
-    } else if (current->data->unix_time > new->data->unix_time) { // insert
-        new->next = current;
-        *index    = new;
-    } else { // recursion
-        r = olm_file_cache_insert_rec(&current->next, new);
-    }
+    sprintf(temp_path, "%s%s", in->dir, filename);
+    if ((r = remove(temp_path)) != 0)
+        return -EINVAL; // file not in cache
+
+    pthread_mutex_lock(&in->mutex);
+    if ((r = olm_file_cache_erase(in, filename)) == 0)
+        r = olm_file_cache_publish(in);
+    pthread_mutex_unlock(&in->mutex);
 
     return r;
 }
 
-/**
- * Recursively add new olm file to link list. Shoud be called under lock.
- * @param in The file cache.
- * @param new_file New olm file to add to link list.
- * @return 0 on success or negative errno on failure.
- */
-static int
-olm_file_cache_insert(olm_file_cache_t *in, olm_file_t *new_file) {
-    struct olm_file_index_t *new_index;
-    int                      r = 0;
+int
+olm_file_cache_remove_range(olm_file_cache_t *in, const char *keyword,
+                            uint32_t start, uint32_t end) {
+    uint32_t(*ranges)[2];
+    uint32_t loc;
+    bool     found;
+    int      r;
 
-    if (in == NULL || new_file == NULL)
+    if (in == NULL || start > end)
         return -EINVAL;
 
-    if ((new_index = malloc(sizeof(struct olm_file_index_t))) == NULL)
-        return -ENOMEM;
+    pthread_mutex_lock(&in->mutex);
 
-    new_index->next = NULL;
-    new_index->data = new_file;
+    if ((ranges = calloc(in->keywords_len + 1, sizeof(*ranges))) == NULL) {
+        pthread_mutex_unlock(&in->mutex);
+        return -ENOMEM;
+    }
 
-    if ((r = olm_file_cache_insert_rec(&in->files, new_index)) >= 0) {
-        // recursively add
-        in->len += r;
-        r = 0;
-    } else { // error, cleanup from malloc
-        free(new_index);
+    if (keyword != NULL) {
+        loc = olm_file_cache_keyword_search(in, keyword, &found);
+        if (found)
+            ranges[loc][1] = olm_file_array_range(
+                in->keywords[loc].files, in->keywords[loc].len, start, end,
+                &ranges[loc][0]);
+    } else {
+        for (loc = 0; loc < in->keywords_len; ++loc)
+            ranges[loc][1] = olm_file_array_range(
+                in->keywords[loc].files, in->keywords[loc].len, start, end,
+                &ranges[loc][0]);
     }
 
+    if ((r = olm_file_cache_erase_ranges(in, ranges)) > 0
+        && olm_file_cache_publish(in) != 0)
+        r = -ENOMEM;
+
+    pthread_mutex_unlock(&in->mutex);
+    free(ranges);
     return r;
 }
 
-static int
-olm_file_cache_remove_rec(struct olm_file_index_t **index, char *filename) {
-    struct olm_file_index_t *current = *index;
-    int                      r       = 0;
+int
+olm_file_cache_keep_newest(olm_file_cache_t *in, const char *keyword,
+                           uint32_t keep) {
+    uint32_t(*ranges)[2];
+    uint32_t loc;
+    bool     found;
+    int      r;
 
-    if (index == NULL || current == NULL) {
-        r = -EINVAL;
-    } else if (strncmp(current->data->name, filename,
-                       strlen(filename) + 1)
-               == 0) { // file found, remove it from list
-        *index = current->next;
-        olm_file_free(current->data);
-        free(current);
-    } else { // recursion
-        r = olm_file_cache_remove_rec(&current->next, filename);
+    if (in == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&in->mutex);
+
+    if ((ranges = calloc(in->keywords_len + 1, sizeof(*ranges))) == NULL) {
+        pthread_mutex_unlock(&in->mutex);
+        return -ENOMEM;
+    }
+
+    // the oldest files of each bucket are at the start of it
+    if (keyword != NULL) {
+        loc = olm_file_cache_keyword_search(in, keyword, &found);
+        if (found && in->keywords[loc].len > keep)
+            ranges[loc][1] = in->keywords[loc].len - keep;
+    } else {
+        for (loc = 0; loc < in->keywords_len; ++loc) {
+            if (in->keywords[loc].len > keep)
+                ranges[loc][1] = in->keywords[loc].len - keep;
+        }
     }
 
+    if ((r = olm_file_cache_erase_ranges(in, ranges)) > 0
+        && olm_file_cache_publish(in) != 0)
+        r = -ENOMEM;
+
+    pthread_mutex_unlock(&in->mutex);
+    free(ranges);
     return r;
 }
 
-/*****************************************************************************/
-// public functions
-
 int
-olm_file_cache_new(char *dir_path, olm_file_cache_t **out) {
-    olm_file_cache_t *new_cache;
-    struct dirent *   dir;
-    char              temp_path[PATH_MAX];
-    olm_file_t *      new_olm_file;
-    struct stat       st;
-    DIR *             d;
-    int               r = 0;
+olm_file_cache_index(olm_file_cache_t *in, int index, const char *keyword,
+                     olm_file_t **out) {
+    const struct olm_file_cache_snap_t *snap;
+    olm_file_t *const *                 files;
+    unsigned int                        epoch;
+    uint32_t                            len;
+    int                                 r = -EINVAL;
 
-    if (dir_path == NULL || dir_path[0] != '/')
+    if (in == NULL || index < 0 || out == NULL)
         return -EINVAL;
 
-    if ((new_cache = malloc(sizeof(olm_file_cache_t))) == NULL)
-        return -ENOMEM;
-
-    new_cache->dir   = NULL;
-    new_cache->files = NULL;
-    new_cache->len   = 0;
-    pthread_mutex_init(&new_cache->mutex, NULL);
-
-    if (dir_path[strlen(dir_path)] == '/')
-        new_cache->dir = malloc(strlen(dir_path) + 1);
-    else // add remove for '/'
-        new_cache->dir = malloc(strlen(dir_path) + 2);
+    snap = olm_file_cache_read_lock(in, &epoch);
 
-    // set dir name
-    if (new_cache->dir == NULL) {
-        free(new_cache);
-        return -ENOMEM;
-    }
-    strncpy(new_cache->dir, dir_path, strlen(dir_path) + 1);
-    if (dir_path[strlen(dir_path)] == '/') {
-        new_cache->dir[strlen(dir_path)]     = '/';
-        new_cache->dir[strlen(dir_path) + 1] = '\0';
+    files = olm_file_snap_list(snap, keyword, &len);
+    if ((uint32_t)index < len) {
+        *out = olm_file_acquire(files[index]);
+        r    = 0;
     }
 
-    if ((d = opendir(dir_path))
-        != NULL) { // add all existing file to linked list
-        while ((dir = readdir(d)) != NULL) { // directory found
-            if (strncmp(dir->d_name, ".", sizeof(dir->d_name)) == 0
-                || strncmp(dir->d_name, "..", sizeof(dir->d_name)) == 0)
-                continue; // skip . and ..
+    olm_file_cache_read_unlock(in, epoch);
+    return r;
+}
+
+int
+olm_file_cache_sync(olm_file_cache_t *in) {
+    char buf[WATCH_BUFFER_LEN]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    bool                        rescan = false;
+    ssize_t                     len;
+    int                         r = 0;
 
-            sprintf(temp_path, "%s%s", new_cache->dir, dir->d_name);
+    if (in == NULL || in->watch_fd < 0)
+        return -EINVAL;
 
-            // check for empty files
-            stat(temp_path, &st);
-            if (st.st_size == 0) {
-                remove(temp_path);
-                continue;
-            }
+    while (r != -ENOMEM && (len = read(in->watch_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len;
+             ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)ptr;
 
-            r = olm_file_new(temp_path, &new_olm_file);
-            if (r == -ENOMEM) { // out of memory
-                break;
-            } else if (r != 0) { // invalid olm file, delete it
-                remove(temp_path);
+            if (event->mask & IN_Q_OVERFLOW)
+                rescan = true; // events were lost
+            else if (event->len == 0 || rescan)
                 continue;
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                r = olm_file_cache_sync_add(in, event->name, false);
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                pthread_mutex_lock(&in->mutex);
+                olm_file_cache_erase(in, event->name); // may already be gone
+                pthread_mutex_unlock(&in->mutex);
             }
 
-            if ((r = olm_file_cache_insert(new_cache, new_olm_file)) != 0) {
-                olm_file_free(new_olm_file);
+            if (r == -ENOMEM)
                 break;
-            }
         }
-        closedir(d);
-    } else {
-        r = -ENOENT;
     }
 
-    if (r == 0)
-        *out = new_cache;
-    else // something failed
-        olm_file_cache_free(new_cache);
+    if (len < 0 && errno != EAGAIN && r == 0)
+        r = -errno;
+
+    if (rescan && r == 0)
+        return olm_file_cache_rescan(in, false);
+
+    // one snapshot for all the events
+    pthread_mutex_lock(&in->mutex);
+    if (olm_file_cache_publish(in) != 0 && r == 0)
+        r = -ENOMEM;
+    pthread_mutex_unlock(&in->mutex);
 
     return r;
 }
 
-void
-olm_file_cache_free(olm_file_cache_t *in) {
+uint32_t
+olm_file_cache_len(olm_file_cache_t *in, const char *keyword) {
+    const struct olm_file_cache_snap_t *snap;
+    unsigned int                        epoch;
+    uint32_t                            len;
+
     if (in == NULL)
-        return;
+        return 0;
 
-    // don't care about locks with the data struct is being freed
+    snap = olm_file_cache_read_lock(in, &epoch);
+    olm_file_snap_list(snap, keyword, &len);
+    olm_file_cache_read_unlock(in, epoch);
 
-    if (in->dir != NULL) {
-        free(in->dir);
-        in->dir = NULL;
-    }
+    return len;
+}
 
-    if (in->files != NULL) {
-        olm_file_cache_free_rec(in->files);
-        in->files = NULL;
-    }
+uint32_t
+olm_file_cache_window_len(olm_file_cache_t *in, const char *keyword,
+                          uint32_t start, uint32_t end) {
+    const struct olm_file_cache_snap_t *snap;
+    unsigned int                        epoch;
+    uint32_t                            len;
 
-    free(in);
-}
+    if (in == NULL)
+        return 0;
 
-int
-olm_file_cache_add(olm_file_cache_t *in, char *filepath) {
-    char        new_filepath[PATH_MAX];
-    olm_file_t *new_file = NULL;
-    int         r        = 0;
+    snap = olm_file_cache_read_lock(in, &epoch);
+    olm_file_snap_window(snap, keyword, start, end, &len);
+    olm_file_cache_read_unlock(in, epoch);
 
-    if ((r = olm_file_new(filepath, &new_file)) != 0)
-        return r;
+    return len;
+}
 
-    // move file
-    sprintf(new_filepath, "%s%s", in->dir, basename(filepath));
-    if ((r = rename(filepath, new_filepath)) == 0) {
-        pthread_mutex_lock(&in->mutex);
-        r = olm_file_cache_insert(in, new_file);
-        pthread_mutex_unlock(&in->mutex);
-    }
+bool
+olm_file_cache_file_exist(olm_file_cache_t *in, const char *filename) {
+    const struct olm_file_cache_snap_t *snap;
+    unsigned int                        epoch;
+    uint32_t                            unix_time;
+    bool                                r = false;
+
+    if (in == NULL || olm_filename_unix_time(filename, &unix_time) != 0)
+        return false;
 
-    if (r != 0 && new_file != NULL)
-        olm_file_free(new_file);
+    snap = olm_file_cache_read_lock(in, &epoch);
+    olm_file_array_search(snap->files, snap->len, unix_time, filename, &r);
+    olm_file_cache_read_unlock(in, epoch);
 
     return r;
 }
 
+uint64_t
+olm_file_cache_bytes(olm_file_cache_t *in, const char *keyword) {
+    const struct olm_file_cache_snap_t *  snap;
+    const struct olm_file_snap_keyword_t *bucket;
+    unsigned int                          epoch;
+    uint64_t                              bytes = 0;
+
+    if (in == NULL)
+        return 0;
+
+    snap = olm_file_cache_read_lock(in, &epoch);
+
+    if (keyword == NULL) // no filter
+        bytes = snap->bytes;
+    else if ((bucket = olm_file_snap_keyword(snap, keyword)) != NULL)
+        bytes = bucket->bytes;
+
+    olm_file_cache_read_unlock(in, epoch);
+    return bytes;
+}
+
 int
-olm_file_cache_remove(olm_file_cache_t *in, char *filename) {
-    char temp_path[PATH_MAX];
-    int  r;
+olm_file_cache_get_budget(olm_file_cache_t *in, const char *keyword,
+                          olm_file_cache_budget_t *out) {
+    const struct olm_file_keyword_budget_t *kw_budget;
+    olm_file_cache_budget_t                 budget
+        = OLM_FILE_CACHE_BUDGET_INITIALIZER;
 
-    sprintf(temp_path, "%s%s", in->dir, filename);
-    if ((r = remove(temp_path)) != 0)
-        return -EINVAL; // file not in cache
+    if (in == NULL || out == NULL)
+        return -EINVAL;
 
     pthread_mutex_lock(&in->mutex);
-    if ((r = olm_file_cache_remove_rec(&in->files, filename))
-        == 0) // remove from list
-        --in->len;
+
+    if (keyword == NULL)
+        budget = in->budget;
+    else if ((kw_budget = olm_file_cache_keyword_budget(in, keyword)) != NULL)
+        budget = kw_budget->budget;
+
     pthread_mutex_unlock(&in->mutex);
 
-    return r;
+    *out = budget;
+    return 0;
 }
 
 int
-olm_file_cache_index(olm_file_cache_t *in, int index, const char *keyword,
-                     olm_file_t **out) {
-    char                     filepath[PATH_MAX];
-    size_t                   len;
-    struct olm_file_index_t *current;
-    int                      r = 0;
+olm_file_cache_set_budget(olm_file_cache_t *in, const char *keyword,
+                          const olm_file_cache_budget_t *budget) {
+    struct olm_file_keyword_budget_t *tmp;
+    uint32_t                          loc;
+    bool                              found;
+    int                               r = 0;
 
-    len = olm_file_cache_len(in, keyword);
-    if ((size_t)index >= len)
+    if (in == NULL || budget == NULL)
         return -EINVAL;
 
     pthread_mutex_lock(&in->mutex);
 
-    size_t i = 0;
-    for (current = in->files; current != NULL && i <= len;
-         current = current->next) {
-        if (keyword != NULL
-            && strncmp(current->data->keyword, keyword, strlen(keyword) + 1)
-                   != 0)
-            continue;
+    if (keyword == NULL) {
+        in->budget = *budget;
+    } else {
+        loc = olm_file_cache_budget_search(in, keyword, &found);
+
+        if (!found) {
+            tmp = realloc(in->budgets, (in->budgets_len + 1) * sizeof(*tmp));
+            if (tmp == NULL) {
+                r = -ENOMEM;
+                goto set_budget_end;
+            }
+            in->budgets = tmp;
 
-        if (i == (size_t)index) {
-            sprintf(filepath, "%s%s", in->dir, current->data->name);
-            r = olm_file_new(filepath, out);
-            break; // index was found, no need to continue
+            memmove(&in->budgets[loc + 1], &in->budgets[loc],
+                    (in->budgets_len - loc) * sizeof(*tmp));
+            if ((in->budgets[loc].keyword = malloc(strlen(keyword) + 1))
+                == NULL) {
+                memmove(&in->budgets[loc], &in->budgets[loc + 1],
+                        (in->budgets_len - loc) * sizeof(*tmp));
+                r = -ENOMEM;
+                goto set_budget_end;
+            }
+            strncpy(in->budgets[loc].keyword, keyword, strlen(keyword) + 1);
+            ++in->budgets_len;
         }
 
-        ++i;
+        in->budgets[loc].budget = *budget;
+
+        // budgets may have moved, so point the buckets at them again
+        for (uint32_t i = 0; i < in->keywords_len; ++i)
+            in->keywords[i].budget
+                = olm_file_cache_keyword_budget(in, in->keywords[i].keyword);
     }
 
+    olm_file_cache_enforce(in, NULL);
+    r = olm_file_cache_publish(in);
+
+set_budget_end:
     pthread_mutex_unlock(&in->mutex);
     return r;
 }
 
-uint32_t
-olm_file_cache_len(olm_file_cache_t *in, const char *keyword) {
-    struct olm_file_index_t *current;
-    uint32_t                 len = 0;
+int
+olm_file_cache_set_eviction(olm_file_cache_t *     in,
+                            olm_file_cache_evict_t evict) {
+    int r;
+
+    if (in == NULL || evict > OLM_FILE_CACHE_EVICT_LRU)
+        return -EINVAL;
 
     pthread_mutex_lock(&in->mutex);
+    in->evict = evict;
+    olm_file_cache_enforce(in, NULL);
+    r = olm_file_cache_publish(in);
+    pthread_mutex_unlock(&in->mutex);
 
-    if (keyword == NULL || in == NULL
-        || in->files == NULL) { // No filter / no list
-        len = in->len;
-    } else { // filter by keyword
-        for (current = in->files; current != NULL && current->data != NULL;
-             current = current->next) {
-            if (current->data == NULL)
-                break;
-            else if (strncmp(current->data->keyword, keyword,
-                             strlen(keyword) + 1)
-                     == 0)
-                ++len;
-        }
+    return r;
+}
+
+int
+olm_file_cache_fits(olm_file_cache_t *in, const char *filename,
+                    uint64_t size) {
+    const struct olm_file_keyword_budget_t *kw_budget;
+    olm_filename_t                          fields;
+    char                                    keyword[NAME_MAX + 1];
+    int                                     r = 0;
+
+    if (in == NULL || filename == NULL
+        || olm_filename_parse(filename, &fields) != 0
+        || fields.keyword_len > NAME_MAX)
+        return -EINVAL;
+
+    memcpy(keyword, &filename[fields.keyword_loc], fields.keyword_len);
+    keyword[fields.keyword_len] = '\0';
+
+    pthread_mutex_lock(&in->mutex);
+
+    if (in->evict != OLM_FILE_CACHE_EVICT_NONE) {
+        kw_budget = olm_file_cache_keyword_budget(in, keyword);
+
+        if ((in->budget.max_bytes != 0 && size > in->budget.max_bytes)
+            || (kw_budget != NULL && kw_budget->budget.max_bytes != 0
+                && size > kw_budget->budget.max_bytes))
+            r = -EFBIG;
     }
 
     pthread_mutex_unlock(&in->mutex);
-    return len;
+
+    return r;
 }
 
-bool
-olm_file_cache_file_exist(olm_file_cache_t *in, const char *filename) {
-    struct olm_file_index_t *current;
-    bool                     r = false;
+void
+olm_file_cache_touch(olm_file_cache_t *in, const char *filename) {
+    const struct olm_file_cache_snap_t *snap;
+    unsigned int                        epoch;
+    uint32_t                            unix_time, loc;
+    bool                                found;
 
-    pthread_mutex_lock(&in->mutex);
+    if (in == NULL || olm_filename_unix_time(filename, &unix_time) != 0)
+        return;
 
-    for (current = in->files; current != NULL && current->data != NULL;
-         current = current->next)
-        if (strncmp(current->data->name, filename, strlen(filename) + 1) == 0) {
-            r = true;
-            break;
-        }
+    snap = olm_file_cache_read_lock(in, &epoch);
+    loc  = olm_file_array_search(snap->files, snap->len, unix_time, filename,
+                                &found);
+    if (found)
+        atomic_store(&snap->files[loc]->last_read, (unsigned)time(NULL));
+    olm_file_cache_read_unlock(in, epoch);
+}
+
+/**
+ * Get a reference to a file in the current snapshot.
+ * @param in The file cache.
+ * @param filename The name of the file.
+ * @return The file, or NULL if it is not in the cache. Must be released with
+ * olm_file_release().
+ */
+static olm_file_t *
+olm_file_cache_find(olm_file_cache_t *in, const char *filename) {
+    const struct olm_file_cache_snap_t *snap;
+    olm_file_t *                        file = NULL;
+    unsigned int                        epoch;
+    uint32_t                            unix_time, loc;
+    bool                                found;
+
+    if (olm_filename_unix_time(filename, &unix_time) != 0)
+        return NULL;
+
+    snap = olm_file_cache_read_lock(in, &epoch);
+    loc  = olm_file_array_search(snap->files, snap->len, unix_time, filename,
+                                &found);
+    if (found)
+        file = olm_file_acquire(snap->files[loc]);
+    olm_file_cache_read_unlock(in, epoch);
+
+    return file;
+}
+
+/**
+ * Set the digests of a file in the cache and add it to the manifest again
+ * with them, if it is still in the index.
+ * @param in The file cache.
+ * @param file The file, held by the caller.
+ * @param digest The digests.
+ */
+static void
+olm_file_cache_digest_store(olm_file_cache_t *in, olm_file_t *file,
+                            const olm_file_digest_t *digest) {
+    uint32_t loc;
+    bool     found;
 
+    if (!olm_file_digest_set(file, digest))
+        return; // already known
+
+    pthread_mutex_lock(&in->mutex);
+    loc = olm_file_array_search(in->files, in->len, file->unix_time,
+                                file->name, &found);
+    if (found && in->files[loc] == file)
+        olm_file_cache_journal(in, file, NULL);
     pthread_mutex_unlock(&in->mutex);
+}
+
+int
+olm_file_cache_digest(olm_file_cache_t *in, const char *filename,
+                      olm_file_digest_t *out) {
+    olm_file_t *file;
+    int         r = 0;
+
+    if (in == NULL || filename == NULL || out == NULL)
+        return -EINVAL;
+
+    if ((file = olm_file_cache_find(in, filename)) == NULL)
+        return -ENOENT;
+
+    if (!olm_file_digest_get(file, out))
+        r = -ENODATA; // not known yet, never read the file for them here
+
+    olm_file_release(file);
+    return r;
+}
+
+int
+olm_file_cache_set_digest(olm_file_cache_t *in, const char *filename,
+                          const olm_file_digest_t *digest) {
+    olm_file_t *file;
+
+    if (in == NULL || filename == NULL || digest == NULL)
+        return -EINVAL;
+
+    if ((file = olm_file_cache_find(in, filename)) == NULL)
+        return -ENOENT;
+
+    olm_file_cache_digest_store(in, file, digest);
+    olm_file_release(file);
+    return 0;
+}
+
+int
+olm_file_cache_cursor_seek(olm_file_cache_t *in,
+                           olm_file_cache_cursor_t *cursor, uint32_t index,
+                           const char *keyword) {
+    return olm_file_cache_cursor_seek_window(in, cursor, index, keyword, 0,
+                                             UINT32_MAX);
+}
+
+int
+olm_file_cache_cursor_seek_window(olm_file_cache_t *       in,
+                                  olm_file_cache_cursor_t *cursor,
+                                  uint32_t index, const char *keyword,
+                                  uint32_t start, uint32_t end) {
+    const struct olm_file_cache_snap_t *snap;
+    olm_file_t *const *                 files;
+    unsigned int                        epoch;
+    uint32_t                            len;
+    int                                 r = 0;
+
+    if (in == NULL || cursor == NULL)
+        return -EINVAL;
+
+    snap = olm_file_cache_read_lock(in, &epoch);
+
+    files = olm_file_snap_window(snap, keyword, start, end, &len);
+    if (index < len) {
+        olm_file_cache_cursor_reset(cursor);
+        cursor->keyword    = keyword;
+        cursor->start      = start;
+        cursor->end        = end;
+        cursor->generation = snap->generation;
+        cursor->index      = index;
+        cursor->file       = olm_file_acquire(files[index]);
+    } else {
+        r = -EINVAL;
+    }
+
+    olm_file_cache_read_unlock(in, epoch);
+    return r;
+}
+
+int
+olm_file_cache_cursor_next(olm_file_cache_t *       in,
+                           olm_file_cache_cursor_t *cursor) {
+    const olm_file_t *file;
+    int               r;
+
+    if ((r = olm_file_cache_cursor_get(in, cursor, &file)) != 0)
+        return r;
+
+    return olm_file_cache_cursor_seek_window(in, cursor, cursor->index + 1,
+                                             cursor->keyword, cursor->start,
+                                             cursor->end);
+}
+
+int
+olm_file_cache_cursor_get(olm_file_cache_t *       in,
+                          olm_file_cache_cursor_t *cursor,
+                          const olm_file_t **      out) {
+    const struct olm_file_cache_snap_t *snap;
+    olm_file_t *const *                 files;
+    unsigned int                        epoch;
+    uint32_t                            len, loc;
+    bool                                found;
+    int                                 r = 0;
+
+    if (in == NULL || cursor == NULL || out == NULL)
+        return -EINVAL;
+    if (cursor->file == NULL)
+        return -EINVAL; // not positioned
+
+    snap = olm_file_cache_read_lock(in, &epoch);
+
+    if (cursor->generation != snap->generation) { // cache changed, revalidate
+        files = olm_file_snap_window(snap, cursor->keyword, cursor->start,
+                                     cursor->end, &len);
+        loc   = olm_file_array_search(files, len, cursor->file->unix_time,
+                                    cursor->file->name, &found);
+        if (found && loc == cursor->index) {
+            cursor->generation = snap->generation;
+            if (files[loc] != cursor->file) { // was replaced
+                olm_file_release(cursor->file);
+                cursor->file = olm_file_acquire(files[loc]);
+            }
+        } else
+            r = -ESTALE;
+    }
+
+    olm_file_cache_read_unlock(in, epoch);
+
+    if (r == 0)
+        *out = cursor->file;
+
     return r;
 }
+
+void
+olm_file_cache_cursor_reset(olm_file_cache_cursor_t *cursor) {
+    if (cursor == NULL)
+        return;
+
+    if (cursor->file != NULL)
+        olm_file_release(cursor->file);
+
+    cursor->keyword    = NULL;
+    cursor->start      = 0;
+    cursor->end        = UINT32_MAX;
+    cursor->generation = 0;
+    cursor->index      = 0;
+    cursor->file       = NULL;
+}
@@ -2,36 +2,191 @@
 #define OLM_FILE_CACHE_H
 
 #include "olm_file.h"
+#include "olm_file_manifest.h"
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
-/** Link list index for the file cache list. */
-struct olm_file_index_t {
-    /** Next olm file */
-    struct olm_file_index_t *next;
-    /** OLM file meta data */
-    olm_file_t *data;
+/** Eviction policies for when a cache or keyword is over its budget. */
+typedef enum {
+    /** Never evict, the budgets are only for reporting. */
+    OLM_FILE_CACHE_EVICT_NONE = 0,
+    /** Evict the oldest file (by the unix time in the filename) first. */
+    OLM_FILE_CACHE_EVICT_OLDEST = 1,
+    /** Evict the oldest file with the lowest priority keyword first. */
+    OLM_FILE_CACHE_EVICT_PRIORITY = 2,
+    /** Evict the least recently read file first. */
+    OLM_FILE_CACHE_EVICT_LRU = 3,
+} olm_file_cache_evict_t;
+
+/** A budget for a cache or for a keyword in a cache. */
+typedef struct {
+    /** The max total size of the files, 0 for no limit. */
+    uint64_t max_bytes;
+    /** The max number of files, 0 for no limit. */
+    uint32_t max_files;
+    /**
+     * Keyword priority for OLM_FILE_CACHE_EVICT_PRIORITY, lowest is evicted
+     * first. Keywords without a budget have a priority of 0. Not used for
+     * the cache budget.
+     */
+    uint8_t priority;
+} olm_file_cache_budget_t;
+
+#define OLM_FILE_CACHE_BUDGET_INITIALIZER                                      \
+    { .max_bytes = 0, .max_files = 0, .priority = 0, }
+
+/** The budget for a keyword, kept even when there are no files for it. */
+struct olm_file_keyword_budget_t {
+    /** The keyword. */
+    char *keyword;
+    /** The budget. */
+    olm_file_cache_budget_t budget;
+};
+
+/** Keyword index (a bucket) for the file cache. */
+struct olm_file_keyword_t {
+    /** The keyword all files in the bucket share, interned. */
+    const char *keyword;
+    /** The files with the keyword. Will be order oldest to newest. */
+    olm_file_t **files;
+    /** The number of files in the bucket. */
+    uint32_t len;
+    /** The number of slots allocated for files. */
+    uint32_t size;
+    /** The total size of the files in the bucket. */
+    uint64_t bytes;
+    /** The budget for the keyword, NULL if it does not have one. */
+    const struct olm_file_keyword_budget_t *budget;
 };
 
+/** A immutable copy of the index for lock-free readers. */
+struct olm_file_cache_snap_t;
+
 /**
  * OLM file cache data. Should be treated as readonly outside
  * olm_file_cache_* functions.
+ *
+ * Writers are serialized by the mutex and publish a new snapshot of the index
+ * after every change. Readers (len, index, file_exist, bytes, touch, digest,
+ * and the cursors) never take the mutex, they use the current snapshot inside
+ * a epoch-based read-side critical section, so a writer doing disk I/O or a
+ * long scan never blocks the CAN thread. A old snapshot, and the files
+ * removed with it, are freed once every reader that could see it is done.
  */
 typedef struct {
     /** The absolute path to the cache. */
     char *dir;
-    /** The link list of files in the cache. Will be order oldest to newest. */
-    struct olm_file_index_t *files;
-    /** The length of lenght files link list for convenience */
+    /**
+     * Array of all files in the cache. Will be order oldest to newest (by unix
+     * time and then by name), so it can be binary searched.
+     */
+    olm_file_t **files;
+    /** The number of files in the cache. */
     uint32_t len;
-    /** Mutex for accessing data */
+    /** The number of slots allocated for files. */
+    uint32_t size;
+    /** The keyword buckets, sorted by keyword. */
+    struct olm_file_keyword_t *keywords;
+    /** The number of keyword buckets. */
+    uint32_t keywords_len;
+    /** Incremented everytime a file is added to or removed from the cache. */
+    uint32_t generation;
+    /**
+     * The inotify file descriptor watching the cache directory, -1 if not
+     * watching. Can be added to a epoll and when readable call
+     * olm_file_cache_sync().
+     */
+    int watch_fd;
+    /** The manifest next to the cache directory, to speed up startup. */
+    olm_file_manifest_t manifest;
+    /** The total size of all files in the cache. */
+    uint64_t bytes;
+    /** The budget for the whole cache. */
+    olm_file_cache_budget_t budget;
+    /** The keyword budgets, sorted by keyword. */
+    struct olm_file_keyword_budget_t *budgets;
+    /** The number of keyword budgets. */
+    uint32_t budgets_len;
+    /** What to evict when over a budget. */
+    olm_file_cache_evict_t evict;
+    /** The number of files evicted. */
+    uint32_t evicted;
+    /** The snapshot readers use, replaced by writers. */
+    _Atomic(struct olm_file_cache_snap_t *) snap;
+    /** Read-side epoch, the low bit picks which reader count to use. */
+    atomic_uint epoch;
+    /** The number of readers in each epoch parity. */
+    atomic_uint readers[2];
+    /** Files removed since the last snapshot, released after it is replaced. */
+    olm_file_t **retired;
+    /** The number of retired files. */
+    uint32_t retired_len;
+    /** The number of slots allocated for retired files. */
+    uint32_t retired_size;
+    /** Files removed or evicted, waiting to be unlinked by the worker. */
+    olm_file_t **unlinks;
+    /** The number of files waiting to be unlinked. */
+    uint32_t unlinks_len;
+    /** The number of slots allocated for files waiting to be unlinked. */
+    uint32_t unlinks_size;
+    /**
+     * Files the unlink worker took off the queue and is unlinking, outside the
+     * lock.
+     */
+    olm_file_t **unlinking;
+    /** The number of files the unlink worker is unlinking. */
+    uint32_t unlinking_len;
+    /** Signaled when the unlink worker is done with the files it took. */
+    pthread_cond_t unlinked_cond;
+    /** Thread that unlinks removed and evicted files. */
+    pthread_t unlink_thread;
+    /** Signaled when there are files to unlink or the worker should stop. */
+    pthread_cond_t unlink_cond;
+    /** Set if the unlink worker was started. */
+    bool unlink_running;
+    /** Set to stop the unlink worker, once its queue is empty. */
+    bool unlink_stop;
+    /** Mutex for writers. */
     pthread_mutex_t mutex;
 } olm_file_cache_t;
 
+/**
+ * A cursor for listing the files in a cache. It remembers the file it is on
+ * and the cache generation it was positioned at, so it can be kept between
+ * calls (like between SDO requests) and a add or remove in the mean time is
+ * detected instead of giving a different file.
+ */
+typedef struct {
+    /** The keyword filter the cursor was positioned with, NULL for none. */
+    const char *keyword;
+    /** The oldest unix time in the cursor's time window, inclusive. */
+    uint32_t start;
+    /** The newest unix time in the cursor's time window, inclusive. */
+    uint32_t end;
+    /** The cache generation when the cursor was last validated. */
+    uint32_t generation;
+    /** The index the cursor is on. */
+    uint32_t index;
+    /** Reference to the olm file the cursor is on, NULL if not positioned. */
+    olm_file_t *file;
+} olm_file_cache_cursor_t;
+
+#define OLM_FILE_CACHE_CURSOR_INITIALIZER                                      \
+    {                                                                          \
+        .keyword = NULL, .start = 0, .end = UINT32_MAX, .generation = 0,       \
+        .index = 0, .file = NULL,                                              \
+    }
+
 /**
  * @brief Create a new olm_file_t cache.
  *
+ * The index is loaded from the manifest next to the directory (the directory
+ * path with a ".manifest" suffix). If the directory mtime still matches the
+ * manifest, the directory is not read at all, otherwise only files not in the
+ * manifest are stat'ed.
+ *
  * @param dir_path The directory to use.
  * @param out The new file cache.
  *
@@ -49,7 +204,9 @@ void
 olm_file_cache_free(olm_file_cache_t *in);
 
 /**
- * @brief Add new file to olm file cache.
+ * @brief Add new file to olm file cache. It is renamed into the cache
+ * directory and the directory is synced, so the file should already be
+ * synced to disk by the caller.
  *
  * @param in The file cache.
  * @oaram filename Path to a new file to add.
@@ -59,6 +216,20 @@ olm_file_cache_free(olm_file_cache_t *in);
 int
 olm_file_cache_add(olm_file_cache_t *in, char *filename);
 
+/**
+ * @brief Add new file to olm file cache with its digests already known, like
+ * when they were worked out as it was written, so they never have to be.
+ *
+ * @param in The file cache.
+ * @param filename Path to a new file to add.
+ * @param digest The digests of the file, can be NULL if not known.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_add_digest(olm_file_cache_t *in, char *filename,
+                          const olm_file_digest_t *digest);
+
 /**
  * @brief Removes a file from olm file cache.
  *
@@ -68,18 +239,50 @@ olm_file_cache_add(olm_file_cache_t *in, char *filename);
  * @return 0 on success or negative errno on failure.
  */
 int
-olm_file_cache_remove(olm_file_cache_t *in, char *filename);
+olm_file_cache_remove(olm_file_cache_t *in, const char *filename);
+
+/**
+ * @brief Remove all files with a unix time in a range from the cache, in one
+ * pass over the index. Can be used for sepecific keywords too. The files are
+ * gone from the index on return and are unlinked later by a worker thread.
+ *
+ * @param in The file cache.
+ * @param keyword The olm keyword to filter with. Set to NULL, if no filter
+ * is wanted.
+ * @param start The oldest unix time to remove, inclusive.
+ * @param end The newest unix time to remove, inclusive.
+ *
+ * @return The number of files removed or negative errno on failure.
+ */
+int
+olm_file_cache_remove_range(olm_file_cache_t *in, const char *keyword,
+                            uint32_t start, uint32_t end);
+
+/**
+ * @brief Remove all but the newest files for each keyword in the cache, in
+ * one pass over the index. The files are gone from the index on return and
+ * are unlinked later by a worker thread.
+ *
+ * @param in The file cache.
+ * @param keyword Only trim this keyword. Set to NULL to trim every keyword.
+ * @param keep The number of files to keep for each keyword.
+ *
+ * @return The number of files removed or negative errno on failure.
+ */
+int
+olm_file_cache_keep_newest(olm_file_cache_t *in, const char *keyword,
+                           uint32_t keep);
 
 /**
- * @brief Get a copy of the olm_file_t at a index. Can be used for sepecific
- * keywords too.
+ * @brief Get a reference to the olm_file_t at a index. Can be used for
+ * sepecific keywords too. Does no syscalls or allocations.
  *
  * @param in The file cache.
  * @param index The index in the list wanted.
  * @param keyword The olm keyword to filter with. Set to NULL, if no filter
  * is wanted.
- * @param out Th copy of olm file data at the index. Must be freed with @ref
- * olm_file_free.
+ * @param out The olm file data at the index. It is immutable and must be
+ * released with @ref olm_file_release.
  *
  * @return 0 on success or negative errno on failure.
  */
@@ -100,6 +303,22 @@ olm_file_cache_index(olm_file_cache_t *in, int index, const char *keyword,
 uint32_t
 olm_file_cache_len(olm_file_cache_t *in, const char *keyword);
 
+/**
+ * @brief Get the number of files in a time window of the file cache, found
+ * by binary search. Can be used for sepecific keywords too. O(log n).
+ *
+ * @param in The file cache.
+ * @param keyword The olm keyword to filter with. Set to NULL, if no filter
+ * is wanted.
+ * @param start The oldest unix time in the window, inclusive.
+ * @param end The newest unix time in the window, inclusive.
+ *
+ * @return The number of files in the window.
+ */
+uint32_t
+olm_file_cache_window_len(olm_file_cache_t *in, const char *keyword,
+                          uint32_t start, uint32_t end);
+
 /**
  * @brief check if file exist in cache
  *
@@ -108,4 +327,205 @@ olm_file_cache_len(olm_file_cache_t *in, const char *keyword);
 bool
 olm_file_cache_file_exist(olm_file_cache_t *in, const char *filename);
 
+/**
+ * @brief Get the total size of the files in the cache. Can be used for
+ * sepecific keywords too. O(1), or O(log k) with a keyword.
+ *
+ * @param in The file cache.
+ * @param keyword The olm keyword to filter with. Set to NULL, if no filter
+ * is wanted.
+ *
+ * @return The total size in bytes.
+ */
+uint64_t
+olm_file_cache_bytes(olm_file_cache_t *in, const char *keyword);
+
+/**
+ * @brief Get the budget for the cache or for a keyword in it.
+ *
+ * @param in The file cache.
+ * @param keyword The keyword, NULL for the budget of the whole cache.
+ * @param out The budget. All zeros if the keyword does not have one.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_get_budget(olm_file_cache_t *in, const char *keyword,
+                          olm_file_cache_budget_t *out);
+
+/**
+ * @brief Set the budget for the cache or for a keyword in it. Files are
+ * evicted right away if it is now over the budget.
+ *
+ * @param in The file cache.
+ * @param keyword The keyword, NULL for the budget of the whole cache.
+ * @param budget The new budget.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_set_budget(olm_file_cache_t *in, const char *keyword,
+                          const olm_file_cache_budget_t *budget);
+
+/**
+ * @brief Set the eviction policy for the cache. Files are evicted right away
+ * if it is over any budget.
+ *
+ * @param in The file cache.
+ * @param evict The eviction policy.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_set_eviction(olm_file_cache_t *     in,
+                            olm_file_cache_evict_t evict);
+
+/**
+ * @brief Check if a file could be added to the cache without going over the
+ * byte budget of the cache or of its keyword on its own. Other files can be
+ * evicted to make room for it, but it can never be under a budget smaller
+ * than it. Always fits with OLM_FILE_CACHE_EVICT_NONE, as the budgets are
+ * only for reporting then.
+ *
+ * @param in The file cache.
+ * @param filename The name of the file, in olm file format.
+ * @param size The size of the file.
+ *
+ * @return 0 if it fits, -EFBIG if it does not, or -EINVAL if the filename is
+ * not in olm file format.
+ */
+int
+olm_file_cache_fits(olm_file_cache_t *in, const char *filename,
+                    uint64_t size);
+
+/**
+ * @brief Mark a file as just read, for OLM_FILE_CACHE_EVICT_LRU.
+ *
+ * @param in The file cache.
+ * @param filename The name of the file read.
+ */
+void
+olm_file_cache_touch(olm_file_cache_t *in, const char *filename);
+
+/**
+ * @brief Get the digests of a file in the cache, if they are known. They are
+ * kept in the index and the manifest. The file is never read for them, so a
+ * file added without them has none until they are set with
+ * olm_file_cache_set_digest(). Lock-free.
+ *
+ * @param in The file cache.
+ * @param filename The name of the file.
+ * @param out The digests.
+ *
+ * @return 0 on success, -ENOENT if the file is not in the cache, -ENODATA if
+ * its digests are not known yet, or other negative errno on failure.
+ */
+int
+olm_file_cache_digest(olm_file_cache_t *in, const char *filename,
+                      olm_file_digest_t *out);
+
+/**
+ * @brief Set the digests of a file in the cache, like when they were worked
+ * out as it was read. Does nothing if they are already known.
+ *
+ * @param in The file cache.
+ * @param filename The name of the file.
+ * @param digest The digests of the file.
+ *
+ * @return 0 on success, -ENOENT if the file is not in the cache, or other
+ * negative errno on failure.
+ */
+int
+olm_file_cache_set_digest(olm_file_cache_t *in, const char *filename,
+                          const olm_file_digest_t *digest);
+
+/**
+ * @brief Apply all pending inotify events for the cache directory to the
+ * index, so files dropped into (or renamed into, or deleted from) the
+ * directory by other processes show up without a rescan. Non-blocking. A full
+ * rescan is only done if the kernel's event queue overflowed.
+ *
+ * @param in The file cache.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_sync(olm_file_cache_t *in);
+
+/**
+ * @brief Move a cursor to a index. Can be used for sepecific keywords too.
+ *
+ * @param in The file cache.
+ * @param cursor The cursor.
+ * @param index The index in the list wanted.
+ * @param keyword The olm keyword to filter with. Set to NULL, if no filter
+ * is wanted. Must be valid until the cursor is reset.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_cursor_seek(olm_file_cache_t *in,
+                           olm_file_cache_cursor_t *cursor, uint32_t index,
+                           const char *keyword);
+
+/**
+ * @brief Move a cursor to a index in a time window. Can be used for sepecific
+ * keywords too. The index is from the oldest file in the window, so the cost
+ * does not depend on how many files are outside of it.
+ *
+ * @param in The file cache.
+ * @param cursor The cursor.
+ * @param index The index in the window wanted.
+ * @param keyword The olm keyword to filter with. Set to NULL, if no filter
+ * is wanted. Must be valid until the cursor is reset.
+ * @param start The oldest unix time in the window, inclusive.
+ * @param end The newest unix time in the window, inclusive.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_cache_cursor_seek_window(olm_file_cache_t *       in,
+                                  olm_file_cache_cursor_t *cursor,
+                                  uint32_t index, const char *keyword,
+                                  uint32_t start, uint32_t end);
+
+/**
+ * @brief Move a cursor to the next file, with the same keyword filter and
+ * time window.
+ *
+ * @param in The file cache.
+ * @param cursor The cursor.
+ *
+ * @return 0 on success, -ESTALE if the cache changed under the cursor, or
+ * other negative errno on failure.
+ */
+int
+olm_file_cache_cursor_next(olm_file_cache_t *       in,
+                           olm_file_cache_cursor_t *cursor);
+
+/**
+ * @brief Get the file the cursor is on. O(1) if the cache has not changed
+ * since the cursor was positioned, otherwise the cursor is revalidated.
+ *
+ * @param in The file cache.
+ * @param cursor The cursor.
+ * @param out The olm file the cursor is on. Borrowed from the cursor, so it
+ * is only valid until the cursor is moved or reset.
+ *
+ * @return 0 on success, -ESTALE if the file was removed or is no longer at
+ * the cursor's index, or other negative errno on failure.
+ */
+int
+olm_file_cache_cursor_get(olm_file_cache_t *       in,
+                          olm_file_cache_cursor_t *cursor,
+                          const olm_file_t **      out);
+
+/**
+ * @brief Reset a cursor, so it is not positioned.
+ *
+ * @param cursor The cursor.
+ */
+void
+olm_file_cache_cursor_reset(olm_file_cache_cursor_t *cursor);
+
 #endif /* OLM_FILE_CACHE_H */
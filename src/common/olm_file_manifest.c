@@ -0,0 +1,384 @@
+/**
+ * On-disk manifest of the files in a olm file cache.
+ *
+ * @file        olm_file_manifest.c
+ * @ingroup     olm_file_manifest
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_file_manifest.h"
+#include "crc32c.h"
+#include "olm_file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <linux/limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Magic at the start of every manifest file. */
+#define MANIFEST_MAGIC "OLMM"
+/** Manifest format version, change if the record format changes. */
+#define MANIFEST_VERSION 2
+/** Seconds the directory must be unchanged for before marking it. */
+#define MANIFEST_MARK_DELAY 2
+
+/** Record types. */
+enum manifest_op {
+    MANIFEST_ADD    = 1,
+    MANIFEST_REMOVE = 2,
+    MANIFEST_MARK   = 3,
+};
+
+/** Record flags. */
+enum manifest_flag {
+    /** A olm_file_digest_t follows the filename of a add record. */
+    MANIFEST_HAS_DIGEST = 0x01,
+};
+
+/** Manifest file header. */
+struct manifest_header_t {
+    char     magic[4];
+    uint32_t version;
+};
+
+/**
+ * Manifest record, followed by name_len bytes of filename (no '\0') and then
+ * the digests if it has them.
+ */
+struct manifest_record_t {
+    /** CRC-32C of the rest of the record, including what follows it. */
+    uint32_t crc;
+    /** A manifest_op. */
+    uint8_t op;
+    /** Length of the filename. */
+    uint8_t name_len;
+    /** manifest_flag bits. */
+    uint8_t flags;
+    uint8_t reserved;
+    /** File size for add records. */
+    uint32_t size;
+    /** Directory mtime for mark records. */
+    uint32_t mtime_nsec;
+    int64_t  mtime_sec;
+};
+
+/** Largest possible record. */
+#define RECORD_MAX_LEN                                                         \
+    (sizeof(struct manifest_record_t) + UINT8_MAX + sizeof(olm_file_digest_t))
+
+/** The length of what follows a record. */
+static size_t
+manifest_record_tail(const struct manifest_record_t *record) {
+    if (record->flags & MANIFEST_HAS_DIGEST)
+        return record->name_len + sizeof(olm_file_digest_t);
+
+    return record->name_len;
+}
+
+/**
+ * Fill out a record in a buffer.
+ * @return The length of the record or 0 if the filename is too long.
+ */
+static size_t
+manifest_record(uint8_t *buf, uint8_t op, const char *filename, uint32_t size,
+                const struct timespec *mtime, const olm_file_digest_t *digest) {
+    struct manifest_record_t record = {0};
+    size_t                   name_len;
+
+    name_len = filename != NULL ? strlen(filename) : 0;
+    if (name_len > UINT8_MAX)
+        return 0;
+
+    record.op       = op;
+    record.name_len = (uint8_t)name_len;
+    record.size     = size;
+    if (mtime != NULL) {
+        record.mtime_sec  = mtime->tv_sec;
+        record.mtime_nsec = mtime->tv_nsec;
+    }
+    if (digest != NULL)
+        record.flags |= MANIFEST_HAS_DIGEST;
+
+    memcpy(buf, &record, sizeof(record));
+    if (name_len > 0)
+        memcpy(&buf[sizeof(record)], filename, name_len);
+    if (digest != NULL)
+        memcpy(&buf[sizeof(record) + name_len], digest, sizeof(*digest));
+    record.crc = crc32c(CRC32C_INIT, &buf[sizeof(record.crc)],
+                        sizeof(record) - sizeof(record.crc)
+                            + manifest_record_tail(&record));
+    memcpy(buf, &record.crc, sizeof(record.crc));
+
+    return sizeof(record) + manifest_record_tail(&record);
+}
+
+/** Get the digests of a file for its add record, NULL if not known. */
+static const olm_file_digest_t *
+manifest_digest(const olm_file_t *file, olm_file_digest_t *digest) {
+    return olm_file_digest_get(file, digest) ? digest : NULL;
+}
+
+/** Append a record to the manifest. */
+static int
+manifest_append(olm_file_manifest_t *manifest, uint8_t op,
+                const char *filename, uint32_t size,
+                const olm_file_digest_t *digest) {
+    uint8_t buf[RECORD_MAX_LEN];
+    size_t  len;
+
+    if (manifest == NULL || manifest->fd < 0)
+        return 0;
+
+    if ((len = manifest_record(buf, op, filename, size, NULL, digest)) == 0)
+        return -ENAMETOOLONG;
+
+    // a single write, so a crash can only tear the last record
+    if (write(manifest->fd, buf, len) != (ssize_t)len) {
+        close(manifest->fd); // stop journaling, startup will reconcile
+        manifest->fd = -1;
+        return -EIO;
+    }
+
+    ++manifest->records;
+    return 0;
+}
+
+/** Write a new empty manifest over a missing or invalid one. */
+static int
+manifest_reset(olm_file_manifest_t *manifest) {
+    return olm_file_manifest_compact(manifest, NULL, 0, NULL);
+}
+
+/** fsync() the directory a path is in, so a rename in it is durable. */
+static void
+fsync_parent_dir(const char *path) {
+    char dir_path[PATH_MAX];
+    int  fd;
+
+    strncpy(dir_path, path, sizeof(dir_path) - 1);
+    dir_path[sizeof(dir_path) - 1] = '\0';
+
+    if ((fd = open(dirname(dir_path), O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+        >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+int
+olm_file_manifest_load(olm_file_manifest_t *manifest, const char *path,
+                       olm_file_manifest_cb_t cb, void *arg,
+                       struct timespec *mark) {
+    struct manifest_header_t header;
+    struct manifest_record_t record;
+    olm_file_digest_t        digest;
+    struct stat              st;
+    uint8_t *                data;
+    char                     filename[UINT8_MAX + 1];
+    size_t                   offset;
+    int                      fd, r = 0;
+
+    if (manifest == NULL || path == NULL || cb == NULL || mark == NULL)
+        return -EINVAL;
+
+    mark->tv_sec  = 0;
+    mark->tv_nsec = 0;
+
+    if ((manifest->path = malloc(strlen(path) + 1)) == NULL)
+        return -ENOMEM;
+    strncpy(manifest->path, path, strlen(path) + 1);
+    manifest->fd      = -1;
+    manifest->records = 0;
+
+    if ((fd = open(path, O_RDWR | O_CLOEXEC)) < 0)
+        return manifest_reset(manifest); // no manifest yet
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header)) {
+        close(fd);
+        return manifest_reset(manifest);
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return manifest_reset(manifest);
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MANIFEST_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MANIFEST_VERSION) {
+        munmap(data, st.st_size);
+        close(fd);
+        return manifest_reset(manifest);
+    }
+
+    // replay records until the end or the first torn / corrupt record
+    offset = sizeof(header);
+    while (offset + sizeof(record) <= (size_t)st.st_size) {
+        memcpy(&record, &data[offset], sizeof(record));
+        if (offset + sizeof(record) + manifest_record_tail(&record)
+                > (size_t)st.st_size
+            || record.crc
+                   != crc32c(CRC32C_INIT, &data[offset + sizeof(record.crc)],
+                             sizeof(record) - sizeof(record.crc)
+                                 + manifest_record_tail(&record)))
+            break;
+
+        memcpy(filename, &data[offset + sizeof(record)], record.name_len);
+        filename[record.name_len] = '\0';
+        if (record.flags & MANIFEST_HAS_DIGEST)
+            memcpy(&digest, &data[offset + sizeof(record) + record.name_len],
+                   sizeof(digest));
+
+        if (record.op == MANIFEST_MARK) {
+            mark->tv_sec  = record.mtime_sec;
+            mark->tv_nsec = record.mtime_nsec;
+        } else if (record.op == MANIFEST_ADD || record.op == MANIFEST_REMOVE) {
+            if ((r = cb(arg, filename, record.size, record.op == MANIFEST_ADD,
+                        record.flags & MANIFEST_HAS_DIGEST ? &digest : NULL))
+                != 0)
+                break;
+            mark->tv_sec  = 0; // only a mark at the end counts
+            mark->tv_nsec = 0;
+            ++manifest->records;
+        } else {
+            break;
+        }
+
+        offset += sizeof(record) + manifest_record_tail(&record);
+    }
+
+    munmap(data, st.st_size);
+
+    if (r == 0 && offset != (size_t)st.st_size) { // drop torn tail
+        if (ftruncate(fd, offset) != 0)
+            r = -errno;
+    }
+    close(fd);
+
+    if (r == 0 && (manifest->fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC))
+                      < 0)
+        r = -errno;
+
+    return r;
+}
+
+int
+olm_file_manifest_add(olm_file_manifest_t *manifest, const olm_file_t *file) {
+    olm_file_digest_t digest;
+
+    if (file == NULL)
+        return -EINVAL;
+
+    return manifest_append(manifest, MANIFEST_ADD, file->name, file->size,
+                           manifest_digest(file, &digest));
+}
+
+int
+olm_file_manifest_remove(olm_file_manifest_t *manifest, const char *filename) {
+    if (filename == NULL)
+        return -EINVAL;
+
+    return manifest_append(manifest, MANIFEST_REMOVE, filename, 0, NULL);
+}
+
+int
+olm_file_manifest_compact(olm_file_manifest_t *manifest, olm_file_t **files,
+                          uint32_t len, const struct timespec *mark) {
+    struct manifest_header_t header = {.version = MANIFEST_VERSION};
+    olm_file_digest_t        digest;
+    char                     tmp_path[PATH_MAX];
+    uint8_t                  buf[RECORD_MAX_LEN];
+    struct timespec          now;
+    size_t                   record_len;
+    uint32_t                 records = 0;
+    FILE *                   fptr;
+    int                      fd, r = 0;
+
+    if (manifest == NULL || manifest->path == NULL)
+        return -EINVAL;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", manifest->path);
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+        < 0)
+        return -errno;
+    if ((fptr = fdopen(fd, "w")) == NULL) {
+        r = -errno;
+        close(fd);
+        remove(tmp_path);
+        return r;
+    }
+
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, fptr) != 1)
+        r = -EIO;
+
+    for (uint32_t i = 0; i < len && r == 0; ++i) {
+        record_len = manifest_record(buf, MANIFEST_ADD, files[i]->name,
+                                     files[i]->size, NULL,
+                                     manifest_digest(files[i], &digest));
+        if (record_len == 0)
+            continue; // can't be in the manifest, startup will reconcile it
+        if (fwrite(buf, record_len, 1, fptr) != 1)
+            r = -EIO;
+        ++records;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (r == 0 && mark != NULL && records == len
+        && now.tv_sec - mark->tv_sec >= MANIFEST_MARK_DELAY) {
+        record_len = manifest_record(buf, MANIFEST_MARK, NULL, 0, mark, NULL);
+        if (fwrite(buf, record_len, 1, fptr) != 1)
+            r = -EIO;
+    }
+
+    if (r == 0 && (fflush(fptr) != 0 || fdatasync(fd) != 0))
+        r = -errno;
+    if (fclose(fptr) != 0 && r == 0)
+        r = -errno;
+
+    if (r == 0 && rename(tmp_path, manifest->path) != 0)
+        r = -errno;
+    if (r != 0) {
+        remove(tmp_path);
+        return r;
+    }
+    fsync_parent_dir(manifest->path);
+
+    if (manifest->fd >= 0)
+        close(manifest->fd);
+    manifest->records = records;
+    if ((manifest->fd = open(manifest->path, O_WRONLY | O_APPEND | O_CLOEXEC))
+        < 0)
+        r = -errno;
+
+    return r;
+}
+
+void
+olm_file_manifest_close(olm_file_manifest_t *manifest) {
+    if (manifest == NULL)
+        return;
+
+    if (manifest->fd >= 0) {
+        close(manifest->fd);
+        manifest->fd = -1;
+    }
+
+    if (manifest->path != NULL) {
+        free(manifest->path);
+        manifest->path = NULL;
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * On-disk manifest of the files in a olm file cache.
+ *
+ * @file        olm_file_manifest.h
+ * @ingroup     olm_file_manifest
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_FILE_MANIFEST_H
+#define OLM_FILE_MANIFEST_H
+
+#include "olm_file.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * A manifest is a append only log of the files added to and removed from a
+ * cache, so the cache can be loaded at startup without a stat() per file.
+ * Add records also have the digests of the file, if they are known, so they
+ * never have to be worked out again. A file whose digests are found later is
+ * added again with them.
+ * Every record has a CRC, so a record torn by a crash or power loss is
+ * dropped on load. It is compacted by writing a new one and renaming it over
+ * the old one.
+ *
+ * A compaction can end with a mark that has the mtime of the cache directory
+ * when the manifest matched it. If the last record is a mark and the
+ * directory mtime is still the same, nothing was added to or removed from
+ * the directory since, so it does not even need to be read.
+ */
+typedef struct {
+    /** The path to the manifest file. */
+    char *path;
+    /** The file descriptor records are appended to, -1 if not open. */
+    int fd;
+    /** The number of add and remove records in the manifest. */
+    uint32_t records;
+} olm_file_manifest_t;
+
+#define OLM_FILE_MANIFEST_INITIALIZER                                          \
+    { .path = NULL, .fd = -1, .records = 0, }
+
+/**
+ * Callback for each file record replayed by olm_file_manifest_load(). The
+ * digest is NULL for remove records and add records without digests.
+ * Return 0 to continue or a negative errno to stop loading.
+ */
+typedef int (*olm_file_manifest_cb_t)(void *arg, const char *filename,
+                                      uint32_t size, bool add,
+                                      const olm_file_digest_t *digest);
+
+/**
+ * @brief Load a manifest and open it for appending. A missing or invalid
+ * manifest is replaced with an empty one and a torn tail is truncated.
+ *
+ * @param manifest The manifest.
+ * @param path The path to the manifest file.
+ * @param cb Called for every add and remove record, in order.
+ * @param arg Passed to cb.
+ * @param mark Set to the directory mtime from the mark, if the last record is
+ * a mark, otherwise set to zero.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_manifest_load(olm_file_manifest_t *manifest, const char *path,
+                       olm_file_manifest_cb_t cb, void *arg,
+                       struct timespec *mark);
+
+/**
+ * @brief Append a add record to the manifest, with the digests of the file if
+ * they are known. Does nothing if the manifest is not open.
+ *
+ * @param manifest The manifest.
+ * @param file The olm file that was added.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_manifest_add(olm_file_manifest_t *manifest, const olm_file_t *file);
+
+/**
+ * @brief Append a remove record to the manifest. Does nothing if the
+ * manifest is not open.
+ *
+ * @param manifest The manifest.
+ * @param filename The name of the file that was removed.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_manifest_remove(olm_file_manifest_t *manifest, const char *filename);
+
+/**
+ * @brief Replace the manifest with one that only has a add record for each
+ * file. The new manifest is synced to disk before it replaces the old one.
+ *
+ * @param manifest The manifest.
+ * @param files The files in the cache.
+ * @param len The number of files.
+ * @param mark The directory mtime the files match, NULL for no mark. No mark
+ * is written if the directory changed in the last couple of seconds, as
+ * another change in the same timestamp tick would not change the mtime.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_file_manifest_compact(olm_file_manifest_t *manifest, olm_file_t **files,
+                          uint32_t len, const struct timespec *mark);
+
+/**
+ * @brief Close the manifest. Does not change the file.
+ *
+ * @param manifest The manifest.
+ */
+void
+olm_file_manifest_close(olm_file_manifest_t *manifest);
+
+#endif /* OLM_FILE_MANIFEST_H */
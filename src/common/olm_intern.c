@@ -0,0 +1,149 @@
+/**
+ * Interned strings shared by olm files.
+ *
+ * @file        olm_intern.c
+ * @ingroup     olm_intern
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_intern.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The starting number of hash table buckets, must be a power of 2. */
+#define INTERN_BUCKETS_MIN 64
+
+/** A interned string, the string is stored right after it. */
+struct intern_entry_t {
+    /** The next entry in the hash bucket. */
+    struct intern_entry_t *next;
+    /** The number of references held. */
+    uint32_t refs;
+    /** The hash of the string. */
+    uint32_t hash;
+    /** The string. */
+    char str[];
+};
+
+/** All interned strings, in a chained hash table. */
+static struct {
+    struct intern_entry_t **buckets;
+    /** The number of buckets, a power of 2. */
+    uint32_t size;
+    /** The number of entries. */
+    uint32_t len;
+    pthread_mutex_t mutex;
+} table = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/** FNV-1a hash. */
+static uint32_t
+intern_hash(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Double the number of hash buckets. Should be called under lock.
+ * @return 0 on success or -1 if out of memory.
+ */
+static int
+intern_grow(void) {
+    struct intern_entry_t **buckets, *entry, *next;
+    uint32_t                size;
+
+    size = table.size == 0 ? INTERN_BUCKETS_MIN : table.size * 2;
+    if ((buckets = calloc(size, sizeof(*buckets))) == NULL)
+        return -1;
+
+    for (uint32_t i = 0; i < table.size; ++i) {
+        for (entry = table.buckets[i]; entry != NULL; entry = next) {
+            next                       = entry->next;
+            entry->next                = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+        }
+    }
+
+    free(table.buckets);
+    table.buckets = buckets;
+    table.size    = size;
+    return 0;
+}
+
+const char *
+olm_intern(const char *str, size_t len) {
+    struct intern_entry_t *entry;
+    uint32_t               hash;
+
+    if (str == NULL)
+        return NULL;
+
+    hash = intern_hash(str, len);
+
+    pthread_mutex_lock(&table.mutex);
+
+    if (table.size > 0) {
+        for (entry = table.buckets[hash & (table.size - 1)]; entry != NULL;
+             entry = entry->next) {
+            if (entry->hash == hash && strncmp(entry->str, str, len) == 0
+                && entry->str[len] == '\0') {
+                ++entry->refs;
+                pthread_mutex_unlock(&table.mutex);
+                return entry->str;
+            }
+        }
+    }
+
+    // new string, keep the load factor at or under 1
+    if ((table.len >= table.size && intern_grow() != 0)
+        || (entry = malloc(sizeof(*entry) + len + 1)) == NULL) {
+        pthread_mutex_unlock(&table.mutex);
+        return NULL;
+    }
+
+    entry->refs = 1;
+    entry->hash = hash;
+    memcpy(entry->str, str, len);
+    entry->str[len] = '\0';
+    entry->next     = table.buckets[hash & (table.size - 1)];
+    table.buckets[hash & (table.size - 1)] = entry;
+    ++table.len;
+
+    pthread_mutex_unlock(&table.mutex);
+    return entry->str;
+}
+
+void
+olm_intern_release(const char *str) {
+    struct intern_entry_t *entry, **prev;
+
+    if (str == NULL)
+        return;
+
+    entry = (struct intern_entry_t *)(str
+                                      - offsetof(struct intern_entry_t, str));
+
+    pthread_mutex_lock(&table.mutex);
+
+    if (--entry->refs == 0) {
+        prev = &table.buckets[entry->hash & (table.size - 1)];
+        while (*prev != entry)
+            prev = &(*prev)->next;
+        *prev = entry->next;
+        --table.len;
+        free(entry);
+    }
+
+    pthread_mutex_unlock(&table.mutex);
+}
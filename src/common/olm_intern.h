@@ -0,0 +1,39 @@
+/**
+ * Interned strings shared by olm files.
+ *
+ * @file        olm_intern.h
+ * @ingroup     olm_intern
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_INTERN_H
+#define OLM_INTERN_H
+
+#include <stddef.h>
+
+/**
+ * @brief Get the one shared copy of a string, making it if needed. Two
+ * interned strings are equal only if their pointers are equal. Thread safe.
+ *
+ * @param str The string, does not need to end with a '\0'.
+ * @param len The length of the string.
+ *
+ * @return The interned string, with a reference the caller must drop with
+ * olm_intern_release(), or NULL if out of memory.
+ */
+const char *
+olm_intern(const char *str, size_t len);
+
+/**
+ * @brief Drop a reference to a interned string. It is freed when the last
+ * reference is dropped. Thread safe.
+ *
+ * @param str The interned string, can be NULL.
+ */
+void
+olm_intern_release(const char *str);
+
+#endif /* OLM_INTERN_H */
@@ -0,0 +1,287 @@
+/**
+ * Reading a file ahead of its reader, on a worker thread.
+ *
+ * @file        olm_readahead.c
+ * @ingroup     olm_readahead
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "olm_readahead.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+struct olm_readahead_t {
+    /** The file. */
+    int fd;
+    /** The length of the file. */
+    uint64_t len;
+    /** The length of a chunk. */
+    uint32_t chunk_len;
+    /** The number of chunks in the ring. */
+    uint32_t depth;
+    /** The ring of chunks, chunk n of the file is in slot n % depth. */
+    uint8_t *ring;
+    /** The first chunk the reader still needs. */
+    uint64_t first;
+    /** The chunk after the last one that is ready. */
+    uint64_t filled;
+    /** Error reading chunk filled, 0 if none. */
+    int err;
+    /**
+     * Bumped each time the reader starts the worker over, so a chunk the
+     * worker was reading for the old position is dropped.
+     */
+    uint32_t generation;
+    /** Set to stop the worker. */
+    bool stop;
+    /** The worker thread. */
+    pthread_t thread;
+    /** Signaled when a chunk is ready or the worker failed. */
+    pthread_cond_t ready;
+    /** Signaled when a slot is free, the worker is started over or stopped. */
+    pthread_cond_t space;
+    /** Mutex for everything but the file and the chunks being read into. */
+    pthread_mutex_t mutex;
+};
+
+/**
+ * Read one whole chunk, or the end of the file.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+olm_readahead_chunk(int fd, uint8_t *out, size_t len, uint64_t pos) {
+    size_t  done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = pread(fd, &out[done], len - done, (off_t)(pos + done));
+        if (n < 0 && errno != EINTR)
+            return -errno;
+        if (n == 0)
+            return -EIO; // the file is shorter than it was
+        if (n > 0)
+            done += n;
+    }
+
+    return 0;
+}
+
+/**
+ * Fill the ring with the chunks after the reader, a chunk at a time, reading
+ * without the lock held.
+ * @param arg The read-ahead.
+ * @return Always NULL.
+ */
+static void *
+olm_readahead_worker(void *arg) {
+    olm_readahead_t *ra = arg;
+    uint64_t         chunk, pos;
+    uint32_t         generation;
+    size_t           len;
+    int              r;
+
+    pthread_mutex_lock(&ra->mutex);
+
+    while (!ra->stop) {
+        chunk = ra->filled;
+        pos   = chunk * ra->chunk_len;
+
+        if (ra->err != 0 || chunk >= ra->first + ra->depth || pos >= ra->len) {
+            pthread_cond_wait(&ra->space, &ra->mutex);
+            continue;
+        }
+
+        len = ra->len - pos < ra->chunk_len ? ra->len - pos : ra->chunk_len;
+        generation = ra->generation;
+        pthread_mutex_unlock(&ra->mutex);
+
+        // the reader never touches this slot until filled is moved past it
+        r = olm_readahead_chunk(
+            ra->fd, &ra->ring[(chunk % ra->depth) * ra->chunk_len], len, pos);
+
+        pthread_mutex_lock(&ra->mutex);
+
+        if (generation != ra->generation)
+            continue; // started over while reading, drop it
+
+        if (r == 0)
+            ++ra->filled;
+        else
+            ra->err = r;
+        pthread_cond_signal(&ra->ready);
+    }
+
+    pthread_mutex_unlock(&ra->mutex);
+    return NULL;
+}
+
+int
+olm_readahead_new(int fd, uint64_t len, uint64_t pos, uint32_t chunk_len,
+                  uint32_t depth, olm_readahead_t **out) {
+    olm_readahead_t *ra;
+    int              r;
+
+    if (fd < 0 || chunk_len == 0 || depth == 0 || out == NULL)
+        return -EINVAL;
+
+    if ((ra = calloc(1, sizeof(olm_readahead_t))) == NULL)
+        return -ENOMEM;
+
+    if ((ra->ring = malloc((size_t)chunk_len * depth)) == NULL) {
+        free(ra);
+        return -ENOMEM;
+    }
+
+    ra->fd        = fd;
+    ra->len       = len;
+    ra->chunk_len = chunk_len;
+    ra->depth     = depth;
+    ra->first     = pos / chunk_len;
+    ra->filled    = ra->first;
+    pthread_mutex_init(&ra->mutex, NULL);
+    pthread_cond_init(&ra->ready, NULL);
+    pthread_cond_init(&ra->space, NULL);
+
+    if ((r = pthread_create(&ra->thread, NULL, olm_readahead_worker, ra))
+        != 0) {
+        pthread_cond_destroy(&ra->space);
+        pthread_cond_destroy(&ra->ready);
+        pthread_mutex_destroy(&ra->mutex);
+        free(ra->ring);
+        free(ra);
+        return -r;
+    }
+
+    *out = ra;
+    return 0;
+}
+
+void
+olm_readahead_free(olm_readahead_t *ra) {
+    if (ra == NULL)
+        return;
+
+    pthread_mutex_lock(&ra->mutex);
+    ra->stop = true;
+    pthread_cond_signal(&ra->space);
+    pthread_mutex_unlock(&ra->mutex);
+    pthread_join(ra->thread, NULL);
+
+    pthread_cond_destroy(&ra->space);
+    pthread_cond_destroy(&ra->ready);
+    pthread_mutex_destroy(&ra->mutex);
+    free(ra->ring);
+    free(ra);
+}
+
+/**
+ * Move the window of chunks the worker reads to a chunk the reader wants.
+ * Shoud be called under lock.
+ * @param ra The read-ahead.
+ * @param chunk The chunk.
+ */
+static void
+olm_readahead_seek(olm_readahead_t *ra, uint64_t chunk) {
+    if (chunk < ra->first || chunk >= ra->first + ra->depth) {
+        // out of order, start the worker over from here
+        ra->first  = chunk;
+        ra->filled = chunk;
+        ra->err    = 0;
+        ++ra->generation;
+        pthread_cond_signal(&ra->space);
+    } else if (chunk > ra->first) {
+        ra->first = chunk; // skipped ahead, the chunks before are free
+        pthread_cond_signal(&ra->space);
+    }
+}
+
+/**
+ * Copy from the ring, waiting for chunks that are not ready. Shoud be called
+ * under lock.
+ * @return 0 on success or negative errno if the worker failed.
+ */
+static int
+olm_readahead_copy(olm_readahead_t *ra, uint64_t pos, uint8_t *out,
+                   size_t len) {
+    uint64_t chunk;
+    size_t   skip, n;
+
+    while (len > 0) {
+        chunk = pos / ra->chunk_len;
+        olm_readahead_seek(ra, chunk);
+
+        while (ra->filled <= chunk && ra->err == 0)
+            pthread_cond_wait(&ra->ready, &ra->mutex);
+
+        if (ra->filled <= chunk)
+            return ra->err;
+
+        skip = pos % ra->chunk_len;
+        n    = ra->chunk_len - skip < len ? ra->chunk_len - skip : len;
+        memcpy(out, &ra->ring[(chunk % ra->depth) * ra->chunk_len + skip], n);
+        out += n;
+        pos += n;
+        len -= n;
+
+        if (pos % ra->chunk_len == 0) { // done with the chunk
+            ra->first = chunk + 1;
+            pthread_cond_signal(&ra->space);
+        }
+    }
+
+    return 0;
+}
+
+int
+olm_readahead_read(olm_readahead_t *ra, uint64_t pos, void *out, size_t len) {
+    int r;
+
+    if (ra == NULL || (out == NULL && len != 0) || pos > ra->len
+        || len > ra->len - pos)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ra->mutex);
+    r = olm_readahead_copy(ra, pos, out, len);
+    pthread_mutex_unlock(&ra->mutex);
+
+    return r;
+}
+
+int
+olm_readahead_try_read(olm_readahead_t *ra, uint64_t pos, void *out,
+                       size_t len) {
+    uint64_t last;
+    int      r;
+
+    if (ra == NULL || (out == NULL && len != 0) || pos > ra->len
+        || len > ra->len - pos
+        || len > (size_t)ra->chunk_len * (ra->depth - 1))
+        return -EINVAL;
+    if (len == 0)
+        return 0;
+
+    last = (pos + len - 1) / ra->chunk_len;
+
+    pthread_mutex_lock(&ra->mutex);
+
+    olm_readahead_seek(ra, pos / ra->chunk_len);
+    if (ra->filled > last)
+        r = olm_readahead_copy(ra, pos, out, len); // all ready, never waits
+    else if (ra->err != 0)
+        r = ra->err;
+    else
+        r = -EAGAIN;
+
+    pthread_mutex_unlock(&ra->mutex);
+    return r;
+}
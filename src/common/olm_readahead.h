@@ -0,0 +1,86 @@
+/**
+ * Reading a file ahead of its reader, on a worker thread.
+ *
+ * @file        olm_readahead.h
+ * @ingroup     olm_readahead
+ *
+ * The worker reads the file into a ring of chunks ahead of where it is being
+ * read, so the reader only copies from chunks that are ready and does not
+ * wait on the disk, as long as it reads in order and slower than the disk.
+ * A read out of order starts the worker over from there.
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef OLM_READAHEAD_H
+#define OLM_READAHEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** A file being read ahead. */
+typedef struct olm_readahead_t olm_readahead_t;
+
+/**
+ * @brief Start reading a file ahead, from a position in it.
+ *
+ * @param fd The file, must stay open until the read-ahead is freed. It is
+ * read with pread, so its file offset is not used.
+ * @param len The length of the file, nothing past it is read.
+ * @param pos Where to start reading ahead.
+ * @param chunk_len The length of each read. Chunks start on multiples of it.
+ * @param depth The number of chunks read ahead.
+ * @param out The new read-ahead.
+ *
+ * @return 0 on success or negative errno on failure.
+ */
+int
+olm_readahead_new(int fd, uint64_t len, uint64_t pos, uint32_t chunk_len,
+                  uint32_t depth, olm_readahead_t **out);
+
+/**
+ * @brief Stop the worker and free a read-ahead. Waits for the read the worker
+ * is in the middle of, if any.
+ *
+ * @param ra The read-ahead, can be NULL.
+ */
+void
+olm_readahead_free(olm_readahead_t *ra);
+
+/**
+ * @brief Read from the file, waiting for the worker only if it has not read
+ * that far yet.
+ *
+ * @param ra The read-ahead.
+ * @param pos Where to read from.
+ * @param out The buffer for the data.
+ * @param len The number of bytes to read, all of them must be in the file.
+ *
+ * @return 0 on success, -EINVAL if it is past the end of the file, or other
+ * negative errno if the worker failed to read it.
+ */
+int
+olm_readahead_read(olm_readahead_t *ra, uint64_t pos, void *out, size_t len);
+
+/**
+ * @brief Read from the file only if the worker has read that far already,
+ * so it never waits on the disk. If the worker was not heading there, it is
+ * started over from there, so a later try can succeed.
+ *
+ * @param ra The read-ahead.
+ * @param pos Where to read from.
+ * @param out The buffer for the data.
+ * @param len The number of bytes to read, all of them must be in the file
+ * and there must be room for them in the ring, less one chunk.
+ *
+ * @return 0 on success, -EAGAIN if the data is not ready yet, -EINVAL if it is
+ * past the end of the file, or other negative errno if the worker failed to
+ * read it.
+ */
+int
+olm_readahead_try_read(olm_readahead_t *ra, uint64_t pos, void *out,
+                       size_t len);
+
+#endif /* OLM_READAHEAD_H */
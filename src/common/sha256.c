@@ -0,0 +1,145 @@
+/**
+ * SHA-256 hash (FIPS 180-4).
+ *
+ * @file        sha256.c
+ * @ingroup     sha256
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "sha256.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Hash one 64 byte block into the state. */
+static void
+sha256_block(uint32_t state[8], const uint8_t *block) {
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16
+               | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+    for (int i = 16; i < 64; ++i)
+        w[i] = w[i - 16]
+               + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3))
+               + w[i - 7]
+               + (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+    a = state[0];
+    b = state[1];
+    c = state[2];
+    d = state[3];
+    e = state[4];
+    f = state[5];
+    g = state[6];
+    h = state[7];
+
+    for (int i = 0; i < 64; ++i) {
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g))
+             + sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+             + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void
+sha256_init(sha256_t *sha) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(sha->state, init, sizeof(init));
+    sha->len = 0;
+}
+
+void
+sha256_update(sha256_t *sha, const void *data, size_t len) {
+    const uint8_t *ptr  = data;
+    size_t         used = sha->len % sizeof(sha->buf), n;
+
+    sha->len += len;
+
+    if (used > 0) { // fill the partial block first
+        n = sizeof(sha->buf) - used < len ? sizeof(sha->buf) - used : len;
+        memcpy(&sha->buf[used], ptr, n);
+        ptr += n;
+        len -= n;
+        if (used + n < sizeof(sha->buf))
+            return;
+        sha256_block(sha->state, sha->buf);
+    }
+
+    for (; len >= sizeof(sha->buf); ptr += 64, len -= 64)
+        sha256_block(sha->state, ptr);
+
+    if (len > 0)
+        memcpy(sha->buf, ptr, len);
+}
+
+void
+sha256_final(const sha256_t *sha, uint8_t out[SHA256_LEN]) {
+    uint32_t state[8];
+    uint8_t  block[64];
+    size_t   used = sha->len % sizeof(block);
+    uint64_t bits = sha->len * 8;
+
+    memcpy(state, sha->state, sizeof(state));
+    memcpy(block, sha->buf, used);
+    block[used++] = 0x80;
+
+    if (used > sizeof(block) - 8) { // no room for the length
+        memset(&block[used], 0, sizeof(block) - used);
+        sha256_block(state, block);
+        used = 0;
+    }
+
+    memset(&block[used], 0, sizeof(block) - 8 - used);
+    for (int i = 0; i < 8; ++i)
+        block[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+    sha256_block(state, block);
+
+    for (int i = 0; i < 8; ++i) {
+        out[i * 4]     = (uint8_t)(state[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(state[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(state[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)state[i];
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * SHA-256 hash (FIPS 180-4).
+ *
+ * @file        sha256.h
+ * @ingroup     sha256
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** The length of a SHA-256 hash in bytes. */
+#define SHA256_LEN 32
+
+/** A SHA-256 hash being made. */
+typedef struct {
+    /** The hash state. */
+    uint32_t state[8];
+    /** The number of bytes hashed. */
+    uint64_t len;
+    /** The data not hashed yet, len % 64 bytes of it. */
+    uint8_t buf[64];
+} sha256_t;
+
+/**
+ * @brief Start a new SHA-256 hash.
+ *
+ * @param sha The hash.
+ */
+void
+sha256_init(sha256_t *sha);
+
+/**
+ * @brief Add data to a SHA-256 hash. Can be called repeatedly to hash data in
+ * chunks.
+ *
+ * @param sha The hash.
+ * @param data The data to add.
+ * @param len The length of the data.
+ */
+void
+sha256_update(sha256_t *sha, const void *data, size_t len);
+
+/**
+ * @brief Get the SHA-256 hash of the data added so far. Does not change the
+ * hash, so more data can still be added after.
+ *
+ * @param sha The hash.
+ * @param out The hash value.
+ */
+void
+sha256_final(const sha256_t *sha, uint8_t out[SHA256_LEN]);
+
+#endif /* SHA256_H */
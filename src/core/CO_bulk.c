@@ -0,0 +1,419 @@
+/**
+ * Bulk streaming of fread files as raw CAN frames.
+ *
+ * @file        CO_bulk.c
+ * @ingroup     bulk
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#include "CO_bulk.h"
+#include "CANopen.h"
+#include "logging.h"
+#include "olm_readahead.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Bytes of the file read ahead at a time. */
+#define READ_AHEAD_CHUNK_LEN (16 * 1024)
+/** Chunks of the file read ahead of the stream. */
+#define READ_AHEAD_DEPTH 4
+
+/**
+ * Close the file of a bulk stream and drop what was waiting to be sent.
+ * Shoud be called under lock.
+ * @param bulk The bulk stream.
+ */
+static void
+CO_bulk_close(CO_bulk_t *bulk) {
+    olm_readahead_free(bulk->ahead);
+    bulk->ahead = NULL;
+
+    if (bulk->fd >= 0) {
+        close(bulk->fd);
+        bulk->fd = -1;
+    }
+
+    bulk->resends_len = 0;
+    bulk->tx_pending  = false;
+}
+
+bool
+CO_bulk_cob_id_valid(uint32_t cob_id) {
+    return cob_id >= CO_BULK_COB_ID_MIN && cob_id <= CO_BULK_COB_ID_MAX;
+}
+
+uint32_t
+CO_bulk_cob_id_default(uint8_t node_id) {
+    uint32_t cob_id = CO_BULK_COB_ID_MIN + node_id;
+
+    return node_id != 0 && CO_bulk_cob_id_valid(cob_id) ? cob_id : 0;
+}
+
+void
+CO_bulk_status(CO_bulk_t *bulk, CO_bulk_status_t *status) {
+    if (bulk == NULL || status == NULL)
+        return;
+
+    pthread_mutex_lock(&bulk->mutex);
+    status->state  = bulk->state;
+    status->cob_id = bulk->cob_id;
+    status->window = bulk->window;
+    status->burst  = bulk->burst;
+    status->acked  = bulk->acked;
+    status->sent   = bulk->sent;
+    status->resent = bulk->resent;
+    pthread_mutex_unlock(&bulk->mutex);
+}
+
+int
+CO_bulk_set_cob_id(CO_bulk_t *bulk, uint32_t cob_id) {
+    int r = 0;
+
+    if (bulk == NULL)
+        return -EINVAL;
+    if (!CO_bulk_cob_id_valid(cob_id))
+        return -ERANGE;
+
+    pthread_mutex_lock(&bulk->mutex);
+    if (bulk->state == CO_BULK_STREAMING)
+        r = -EBUSY; // the frames sent so far are on the old one
+    else
+        bulk->cob_id = cob_id;
+    pthread_mutex_unlock(&bulk->mutex);
+
+    return r;
+}
+
+int
+CO_bulk_set_window(CO_bulk_t *bulk, uint8_t window) {
+    int r = 0;
+
+    if (bulk == NULL)
+        return -EINVAL;
+    if (window == 0)
+        return -ERANGE;
+
+    pthread_mutex_lock(&bulk->mutex);
+    if (bulk->state == CO_BULK_STREAMING)
+        r = -EBUSY; // the receiver counts on the window it set
+    else
+        bulk->window = window;
+    pthread_mutex_unlock(&bulk->mutex);
+
+    return r;
+}
+
+int
+CO_bulk_set_burst(CO_bulk_t *bulk, uint8_t burst) {
+    if (bulk == NULL)
+        return -EINVAL;
+    if (burst == 0 || burst > CO_BULK_BURST_MAX)
+        return -ERANGE;
+
+    pthread_mutex_lock(&bulk->mutex);
+    bulk->burst = burst;
+    pthread_mutex_unlock(&bulk->mutex);
+
+    return 0;
+}
+
+int
+CO_bulk_start(CO_bulk_t *bulk, int fd, uint32_t offset, uint32_t length) {
+    uint32_t frames;
+    int      r = 0;
+
+    if (bulk == NULL || fd < 0 || offset > length)
+        return -EINVAL;
+
+    frames = ((uint64_t)length - offset + CO_BULK_FRAME_DATA_LEN - 1)
+             / CO_BULK_FRAME_DATA_LEN;
+
+    pthread_mutex_lock(&bulk->mutex);
+
+    if (bulk->state == CO_BULK_STREAMING) {
+        r = -EBUSY;
+        goto start_end;
+    }
+    if (!CO_bulk_cob_id_valid(bulk->cob_id)) {
+        r = -EINVAL;
+        goto start_end;
+    }
+
+    if (bulk->state == CO_BULK_DONE)
+        bulk->acked = 0; // start over
+    if (bulk->acked > frames) {
+        r = -ERANGE;
+        goto start_end;
+    }
+
+    // a copy, so fread can select another file while streaming
+    if ((bulk->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        r = -errno;
+        goto start_end;
+    }
+
+    if ((r = olm_readahead_new(bulk->fd, length,
+                               offset
+                                   + (uint64_t)bulk->acked
+                                         * CO_BULK_FRAME_DATA_LEN,
+                               READ_AHEAD_CHUNK_LEN, READ_AHEAD_DEPTH,
+                               &bulk->ahead))
+        != 0) {
+        CO_bulk_close(bulk);
+        goto start_end;
+    }
+
+    bulk->offset      = offset;
+    bulk->length      = length;
+    bulk->frames      = frames;
+    bulk->next        = bulk->acked;
+    bulk->loaded      = bulk->acked;
+    bulk->resends_len = 0;
+    bulk->sent        = 0;
+    bulk->resent      = 0;
+    bulk->tx_pending  = false;
+    bulk->state       = CO_BULK_STREAMING;
+
+    if (bulk->acked == frames) { // nothing left
+        CO_bulk_close(bulk);
+        bulk->state = CO_BULK_DONE;
+    }
+
+    log_printf(LOG_DEBUG, "bulk stream of %u frames from %u started",
+               bulk->frames, bulk->acked);
+
+start_end:
+    pthread_mutex_unlock(&bulk->mutex);
+    return r;
+}
+
+void
+CO_bulk_stop(CO_bulk_t *bulk) {
+    if (bulk == NULL)
+        return;
+
+    pthread_mutex_lock(&bulk->mutex);
+
+    CO_bulk_close(bulk);
+    if (bulk->state == CO_BULK_STREAMING)
+        bulk->state = CO_BULK_IDLE;
+
+    pthread_mutex_unlock(&bulk->mutex);
+}
+
+int
+CO_bulk_ack(CO_bulk_t *bulk, uint32_t ack) {
+    CO_bulk_range_t *range;
+    uint8_t          len = 0;
+    int              r   = 0;
+
+    if (bulk == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&bulk->mutex);
+
+    if (bulk->state != CO_BULK_STREAMING) {
+        bulk->acked = ack; // where the next start carries on from
+        if (bulk->state == CO_BULK_DONE)
+            bulk->state = CO_BULK_IDLE;
+    } else if (ack < bulk->acked || ack > bulk->loaded) {
+        r = -ERANGE;
+    } else {
+        bulk->acked = ack;
+        if (bulk->next < ack)
+            bulk->next = ack;
+
+        // drop the parts of the resends that were acknowledged
+        for (uint8_t i = 0; i < bulk->resends_len; ++i) {
+            range = &bulk->resends[i];
+            if (range->first + range->count <= ack)
+                continue;
+            if (range->first < ack) {
+                range->count -= ack - range->first;
+                range->first = ack;
+            }
+            bulk->resends[len++] = *range;
+        }
+        bulk->resends_len = len;
+
+        // a frame still waiting for the socket queue is not needed anymore
+        if (bulk->tx_pending && bulk->tx_frame < ack)
+            bulk->tx_pending = false;
+
+        if (ack == bulk->frames) {
+            log_printf(LOG_DEBUG, "bulk stream done, %u frames sent again",
+                       bulk->resent);
+            CO_bulk_close(bulk);
+            bulk->state = CO_BULK_DONE;
+        }
+    }
+
+    pthread_mutex_unlock(&bulk->mutex);
+    return r;
+}
+
+int
+CO_bulk_resend(CO_bulk_t *bulk, uint32_t first, uint32_t count) {
+    int r = 0;
+
+    if (bulk == NULL)
+        return -EINVAL;
+
+    pthread_mutex_lock(&bulk->mutex);
+
+    if (bulk->state != CO_BULK_STREAMING) {
+        r = -EINVAL;
+    } else if (count == 0 || first < bulk->acked || first > bulk->loaded
+               || count > bulk->loaded - first) {
+        r = -ERANGE;
+    } else if (bulk->resends_len == CO_BULK_RESENDS_MAX) {
+        // too many gaps, go back to the first one and send everything after
+        for (uint8_t i = 0; i < bulk->resends_len; ++i) {
+            if (bulk->resends[i].first < first)
+                first = bulk->resends[i].first;
+        }
+        if (bulk->next > first)
+            bulk->next = first;
+        bulk->resends_len = 0;
+    } else {
+        bulk->resends[bulk->resends_len].first = first;
+        bulk->resends[bulk->resends_len].count = count;
+        ++bulk->resends_len;
+    }
+
+    pthread_mutex_unlock(&bulk->mutex);
+    return r;
+}
+
+/**
+ * Make the next frame to send, a resend if there is one, else a new frame if
+ * the window has room for it. Shoud be called under lock.
+ * @param bulk The bulk stream.
+ * @return 0 if a frame was made, 1 if there is nothing to send, -EAGAIN if
+ * the file was not read that far yet, or other negative errno on failure.
+ */
+static int
+CO_bulk_frame(CO_bulk_t *bulk) {
+    CO_bulk_range_t *range = &bulk->resends[0];
+    uint8_t *        slot;
+    uint32_t         n, len;
+    bool             resend;
+    int              r;
+
+    if (bulk->resends_len > 0) {
+        n      = range->first;
+        resend = true;
+    } else if (bulk->next < bulk->frames
+               && bulk->next - bulk->acked < bulk->window) {
+        n      = bulk->next;
+        resend = n < bulk->loaded; // gone back
+    } else {
+        return 1;
+    }
+
+    len = bulk->length - bulk->offset - n * CO_BULK_FRAME_DATA_LEN;
+    if (len > CO_BULK_FRAME_DATA_LEN)
+        len = CO_BULK_FRAME_DATA_LEN;
+    slot = bulk->ring[n % (CO_BULK_WINDOW_MAX + 1)];
+
+    if (n == bulk->loaded) {
+        r = olm_readahead_try_read(bulk->ahead,
+                                   bulk->offset
+                                       + (uint64_t)n * CO_BULK_FRAME_DATA_LEN,
+                                   slot, len);
+        if (r != 0)
+            return r;
+        ++bulk->loaded;
+    }
+
+    bulk->tx.ident   = bulk->cob_id & CAN_SFF_MASK;
+    bulk->tx.DLC     = 1 + len;
+    bulk->tx.data[0] = n & 0xFF;
+    memcpy(&bulk->tx.data[1], slot, len);
+    bulk->tx_frame   = n;
+    bulk->tx_pending = true;
+    bulk->tx_resend  = resend;
+
+    if (bulk->resends_len == 0) {
+        ++bulk->next;
+    } else if (++range->first, --range->count == 0) {
+        --bulk->resends_len;
+        memmove(&bulk->resends[0], &bulk->resends[1],
+                bulk->resends_len * sizeof(CO_bulk_range_t));
+    }
+
+    return 0;
+}
+
+/**
+ * Get the time for pacing the bursts.
+ * @return The monotonic time in us.
+ */
+static uint64_t
+CO_bulk_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+CO_bulk_process(CO_bulk_t *bulk, CO_CANmodule_t *CANmodule) {
+    CO_ReturnError_t err;
+    uint64_t         now;
+    int              r;
+
+    // never wait for the ODF, try again next time
+    if (bulk == NULL || CANmodule == NULL
+        || pthread_mutex_trylock(&bulk->mutex) != 0)
+        return;
+
+    // the thread wakes for every frame received too, so pace it by time
+    now = CO_bulk_now_us();
+    if (bulk->state != CO_BULK_STREAMING || now < bulk->next_burst_us) {
+        pthread_mutex_unlock(&bulk->mutex);
+        return;
+    }
+    bulk->next_burst_us = now + CO_BULK_BURST_PERIOD_US;
+
+    for (uint8_t i = 0; bulk->state == CO_BULK_STREAMING && i < bulk->burst;
+         ++i) {
+        if (!bulk->tx_pending && (r = CO_bulk_frame(bulk)) != 0) {
+            if (r < 0 && r != -EAGAIN) {
+                log_printf(LOG_ERR, "bulk stream failed to read file: %d", r);
+                CO_bulk_close(bulk);
+                bulk->state = CO_BULK_FAILED;
+            }
+            break;
+        }
+
+        /* When the socket queue is full, the bus is. Back off for longer
+         * than it takes to drain, so the other frames get in before the
+         * stream fills it again.
+         */
+        if ((err = CO_CANtrySend(CANmodule, &bulk->tx)) != CO_ERROR_NO) {
+            if (err != CO_ERROR_TX_BUSY)
+                log_printf(LOG_DEBUG, "bulk stream send failed: %d", err);
+            bulk->next_burst_us = now + CO_BULK_BACKOFF_US;
+            break;
+        }
+
+        bulk->tx_pending = false;
+        ++bulk->sent;
+        if (bulk->tx_resend)
+            ++bulk->resent;
+    }
+
+    pthread_mutex_unlock(&bulk->mutex);
+}
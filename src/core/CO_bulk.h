@@ -0,0 +1,290 @@
+/**
+ * Bulk streaming of fread files as raw CAN frames.
+ *
+ * @file        CO_bulk.h
+ * @ingroup     bulk
+ *
+ * A file pinned by fread is pushed as consecutive CAN frames on its own
+ * COB-ID, without the SDO handshake. Each frame is a sequence number (the
+ * frame number mod 256) then up to 7 bytes of the file, frame n has the
+ * bytes at 7 * n from the fread offset. Only the last frame is short.
+ *
+ * The receiver paces the stream with a window of credit: frames are only
+ * sent up to the window past the frames it acknowledged, so the sequence
+ * number is never ambiguous. It acknowledges the frames it got in order and
+ * asks for ranges it missed to be sent again, both through the fread OD
+ * entry. The fread CRC-32C and SHA-256 check the whole file at the end.
+ *
+ * This file is part of OreSat Linux Manager, a common CAN to Dbus interface
+ * for daemons running on OreSat Linux boards.
+ * Project home page is <https://github.com/oresat/oresat-linux-manager>.
+ */
+
+#ifndef CO_BULK_H
+#define CO_BULK_H
+
+#include "CANopen.h"
+#include "olm_readahead.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The COB-IDs a bulk stream can use. CiA 301 restricts 0x6E0 to 0x6FF, and
+ * the restricted IDs and the predefined connection set take all the other
+ * 11-bit IDs. The default is the node id added to the first one, for node ids
+ * up to 0x5F. Other nodes have to set one.
+ */
+#define CO_BULK_COB_ID_MIN 0x680
+#define CO_BULK_COB_ID_MAX 0x6DF
+/** Bytes of the file in each frame, after the sequence number. */
+#define CO_BULK_FRAME_DATA_LEN 7
+/** The largest window, so a sequence number is never ambiguous. */
+#define CO_BULK_WINDOW_MAX 255
+/** The default window. */
+#define CO_BULK_WINDOW_DEFAULT 128
+/**
+ * The most frames sent in a burst. The stream shares the CAN socket and the
+ * interface queue (txqueuelen is 10 by default) with the heartbeats, EMCYs
+ * and SDO responses, so it never takes more than part of it at a time.
+ */
+#define CO_BULK_BURST_MAX 4
+/** The default max frames sent in a burst. */
+#define CO_BULK_BURST_DEFAULT CO_BULK_BURST_MAX
+/** The least time between bursts, in us. */
+#define CO_BULK_BURST_PERIOD_US 1000
+/**
+ * How long the stream waits after the CAN socket queue was full, in us, so
+ * the queue drains and the other frames get in, even on a slow bus.
+ */
+#define CO_BULK_BACKOFF_US 10000
+/** The most ranges waiting to be sent again, more fall back to go-back-N. */
+#define CO_BULK_RESENDS_MAX 8
+
+/** States of a bulk stream. */
+typedef enum {
+    /** Not streaming, a start carries on from the ack. */
+    CO_BULK_IDLE = 0,
+    /** Sending frames, or waiting for the acks of all of them. */
+    CO_BULK_STREAMING = 1,
+    /** All frames were acknowledged, a start starts over. */
+    CO_BULK_DONE = 2,
+    /** Reading the file failed, a start carries on from the ack. */
+    CO_BULK_FAILED = 3,
+} CO_bulk_state_t;
+
+/** A range of frames to send again. */
+typedef struct {
+    /** The first frame. */
+    uint32_t first;
+    /** The number of frames. */
+    uint32_t count;
+} CO_bulk_range_t;
+
+/** A copy of the settings and counters of a bulk stream, for the ODF. */
+typedef struct {
+    /** The state. */
+    CO_bulk_state_t state;
+    /** The COB-ID of the frames, 0 until set. */
+    uint32_t cob_id;
+    /** The max frames sent past the ack. */
+    uint8_t window;
+    /** The max frames sent in a burst. */
+    uint8_t burst;
+    /** The receiver has all frames before this. */
+    uint32_t acked;
+    /** Frames sent, with the ones sent again. */
+    uint32_t sent;
+    /** Frames sent again. */
+    uint32_t resent;
+} CO_bulk_status_t;
+
+/** A bulk stream. */
+typedef struct {
+    /** The state. */
+    CO_bulk_state_t state;
+    /** The COB-ID of the frames, 0 until set. */
+    uint32_t cob_id;
+    /** The max frames sent past the ack. */
+    uint8_t window;
+    /** The max frames sent in a burst, 1 to CO_BULK_BURST_MAX. */
+    uint8_t burst;
+    /** No burst is sent before this time, in us from CLOCK_MONOTONIC. */
+    uint64_t next_burst_us;
+    /** A copy of the fd of the file, -1 if none. */
+    int fd;
+    /** Reads the file ahead, so frames are sent without waiting on it. */
+    olm_readahead_t *ahead;
+    /** Where the stream starts in the file. */
+    uint32_t offset;
+    /** The length of the file. */
+    uint32_t length;
+    /** The number of frames in the stream. */
+    uint32_t frames;
+    /** The receiver has all frames before this. */
+    uint32_t acked;
+    /** The next frame to send, not counting resends. */
+    uint32_t next;
+    /** Frames up to this were read from the file into the ring. */
+    uint32_t loaded;
+    /** The frames past the ack, slot n % 256 is frame n. */
+    uint8_t ring[CO_BULK_WINDOW_MAX + 1][CO_BULK_FRAME_DATA_LEN];
+    /** Ranges to send again before any new frames. */
+    CO_bulk_range_t resends[CO_BULK_RESENDS_MAX];
+    /** The number of ranges to send again. */
+    uint8_t resends_len;
+    /** Frames sent, with the ones sent again. */
+    uint32_t sent;
+    /** Frames sent again. */
+    uint32_t resent;
+    /** The frame being sent, kept while the CAN socket queue is full. */
+    CO_CANtx_t tx;
+    /** The number of the frame in tx. */
+    uint32_t tx_frame;
+    /** True if the frame in tx has not been sent yet. */
+    bool tx_pending;
+    /** True if the frame in tx is one sent again. */
+    bool tx_resend;
+    /** Mutex between the ODF and the thread sending the frames. */
+    pthread_mutex_t mutex;
+} CO_bulk_t;
+
+#define CO_BULK_INITIALIZER                                                    \
+    {                                                                          \
+        .state = CO_BULK_IDLE, .cob_id = 0,                                    \
+        .window = CO_BULK_WINDOW_DEFAULT, .burst = CO_BULK_BURST_DEFAULT,      \
+        .next_burst_us = 0, .fd = -1, .ahead = NULL, .offset = 0,              \
+        .length = 0, .frames = 0, .acked = 0, .next = 0, .loaded = 0,          \
+        .resends_len = 0, .sent = 0, .resent = 0, .tx_frame = 0,               \
+        .tx_pending = false, .tx_resend = false,                               \
+        .mutex = PTHREAD_MUTEX_INITIALIZER,                                    \
+    }
+
+/**
+ * @brief Check a COB-ID can be used for a bulk stream.
+ *
+ * @param cob_id The COB-ID.
+ *
+ * @return True if it is between CO_BULK_COB_ID_MIN and CO_BULK_COB_ID_MAX.
+ */
+bool
+CO_bulk_cob_id_valid(uint32_t cob_id);
+
+/**
+ * @brief Get the default COB-ID of the bulk stream of a node.
+ *
+ * @param node_id The node id.
+ *
+ * @return The COB-ID, or 0 if the node id is too high to have one.
+ */
+uint32_t
+CO_bulk_cob_id_default(uint8_t node_id);
+
+/**
+ * @brief Get a copy of the settings and counters of a bulk stream, all from
+ * the same time.
+ *
+ * @param bulk The bulk stream.
+ * @param status The copy.
+ */
+void
+CO_bulk_status(CO_bulk_t *bulk, CO_bulk_status_t *status);
+
+/**
+ * @brief Set the COB-ID of the frames, when not streaming.
+ *
+ * @param bulk The bulk stream.
+ * @param cob_id The COB-ID.
+ *
+ * @return 0 on success, -ERANGE if it is not a valid COB-ID, or -EBUSY if
+ * streaming.
+ */
+int
+CO_bulk_set_cob_id(CO_bulk_t *bulk, uint32_t cob_id);
+
+/**
+ * @brief Set the max frames sent past the ack, when not streaming.
+ *
+ * @param bulk The bulk stream.
+ * @param window The window, 1 to CO_BULK_WINDOW_MAX.
+ *
+ * @return 0 on success, -ERANGE if the window is 0, or -EBUSY if streaming.
+ */
+int
+CO_bulk_set_window(CO_bulk_t *bulk, uint8_t window);
+
+/**
+ * @brief Set the max frames sent in a burst, streaming or not.
+ *
+ * @param bulk The bulk stream.
+ * @param burst The burst, 1 to CO_BULK_BURST_MAX.
+ *
+ * @return 0 on success or -ERANGE if the burst is out of range.
+ */
+int
+CO_bulk_set_burst(CO_bulk_t *bulk, uint8_t burst);
+
+/**
+ * @brief Start streaming a file. After a stop or failure it carries on from
+ * the ack, after a stream that was done it starts over.
+ *
+ * @param bulk The bulk stream.
+ * @param fd The file, it is copied so it can be closed after.
+ * @param offset Where to start in the file.
+ * @param length The length of the file.
+ *
+ * @return 0 on success, -EBUSY if already streaming, -EINVAL if no COB-ID
+ * was set, -ERANGE if the ack is past the end, or other negative errno on
+ * failure.
+ */
+int
+CO_bulk_start(CO_bulk_t *bulk, int fd, uint32_t offset, uint32_t length);
+
+/**
+ * @brief Stop streaming and close the file. The ack is kept, so a start
+ * carries on from it.
+ *
+ * @param bulk The bulk stream.
+ */
+void
+CO_bulk_stop(CO_bulk_t *bulk);
+
+/**
+ * @brief Acknowledge frames. Before a start, sets the frame to start from.
+ *
+ * @param bulk The bulk stream.
+ * @param ack The receiver has all frames before this one.
+ *
+ * @return 0 on success, -ERANGE if it is before the last ack or past the
+ * frames sent.
+ */
+int
+CO_bulk_ack(CO_bulk_t *bulk, uint32_t ack);
+
+/**
+ * @brief Ask for frames to be sent again.
+ *
+ * @param bulk The bulk stream.
+ * @param first The first frame.
+ * @param count The number of frames.
+ *
+ * @return 0 on success, -EINVAL if not streaming, or -ERANGE if they were
+ * not sent yet or were acknowledged.
+ */
+int
+CO_bulk_resend(CO_bulk_t *bulk, uint32_t first, uint32_t count);
+
+/**
+ * @brief Send a burst of frames, up to the window, and without waiting for
+ * the CAN socket queue or the file. Bursts are at least
+ * CO_BULK_BURST_PERIOD_US apart, and CO_BULK_BACKOFF_US apart after the queue
+ * was full, however often this is called. Call every millisecond or so from
+ * the real-time thread.
+ *
+ * @param bulk The bulk stream.
+ * @param CANmodule The CAN module to send on.
+ */
+void
+CO_bulk_process(CO_bulk_t *bulk, CO_CANmodule_t *CANmodule);
+
+#endif /* CO_BULK_H */
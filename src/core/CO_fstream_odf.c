@@ -9,14 +9,21 @@
  * Project home page is <https://github.com/oresat/oresat-linux-manager>.
  */
 
+#define _GNU_SOURCE
 #include "CO_fstream_odf.h"
 #include "CANopen.h"
+#include "crc32c.h"
 #include "logging.h"
+#include "olm_codec.h"
+#include "olm_delta.h"
 #include "olm_file.h"
 #include "olm_file_cache.h"
+#include "olm_readahead.h"
+#include "sha256.h"
 #include "utility.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <linux/limits.h>
 #include <stdbool.h>
@@ -27,23 +34,914 @@
 #include <string.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/syslog.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
 #define SDO_BLOCK_LEN (127 * 7)
 
-void
-CO_fstream_reset(CO_fstream_t *data) {
+/** Extension of the file next to a partial fwrite file with its progress. */
+#define CHECKPOINT_EXT ".ckpt"
+/**
+ * Bytes written between fwrite progress checkpoints. Each one syncs the file,
+ * so they are far apart enough to not limit the throughput.
+ */
+#define CHECKPOINT_LEN (1024 * 1024)
+/**
+ * Size of the fwrite write-behind buffer. Writes to the partial file end on a
+ * multiple of it, so all but the first are whole aligned buffers.
+ */
+#define WRITE_BUFFER_LEN (64 * 1024)
+/** Bytes of the file run through a codec at a time. */
+#define CODEC_CHUNK_LEN 4096
+/** Bytes fread reads ahead at a time. */
+#define READ_AHEAD_CHUNK_LEN (16 * 1024)
+/** Chunks fread reads ahead of the transfer. */
+#define READ_AHEAD_DEPTH 4
+/** The window the current rate of a transfer is measured over, in us. */
+#define PROGRESS_WINDOW_US 1000000
+
+/**
+ * Write out the fwrite write-behind buffer to the partial file.
+ * @param data The fwrite data with the partial file opened.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_flush(CO_fstream_t *data) {
+    uint32_t pos = data->length - data->wbuf_len, done = 0;
+    ssize_t  n;
+
+    while (done < data->wbuf_len) {
+        n = pwrite(data->wfd, &data->wbuf[done], data->wbuf_len - done,
+                   (off_t)pos + done);
+        if (n < 0 && errno != EINTR)
+            return -errno;
+        if (n > 0)
+            done += n;
+    }
+
+    data->wbuf_len = 0;
+    return 0;
+}
+
+/**
+ * Make the partial fwrite file durable up to its current length and record
+ * that length in its checkpoint file.
+ *
+ * The checkpoint is a decimal length written in place, so a checkpoint torn
+ * by a power loss can only be empty or shorter, which only makes the resume
+ * point earlier.
+ * @param data The fwrite data with the partial file opened.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_checkpoint(CO_fstream_t *data) {
+    char  filepath[PATH_MAX];
+    FILE *fptr;
+    int   r = 0;
+
+    if ((r = CO_fstream_flush(data)) != 0)
+        return r;
+    if (fdatasync(data->wfd) != 0)
+        return -errno;
+
+    sprintf(filepath, "%s%s" CHECKPOINT_EXT, data->dir, data->file);
+    if ((fptr = fopen(filepath, "w")) == NULL)
+        return -errno;
+
+    fprintf(fptr, "%u", data->length);
+    if (fflush(fptr) != 0 || fdatasync(fileno(fptr)) != 0)
+        r = -errno;
+    fclose(fptr);
+
+    if (r == 0) {
+        data->synced = data->length;
+        log_printf(LOG_DEBUG, "%s checkpointed at %u", data->file,
+                   data->length);
+    }
+
+    return r;
+}
+
+/**
+ * Make a finished fwrite file durable and close it, with the one sync of the
+ * whole transfer after the last checkpoint. It is then safe to move into the
+ * cache, it can not show up there cut short after a power loss.
+ * @param data The fwrite data with the partial file opened.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_commit(CO_fstream_t *data) {
+    int r;
+
+    if ((r = CO_fstream_flush(data)) == 0 && fdatasync(data->wfd) != 0)
+        r = -errno;
+    if (r != 0)
+        return r; // still open, so close() checkpoints it
+
+    close(data->wfd);
+    data->wfd    = -1;
+    data->synced = data->length;
+    FREE_AND_NULL(data->wbuf);
+    return 0;
+}
+
+/**
+ * Get the length of a partial fwrite file that can be resumed from, that is
+ * the length in its checkpoint. Anything past it is dropped, as it may not
+ * have made it to flash.
+ * @param data The fwrite data with a file name selected.
+ * @return The length to resume from, 0 if there is nothing to resume.
+ */
+static uint32_t
+CO_fstream_resume_len(CO_fstream_t *data) {
+    char          filepath[PATH_MAX];
+    FILE *        fptr;
+    struct stat   st;
+    unsigned long len = 0;
+
+    sprintf(filepath, "%s%s" CHECKPOINT_EXT, data->dir, data->file);
+    if ((fptr = fopen(filepath, "r")) == NULL)
+        return 0; // nothing to resume
+
+    if (fscanf(fptr, "%lu", &len) != 1)
+        len = 0;
+    fclose(fptr);
+
+    sprintf(filepath, "%s%s", data->dir, data->file);
+    if (stat(filepath, &st) != 0)
+        len = 0;
+    else if ((unsigned long)st.st_size < len)
+        len = st.st_size;
+
+    if (len > UINT32_MAX || truncate(filepath, len) != 0)
+        len = 0;
+
+    return len;
+}
+
+/**
+ * Open the partial fwrite file if needed and move to the fwrite offset,
+ * dropping anything after it.
+ * @param data The fwrite data with a file name selected.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_seek(CO_fstream_t *data) {
+    char filepath[PATH_MAX];
+    int  r;
+
+    if (data->wfd < 0) {
+        sprintf(filepath, "%s%s", data->dir, data->file);
+
+        if ((data->wfd = open(filepath, O_WRONLY | O_CREAT | O_CLOEXEC, 0666))
+            < 0)
+            return -errno;
+        if ((data->wbuf = malloc(WRITE_BUFFER_LEN)) == NULL) {
+            close(data->wfd);
+            data->wfd = -1;
+            return -ENOMEM;
+        }
+        log_printf(LOG_INFO, "opened %s", filepath);
+    } else if ((r = CO_fstream_flush(data)) != 0) {
+        return r;
+    }
+
+    if (ftruncate(data->wfd, data->offset) != 0)
+        return -errno;
+
+    data->length = data->offset;
+    if (data->synced > data->length) // checkpoint is past the new end
+        return CO_fstream_checkpoint(data);
+
+    return 0;
+}
+
+/**
+ * Check a fwrite file of a known size can be kept and reserve the space for
+ * the rest of it, so it is laid out contiguously instead of growing a segment
+ * at a time. The reserved space is past the end of the partial file, so its
+ * length stays what was written, for resumes.
+ * @param data The fwrite data with the partial file opened.
+ * @param size The size the file will be.
+ * @return 0 on success, -EFBIG if it is over a budget of the cache, -ENOSPC
+ * if the filesystem does not have room for it, or other negative errno on
+ * failure.
+ */
+static int
+CO_fstream_reserve(CO_fstream_t *data, uint64_t size) {
+    struct statvfs st;
+    off_t          len;
+
+    if (olm_file_cache_fits(data->cache, data->file, size) == -EFBIG)
+        return -EFBIG;
+    if (size <= data->length)
+        return 0;
+
+    len = (off_t)(size - data->length);
+    if (fstatvfs(data->wfd, &st) == 0
+        && (uint64_t)st.f_bavail * st.f_frsize < (uint64_t)len)
+        return -ENOSPC;
+
+    // not all filesystems can, then it is only a hint that was not taken
+    if (fallocate(data->wfd, FALLOC_FL_KEEP_SIZE, data->length, len) != 0
+        && errno != EOPNOTSUPP && errno != ENOSYS)
+        return -errno;
+
+    return 0;
+}
+
+/**
+ * Start the digests of a session over, for a file written or read from its
+ * start.
+ * @param data The session.
+ */
+static void
+CO_fstream_digest_reset(CO_fstream_t *data) {
+    data->crc        = CRC32C_INIT;
+    data->digest_len = 0;
+    sha256_init(&data->sha);
+}
+
+/**
+ * Add file data to the digests of a session, if it carries on from the end of
+ * the data already in them.
+ * @param data The session.
+ * @param pos Where the data is in the file.
+ * @param buf The data.
+ * @param len The length of the data.
+ */
+static void
+CO_fstream_digest_update(CO_fstream_t *data, uint32_t pos, const uint8_t *buf,
+                         size_t len) {
+    if (pos != data->digest_len || len == 0)
+        return;
+
+    data->crc = crc32c(data->crc, buf, len);
+    sha256_update(&data->sha, buf, len);
+    data->digest_len += len;
+}
+
+/**
+ * Get the digests of a session.
+ * @param data The session.
+ * @param out The digests of the first digest_len bytes of the file.
+ */
+static void
+CO_fstream_digest(const CO_fstream_t *data, olm_file_digest_t *out) {
+    out->crc32c = data->crc;
+    sha256_final(&data->sha, out->sha256);
+}
+
+/**
+ * Stop the worker reading the file for the digests of a session, if any.
+ * @param data The session.
+ */
+static void
+CO_fstream_digest_stop(CO_fstream_t *data) {
+    olm_digest_free(data->hasher);
+    data->hasher = NULL;
+}
+
+/**
+ * Take the digests of the partial fwrite file from the worker, if it is done.
+ * @param data The fwrite data.
+ * @return 0 if there is no worker or it is done, -EAGAIN if it is still
+ * reading the file, or other negative errno if it failed.
+ */
+static int
+CO_fstream_digest_take(CO_fstream_t *data) {
+    sha256_t sha;
+    uint32_t len, crc;
+    int      r;
+
+    if (data->hasher == NULL)
+        return 0;
+
+    if ((r = olm_digest_poll(data->hasher, &len, &crc, &sha)) == -EAGAIN)
+        return r;
+
+    CO_fstream_digest_stop(data);
+    if (r != 0)
+        return r; // try again next time
+
+    data->crc        = crc;
+    data->sha        = sha;
+    data->digest_len = len;
+    return 0;
+}
+
+/**
+ * Make the digests of the partial fwrite file match its length, after it was
+ * resumed or rewound. Only then is the file read again, up to the length, on
+ * a worker thread. Data written while it reads is not in the digests, so it
+ * is read by the next worker.
+ * @param data The fwrite data with a file name selected.
+ * @return 0 on success, -EAGAIN if the worker is still reading the file, or
+ * other negative errno on failure.
+ */
+static int
+CO_fstream_digest_sync(CO_fstream_t *data) {
+    char filepath[PATH_MAX];
+    int  fd, r;
+
+    if ((r = CO_fstream_digest_take(data)) != 0)
+        return r;
+
+    if (data->digest_len == data->length)
+        return 0;
+
+    // the file was rewound past the end of the digests
+    if (data->digest_len > data->length)
+        CO_fstream_digest_reset(data);
+    if (data->wfd >= 0 && (r = CO_fstream_flush(data)) != 0)
+        return r;
+
+    sprintf(filepath, "%s%s", data->dir, data->file);
+    if ((fd = open(filepath, O_RDONLY | O_CLOEXEC)) < 0)
+        return -errno;
+
+    r = olm_digest_new(fd, data->digest_len, data->length, data->crc,
+                       &data->sha, &data->hasher);
+    close(fd);
+    return r == 0 ? -EAGAIN : r;
+}
+
+/**
+ * Get the digests of the file pinned by fread, from the cache index if it has
+ * them, from the session if the whole file was just read, or else from a
+ * worker thread reading the file. The digests from the worker are given to the
+ * cache index too.
+ * @param data The fread data with the file pinned.
+ * @param out The digests.
+ * @return 0 on success, -EAGAIN if the worker is still reading the file, or
+ * other negative errno on failure.
+ */
+static int
+CO_fstream_file_digest(CO_fstream_t *data, olm_file_digest_t *out) {
+    sha256_t sha;
+    uint32_t len;
+    int      r;
+
+    if (olm_file_cache_digest(data->cache, data->file, out) == 0)
+        return 0;
+
+    if (data->digest_len == data->length) {
+        CO_fstream_digest(data, out);
+        return 0;
+    }
+
+    if (data->hasher == NULL) {
+        sha256_init(&sha);
+        if ((r = olm_digest_new(data->fd, 0, data->length, CRC32C_INIT, &sha,
+                                &data->hasher))
+            != 0)
+            return r;
+    }
+
+    // kept until the file is unpinned, in case it is not in the cache anymore
+    r = olm_digest_poll(data->hasher, &len, &out->crc32c, &sha);
+    if (r != 0) {
+        if (r != -EAGAIN)
+            CO_fstream_digest_stop(data); // try again next time
+        return r;
+    }
+
+    sha256_final(&sha, out->sha256);
+    olm_file_cache_set_digest(data->cache, data->file, out);
+    return 0;
+}
+
+/**
+ * Give the digests of a file fread read all of to the cache index, so they
+ * never have to be worked out by reading it again.
+ * @param data The fread data with the file pinned.
+ */
+static void
+CO_fstream_digest_cache(CO_fstream_t *data) {
+    olm_file_digest_t digest;
+
+    if (data->digest_len != data->length)
+        return; // not read from the start
+
+    CO_fstream_digest(data, &digest);
+    olm_file_cache_set_digest(data->cache, data->file, &digest);
+}
+
+/**
+ * Read a digest sub index.
+ * @param ODF_arg The ODF argument.
+ * @param digest The digests.
+ * @param sha True for the SHA-256 (a domain), false for the CRC-32C.
+ */
+static void
+CO_fstream_digest_odf(CO_ODF_arg_t *ODF_arg, const olm_file_digest_t *digest,
+                      bool sha) {
+    if (sha) {
+        ODF_arg->dataLengthTotal = SHA256_LEN;
+        ODF_arg->dataLength      = SHA256_LEN;
+        memcpy(ODF_arg->data, digest->sha256, SHA256_LEN);
+        ODF_arg->lastSegment = true;
+    } else {
+        CO_setUint32(ODF_arg->data, digest->crc32c);
+    }
+}
+
+/**
+ * Read from the file pinned by fread, through the read-ahead if it has one.
+ * @param data The fread data with the file pinned.
+ * @param out The buffer for the data.
+ * @param len The number of bytes to read.
+ * @param pos Where to read from.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_pread(CO_fstream_t *data, void *out, size_t len, uint32_t pos) {
+    if (data->ahead != NULL)
+        return olm_readahead_read(data->ahead, pos, out, len);
+
+    if (pread(data->fd, out, len, pos) != (ssize_t)len)
+        return -EIO;
+
+    return 0;
+}
+
+/**
+ * Get the time for measuring how long ODF calls take.
+ * @return The monotonic time in us.
+ */
+static uint64_t
+CO_fstream_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Record how long an ODF call took, if it is the longest in the transfer.
+ * @param data The session.
+ * @param start The time the call started, from CO_fstream_now_us().
+ */
+static void
+CO_fstream_latency(CO_fstream_t *data, uint64_t start) {
+    uint64_t us = CO_fstream_now_us() - start;
+
+    if (us > data->max_latency)
+        data->max_latency = us > UINT32_MAX ? UINT32_MAX : us;
+}
+
+/**
+ * Update the progress of a session's transfer after a data segment. Only the
+ * time taken at the start of the ODF call is used, so it adds no syscalls.
+ * @param data The session.
+ * @param ODF_arg The ODF argument of the segment.
+ * @param now The time the ODF call started, from CO_fstream_now_us().
+ * @param ret The abort code the ODF call returns.
+ */
+static void
+CO_fstream_progress(CO_fstream_t *data, const CO_ODF_arg_t *ODF_arg,
+                    uint64_t now, CO_SDO_abortCode_t ret) {
+    CO_fstream_progress_t *p = &data->progress;
+
+    if (ODF_arg->firstSegment) {
+        if (p->active)
+            ++p->aborts; // the last one was never finished
+        p->active       = true;
+        p->total        = ODF_arg->dataLengthTotal;
+        p->segments     = 0;
+        p->start_us     = now;
+        p->window_us    = now;
+        p->window_bytes = 0;
+        p->rate         = 0;
+    }
+
+    if (ret != CO_SDO_AB_NONE) {
+        if (p->active)
+            ++p->aborts;
+        p->active = false;
+        return;
+    }
+
+    ++p->segments;
+    p->last_us = now;
+    p->window_bytes += ODF_arg->dataLength;
+
+    if (now - p->window_us >= PROGRESS_WINDOW_US) {
+        p->rate = (uint64_t)p->window_bytes * 1000000 / (now - p->window_us);
+        p->window_us    = now;
+        p->window_bytes = 0;
+    }
+
+    if (ODF_arg->lastSegment)
+        p->active = false;
+}
+
+/**
+ * Read a progress sub index, they are in the same order in the fread and
+ * fwrite records.
+ * @param ODF_arg The ODF argument.
+ * @param data The session.
+ * @param first The bytes total sub index of the record.
+ * @return SDO abort code.
+ */
+static CO_SDO_abortCode_t
+CO_fstream_progress_odf(CO_ODF_arg_t *ODF_arg, const CO_fstream_t *data,
+                        uint8_t first) {
+    const CO_fstream_progress_t *p     = &data->progress;
+    uint64_t                     value = 0, now;
+
+    if (!ODF_arg->reading)
+        return CO_SDO_AB_READONLY;
+
+    switch (ODF_arg->subIndex - first) {
+    case 0: // bytes total
+        value = p->total;
+        break;
+    case 1: // segments
+        value = p->segments;
+        break;
+    case 2: // current bytes/s, 0 if stalled for a window
+        now = CO_fstream_now_us();
+        if (!p->active || now - p->last_us < PROGRESS_WINDOW_US)
+            value = p->rate;
+        break;
+    case 3: // average bytes/s
+        if (p->last_us > p->start_us)
+            value = (uint64_t)data->wire_bytes * 1000000
+                    / (p->last_us - p->start_us);
+        break;
+    case 4: // ms since the last segment
+        if (p->segments > 0)
+            value = (CO_fstream_now_us() - p->last_us) / 1000;
+        break;
+    case 5: // aborts
+        value = p->aborts;
+        break;
+    }
+
+    CO_setUint32(ODF_arg->data, value > UINT32_MAX ? UINT32_MAX : value);
+    return CO_SDO_AB_NONE;
+}
+
+/**
+ * Get where the fread transfer of a session ends, the end of the range from
+ * the offset or the end of the file, whichever is first.
+ * @param data The fread data with the file pinned.
+ * @return The byte offset in the file.
+ */
+static uint32_t
+CO_fstream_end(const CO_fstream_t *data) {
+    if (data->range == 0 || data->range > data->length - data->offset)
+        return data->length;
+    return data->offset + data->range;
+}
+
+/**
+ * Fill a fread segment with compressed file data, carrying on from where the
+ * last segment stopped.
+ * @param data The fread data with the file pinned and a codec stream.
+ * @param out The segment buffer.
+ * @param out_len In: the size of the segment buffer. Out: the bytes in it.
+ * @return 1 if this is the last segment, 0 if not, or negative errno on
+ * failure.
+ */
+static int
+CO_fstream_compress(CO_fstream_t *data, uint8_t *out, uint32_t *out_len) {
+    uint8_t  raw[CODEC_CHUNK_LEN];
+    uint32_t total   = CO_fstream_end(data) - data->offset;
+    size_t   written = 0, in_len, len;
+    int      r       = 0;
+
+    while (r == 0 && written < *out_len) {
+        in_len = total - data->raw_bytes;
+        if (in_len > sizeof(raw))
+            in_len = sizeof(raw);
+        len = *out_len - written;
+
+        if ((r = CO_fstream_pread(data, raw, in_len,
+                                  data->offset + data->raw_bytes))
+            != 0)
+            return r;
+
+        r = olm_codec_run(data->stream, raw, &in_len, &out[written], &len,
+                          data->raw_bytes + in_len == total);
+        if (r < 0)
+            return r;
+        if (r == 0 && in_len == 0 && len == 0)
+            return -EIO; // no progress
+
+        CO_fstream_digest_update(data, data->offset + data->raw_bytes, raw,
+                                 in_len);
+        data->raw_bytes += in_len;
+        written += len;
+    }
+
+    *out_len = written;
+    return r;
+}
+
+/**
+ * Append data to the partial fwrite file, through the write-behind buffer.
+ * @param data The fwrite data with the partial file opened.
+ * @param in The data.
+ * @param in_len The length of the data.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_append(CO_fstream_t *data, const uint8_t *in, size_t in_len) {
+    size_t len;
+    int    r;
+
+    if (in_len > UINT32_MAX - data->length)
+        return -EFBIG;
+
+    while (in_len > 0) {
+        // only fill the buffer up to the next aligned offset in the file
+        len = WRITE_BUFFER_LEN - data->length % WRITE_BUFFER_LEN;
+        if (len > in_len)
+            len = in_len;
+
+        memcpy(&data->wbuf[data->wbuf_len], in, len);
+        CO_fstream_digest_update(data, data->length, in, len);
+        data->wbuf_len += len;
+        data->length += len;
+        data->raw_bytes += len;
+        in += len;
+        in_len -= len;
+
+        if (data->length % WRITE_BUFFER_LEN == 0
+            && (r = CO_fstream_flush(data)) != 0)
+            return r;
+    }
+
+    return 0;
+}
+
+/**
+ * Write fwrite data to the partial file, applying it to the delta base first
+ * if the transfer is a delta.
+ * @param data The fwrite data with the partial file opened.
+ * @param in The data, or the delta instructions.
+ * @param in_len The length of the data.
+ * @return 1 if the end of the delta was reached, 0 if not, or negative errno
+ * on failure.
+ */
+static int
+CO_fstream_write(CO_fstream_t *data, const uint8_t *in, size_t in_len) {
+    uint8_t raw[CODEC_CHUNK_LEN];
+    size_t  used, len;
+    int     r, ended;
+
+    if (data->delta == NULL)
+        return CO_fstream_append(data, in, in_len);
+
+    while (true) {
+        used = in_len;
+        len  = sizeof(raw);
+
+        if ((ended = olm_delta_run(data->delta, in, &used, raw, &len)) < 0)
+            return ended;
+        if ((r = CO_fstream_append(data, raw, len)) < 0)
+            return r;
+
+        in += used;
+        in_len -= used;
+
+        if (used == 0 && len < sizeof(raw))
+            break; // needs the next segment, or the delta ended
+    }
+
+    if (ended == 1 && in_len != 0)
+        return -EINVAL; // data after the end of the delta
+
+    return ended;
+}
+
+/**
+ * Decompress a fwrite segment into the partial file.
+ * @param data The fwrite data with the partial file opened and a codec
+ * stream.
+ * @param in The segment.
+ * @param in_len The length of the segment.
+ * @return 1 if the end of the compressed data was reached, 0 if not, or
+ * negative errno on failure.
+ */
+static int
+CO_fstream_decompress(CO_fstream_t *data, const uint8_t *in, size_t in_len) {
+    uint8_t raw[CODEC_CHUNK_LEN];
+    size_t  used, len;
+    int     r = 0, w;
+
+    while (r == 0) {
+        used = in_len;
+        len  = sizeof(raw);
+
+        if ((r = olm_codec_run(data->stream, in, &used, raw, &len, false)) < 0)
+            return r;
+        // fails on data after the end of the delta, if any
+        if ((w = CO_fstream_write(data, raw, len)) < 0)
+            return w;
+
+        in += used;
+        in_len -= used;
+
+        if (used == 0 && len < sizeof(raw))
+            break; // needs the next segment
+    }
+
+    if (r == 1 && in_len != 0)
+        return -EINVAL; // data after the end of the compressed data
+
+    return r;
+}
+
+/**
+ * Start the codec stream for a transfer, if the session has a codec, and the
+ * delta, if a fwrite delta base is selected. Clears the transfer byte
+ * counters and the longest ODF call. The fread digests are started over, the
+ * fwrite ones are made to match the partial file.
+ * @param data The session.
+ * @param compress True for fread, false for fwrite.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_start(CO_fstream_t *data, bool compress) {
+    int r = 0;
+
+    olm_codec_free(data->stream);
+    data->stream = NULL;
+    olm_delta_free(data->delta);
+    data->delta      = NULL;
+    data->raw_bytes   = 0;
+    data->wire_bytes  = 0;
+    data->max_latency = 0;
+
+    if (compress)
+        CO_fstream_digest_reset(data); // only made if read from the start
+    else if ((r = CO_fstream_digest_sync(data)) == -EAGAIN)
+        r = 0; // the worker carries on with them
+
+    if (r == 0 && data->codec != OLM_CODEC_NONE)
+        r = olm_codec_new(data->codec, data->codec_level, compress,
+                          &data->stream);
+
+    // the delta checks the CRC of the whole new file, so it starts from ours
+    if (r == 0 && !compress && data->base_fd >= 0)
+        r = olm_delta_new(data->base_fd, data->base_len, data->block_len,
+                          data->crc, &data->delta);
+
+    return r;
+}
+
+/**
+ * Close any opened files and clear the file selected for a session. A
+ * partial fwrite file is checkpointed and kept in the temp directory, so the
+ * transfer can be resumed later, even after a restart.
+ * @param data The session to close.
+ */
+static void
+CO_fstream_close(CO_fstream_t *data) {
     if (data != NULL) {
-        if (data->fptr != NULL) {
+        CO_fstream_digest_stop(data);
+        // digests of only part of the partial file are no use once closed
+        if (data->wfd >= 0 && data->digest_len != data->length)
+            CO_fstream_digest_reset(data);
+
+        if (data->wfd >= 0) {
+            if (data->synced != data->length
+                && CO_fstream_checkpoint(data) != 0)
+                log_printf(LOG_ERR, "failed to checkpoint %s", data->file);
             log_printf(LOG_INFO, "%s has been closed", data->file);
-            fclose(data->fptr);
-            data->fptr = NULL;
+            close(data->wfd);
+            data->wfd = -1;
         }
+        FREE_AND_NULL(data->wbuf);
+        data->wbuf_len = 0;
+
+        olm_readahead_free(data->ahead);
+        data->ahead = NULL;
+
+        if (data->fd >= 0) {
+            log_printf(LOG_INFO, "%s has been unpinned", data->file);
+            close(data->fd);
+            data->fd = -1;
+        }
+
+        olm_codec_free(data->stream);
+        data->stream = NULL;
+        olm_delta_free(data->delta);
+        data->delta = NULL;
 
-        clear_dir(data->dir);
+        if (data->base_fd >= 0) {
+            close(data->base_fd);
+            data->base_fd = -1;
+        }
 
+        FREE_AND_NULL(data->base);
         FREE_AND_NULL(data->file);
+        data->offset   = 0;
+        data->range    = 0;
+        data->length   = 0;
+        data->synced   = 0;
+        data->base_len = 0;
+    }
+}
+
+/**
+ * Check if a file in the temp directory belongs to a session other than the
+ * one given, that is the session's file or its checkpoint.
+ * @param fstreams All the sessions.
+ * @param data The session to skip.
+ * @param name The file name in the temp directory.
+ * @return true if another session has the file.
+ */
+static bool
+CO_fstream_in_use(const CO_fstreams_t *fstreams, const CO_fstream_t *data,
+                  const char *name) {
+    for (unsigned int i = 0; i < CO_NO_SDO_SERVER; ++i) {
+        const CO_fstream_t *other = &fstreams->sessions[i];
+        size_t              len;
+
+        if (other == data || other->file == NULL)
+            continue;
+
+        len = strlen(other->file);
+        if (strncmp(name, other->file, len) == 0
+            && (name[len] == '\0' || strcmp(&name[len], CHECKPOINT_EXT) == 0))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Reset a session, closing any opened files and removing all partial files
+ * from the temp directory, other than the ones other sessions are using.
+ * @param fstreams All the sessions.
+ * @param data The session to reset.
+ */
+static void
+CO_fstream_reset(CO_fstreams_t *fstreams, CO_fstream_t *data) {
+    char           filepath[PATH_MAX];
+    struct dirent *dir;
+    DIR *          d;
+
+    CO_fstream_close(data);
+    CO_fstream_digest_reset(data);
+    data->codec       = OLM_CODEC_NONE;
+    data->codec_level = 0;
+    data->raw_bytes   = 0;
+    data->wire_bytes  = 0;
+    data->block_len   = OLM_DELTA_BLOCK_LEN_DEFAULT;
+
+    if ((d = opendir(data->dir)) == NULL)
+        return;
+
+    while ((dir = readdir(d)) != NULL) {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0
+            || CO_fstream_in_use(fstreams, data, dir->d_name))
+            continue; // skip . and .. and files in use
+
+        sprintf(filepath, "%s%s", data->dir, dir->d_name);
+        remove(filepath);
+    }
+
+    closedir(d);
+}
+
+/**
+ * Get the session for the SDO server the ODF was called from. The SDO
+ * servers share the OD extensions, so the argument is the only thing that
+ * tells them apart.
+ * @param fstreams All the sessions.
+ * @param ODF_arg The ODF argument.
+ * @return The session or NULL if the SDO server is unknown.
+ */
+static CO_fstream_t *
+CO_fstream_session(CO_fstreams_t *fstreams, CO_ODF_arg_t *ODF_arg) {
+    const CO_SDO_t *SDO = (const CO_SDO_t *)((const uint8_t *)ODF_arg
+                                             - offsetof(CO_SDO_t, ODF_arg));
+
+    if (fstreams == NULL)
+        return NULL;
+
+    for (unsigned int i = 0; i < CO_NO_SDO_SERVER; ++i) {
+        if (CO->SDO[i] == SDO)
+            return &fstreams->sessions[i];
+    }
+
+    return NULL;
+}
+
+void
+CO_fstreams_close(CO_fstreams_t *fstreams) {
+    if (fstreams != NULL) {
+        CO_bulk_stop(&fstreams->bulk);
+        for (unsigned int i = 0; i < CO_NO_SDO_SERVER; ++i)
+            CO_fstream_close(&fstreams->sessions[i]);
     }
 }
 
@@ -64,41 +962,365 @@ CO_fstream_filename(CO_ODF_arg_t *ODF_arg, CO_fstream_t *fdata) {
     } else {
         char filename[SDO_BLOCK_LEN];
 
-        if (ODF_arg->dataLengthTotal > SDO_BLOCK_LEN)
-            return CO_SDO_AB_DATA_LONG;
+        if (ODF_arg->dataLengthTotal > SDO_BLOCK_LEN)
+            return CO_SDO_AB_DATA_LONG;
+
+        CO_fstream_close(fdata);
+
+        memcpy(filename, ODF_arg->data, ODF_arg->dataLengthTotal);
+
+        // make sure string ends with '\0'
+        if (filename[ODF_arg->dataLengthTotal - 1] != '\0')
+            filename[ODF_arg->dataLengthTotal] = '\0';
+
+        log_printf(LOG_DEBUG, "new fstream filename %s", filename);
+
+        if (!is_olm_file(filename)) {
+            log_printf(
+                LOG_DEBUG,
+                "fstream filename %s does not follow olm file format, ingoring",
+                filename);
+            return CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        // update filename
+        size_t len = strlen(filename) + 1;
+        if ((fdata->file = malloc(len)) == NULL)
+            return CO_SDO_AB_OUT_OF_MEM;
+        strncpy(fdata->file, filename, len);
+        CO_fstream_digest_reset(fdata);
+    }
+
+    return ret;
+}
+
+static CO_SDO_abortCode_t
+CO_fstream_codec(CO_ODF_arg_t *ODF_arg, CO_fstream_t *fdata) {
+    if (ODF_arg->reading) {
+        CO_setUint8(ODF_arg->data, fdata->codec);
+    } else {
+        if (CO_getUint8(ODF_arg->data) > OLM_CODEC_MAX)
+            return CO_SDO_AB_VALUE_HIGH; // unknown codec
+
+        // used from the next transfer, not the current one
+        fdata->codec = CO_getUint8(ODF_arg->data);
+    }
+
+    return CO_SDO_AB_NONE;
+}
+
+static CO_SDO_abortCode_t
+CO_fstream_codec_level(CO_ODF_arg_t *ODF_arg, CO_fstream_t *fdata) {
+    if (ODF_arg->reading) {
+        CO_setUint8(ODF_arg->data, fdata->codec_level);
+    } else {
+        if (CO_getUint8(ODF_arg->data) > OLM_CODEC_LEVEL_MAX)
+            return CO_SDO_AB_VALUE_HIGH;
+
+        fdata->codec_level = CO_getUint8(ODF_arg->data);
+    }
+
+    return CO_SDO_AB_NONE;
+}
+
+/**
+ * Open a fwrite delta base file from the session's cache or the other cache.
+ * @param data The session.
+ * @param cache The cache to look in, can be NULL.
+ * @param name The file name.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+CO_fstream_base_open(CO_fstream_t *data, olm_file_cache_t *cache,
+                     const char *name) {
+    char        filepath[PATH_MAX];
+    struct stat st;
+
+    if (cache == NULL)
+        return -ENOENT;
+
+    sprintf(filepath, "%s%s", cache->dir, name);
+    if ((data->base_fd = open(filepath, O_RDONLY | O_CLOEXEC)) < 0)
+        return -errno;
+
+    if (fstat(data->base_fd, &st) != 0 || st.st_size > UINT32_MAX) {
+        close(data->base_fd);
+        data->base_fd = -1;
+        return -EFBIG;
+    }
+
+    data->base_len = st.st_size;
+    log_printf(LOG_DEBUG, "fwrite delta base %s, %u bytes", filepath,
+               data->base_len);
+    return 0;
+}
+
+static CO_SDO_abortCode_t
+CO_fstream_base(CO_ODF_arg_t *ODF_arg, CO_fstream_t *fdata) {
+    char   filename[SDO_BLOCK_LEN + 1];
+    size_t len;
+
+    if (ODF_arg->reading) {
+        if (fdata->base == NULL)
+            return CO_SDO_AB_NO_DATA;
+
+        ODF_arg->dataLengthTotal = strlen(fdata->base) + 1;
+        ODF_arg->dataLength      = ODF_arg->dataLengthTotal;
+        memcpy(ODF_arg->data, fdata->base, ODF_arg->dataLength);
+        ODF_arg->lastSegment = true;
+        return CO_SDO_AB_NONE;
+    }
+
+    if (ODF_arg->dataLengthTotal > SDO_BLOCK_LEN)
+        return CO_SDO_AB_DATA_LONG;
+
+    if (fdata->file == NULL)
+        return CO_SDO_AB_NO_DATA; // the file name must be selected first
+
+    memcpy(filename, ODF_arg->data, ODF_arg->dataLengthTotal);
+    filename[ODF_arg->dataLengthTotal] = '\0';
+
+    if (!is_olm_file(filename))
+        return CO_SDO_AB_DATA_LOC_CTRL;
+
+    if (fdata->base_fd >= 0) {
+        close(fdata->base_fd);
+        fdata->base_fd = -1;
+    }
+    FREE_AND_NULL(fdata->base);
+
+    // the base can be a past fwrite file or any file in the other cache
+    if (CO_fstream_base_open(fdata, fdata->cache, filename) != 0
+        && CO_fstream_base_open(fdata, fdata->base_cache, filename) != 0) {
+        log_printf(LOG_ERR, "delta base %s not found", filename);
+        return CO_SDO_AB_DATA_LOC_CTRL;
+    }
+
+    len = strlen(filename) + 1;
+    if ((fdata->base = malloc(len)) == NULL) {
+        close(fdata->base_fd);
+        fdata->base_fd = -1;
+        return CO_SDO_AB_OUT_OF_MEM;
+    }
+    strncpy(fdata->base, filename, len);
+
+    return CO_SDO_AB_NONE;
+}
+
+/**
+ * Fill a fread data segment, from the pinned file or its read-ahead.
+ * @param ODF_arg The ODF argument.
+ * @param fstreams All the sessions.
+ * @param fdata The session.
+ * @return SDO abort code.
+ */
+static CO_SDO_abortCode_t
+CO_fread_data(CO_ODF_arg_t *ODF_arg, CO_fstreams_t *fstreams,
+              CO_fstream_t *fdata) {
+    if (ODF_arg->reading == false)
+        return CO_SDO_AB_READONLY;
+
+    if (ODF_arg->firstSegment == true) { // 1st segment only
+        if (fdata->file == NULL || fdata->fd < 0)
+            return CO_SDO_AB_NO_DATA;
+
+        if (CO_fstream_start(fdata, true) != 0) {
+            log_printf(LOG_ERR, "failed to start codec %d for %s",
+                       fdata->codec, fdata->file);
+            return CO_SDO_AB_OUT_OF_MEM;
+        }
+
+        /* The transfer is the range from the offset, or the rest of the
+         * file. The compressed size is not known until the end, so it is not
+         * indicated.
+         */
+        if (fdata->stream == NULL)
+            ODF_arg->dataLengthTotal = CO_fstream_end(fdata) - fdata->offset;
+        else
+            ODF_arg->dataLengthTotal = 0;
+
+        log_printf(LOG_DEBUG, "fread file size %u from offset %u to %u",
+                   fdata->length, fdata->offset, CO_fstream_end(fdata));
+    }
+
+    if (fdata->stream != NULL) { // compressed
+        uint32_t len = SDO_BLOCK_LEN;
+        int      r   = CO_fstream_compress(fdata, ODF_arg->data, &len);
+
+        if (r < 0) {
+            log_printf(LOG_ERR, "failed to compress %s", fdata->file);
+            CO_fstream_reset(fstreams, fdata);
+            return CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        ODF_arg->dataLength  = len;
+        ODF_arg->lastSegment = r == 1;
+        fdata->wire_bytes += len;
+
+        if (ODF_arg->lastSegment) {
+            log_printf(LOG_DEBUG, "fread %s compressed %u to %u bytes",
+                       fdata->file, fdata->raw_bytes, fdata->wire_bytes);
+            olm_codec_free(fdata->stream);
+            fdata->stream = NULL;
+            CO_fstream_digest_cache(fdata);
+        }
+        return CO_SDO_AB_NONE;
+    }
+
+    // Check if there are more segements needed
+    uint32_t bytes_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
+    if (bytes_left > SDO_BLOCK_LEN) { // more segements needed
+        ODF_arg->dataLength  = SDO_BLOCK_LEN;
+        ODF_arg->lastSegment = false;
+    } else { // last segement
+        ODF_arg->dataLength  = bytes_left;
+        ODF_arg->lastSegment = true;
+    }
+
+    log_printf(LOG_DEBUG, "fread data buffer len %d", ODF_arg->dataLength);
+
+    /* Read file data straight from the pinned file. The fd is kept open
+     * after the last segment, as the CANopen Network Manager may want to
+     * read the file again or use the OD_3003_4_fread_deleteFile sub index.
+     */
+    if (CO_fstream_pread(fdata, ODF_arg->data, ODF_arg->dataLength,
+                         fdata->offset + ODF_arg->offset)
+        != 0) {
+        log_printf(LOG_ERR, "Failed to read to file %s", fdata->file);
+        CO_fstream_reset(fstreams, fdata);
+        return CO_SDO_AB_DATA_LOC_CTRL;
+    }
+
+    CO_fstream_digest_update(fdata, fdata->offset + ODF_arg->offset,
+                             ODF_arg->data, ODF_arg->dataLength);
+    fdata->raw_bytes += ODF_arg->dataLength;
+    fdata->wire_bytes += ODF_arg->dataLength;
 
-        CO_fstream_reset(fdata);
+    if (ODF_arg->lastSegment) {
+        log_printf(LOG_DEBUG, "fread %s longest ODF call %u us", fdata->file,
+                   fdata->max_latency);
+        CO_fstream_digest_cache(fdata);
+    }
 
-        memcpy(filename, ODF_arg->data, ODF_arg->dataLengthTotal);
+    return CO_SDO_AB_NONE;
+}
 
-        // make sure string ends with '\0'
-        if (filename[ODF_arg->dataLengthTotal - 1] != '\0')
-            filename[ODF_arg->dataLengthTotal] = '\0';
+/**
+ * Handle the fread bulk stream sub indexes.
+ * @param ODF_arg The ODF argument.
+ * @param bulk The bulk stream.
+ * @param fdata The session, a start streams its pinned file.
+ * @return SDO abort code.
+ */
+static CO_SDO_abortCode_t
+CO_fread_bulk(CO_ODF_arg_t *ODF_arg, CO_bulk_t *bulk, CO_fstream_t *fdata) {
+    CO_bulk_status_t status;
+    uint32_t         value = 0;
+    uint64_t         range;
+    int              r = 0;
 
-        log_printf(LOG_DEBUG, "new fstream filename %s", filename);
+    if (ODF_arg->reading) {
+        // a copy, as the RT thread changes them while streaming
+        CO_bulk_status(bulk, &status);
+
+        switch (ODF_arg->subIndex) {
+        case OD_3003_14_fread_bulkControl:
+            CO_setUint8(ODF_arg->data, status.state);
+            return CO_SDO_AB_NONE;
+        case OD_3003_15_fread_bulkCobId:
+            value = status.cob_id;
+            break;
+        case OD_3003_16_fread_bulkWindow:
+            CO_setUint8(ODF_arg->data, status.window);
+            return CO_SDO_AB_NONE;
+        case OD_3003_17_fread_bulkBurst:
+            CO_setUint8(ODF_arg->data, status.burst);
+            return CO_SDO_AB_NONE;
+        case OD_3003_18_fread_bulkAck:
+            value = status.acked;
+            break;
+        case OD_3003_19_fread_bulkResend:
+            return CO_SDO_AB_WRITEONLY;
+        case OD_3003_20_fread_bulkFramesSent:
+            value = status.sent;
+            break;
+        case OD_3003_21_fread_bulkFramesResent:
+            value = status.resent;
+            break;
+        }
 
-        if (!is_olm_file(filename)) {
-            log_printf(
-                LOG_DEBUG,
-                "fstream filename %s does not follow olm file format, ingoring",
-                filename);
-            return CO_SDO_AB_DATA_LOC_CTRL;
+        CO_setUint32(ODF_arg->data, value);
+        return CO_SDO_AB_NONE;
+    }
+
+    switch (ODF_arg->subIndex) {
+    case OD_3003_14_fread_bulkControl:
+        if (CO_getUint8(ODF_arg->data) > 1)
+            return CO_SDO_AB_VALUE_HIGH;
+
+        if (CO_getUint8(ODF_arg->data) == 0) {
+            CO_bulk_stop(bulk);
+            break;
         }
 
-        // update filename
-        size_t len = strlen(filename) + 1;
-        if ((fdata->file = malloc(len)) == NULL)
-            return CO_SDO_AB_OUT_OF_MEM;
-        strncpy(fdata->file, filename, len);
+        if (fdata->file == NULL || fdata->fd < 0)
+            return CO_SDO_AB_NO_DATA;
+
+        // the stream ends where the range does
+        r = CO_bulk_start(bulk, fdata->fd, fdata->offset,
+                          CO_fstream_end(fdata));
+        if (r == 0)
+            log_printf(LOG_DEBUG, "fread bulk stream of %s from offset %u",
+                       fdata->file, fdata->offset);
+        break;
+    case OD_3003_15_fread_bulkCobId:
+        // not a restricted one or one of the predefined connection set
+        if ((r = CO_bulk_set_cob_id(bulk, CO_getUint32(ODF_arg->data)))
+            == -ERANGE)
+            return CO_SDO_AB_INVALID_VALUE;
+        break;
+    case OD_3003_16_fread_bulkWindow:
+        if ((r = CO_bulk_set_window(bulk, CO_getUint8(ODF_arg->data)))
+            == -ERANGE)
+            return CO_SDO_AB_VALUE_LOW;
+        break;
+    case OD_3003_17_fread_bulkBurst:
+        if (CO_getUint8(ODF_arg->data) == 0)
+            return CO_SDO_AB_VALUE_LOW;
+        if (CO_bulk_set_burst(bulk, CO_getUint8(ODF_arg->data)) != 0)
+            return CO_SDO_AB_VALUE_HIGH; // leave room in the CAN queue
+        break;
+    case OD_3003_18_fread_bulkAck:
+        r = CO_bulk_ack(bulk, CO_getUint32(ODF_arg->data));
+        break;
+    case OD_3003_19_fread_bulkResend: // first frame, then count in high bits
+        memcpy(&range, ODF_arg->data, sizeof(range));
+        r = CO_bulk_resend(bulk, range & UINT32_MAX, range >> 32);
+        break;
+    default: // frame counters
+        return CO_SDO_AB_READONLY;
     }
 
-    return ret;
+    if (r == -ERANGE)
+        return CO_SDO_AB_INVALID_VALUE;
+    if (r == -EBUSY || r == -EINVAL)
+        return CO_SDO_AB_DATA_DEV_STATE;
+    if (r != 0) {
+        log_printf(LOG_ERR, "fread bulk stream failed to start: %d", r);
+        return CO_SDO_AB_DATA_LOC_CTRL;
+    }
+
+    return CO_SDO_AB_NONE;
 }
 
 CO_SDO_abortCode_t
 CO_fread_ODF(CO_ODF_arg_t *ODF_arg) {
-    CO_fstream_t *     fdata = (CO_fstream_t *)ODF_arg->object;
-    CO_SDO_abortCode_t ret   = CO_SDO_AB_NONE;
+    CO_fstreams_t *    fstreams = (CO_fstreams_t *)ODF_arg->object;
+    CO_fstream_t *     fdata    = CO_fstream_session(fstreams, ODF_arg);
+    CO_SDO_abortCode_t ret      = CO_SDO_AB_NONE;
+    olm_file_digest_t  digest;
+    uint64_t           start;
+    int                r;
 
     if (fdata == NULL)
         return CO_SDO_AB_DATA_LOC_CTRL;
@@ -109,19 +1331,32 @@ CO_fread_ODF(CO_ODF_arg_t *ODF_arg) {
 
         ret = CO_fstream_filename(ODF_arg, fdata);
 
-        // copy file from cache to tmp dir
+        /* Pin the file in the cache with an open fd instead of copying it.
+         * Cache files are never modified in place, so the fd is a snapshot of
+         * the file that stays readable even if it is evicted or deleted
+         * before the transfer is done.
+         */
         if (!ODF_arg->reading && ret == CO_SDO_AB_NONE) {
-            char temp_filepath[PATH_MAX];
-            char cache_filepath[PATH_MAX];
+            char        cache_filepath[PATH_MAX];
+            struct stat st;
 
-            sprintf(temp_filepath, "%s%s", fdata->dir, fdata->file);
             sprintf(cache_filepath, "%s%s", fdata->cache->dir, fdata->file);
-            log_printf(LOG_DEBUG, "fread %s -> %s\n", cache_filepath,
-                       temp_filepath);
+            log_printf(LOG_DEBUG, "fread pinning %s", cache_filepath);
 
-            if (copyfile(cache_filepath, temp_filepath) != 0) {
-                CO_fstream_reset(fdata);
+            if ((fdata->fd = open(cache_filepath, O_RDONLY | O_CLOEXEC)) < 0
+                || fstat(fdata->fd, &st) != 0 || st.st_size > UINT32_MAX) {
+                CO_fstream_reset(fstreams, fdata);
                 ret = CO_SDO_AB_DATA_LOC_CTRL;
+            } else {
+                fdata->length = st.st_size;
+                olm_file_cache_touch(fdata->cache, fdata->file); // for LRU
+
+                // start reading while the client gets ready for the data
+                if (olm_readahead_new(fdata->fd, fdata->length, 0,
+                                      READ_AHEAD_CHUNK_LEN, READ_AHEAD_DEPTH,
+                                      &fdata->ahead)
+                    != 0)
+                    log_printf(LOG_ERR, "no read-ahead for %s", fdata->file);
             }
         }
 
@@ -129,103 +1364,311 @@ CO_fread_ODF(CO_ODF_arg_t *ODF_arg) {
 
     case OD_3003_2_fread_fileData: // file data, domain, readonly
 
-        if (ODF_arg->reading == false)
-            return CO_SDO_AB_READONLY;
+        start = CO_fstream_now_us();
+        ret   = CO_fread_data(ODF_arg, fstreams, fdata);
+        CO_fstream_latency(fdata, start);
+        CO_fstream_progress(fdata, ODF_arg, start, ret);
+        break;
 
-        if (ODF_arg->firstSegment == true) { // 1st segment only
-            char        filepath[PATH_MAX] = "\0";
-            struct stat st;
+    case OD_3003_3_fread_reset: // reset fread, domain, writeonly
 
-            if (fdata->file == NULL)
-                return CO_SDO_AB_NO_DATA;
+        if (ODF_arg->reading)
+            ret = CO_SDO_AB_WRITEONLY;
+        else
+            CO_fstream_reset(fstreams, fdata);
 
-            sprintf(filepath, "%s%s", fdata->dir, fdata->file);
+        break;
 
-            if (stat(filepath, &st) == 0) {
-                ODF_arg->dataLengthTotal = st.st_size;
-            } else {
-                log_printf(LOG_ERR, "%s does not exist", filepath);
-                ret = CO_SDO_AB_DATA_LOC_CTRL;
-                break;
-            }
+    case OD_3003_4_fread_deleteFile: // delete file from cache, domain, readonly
 
-            log_printf(LOG_DEBUG, "fread file size %d", ODF_arg->dataLength);
+        if (ODF_arg->reading) {
+            ret = CO_SDO_AB_WRITEONLY;
+        } else {
+            if (fdata->file == NULL)
+                return CO_SDO_AB_NO_DATA;
 
-            if ((fdata->fptr = fopen(filepath, "r")) != NULL) {
-                log_printf(LOG_INFO, "opened %s", filepath);
-            } else {
-                log_printf(LOG_ERR, "failed to open %s", filepath);
-                CO_fstream_reset(fdata);
+            if (olm_file_cache_remove(fdata->cache, fdata->file) != 0)
                 ret = CO_SDO_AB_DATA_LOC_CTRL;
-                break;
-            }
-        }
 
-        // Check if there are more segements needed
-        uint32_t bytes_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
-        if (bytes_left > SDO_BLOCK_LEN) { // more segements needed
-            ODF_arg->dataLength  = SDO_BLOCK_LEN;
-            ODF_arg->lastSegment = false;
-        } else { // last segement
-            ODF_arg->dataLength  = bytes_left;
-            ODF_arg->lastSegment = true;
+            CO_fstream_reset(fstreams, fdata);
         }
 
-        log_printf(LOG_DEBUG, "fread data buffer len %d", ODF_arg->dataLength);
+        break;
 
-        // read file data
-        if (fread(ODF_arg->data, 1, ODF_arg->dataLength, fdata->fptr) == 0) {
-            log_printf(LOG_ERR, "Failed to read to file %s", fdata->file);
-            CO_fstream_reset(fdata);
-            ret = CO_SDO_AB_DATA_LOC_CTRL;
-            break;
+    case OD_3003_5_fread_offset: // offset to read from, uint32, readwrite
+
+        if (ODF_arg->reading) {
+            CO_setUint32(ODF_arg->data, fdata->offset);
+        } else {
+            if (fdata->file == NULL)
+                return CO_SDO_AB_NO_DATA;
+
+            if (CO_getUint32(ODF_arg->data) > fdata->length)
+                return CO_SDO_AB_VALUE_HIGH; // past the end of the file
+
+            fdata->offset = CO_getUint32(ODF_arg->data);
         }
 
-        if (ODF_arg->lastSegment) {
-            /* Do not call CO_fstream_reset() here as the CANopen Network
-             * Manager may want to use the OD_3003_4_fread_deleteFile sub
-             * index.
-             */
-            log_printf(LOG_INFO, "%s has been closed", fdata->file);
-            fclose(fdata->fptr);
-            fdata->fptr = NULL;
+        break;
+
+    case OD_3003_6_fread_length: // length of the file, uint32, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        if (fdata->file == NULL)
+            return CO_SDO_AB_NO_DATA;
+
+        CO_setUint32(ODF_arg->data, fdata->length);
+        break;
+
+    case OD_3003_7_fread_codec: // codec to compress with, uint8, readwrite
+
+        ret = CO_fstream_codec(ODF_arg, fdata);
+        break;
+
+    case OD_3003_8_fread_codecLevel: // compression level, uint8, readwrite
+
+        ret = CO_fstream_codec_level(ODF_arg, fdata);
+        break;
+
+    case OD_3003_9_fread_rawBytes: // file bytes read, uint32, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        CO_setUint32(ODF_arg->data, fdata->raw_bytes);
+        break;
+
+    case OD_3003_10_fread_wireBytes: // bytes sent, uint32, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        CO_setUint32(ODF_arg->data, fdata->wire_bytes);
+        break;
+
+    case OD_3003_11_fread_crc32c: // CRC-32C of the file, uint32, readonly
+    case OD_3003_12_fread_sha256: // SHA-256 of the file, domain, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        if (fdata->file == NULL || fdata->fd < 0)
+            return CO_SDO_AB_NO_DATA;
+
+        r = CO_fstream_file_digest(fdata, &digest);
+        if (r == -EAGAIN)
+            return CO_SDO_AB_DATA_DEV_STATE; // still being read, try again
+        if (r != 0) {
+            log_printf(LOG_ERR, "failed to get the digests of %s",
+                       fdata->file);
+            return CO_SDO_AB_DATA_LOC_CTRL;
         }
 
+        CO_fstream_digest_odf(ODF_arg, &digest,
+                              ODF_arg->subIndex == OD_3003_12_fread_sha256);
         break;
 
-    case OD_3003_3_fread_reset: // reset fread, domain, writeonly
+    case OD_3003_13_fread_maxLatency: // longest data ODF call, uint32, readonly
 
-        if (ODF_arg->reading)
-            ret = CO_SDO_AB_WRITEONLY;
-        else
-            CO_fstream_reset(fdata);
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
 
+        CO_setUint32(ODF_arg->data, fdata->max_latency);
         break;
 
-    case OD_3003_4_fread_deleteFile: // delete file from cache, domain, readonly
+    case OD_3003_14_fread_bulkControl: // start/stop bulk stream, uint8,
+                                       // readwrite
+    case OD_3003_15_fread_bulkCobId: // bulk stream COB-ID, uint32, readwrite
+    case OD_3003_16_fread_bulkWindow: // frames past the ack, uint8, readwrite
+    case OD_3003_17_fread_bulkBurst: // frames per send, uint8, readwrite
+    case OD_3003_18_fread_bulkAck: // frames received, uint32, readwrite
+    case OD_3003_19_fread_bulkResend: // frames to send again, uint64,
+                                      // writeonly
+    case OD_3003_20_fread_bulkFramesSent: // frames sent, uint32, readonly
+    case OD_3003_21_fread_bulkFramesResent: // frames sent again, uint32,
+                                            // readonly
+
+        ret = CO_fread_bulk(ODF_arg, &fstreams->bulk, fdata);
+        break;
+
+    case OD_3003_22_fread_rangeLength: // max bytes to read from the offset,
+                                       // uint32, readwrite
 
         if (ODF_arg->reading) {
-            ret = CO_SDO_AB_WRITEONLY;
+            CO_setUint32(ODF_arg->data, fdata->range);
         } else {
             if (fdata->file == NULL)
                 return CO_SDO_AB_NO_DATA;
 
-            if (olm_file_cache_remove(fdata->cache, fdata->file) != 0)
-                ret = CO_SDO_AB_DATA_LOC_CTRL;
-
-            CO_fstream_reset(fdata);
+            // 0 or past the end of the file reads the rest of it
+            fdata->range = CO_getUint32(ODF_arg->data);
         }
 
         break;
+
+    case OD_3003_23_fread_bytesTotal: // bytes in the transfer, uint32, readonly
+    case OD_3003_24_fread_segments: // segments sent, uint32, readonly
+    case OD_3003_25_fread_rate: // current bytes/s, uint32, readonly
+    case OD_3003_26_fread_averageRate: // average bytes/s, uint32, readonly
+    case OD_3003_27_fread_idleTime: // ms since last segment, uint32, readonly
+    case OD_3003_28_fread_aborts: // transfers aborted, uint32, readonly
+
+        ret = CO_fstream_progress_odf(ODF_arg, fdata,
+                                      OD_3003_23_fread_bytesTotal);
+        break;
     }
 
     return ret;
 }
 
+/**
+ * Take a fwrite data segment, writing it to the partial file through the
+ * codec and the delta if any, and add the file to the cache after the last
+ * one.
+ * @param ODF_arg The ODF argument.
+ * @param fdata The session.
+ * @return SDO abort code.
+ */
+static CO_SDO_abortCode_t
+CO_fwrite_data(CO_ODF_arg_t *ODF_arg, CO_fstream_t *fdata) {
+    olm_file_digest_t digest;
+
+    if (ODF_arg->reading)
+        return CO_SDO_AB_WRITEONLY;
+
+    unsigned int len = 0;
+    if (ODF_arg->dataLength != 0)
+        len = ODF_arg->dataLength;
+    else if (ODF_arg->dataLengthTotal <= SDO_BLOCK_LEN)
+        len = ODF_arg->dataLength;
+    else
+        return CO_SDO_AB_NO_DATA;
+
+    log_printf(LOG_DEBUG, "fwrite data buffer len %d", len);
+
+    if (ODF_arg->firstSegment) {
+        if (fdata->file == NULL)
+            return CO_SDO_AB_NO_DATA;
+
+        // the worker must not read what is dropped and written again
+        if (fdata->offset < fdata->length)
+            CO_fstream_digest_stop(fdata);
+
+        if (CO_fstream_seek(fdata) != 0) {
+            log_printf(LOG_ERR, "failed to open %s at %u", fdata->file,
+                       fdata->offset);
+            CO_fstream_close(fdata);
+            return CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        if (CO_fstream_start(fdata, false) != 0) {
+            log_printf(LOG_ERR, "failed to start codec %d for %s",
+                       fdata->codec, fdata->file);
+            CO_fstream_close(fdata);
+            return CO_SDO_AB_OUT_OF_MEM;
+        }
+
+        // the size is only the file size when the data is the file as is
+        if (fdata->stream == NULL && fdata->delta == NULL
+            && ODF_arg->dataLengthTotal != 0) {
+            uint64_t size = (uint64_t)fdata->offset
+                            + ODF_arg->dataLengthTotal;
+            int      err  = CO_fstream_reserve(fdata, size);
+
+            if (err != 0) {
+                log_printf(LOG_ERR, "no room for %s of %llu bytes: %s",
+                           fdata->file, (unsigned long long)size,
+                           strerror(-err));
+                CO_fstream_close(fdata);
+                if (err == -EFBIG)
+                    return CO_SDO_AB_DATA_LONG;
+                else if (err == -ENOSPC)
+                    return CO_SDO_AB_OUT_OF_MEM;
+                return CO_SDO_AB_DATA_LOC_CTRL;
+            }
+        }
+    }
+
+    fdata->wire_bytes += len;
+
+    // write file data, through the codec and the delta if any
+    int r;
+    if (fdata->stream != NULL)
+        r = CO_fstream_decompress(fdata, ODF_arg->data, len);
+    else
+        r = CO_fstream_write(fdata, ODF_arg->data, len);
+
+    // the compressed data and the delta must not be cut short
+    if (r >= 0 && ODF_arg->lastSegment
+        && ((fdata->stream != NULL && r != 1)
+            || (fdata->delta != NULL && !olm_delta_ended(fdata->delta))))
+        r = -EBADMSG;
+
+    if (r < 0) {
+        log_printf(LOG_ERR, "failed to write to file %s", fdata->file);
+        CO_fstream_close(fdata); // keeps what was written for a resume
+        return CO_SDO_AB_DATA_LOC_CTRL;
+    } else {
+        log_printf(LOG_DEBUG, "%d bytes written to %s", len, fdata->file);
+    }
+
+    if (fdata->length - fdata->synced >= CHECKPOINT_LEN
+        && CO_fstream_checkpoint(fdata) != 0)
+        log_printf(LOG_ERR, "failed to checkpoint %s", fdata->file);
+
+    if (ODF_arg->lastSegment) {
+        char filepath[PATH_MAX];
+        log_printf(LOG_DEBUG, "last fwrite data segment");
+
+        if (CO_fstream_commit(fdata) != 0) {
+            log_printf(LOG_ERR, "failed to sync %s", fdata->file);
+            CO_fstream_close(fdata); // keeps what was written for a resume
+            return CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        sprintf(filepath, "%s%s", fdata->dir, fdata->file);
+
+        olm_codec_free(fdata->stream);
+        fdata->stream = NULL;
+        olm_delta_free(fdata->delta);
+        fdata->delta = NULL;
+        log_printf(LOG_ERR, "closed %s", fdata->file);
+
+        // made as it was written, so the cache never has to read it, unless
+        // the worker is still reading a resumed file for them
+        if (CO_fstream_digest_take(fdata) != 0
+            || fdata->digest_len != fdata->length)
+            CO_fstream_digest_reset(fdata);
+        CO_fstream_digest(fdata, &digest);
+        if (olm_file_cache_add_digest(fdata->cache, filepath,
+                                      fdata->digest_len == fdata->length
+                                          ? &digest
+                                          : NULL)
+            != 0) {
+            log_printf(LOG_ERR, "%s failed to be added the fwrite cache",
+                       fdata->file);
+            CO_fstream_close(fdata); // keeps it and its checkpoint to resume
+            return CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        sprintf(filepath, "%s%s" CHECKPOINT_EXT, fdata->dir, fdata->file);
+        remove(filepath); // the file is complete
+        log_printf(LOG_ERR, "%s was added to the fwrite cache", fdata->file);
+        CO_fstream_close(fdata);
+    }
+
+    return CO_SDO_AB_NONE;
+}
+
 CO_SDO_abortCode_t
 CO_fwrite_ODF(CO_ODF_arg_t *ODF_arg) {
-    CO_fstream_t *     fdata = (CO_fstream_t *)ODF_arg->object;
-    CO_SDO_abortCode_t ret   = CO_SDO_AB_NONE;
+    CO_fstreams_t *    fstreams = (CO_fstreams_t *)ODF_arg->object;
+    CO_fstream_t *     fdata    = CO_fstream_session(fstreams, ODF_arg);
+    CO_SDO_abortCode_t ret      = CO_SDO_AB_NONE;
+    olm_file_digest_t  digest;
+    uint64_t           start;
 
     if (fdata == NULL)
         return CO_SDO_AB_DATA_LOC_CTRL;
@@ -236,81 +1679,195 @@ CO_fwrite_ODF(CO_ODF_arg_t *ODF_arg) {
 
         ret = CO_fstream_filename(ODF_arg, fdata);
 
+        // only one session can write a file at a time
+        if (!ODF_arg->reading && ret == CO_SDO_AB_NONE
+            && CO_fstream_in_use(fstreams, fdata, fdata->file)) {
+            log_printf(LOG_ERR, "%s is being written by another session",
+                       fdata->file);
+            CO_fstream_close(fdata);
+            ret = CO_SDO_AB_DATA_LOC_CTRL;
+        }
+
+        // pick up any partial file from an interrupted transfer
+        if (!ODF_arg->reading && ret == CO_SDO_AB_NONE) {
+            fdata->length = CO_fstream_resume_len(fdata);
+            fdata->synced = fdata->length;
+            if (fdata->length > 0)
+                log_printf(LOG_INFO, "%s can be resumed from %u", fdata->file,
+                           fdata->length);
+        }
+
         break;
 
     case OD_3004_2_fwrite_fileData: // file data, domain, writeonly
 
-        if (ODF_arg->reading)
-            return CO_SDO_AB_WRITEONLY;
+        start = CO_fstream_now_us();
+        ret   = CO_fwrite_data(ODF_arg, fdata);
+        CO_fstream_progress(fdata, ODF_arg, start, ret);
+        break;
+
+    case OD_3004_3_fwrite_reset: // reset fwrite, domain, writeonly
 
-        unsigned int len = 0;
-        if (ODF_arg->dataLength != 0)
-            len = ODF_arg->dataLength;
-        else if (ODF_arg->dataLengthTotal <= SDO_BLOCK_LEN)
-            len = ODF_arg->dataLength;
+        if (ODF_arg->reading)
+            ret = CO_SDO_AB_WRITEONLY;
         else
-            return CO_SDO_AB_NO_DATA;
+            CO_fstream_reset(fstreams, fdata);
+
+        break;
 
-        log_printf(LOG_DEBUG, "fwrite data buffer len %d", len);
+    case OD_3004_4_fwrite_offset: // offset to write at, uint32, readwrite
 
-        if (ODF_arg->firstSegment) {
+        if (ODF_arg->reading) {
+            CO_setUint32(ODF_arg->data, fdata->offset);
+        } else {
             if (fdata->file == NULL)
                 return CO_SDO_AB_NO_DATA;
 
-            char filepath[PATH_MAX];
+            if (CO_getUint32(ODF_arg->data) > fdata->length)
+                return CO_SDO_AB_VALUE_HIGH; // would leave a hole
 
-            sprintf(filepath, "%s%s", fdata->dir, fdata->file);
+            fdata->offset = CO_getUint32(ODF_arg->data);
+        }
 
-            if ((fdata->fptr = fopen(filepath, "w")) != NULL) {
-                log_printf(LOG_INFO, "opened %s", filepath);
-            } else {
-                log_printf(LOG_ERR, "failed to open %s", filepath);
-                CO_fstream_reset(fdata);
-                ret = CO_SDO_AB_DATA_LOC_CTRL;
-                break;
-            }
+        break;
+
+    case OD_3004_5_fwrite_length: // length of the partial file, uint32,
+                                  // readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        if (fdata->file == NULL)
+            return CO_SDO_AB_NO_DATA;
+
+        CO_setUint32(ODF_arg->data, fdata->length);
+        break;
+
+    case OD_3004_6_fwrite_codec: // codec to decompress with, uint8, readwrite
+
+        ret = CO_fstream_codec(ODF_arg, fdata);
+        break;
+
+    case OD_3004_7_fwrite_codecLevel: // compression level, uint8, readwrite
+
+        ret = CO_fstream_codec_level(ODF_arg, fdata);
+        break;
+
+    case OD_3004_8_fwrite_rawBytes: // file bytes written, uint32, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        CO_setUint32(ODF_arg->data, fdata->raw_bytes);
+        break;
+
+    case OD_3004_9_fwrite_wireBytes: // bytes received, uint32, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        CO_setUint32(ODF_arg->data, fdata->wire_bytes);
+        break;
+
+    case OD_3004_10_fwrite_deltaBase: // delta base file, domain, readwrite
+
+        ret = CO_fstream_base(ODF_arg, fdata);
+        break;
+
+    case OD_3004_11_fwrite_deltaBlockLen: // delta block length, uint32,
+                                          // readwrite
+
+        if (ODF_arg->reading) {
+            CO_setUint32(ODF_arg->data, fdata->block_len);
+        } else {
+            if (CO_getUint32(ODF_arg->data) < OLM_DELTA_BLOCK_LEN_MIN)
+                return CO_SDO_AB_VALUE_LOW;
+            if (CO_getUint32(ODF_arg->data) > OLM_DELTA_BLOCK_LEN_MAX)
+                return CO_SDO_AB_VALUE_HIGH;
+
+            fdata->block_len = CO_getUint32(ODF_arg->data);
+        }
+
+        break;
+
+    case OD_3004_12_fwrite_deltaSignatures: // delta base block signatures,
+                                            // domain, readonly
+
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        if (fdata->base_fd < 0)
+            return CO_SDO_AB_NO_DATA;
+
+        if (ODF_arg->firstSegment)
+            ODF_arg->dataLengthTotal
+                = olm_delta_signature_len(fdata->base_len, fdata->block_len);
+
+        uint32_t sig_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
+        if (sig_left > SDO_BLOCK_LEN) { // more segements needed
+            ODF_arg->dataLength  = SDO_BLOCK_LEN;
+            ODF_arg->lastSegment = false;
+        } else { // last segement
+            ODF_arg->dataLength  = sig_left;
+            ODF_arg->lastSegment = true;
         }
 
-        // write file data
-        if (fwrite(ODF_arg->data, 1, len, fdata->fptr) != len) {
-            log_printf(LOG_ERR, "failed to write to file %s", fdata->file);
-            CO_fstream_reset(fdata);
+        /* Only the blocks for this segment are read, so making the
+         * signatures of a large base does not hold up CO_process().
+         */
+        if (olm_delta_signature(fdata->base_fd, fdata->base_len,
+                                fdata->block_len, ODF_arg->offset,
+                                ODF_arg->data, ODF_arg->dataLength)
+            != 0) {
+            log_printf(LOG_ERR, "failed to make signatures of %s",
+                       fdata->base);
             ret = CO_SDO_AB_DATA_LOC_CTRL;
-            break;
-        } else {
-            log_printf(LOG_DEBUG, "%d bytes written to %s", len, fdata->file);
         }
 
-        if (ODF_arg->lastSegment) {
-            char filepath[PATH_MAX];
-            sprintf(filepath, "%s%s", fdata->dir, fdata->file);
-            log_printf(LOG_DEBUG, "last fwrite data segment");
+        break;
 
-            if (fdata->fptr != NULL) {
-                fclose(fdata->fptr);
-                fdata->fptr = NULL;
-            }
-            log_printf(LOG_ERR, "closed %s", fdata->file);
+    case OD_3004_13_fwrite_crc32c: // CRC-32C of the file written, uint32,
+                                   // readonly
+    case OD_3004_14_fwrite_sha256: // SHA-256 of the file written, domain,
+                                   // readonly
 
-            if (olm_file_cache_add(fdata->cache, filepath) == 0) {
-                log_printf(LOG_ERR, "%s was added to the fwrite cache",
-                           fdata->file);
-                CO_fstream_reset(fdata);
-            } else {
-                log_printf(LOG_ERR, "%s failed to be added the fwrite cache",
+        if (!ODF_arg->reading)
+            return CO_SDO_AB_READONLY;
+
+        /* The partial file so far, or the last file written. They are made
+         * as the data is written, the file is only read again for them if it
+         * was resumed or rewound, on a worker thread.
+         */
+        if (fdata->file != NULL) {
+            int r = CO_fstream_digest_sync(fdata);
+
+            if (r == -EAGAIN)
+                return CO_SDO_AB_DATA_DEV_STATE; // still being read
+            if (r != 0) {
+                log_printf(LOG_ERR, "failed to get the digests of %s",
                            fdata->file);
+                return CO_SDO_AB_DATA_LOC_CTRL;
             }
         }
 
-        break;
+        if (fdata->digest_len == 0)
+            return CO_SDO_AB_NO_DATA;
 
-    case OD_3004_3_fwrite_reset: // reset fwrite, domain, writeonly
+        CO_fstream_digest(fdata, &digest);
+        CO_fstream_digest_odf(ODF_arg, &digest,
+                              ODF_arg->subIndex == OD_3004_14_fwrite_sha256);
+        break;
 
-        if (ODF_arg->reading)
-            ret = CO_SDO_AB_WRITEONLY;
-        else
-            CO_fstream_reset(fdata);
+    case OD_3004_15_fwrite_bytesTotal: // bytes in the transfer, uint32,
+                                       // readonly
+    case OD_3004_16_fwrite_segments: // segments received, uint32, readonly
+    case OD_3004_17_fwrite_rate: // current bytes/s, uint32, readonly
+    case OD_3004_18_fwrite_averageRate: // average bytes/s, uint32, readonly
+    case OD_3004_19_fwrite_idleTime: // ms since last segment, uint32, readonly
+    case OD_3004_20_fwrite_aborts: // transfers aborted, uint32, readonly
 
+        ret = CO_fstream_progress_odf(ODF_arg, fdata,
+                                      OD_3004_15_fwrite_bytesTotal);
         break;
     }
 
@@ -13,39 +13,171 @@
 #define _CO_FILE_TRANSFER_H_
 
 #include "CANopen.h"
+#include "CO_bulk.h"
+#include "crc32c.h"
+#include "olm_codec.h"
+#include "olm_delta.h"
+#include "olm_digest.h"
 #include "olm_file.h"
 #include "olm_file_cache.h"
+#include "olm_readahead.h"
+#include "sha256.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
-/** fread / fwrite ODF private data */
+/** Progress of the fread or fwrite transfer of a session. */
 typedef struct {
-    /** The temp directory to read files in to or write files into. */
+    /** Bytes the transfer said it has, 0 if it did not say. */
+    uint32_t total;
+    /** Data segments of the transfer. */
+    uint32_t segments;
+    /** Time of the first segment, in us from CLOCK_MONOTONIC. */
+    uint64_t start_us;
+    /** Time of the last segment, in us. */
+    uint64_t last_us;
+    /** Start of the window the current rate is being measured over, in us. */
+    uint64_t window_us;
+    /** Bytes sent or received in the window. */
+    uint32_t window_bytes;
+    /** Bytes per second over the last window. */
+    uint32_t rate;
+    /** True from the first segment until the last one or an abort. */
+    bool active;
+    /** Transfers aborted or left unfinished, since OLM started. */
+    uint32_t aborts;
+} CO_fstream_progress_t;
+
+/** fread / fwrite session data for one SDO server */
+typedef struct {
+    /**
+     * The temp directory to write files into. Files read are not copied to it,
+     * it is only cleared on reset.
+     */
     const char *dir;
     /** The file cahe to use. */
     olm_file_cache_t *cache;
+    /** Another cache fwrite delta bases can be taken from, can be NULL. */
+    olm_file_cache_t *base_cache;
     /** The name of file selected. */
     char *file;
-    /** Pointer to file being sent currently. */
-    FILE *fptr;
-    /** The progess of file transfer. */
+    /** File descriptor of the partial file being written, -1 if none. */
+    int wfd;
+    /**
+     * Write-behind buffer for the partial file being written, so it is
+     * written in large aligned chunks instead of a segment at a time.
+     */
+    uint8_t *wbuf;
+    /** Bytes at the end of the partial file still in the buffer. */
+    uint32_t wbuf_len;
+    /** File descriptor pinning the cache file being read, -1 if none. */
+    int fd;
+    /**
+     * Reads the pinned file ahead of the fread transfer on a worker thread,
+     * so the ODF does not wait on the disk. NULL if none.
+     */
+    olm_readahead_t *ahead;
+    /** The byte offset in the file the next transfer starts at. */
+    uint32_t offset;
+    /**
+     * The max bytes from the offset the next fread transfer reads, 0 for the
+     * rest of the file.
+     */
+    uint32_t range;
+    /**
+     * The length of the file being read, or the length of the partial file
+     * being written.
+     */
+    uint32_t length;
+    /** The length of the partial file being written in its checkpoint. */
+    uint32_t synced;
+    /** The codec for the next transfer, kept until reset. */
+    olm_codec_type_t codec;
+    /** The compression level for the next fread transfer. */
+    uint8_t codec_level;
+    /** The codec stream of the current transfer, NULL if not compressed. */
+    olm_codec_t *stream;
+    /** Bytes of the file read or written by the last transfer. */
+    uint32_t raw_bytes;
+    /** Bytes sent or received over CAN by the last transfer. */
+    uint32_t wire_bytes;
+    /** The name of the fwrite delta base file selected. */
+    char *base;
+    /** File descriptor pinning the delta base file, -1 if none. */
+    int base_fd;
+    /** The length of the delta base file. */
+    uint32_t base_len;
+    /** The delta block length, kept until reset. */
+    uint32_t block_len;
+    /** The delta being applied by the current transfer, NULL if none. */
+    olm_delta_t *delta;
+    /** CRC-32C of the first digest_len bytes of the file. */
+    uint32_t crc;
+    /** SHA-256 of the first digest_len bytes of the file. */
+    sha256_t sha;
+    /**
+     * Bytes of the file in the digests. They are made as the file is written
+     * or read from its start, so the file is never read again for them.
+     */
+    uint32_t digest_len;
+    /**
+     * Reads the file for the digests on a worker thread, when they cannot be
+     * made as it is written or read, so the ODF never does. NULL if none.
+     */
+    olm_digest_t *hasher;
+    /** The longest a fread data ODF call took in the last transfer, in us. */
+    uint32_t max_latency;
+    /** Progress of the last transfer, for telemetry. */
+    CO_fstream_progress_t progress;
 } CO_fstream_t;
 
-#define CO_FSTREAM_INITALIZER(_dir, _cache)                                    \
-    { .dir = _dir, .cache = _cache, .file = NULL, .fptr = NULL, }
+#define CO_FSTREAM_INITALIZER(_dir, _cache, _base_cache)                       \
+    {                                                                          \
+        .dir = _dir, .cache = _cache, .base_cache = _base_cache, .file = NULL, \
+        .wfd = -1, .wbuf = NULL, .wbuf_len = 0, .fd = -1, .ahead = NULL,       \
+        .offset = 0, .range = 0, .length = 0, .synced = 0,                     \
+        .codec = OLM_CODEC_NONE, .codec_level = 0, .stream = NULL,             \
+        .raw_bytes = 0, .wire_bytes = 0, .base = NULL, .base_fd = -1,          \
+        .base_len = 0, .block_len = OLM_DELTA_BLOCK_LEN_DEFAULT,               \
+        .delta = NULL, .crc = CRC32C_INIT, .digest_len = 0, .hasher = NULL,    \
+        .max_latency = 0, .progress = {0},                                     \
+    }
+
+/**
+ * fread / fwrite sessions, one for each SDO server, so transfers on different
+ * SDO servers can run at the same time without interfering.
+ */
+typedef struct {
+    /** The sessions, indexed by SDO server. */
+    CO_fstream_t sessions[CO_NO_SDO_SERVER];
+    /**
+     * Bulk stream of a file pinned by fread, shared by all sessions as there
+     * is one COB-ID for it.
+     */
+    CO_bulk_t bulk;
+} CO_fstreams_t;
+
+#define CO_FSTREAMS_INITALIZER(_dir, _cache, _base_cache)                      \
+    {                                                                          \
+        .sessions = {[0 ... CO_NO_SDO_SERVER - 1]                              \
+                     = CO_FSTREAM_INITALIZER(_dir, _cache, _base_cache)},      \
+        .bulk = CO_BULK_INITIALIZER,                                           \
+    }
 
 /**
- * @brief Reset all CO_fstream data, including closing any opened files.
+ * @brief Close all opened files in all sessions. Partial fwrite files are
+ * checkpointed and kept in the temp directory, so the transfers can be
+ * resumed later, even after a restart.
  *
- * @param data The data to cleanup.
+ * @param fstreams The sessions to close.
  */
 void
-CO_fstream_reset(CO_fstream_t *data);
+CO_fstreams_close(CO_fstreams_t *fstreams);
 
 /**
  * @brief Callback for using inside CO_OD_configure() function for reading
  * files from object dictionary. When add with @ref CO_OD_configure, a
- * CO_fstream_t object must be pass into the object arguemnt.
+ * CO_fstreams_t object must be pass into the object arguemnt.
  *
  * @param ODF_arg Current ODF arguemnt for SDO
  *
@@ -57,7 +189,7 @@ CO_fread_ODF(CO_ODF_arg_t *ODF_arg);
 /**
  * @brief Callback for using inside CO_OD_configure() function for writing
  * files from object dictionary. When add with @ref CO_OD_configure, a
- * CO_fstream_t object must be pass into the object arguemnt.
+ * CO_fstreams_t object must be pass into the object arguemnt.
  *
  * @param ODF_arg Current ODF arguemnt for SDO
  *
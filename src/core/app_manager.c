@@ -54,7 +54,7 @@ app_manager_async(olm_app_t **apps, olm_file_cache_t *fwrite_cache) {
     olm_file_t *file;
     uint32_t    active_apps = 0, failed_apps = 0;
     uint8_t     last_state;
-    int         files, r;
+    int         r;
 
     if (apps == NULL || fwrite_cache == NULL) {
         log_printf(LOG_DEBUG, "app_manager_async() missing inputs");
@@ -112,10 +112,9 @@ app_manager_async(olm_app_t **apps, olm_file_cache_t *fwrite_cache) {
         }
 
         // send file(s) from fwrite cache to daemon
-        files = olm_file_cache_len(fwrite_cache, apps[i]->fwrite_keyword);
-        if (files > 0) { // iterate thru file with app's keyword
-            olm_file_cache_index(fwrite_cache, 0, apps[i]->fwrite_keyword,
-                                 &file);
+        if (olm_file_cache_index(fwrite_cache, 0, apps[i]->fwrite_keyword,
+                                 &file)
+            == 0) { // iterate thru file with app's keyword
             sprintf(path, "%s%s", fwrite_cache->dir, file->name);
             log_printf(LOG_DEBUG, "send file %s to app", path);
 
@@ -132,7 +131,7 @@ app_manager_async(olm_app_t **apps, olm_file_cache_t *fwrite_cache) {
                            file->name);
             }
 
-            olm_file_free(file);
+            olm_file_release(file);
         }
     }
 
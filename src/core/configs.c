@@ -11,6 +11,7 @@
 
 #define _GNU_SOURCE
 #include "configs.h"
+#include "CO_bulk.h"
 #include "logging.h"
 #include <stdint.h>
 #include <stdio.h>
@@ -22,9 +23,66 @@
 #define BUS_SECTION  "[Bus]"
 #define BUS_NAME_KEY "Name="
 
-#define NODE_SECTION "[Node]"
-#define NODE_ID_KEY  "ID="
-#define BIT_RATE_KEY "BitRate="
+#define NODE_SECTION    "[Node]"
+#define NODE_ID_KEY     "ID="
+#define BIT_RATE_KEY    "BitRate="
+#define BULK_COB_ID_KEY "BulkCobId="
+
+#define FREAD_CACHE_SECTION  "[FreadCache]"
+#define FWRITE_CACHE_SECTION "[FwriteCache]"
+#define MAX_BYTES_KEY        "MaxBytes="
+#define MAX_FILES_KEY        "MaxFiles="
+#define EVICTION_KEY         "Eviction="
+#define KEYWORD_KEY          "Keyword="
+
+/** Eviction policy names for EVICTION_KEY, in olm_file_cache_evict_t order. */
+static const char *evictions[] = {"none", "oldest", "priority", "lru"};
+
+/**
+ * Parse a key in a file cache section.
+ * @param cache The cache configs to fill out.
+ * @param line The line with the key.
+ */
+static void
+read_cache_key(olm_cache_configs_t *cache, const char *line) {
+    olm_keyword_configs_t *kw;
+    unsigned long long     max_bytes;
+    unsigned int           max_files, priority;
+    char *                 end;
+
+    if (strncmp(MAX_BYTES_KEY, line, strlen(MAX_BYTES_KEY)) == 0) {
+        cache->budget.max_bytes
+            = (uint64_t)strtoull(&line[strlen(MAX_BYTES_KEY)], &end, 0);
+    } else if (strncmp(MAX_FILES_KEY, line, strlen(MAX_FILES_KEY)) == 0) {
+        cache->budget.max_files
+            = (uint32_t)strtoul(&line[strlen(MAX_FILES_KEY)], &end, 0);
+    } else if (strncmp(EVICTION_KEY, line, strlen(EVICTION_KEY)) == 0) {
+        for (size_t i = 0; i < sizeof(evictions) / sizeof(evictions[0]); ++i) {
+            if (strcmp(evictions[i], &line[strlen(EVICTION_KEY)]) == 0)
+                cache->evict = (olm_file_cache_evict_t)i;
+        }
+    } else if (strncmp(KEYWORD_KEY, line, strlen(KEYWORD_KEY)) == 0) {
+        if (cache->keywords_len >= CACHE_KEYWORDS_MAX) {
+            printf("Too many keywords in " CONFIG_FILE "\n");
+            return;
+        }
+
+        // Keyword=<keyword> <max bytes> <max files> <priority>
+        kw = &cache->keywords[cache->keywords_len];
+        if (sscanf(&line[strlen(KEYWORD_KEY)], "%31s %llu %u %u", kw->keyword,
+                   &max_bytes, &max_files, &priority)
+                != 4
+            || priority > UINT8_MAX) {
+            printf("Invalid keyword in " CONFIG_FILE "\n");
+            return;
+        }
+
+        kw->budget.max_bytes = (uint64_t)max_bytes;
+        kw->budget.max_files = (uint32_t)max_files;
+        kw->budget.priority  = (uint8_t)priority;
+        ++cache->keywords_len;
+    }
+}
 
 int
 read_config_file(olm_configs_t *configs) {
@@ -54,6 +112,16 @@ read_config_file(olm_configs_t *configs) {
                 strncpy(section, BUS_SECTION, strlen(BUS_SECTION) + 1);
             else if (strncmp(NODE_SECTION, line, strlen(NODE_SECTION)) == 0)
                 strncpy(section, NODE_SECTION, strlen(NODE_SECTION) + 1);
+            else if (strncmp(FREAD_CACHE_SECTION, line,
+                             strlen(FREAD_CACHE_SECTION))
+                     == 0)
+                strncpy(section, FREAD_CACHE_SECTION,
+                        strlen(FREAD_CACHE_SECTION) + 1);
+            else if (strncmp(FWRITE_CACHE_SECTION, line,
+                             strlen(FWRITE_CACHE_SECTION))
+                     == 0)
+                strncpy(section, FWRITE_CACHE_SECTION,
+                        strlen(FWRITE_CACHE_SECTION) + 1);
 
             continue;
         }
@@ -69,6 +137,18 @@ read_config_file(olm_configs_t *configs) {
             else if (strncmp(BIT_RATE_KEY, line, strlen(BIT_RATE_KEY)) == 0)
                 configs->bit_rate
                     = (uint16_t)strtoul(&line[strlen(BIT_RATE_KEY)], &end, 0);
+            else if (strncmp(BULK_COB_ID_KEY, line, strlen(BULK_COB_ID_KEY))
+                     == 0)
+                configs->bulk_cob_id
+                    = strtoul(&line[strlen(BULK_COB_ID_KEY)], &end, 0);
+        } else if (strncmp(FREAD_CACHE_SECTION, section,
+                           strlen(FREAD_CACHE_SECTION))
+                   == 0) {
+            read_cache_key(&configs->fread_cache, line);
+        } else if (strncmp(FWRITE_CACHE_SECTION, section,
+                           strlen(FWRITE_CACHE_SECTION))
+                   == 0) {
+            read_cache_key(&configs->fwrite_cache, line);
         }
     }
 
@@ -81,6 +161,11 @@ read_config_file(olm_configs_t *configs) {
         configs->bit_rate = BIT_RATE_DEFAULT;
         printf("Invalid bit rate in " CONFIG_FILE "\n");
     }
+    if (configs->bulk_cob_id != 0
+        && !CO_bulk_cob_id_valid(configs->bulk_cob_id)) {
+        configs->bulk_cob_id = 0;
+        printf("Invalid bulk COB-ID in " CONFIG_FILE "\n");
+    }
 
     free(line);
     return 1;
@@ -12,8 +12,40 @@
 #ifndef OLM_CONFIGS_H
 #define OLM_CONFIGS_H
 
+#include "olm_file_cache.h"
 #include <stdint.h>
 
+/** Max number of keyword budgets per cache in the conf file. */
+#define CACHE_KEYWORDS_MAX 16
+/** Max length of a keyword in the conf file, including the '\0'. */
+#define CACHE_KEYWORD_LEN 32
+
+/** A keyword budget from the conf file. */
+typedef struct {
+    /** The keyword. */
+    char keyword[CACHE_KEYWORD_LEN];
+    /** The budget for the keyword. */
+    olm_file_cache_budget_t budget;
+} olm_keyword_configs_t;
+
+/** Budgets and eviction policy for a file cache from the conf file. */
+typedef struct {
+    /** The budget for the whole cache. */
+    olm_file_cache_budget_t budget;
+    /** What to evict when over a budget. */
+    olm_file_cache_evict_t evict;
+    /** The keyword budgets. */
+    olm_keyword_configs_t keywords[CACHE_KEYWORDS_MAX];
+    /** The number of keyword budgets. */
+    uint8_t keywords_len;
+} olm_cache_configs_t;
+
+#define OLM_CACHE_CONFIGS_DEFAULT                                              \
+    {                                                                          \
+        .budget = OLM_FILE_CACHE_BUDGET_INITIALIZER,                           \
+        .evict = OLM_FILE_CACHE_EVICT_NONE, .keywords_len = 0,                 \
+    }
+
 /** All OLM's configs from conf file. */
 typedef struct {
     /** CANbus interface */
@@ -22,6 +54,12 @@ typedef struct {
     uint8_t node_id;
     /** CANbus bit rate in kbit/s. Can be 0 for Max is 1000. */
     uint16_t bit_rate;
+    /** The fread bulk stream COB-ID, 0 for the default of the node id. */
+    uint32_t bulk_cob_id;
+    /** Budgets for the fread cache. */
+    olm_cache_configs_t fread_cache;
+    /** Budgets for the fwrite cache. */
+    olm_cache_configs_t fwrite_cache;
 } olm_configs_t;
 
 #define NODE_ID_DEFAULT  0x7C
@@ -30,7 +68,9 @@ typedef struct {
 #define OLM_CONFIGS_DEFAULT                                                    \
     {                                                                          \
         .interface = "can0", .node_id = NODE_ID_DEFAULT,                       \
-        .bit_rate = BIT_RATE_DEFAULT,                                          \
+        .bit_rate = BIT_RATE_DEFAULT, .bulk_cob_id = 0,                        \
+        .fread_cache = OLM_CACHE_CONFIGS_DEFAULT,                              \
+        .fwrite_cache = OLM_CACHE_CONFIGS_DEFAULT,                             \
     }
 
 /**
@@ -14,13 +14,16 @@
 #include "logging.h"
 #include "olm_file.h"
 #include "olm_file_cache.h"
+#include "olm_intern.h"
 #include "utility.h"
+#include <errno.h>
 #include <linux/limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/statvfs.h>
 
 void
 file_caches_free(file_caches_t *caches) {
@@ -29,16 +32,131 @@ file_caches_free(file_caches_t *caches) {
         caches->fread_cache  = NULL;
         caches->fwrite_cache = NULL;
 
-        FREE_AND_NULL(caches->keyword);
+        olm_file_cache_cursor_reset(&caches->cursor);
+        olm_intern_release(caches->keyword);
+        caches->keyword = NULL;
     }
 }
 
+/**
+ * Change one field of the budget for the selected cache and filter.
+ * @param caches The file caches.
+ * @param cache The selected cache.
+ * @param ODF_arg The ODF argument with the new value.
+ * @return SDO abort code
+ */
+static CO_SDO_abortCode_t
+file_caches_set_budget(file_caches_t *caches, olm_file_cache_t *cache,
+                       CO_ODF_arg_t *ODF_arg) {
+    olm_file_cache_budget_t budget;
+
+    if (olm_file_cache_get_budget(cache, caches->keyword, &budget) != 0)
+        return CO_SDO_AB_GENERAL;
+
+    if (ODF_arg->subIndex == OD_3002_11_fileCaches_maxBytes)
+        memcpy(&budget.max_bytes, ODF_arg->data, sizeof(budget.max_bytes));
+    else if (ODF_arg->subIndex == OD_3002_12_fileCaches_maxFiles)
+        budget.max_files = CO_getUint32(ODF_arg->data);
+    else
+        budget.priority = CO_getUint8(ODF_arg->data);
+
+    if (olm_file_cache_set_budget(cache, caches->keyword, &budget) != 0)
+        return CO_SDO_AB_GENERAL;
+
+    return CO_SDO_AB_NONE;
+}
+
+/**
+ * Get the time window set by the window start and end subindexes. An end of
+ * 0 means the window has no end.
+ * @param start The oldest unix time in the window, inclusive.
+ * @param end The newest unix time in the window, inclusive.
+ */
+static void
+file_caches_window(uint32_t *start, uint32_t *end) {
+    *start = OD_fileCaches.windowStart;
+    *end   = OD_fileCaches.windowEnd;
+
+    if (*end == 0) // no end
+        *end = UINT32_MAX;
+}
+
+/**
+ * Remove many files from the selected cache and filter at once.
+ * @param caches The file caches.
+ * @param cache The selected cache.
+ * @param ODF_arg The ODF argument for the bulk remove subindex.
+ * @return SDO abort code
+ */
+static CO_SDO_abortCode_t
+file_caches_bulk_remove(file_caches_t *caches, olm_file_cache_t *cache,
+                        CO_ODF_arg_t *ODF_arg) {
+    uint32_t start, end;
+    int      r = 0;
+
+    file_caches_window(&start, &end);
+
+    if (ODF_arg->subIndex == OD_3002_16_fileCaches_deleteFiltered) {
+        r = olm_file_cache_remove_range(cache, caches->keyword, start, end);
+    } else if (ODF_arg->subIndex == OD_3002_18_fileCaches_keepNewest) {
+        r = olm_file_cache_keep_newest(cache, caches->keyword,
+                                       CO_getUint32(ODF_arg->data));
+    } else if (CO_getUint32(ODF_arg->data) > start) { // something is older
+        if (end >= CO_getUint32(ODF_arg->data))
+            end = CO_getUint32(ODF_arg->data) - 1;
+        r = olm_file_cache_remove_range(cache, caches->keyword, start, end);
+    }
+
+    if (r < 0)
+        return CO_SDO_AB_GENERAL;
+
+    if (r > 0) {
+        log_printf(LOG_INFO, "bulk remove deleted %d files", r);
+        olm_file_cache_cursor_reset(&caches->cursor);
+        OD_fileCaches.iterator = 0;
+    }
+
+    return CO_SDO_AB_NONE;
+}
+
+/**
+ * Get the file the iterator is on, positioning the cursor on the iterator if
+ * it is not already.
+ * @param caches The file caches.
+ * @param cache The selected cache.
+ * @param file The file the iterator is on.
+ * @return SDO abort code
+ */
+static CO_SDO_abortCode_t
+file_caches_current(file_caches_t *caches, olm_file_cache_t *cache,
+                    const olm_file_t **file) {
+    uint32_t start, end;
+    int      r = 0;
+
+    file_caches_window(&start, &end);
+
+    if (caches->cursor.file == NULL)
+        r = olm_file_cache_cursor_seek_window(cache, &caches->cursor,
+                                              OD_fileCaches.iterator,
+                                              caches->keyword, start, end);
+    if (r == 0)
+        r = olm_file_cache_cursor_get(cache, &caches->cursor, file);
+
+    if (r == -ESTALE)
+        return CO_SDO_AB_DATA_DEV_STATE; // cache changed, iterator must be set
+    else if (r != 0)
+        return CO_SDO_AB_NO_DATA;
+
+    return CO_SDO_AB_NONE;
+}
+
 CO_SDO_abortCode_t
 file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
     file_caches_t *    caches = (file_caches_t *)ODF_arg->object;
     CO_SDO_abortCode_t ret    = CO_SDO_AB_NONE;
     olm_file_cache_t * cache  = NULL;
-    olm_file_t *       file   = NULL;
+    const olm_file_t * file   = NULL;
+    uint32_t           count;
 
     if (caches == NULL || caches->fread_cache == NULL
         || caches->fwrite_cache == NULL)
@@ -54,10 +172,8 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
     case OD_3002_1_fileCaches_freadCacheLen: // read cache len, uint8, readonly
 
         if (ODF_arg->reading) {
-            if (caches->fread_cache->len < UINT8_MAX)
-                CO_setUint8(ODF_arg->data, (uint8_t)caches->fread_cache->len);
-            else
-                CO_setUint8(ODF_arg->data, UINT8_MAX);
+            count = olm_file_cache_len(caches->fread_cache, NULL);
+            CO_setUint8(ODF_arg->data, count < UINT8_MAX ? count : UINT8_MAX);
         } else {
             ret = CO_SDO_AB_READONLY;
         }
@@ -68,10 +184,8 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
                                               // readonly
 
         if (ODF_arg->reading) {
-            if (caches->fwrite_cache->len < UINT8_MAX)
-                CO_setUint8(ODF_arg->data, (uint8_t)caches->fwrite_cache->len);
-            else
-                CO_setUint8(ODF_arg->data, UINT8_MAX);
+            count = olm_file_cache_len(caches->fwrite_cache, NULL);
+            CO_setUint8(ODF_arg->data, count < UINT8_MAX ? count : UINT8_MAX);
         } else {
             ret = CO_SDO_AB_READONLY;
         }
@@ -85,6 +199,8 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
 
             if (temp != FREAD_CACHE && temp != FWRITE_CACHE)
                 return CO_SDO_AB_VALUE_HIGH; // invalid selector
+
+            olm_file_cache_cursor_reset(&caches->cursor);
         }
 
         break;
@@ -100,27 +216,20 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
                 memcpy(ODF_arg->data, caches->keyword, ODF_arg->dataLength);
             }
         } else {
-            if (caches->keyword != NULL) {
-                free(caches->keyword);
-                caches->keyword = NULL;
-            }
+            olm_file_cache_cursor_reset(&caches->cursor);
 
-            unsigned int len = ODF_arg->dataLength;
+            olm_intern_release(caches->keyword);
+            caches->keyword = NULL;
 
-            if (len == 1 && ODF_arg->data[0] == 0)
+            if (ODF_arg->dataLength == 1 && ODF_arg->data[0] == 0)
                 break; // only clearing keyword
 
-            // check if str end with '\0'
-            if (ODF_arg->data[len - 1] != '\0')
-                ++len; // add room for `\0`
-
-            if ((caches->keyword = malloc(len)) == NULL)
+            // interned once here, so the cache finds its bucket by pointer
+            caches->keyword = olm_intern(
+                (const char *)ODF_arg->data,
+                strnlen((const char *)ODF_arg->data, ODF_arg->dataLength));
+            if (caches->keyword == NULL)
                 ret = CO_SDO_AB_GENERAL;
-
-            memcpy(caches->keyword, ODF_arg->data, ODF_arg->dataLength);
-
-            if (len != ODF_arg->dataLength)
-                caches->keyword[ODF_arg->dataLength] = '\0'; // add missing '\0'
         }
 
         break;
@@ -129,14 +238,12 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
                                         // filter, uint32, readonly
 
         if (ODF_arg->reading) {
-            uint32_t len;
-
-            if (OD_fileCaches.cacheSelector == FREAD_CACHE)
-                len = olm_file_cache_len(caches->fread_cache, caches->keyword);
-            else
-                len = olm_file_cache_len(caches->fwrite_cache, caches->keyword);
+            uint32_t start, end;
 
-            CO_setUint32(ODF_arg->data, len);
+            file_caches_window(&start, &end);
+            CO_setUint32(ODF_arg->data,
+                         olm_file_cache_window_len(cache, caches->keyword,
+                                                   start, end));
         } else {
             ret = CO_SDO_AB_READONLY;
         }
@@ -147,8 +254,13 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
                                         // readwrite
 
         if (!ODF_arg->reading) {
-            if (CO_getUint32(ODF_arg->data)
-                >= olm_file_cache_len(cache, caches->keyword))
+            uint32_t start, end;
+
+            file_caches_window(&start, &end);
+            if (olm_file_cache_cursor_seek_window(
+                    cache, &caches->cursor, CO_getUint32(ODF_arg->data),
+                    caches->keyword, start, end)
+                != 0)
                 return CO_SDO_AB_VALUE_HIGH; // invalid iterator value
         }
 
@@ -159,13 +271,10 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
         if (!ODF_arg->reading)
             return CO_SDO_AB_READONLY;
 
-        olm_file_cache_index(cache, OD_fileCaches.iterator, caches->keyword,
-                             &file);
-        if (file != NULL && file->name != NULL) { // file exist
+        if ((ret = file_caches_current(caches, cache, &file))
+            == CO_SDO_AB_NONE) {
             ODF_arg->dataLength = strlen(file->name) + 1;
             memcpy(ODF_arg->data, file->name, ODF_arg->dataLength);
-        } else { // no file
-            ret = CO_SDO_AB_NO_DATA;
         }
 
         break;
@@ -175,12 +284,9 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
         if (!ODF_arg->reading)
             return CO_SDO_AB_READONLY;
 
-        olm_file_cache_index(cache, OD_fileCaches.iterator, caches->keyword,
-                             &file);
-        if (file != NULL) // file exist
+        if ((ret = file_caches_current(caches, cache, &file))
+            == CO_SDO_AB_NONE)
             CO_setUint32(ODF_arg->data, file->size);
-        else // no file
-            ret = CO_SDO_AB_NO_DATA;
 
         break;
 
@@ -190,20 +296,128 @@ file_caches_ODF(CO_ODF_arg_t *ODF_arg) {
         if (ODF_arg->reading)
             return CO_SDO_AB_WRITEONLY;
 
-        olm_file_cache_index(cache, OD_fileCaches.iterator, caches->keyword,
-                             &file);
-        if (file != NULL) { // no file
+        if ((ret = file_caches_current(caches, cache, &file))
+            == CO_SDO_AB_NONE) {
             olm_file_cache_remove(cache, file->name);
+            olm_file_cache_cursor_reset(&caches->cursor);
             OD_fileCaches.iterator = 0;
+        }
+
+        break;
+
+    case OD_3002_10_fileCaches_cacheBytes: // total size of the files for
+                                           // selected cache and filter,
+                                           // uint64, readonly
+
+        if (ODF_arg->reading) {
+            uint64_t bytes = olm_file_cache_bytes(cache, caches->keyword);
+
+            memcpy(ODF_arg->data, &bytes, sizeof(bytes));
         } else {
-            ret = CO_SDO_AB_NO_DATA;
+            ret = CO_SDO_AB_READONLY;
         }
 
         break;
-    }
 
-    if (file != NULL)
-        olm_file_free(file);
+    case OD_3002_11_fileCaches_maxBytes: // byte budget for selected cache and
+                                         // filter, uint64, readwrite
+    case OD_3002_12_fileCaches_maxFiles: // file count budget for selected
+                                         // cache and filter, uint32,
+                                         // readwrite
+
+        if (ODF_arg->reading) {
+            olm_file_cache_budget_t budget;
+
+            olm_file_cache_get_budget(cache, caches->keyword, &budget);
+            if (ODF_arg->subIndex == OD_3002_11_fileCaches_maxBytes)
+                memcpy(ODF_arg->data, &budget.max_bytes,
+                       sizeof(budget.max_bytes));
+            else
+                CO_setUint32(ODF_arg->data, budget.max_files);
+        } else {
+            ret = file_caches_set_budget(caches, cache, ODF_arg);
+        }
+
+        break;
+
+    case OD_3002_13_fileCaches_keywordPriority: // eviction priority for the
+                                                // filter, uint8, readwrite
+
+        if (caches->keyword == NULL)
+            return CO_SDO_AB_NO_DATA; // only keywords have a priority
+
+        if (ODF_arg->reading) {
+            olm_file_cache_budget_t budget;
+
+            olm_file_cache_get_budget(cache, caches->keyword, &budget);
+            CO_setUint8(ODF_arg->data, budget.priority);
+        } else {
+            ret = file_caches_set_budget(caches, cache, ODF_arg);
+        }
+
+        break;
+
+    case OD_3002_14_fileCaches_evictionPolicy: // eviction policy for selected
+                                               // cache, uint8, readwrite
+
+        if (ODF_arg->reading) {
+            CO_setUint8(ODF_arg->data, (uint8_t)cache->evict);
+        } else {
+            uint8_t temp = CO_getUint8(ODF_arg->data);
+
+            if (temp > OLM_FILE_CACHE_EVICT_LRU)
+                return CO_SDO_AB_VALUE_HIGH; // invalid policy
+
+            olm_file_cache_set_eviction(cache, (olm_file_cache_evict_t)temp);
+        }
+
+        break;
+
+    case OD_3002_15_fileCaches_freeBytes: // free space on the filesystem of
+                                          // selected cache, uint64, readonly
+
+        if (ODF_arg->reading) {
+            struct statvfs st;
+            uint64_t       bytes;
+
+            if (statvfs(cache->dir, &st) != 0)
+                return CO_SDO_AB_GENERAL;
+
+            bytes = (uint64_t)st.f_bavail * st.f_frsize;
+            memcpy(ODF_arg->data, &bytes, sizeof(bytes));
+        } else {
+            ret = CO_SDO_AB_READONLY;
+        }
+
+        break;
+
+    case OD_3002_16_fileCaches_deleteFiltered: // delete all files for
+                                               // selected cache and filter,
+                                               // domain, writeonly
+    case OD_3002_17_fileCaches_deleteBefore: // delete files older than a unix
+                                             // time for selected cache and
+                                             // filter, uint32, writeonly
+    case OD_3002_18_fileCaches_keepNewest: // delete all but the newest files
+                                           // of each keyword for selected
+                                           // cache and filter, uint32,
+                                           // writeonly
+
+        if (ODF_arg->reading)
+            return CO_SDO_AB_WRITEONLY;
+
+        ret = file_caches_bulk_remove(caches, cache, ODF_arg);
+        break;
+
+    case OD_3002_19_fileCaches_windowStart: // oldest unix time to list,
+                                            // uint32, readwrite
+    case OD_3002_20_fileCaches_windowEnd: // newest unix time to list, 0 for no
+                                          // end, uint32, readwrite
+
+        if (!ODF_arg->reading) // the iterator is relative to the window
+            olm_file_cache_cursor_reset(&caches->cursor);
+
+        break;
+    }
 
     return ret;
 }
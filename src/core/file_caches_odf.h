@@ -28,14 +28,19 @@ typedef struct {
     olm_file_cache_t *fread_cache;
     /** The file cache for files written to the Linux board */
     olm_file_cache_t *fwrite_cache;
-    /** The current filter, will be NULL for no filter. */
-    char *keyword;
+    /** The current filter, interned, will be NULL for no filter. */
+    const char *keyword;
+    /**
+     * Cursor on the file selected by the iterator, kept between SDO requests.
+     * Reset when the cache selector or filter changes.
+     */
+    olm_file_cache_cursor_t cursor;
 } file_caches_t;
 
 #define FILE_CACHES_INTIALIZER(_fread_cache, _fwrite_cache)                    \
     {                                                                          \
         .fread_cache = _fread_cache, .fwrite_cache = _fwrite_cache,            \
-        .keyword = NULL,                                                       \
+        .keyword = NULL, .cursor = OLM_FILE_CACHE_CURSOR_INITIALIZER,          \
     }
 
 void
@@ -14,15 +14,29 @@
 #include "logging.h"
 #include "utility.h"
 #include <errno.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define SDO_BLOCK_LEN  (127 * 7)
 #define BUFFER_LEN     1024
+/**
+ * The reply ring length, a power of 2 so its index carries on across the head
+ * and tail wrapping.
+ */
 #define BUFFER_LEN_MAX (BUFFER_LEN * 128)
+/**
+ * How often to check if a command exited after the end of its output, at
+ * first and at most. It is most often right away, so the delay doubles.
+ */
+#define REAP_DELAY_MIN_US 50
+#define REAP_DELAY_MAX_US 10000
 
 /** OS command status values defined by CiA 301 */
 enum os_command_status {
@@ -34,115 +48,395 @@ enum os_command_status {
     os_cmd_executing = 0xFF,
 };
 
-void
-co_command_async(os_command_t *data) {
-    FILE *pipe;
-    char *temp;
-    int   c;
+/**
+ * Set the status of a job once it is done, and of the OS command OD entry for
+ * the default job. It has a reply if some is left in its ring.
+ * @param data The OS command data.
+ * @param job The job.
+ * @param failed True if the command failed.
+ */
+static void
+os_command_done(os_command_t *data, os_command_job_t *job, bool failed) {
+    CO_LOCK_OD(); // the reply can be streamed out at the same time
+    if (job->reply_head == job->reply_tail)
+        job->status = failed ? os_cmd_error_no_reply : os_cmd_no_error_no_reply;
+    else
+        job->status = failed ? os_cmd_error_reply : os_cmd_no_error_reply;
 
-    if (data == NULL) {
-        log_printf(LOG_DEBUG, "os command is missing argument data");
-        return;
-    } else if (OD_OSCommand.status != os_cmd_executing) {
-        return; // nothing todo
+    if (job == &data->jobs[0])
+        OD_OSCommand.status = job->status;
+    CO_UNLOCK_OD();
+}
+
+/**
+ * Start or stop reading the stdout of a job's command. Shoud be called under
+ * lock.
+ * @param data The OS command data.
+ * @param job The job, with its stdout open.
+ * @param pause True to stop, so the command blocks once the pipe is full.
+ */
+static void
+os_command_pause(os_command_t *data, os_command_job_t *job, bool pause) {
+    struct epoll_event ev;
+    int                op = pause ? EPOLL_CTL_DEL : EPOLL_CTL_ADD;
+
+    // out of the set, as a hang up is reported even with no events asked for
+    ev.events   = EPOLLIN;
+    ev.data.ptr = job;
+    if (epoll_ctl(data->epoll_fd, op, job->cmd.fd, &ev) == 0)
+        job->reply_paused = pause;
+    else
+        log_printf(LOG_ERR, "bash reply pause failed: %s", strerror(errno));
+}
+
+/**
+ * Copy part of the reply out of a job's ring.
+ * @param job The job.
+ * @param offset Where to start, from the read cursor.
+ * @param dest Where to copy it to.
+ * @param len The number of bytes, no more than there is from the offset.
+ */
+static void
+os_command_copy(os_command_job_t *job, uint32_t offset, uint8_t *dest,
+                uint32_t len) {
+    uint32_t index = (job->reply_tail + offset) % job->reply_buf_len;
+    uint32_t first = job->reply_buf_len - index; // up to the end of the ring
+
+    if (first > len)
+        first = len;
+
+    memcpy(dest, &job->reply_buf[index], first);
+    memcpy(&dest[first], job->reply_buf, len - first);
+}
+
+/**
+ * Set the length of the next segment of a domain read.
+ * @param ODF_arg The ODF argument, with the total length and offset set.
+ */
+static void
+os_command_segment(CO_ODF_arg_t *ODF_arg) {
+    uint32_t bytes_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
+
+    // Check if there are more segements needed
+    if (bytes_left > SDO_BLOCK_LEN) { // more segements needed
+        ODF_arg->dataLength  = SDO_BLOCK_LEN;
+        ODF_arg->lastSegment = false;
+    } else { // last segement
+        ODF_arg->dataLength  = bytes_left;
+        ODF_arg->lastSegment = true;
     }
+}
 
-    if (data->command == NULL) {
-        CO_LOCK_OD();
-        OD_OSCommand.status = os_cmd_error_no_reply;
-        CO_UNLOCK_OD();
-        log_printf(LOG_DEBUG, "no command in excuting state");
-        return;
+/**
+ * Spawn the command of a job, with its stdout in the epoll set.
+ * @param data The OS command data.
+ * @param job The job, with a command.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+os_command_start(os_command_t *data, os_command_job_t *job) {
+    struct epoll_event ev;
+    int                r;
+
+    // allocated once at its max, so the reply is never copied to grow it
+    if (job->reply_buf == NULL) {
+        if ((job->reply_buf = malloc(BUFFER_LEN_MAX)) == NULL)
+            return -ENOMEM;
+        job->reply_buf_len = BUFFER_LEN_MAX;
+    }
+    job->reply_head    = 0;
+    job->reply_tail    = 0;
+    job->reply_paused  = false;
+    job->reply_dropped = 0;
+    job->exit_code     = 0;
+
+    if (data->epoll_fd < 0
+        && (data->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -errno;
+
+    if ((r = olm_cmd_spawn(&job->cmd, job->command)) != 0)
+        return r;
+
+    ev.events   = EPOLLIN;
+    ev.data.ptr = job;
+    if (epoll_ctl(data->epoll_fd, EPOLL_CTL_ADD, job->cmd.fd, &ev) != 0) {
+        r = -errno;
+        olm_cmd_kill(&job->cmd);
+        return r;
     }
 
-    if (data->command_len < 50)
-        log_printf(LOG_DEBUG, "running bash command: %s", data->command);
-    else
-        log_printf(LOG_DEBUG, "running long bash command");
+    return 0;
+}
 
-    pipe = popen(data->command, "r");
-    if (pipe == NULL) {
-        CO_LOCK_OD();
-        OD_OSCommand.status = os_cmd_error_no_reply;
+/**
+ * Read all the output the command of a job has so far into its reply ring, a
+ * pipe full at a time. When the ring is full, stdout is not read until there
+ * is room, so the command blocks on it instead of its output being dropped.
+ * The default job drops the output instead, until its reply is streamed.
+ * @param data The OS command data.
+ * @param job The job, with a command running.
+ * @return 0 on success or negative errno on failure.
+ */
+static int
+os_command_read(os_command_t *data, os_command_job_t *job) {
+    char     discard[BUFFER_LEN];
+    uint32_t index, len;
+    bool     drop;
+    ssize_t  n;
+
+    do {
+        CO_LOCK_OD(); // the tail moves as the reply is streamed out
+        len  = job->reply_buf_len - (job->reply_head - job->reply_tail);
+        drop = len == 0 && job == &data->jobs[0] && !job->reply_streamed;
+        if (len == 0 && !drop)
+            os_command_pause(data, job, true);
         CO_UNLOCK_OD();
-        log_printf(LOG_ERR, "popen failed");
-    } else {
-        // initialize buffer
-        FREE(data->reply_buf);
-        data->reply_buf_len = BUFFER_LEN;
-        if ((data->reply_buf = malloc(BUFFER_LEN)) == NULL) {
+
+        if (drop) {
+            // a CiA 301 client waits for the end, so it must not wait on reads
+            n = olm_cmd_read(&job->cmd, discard, sizeof(discard));
+            if (n > 0) {
+                if (job->reply_dropped == 0)
+                    log_printf(LOG_WARNING, "bash reply max limit hit, "
+                                            "dropping the rest");
+                job->reply_dropped += n;
+            }
+            continue;
+        }
+
+        if (len == 0) {
+            log_printf(LOG_DEBUG, "bash reply ring full, waiting on reads");
+            return 0;
+        }
+
+        // only the ring's free part up to its end, the rest is next time round
+        index = job->reply_head % job->reply_buf_len;
+        if (len > job->reply_buf_len - index)
+            len = job->reply_buf_len - index;
+
+        n = olm_cmd_read(&job->cmd, &job->reply_buf[index], len);
+
+        if (n > 0) {
             CO_LOCK_OD();
-            OD_OSCommand.status = os_cmd_no_error_no_reply;
+            job->reply_head += n;
             CO_UNLOCK_OD();
-            log_printf(LOG_ERR, "bash reply malloc failed");
-            return;
         }
+    } while (n > 0);
 
-        for (data->reply_len = 0; (c = fgetc(pipe)) != EOF; ++data->reply_len) {
-            if (data->reply_len > data->reply_buf_len) { // grow buffer
-                if (data->reply_len > BUFFER_LEN_MAX) {
-                    log_printf(LOG_INFO, "bash reply max limit hit");
-                    break; // max len reached
-                }
-
-                data->reply_buf_len *= 2;
-
-                if ((temp = realloc(data->reply_buf, data->reply_buf_len))
-                    == NULL) {
-                    log_printf(LOG_ERR, "bash reply realloc failed");
-                    break; // realloc failed;
-                } else {
-                    log_printf(LOG_DEBUG, "bash reply realloc to %d",
-                               data->reply_buf_len);
-                    data->reply_buf = temp;
-                }
-            }
-            data->reply_buf[data->reply_len] = (char)c; // old compiler fix
+    return n == -EAGAIN ? 0 : n;
+}
+
+/**
+ * Set the status of a job once its command is done. Never waits for it to
+ * exit.
+ * @param data The OS command data.
+ * @param job The job, executing.
+ */
+static void
+os_command_finish(os_command_t *data, os_command_job_t *job) {
+    int  status;
+    bool failed;
+    int  r = 0;
+
+    if (job->cmd.fd >= 0)
+        return; // more output to come
+    if (job->cmd.pid >= 0 && (r = olm_cmd_reap(&job->cmd)) == 0)
+        return; // output ended, but not exited yet
+
+    status = job->cmd.status;
+    if (WIFSIGNALED(status))
+        job->exit_code = -WTERMSIG(status);
+    else
+        job->exit_code = WEXITSTATUS(status);
+
+    // a reply cut short is an error too, so the client knows
+    failed = r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0
+             || job->reply_dropped != 0;
+    log_printf(LOG_DEBUG,
+               "bash command job %d done, status 0x%x, %u bytes, %u dropped",
+               (int)(job - data->jobs), status, job->reply_head,
+               job->reply_dropped);
+
+    os_command_done(data, job, failed);
+}
+
+/**
+ * Kill the command of a job if the cancel subindex was written for it, and
+ * set its status to failed.
+ * @param data The OS command data.
+ * @param job The job.
+ */
+static void
+os_command_cancel(os_command_t *data, os_command_job_t *job) {
+    bool cancel;
+
+    CO_LOCK_OD(); // set by the ODF
+    cancel      = job->cancel;
+    job->cancel = false;
+    CO_UNLOCK_OD();
+
+    if (!cancel || job->status != os_cmd_executing)
+        return; // or it was done before it could be killed
+
+    olm_cmd_kill(&job->cmd);
+    job->exit_code = -SIGKILL;
+    log_printf(LOG_DEBUG, "bash command job %d canceled",
+               (int)(job - data->jobs));
+
+    os_command_done(data, job, true);
+}
+
+void
+co_command_async(os_command_t *data) {
+    struct epoll_event events[OS_COMMAND_JOBS];
+    os_command_job_t * job;
+    int                n = 0, r;
+
+    if (data == NULL) {
+        log_printf(LOG_DEBUG, "os command is missing argument data");
+        return;
+    }
+
+    for (int i = 0; i < OS_COMMAND_JOBS; ++i)
+        os_command_cancel(data, &data->jobs[i]);
+
+    for (int i = 0; i < OS_COMMAND_JOBS; ++i) {
+        job = &data->jobs[i];
+        if (job->status != os_cmd_executing || job->cmd.pid >= 0
+            || job->cmd.fd >= 0)
+            continue; // nothing todo, or already running
+
+        if (job->command == NULL) {
+            os_command_done(data, job, true);
+            log_printf(LOG_DEBUG, "no command in excuting state");
+            continue;
         }
 
-        CO_LOCK_OD();
-        if (data->reply_len == 0)
-            OD_OSCommand.status = os_cmd_no_error_no_reply;
+        if (job->command_len < 50)
+            log_printf(LOG_DEBUG, "running bash command job %d: %s", i,
+                       job->command);
         else
-            OD_OSCommand.status = os_cmd_no_error_reply;
-        CO_UNLOCK_OD();
+            log_printf(LOG_DEBUG, "running long bash command job %d", i);
+
+        if ((r = os_command_start(data, job)) != 0) {
+            os_command_done(data, job, true);
+            log_printf(LOG_ERR, "bash command spawn failed: %s", strerror(-r));
+        }
+    }
+
+    // take the output there is so far, without waiting for more
+    if (data->epoll_fd >= 0)
+        n = epoll_wait(data->epoll_fd, events, OS_COMMAND_JOBS, 0);
+    for (int i = 0; i < n; ++i) {
+        job = events[i].data.ptr;
+        if ((r = os_command_read(data, job)) != 0) {
+            log_printf(LOG_ERR, "bash reply read failed: %s", strerror(-r));
+            olm_cmd_kill(&job->cmd);
+        }
+    }
+
+    for (int i = 0; i < OS_COMMAND_JOBS; ++i) {
+        if (data->jobs[i].status == os_cmd_executing)
+            os_command_finish(data, &data->jobs[i]);
+    }
+}
+
+/**
+ * Check if the command of a job whose output ended has exited, without
+ * reaping it.
+ * @param job The job.
+ * @return True if it exited.
+ */
+static bool
+os_command_exited(os_command_job_t *job) {
+    siginfo_t info = {0};
+
+    return waitid(P_PID, job->cmd.pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0
+           || info.si_pid != 0;
+}
+
+void
+os_command_wait(os_command_t *data, uint32_t timeout_us) {
+    struct epoll_event ev;
+    os_command_job_t * exiting = NULL;
+    bool               reading = false;
+    uint32_t           delay   = REAP_DELAY_MIN_US;
+
+    for (int i = 0; data != NULL && i < OS_COMMAND_JOBS; ++i) {
+        if (data->jobs[i].cmd.fd >= 0)
+            reading = true;
+        else if (data->jobs[i].cmd.pid >= 0)
+            exiting = &data->jobs[i];
+    }
+
+    if (exiting != NULL) {
+        // its output ended, so it is exiting, wait for that or other output
+        for (uint32_t t = 0; t < timeout_us; t += delay) {
+            if (os_command_exited(exiting)
+                || (reading && epoll_wait(data->epoll_fd, &ev, 1, 0) > 0))
+                break;
+            usleep(delay);
+            if (delay < REAP_DELAY_MAX_US)
+                delay *= 2;
+        }
+    } else if (reading) {
+        // rounded up, so it does not spin for the last ms
+        epoll_wait(data->epoll_fd, &ev, 1, (timeout_us + 999) / 1000);
+    } else {
+        usleep(timeout_us);
+    }
+}
+
+void
+os_command_free(os_command_t *data) {
+    os_command_job_t *job;
+
+    if (data == NULL)
+        return;
+
+    for (int i = 0; i < OS_COMMAND_JOBS; ++i) {
+        job = &data->jobs[i];
+        olm_cmd_kill(&job->cmd);
+        FREE_AND_NULL(job->command);
+        FREE_AND_NULL(job->reply_buf);
+        job->reply_buf_len = 0;
+        job->reply_head    = 0;
+        job->reply_tail    = 0;
     }
 
-    return;
+    if (data->epoll_fd >= 0) {
+        close(data->epoll_fd);
+        data->epoll_fd = -1;
+    }
 }
 
 CO_SDO_abortCode_t
 OS_COMMAND_1023_ODF(CO_ODF_arg_t *ODF_arg) {
     os_command_t *     data = (os_command_t *)ODF_arg->object;
     CO_SDO_abortCode_t ret  = CO_SDO_AB_NONE;
-    uint32_t           bytes_left;
+    os_command_job_t * job;
+    uint8_t            count;
 
     if (data == NULL)
         return CO_SDO_AB_DATA_LOC_CTRL;
 
+    job = &data->jobs[data->job_id];
+
     switch (ODF_arg->subIndex) {
     case OD_1023_1_OSCommand_command: // bash command, domain, readwrite
 
         if (ODF_arg->reading) {
             if (ODF_arg->firstSegment == true) {
-                if (data->command == NULL)
+                if (job->command == NULL)
                     return CO_SDO_AB_NO_DATA;
 
                 ODF_arg->offset          = 0;
-                ODF_arg->dataLengthTotal = strlen(data->command) + 1;
+                ODF_arg->dataLengthTotal = strlen(job->command) + 1;
             }
 
-            // Check if there are more segements needed
-            bytes_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
-            if (bytes_left > SDO_BLOCK_LEN) { // more segements needed
-                ODF_arg->dataLength  = SDO_BLOCK_LEN;
-                ODF_arg->lastSegment = false;
-            } else { // last segement
-                ODF_arg->dataLength  = bytes_left;
-                ODF_arg->lastSegment = true;
-            }
+            os_command_segment(ODF_arg);
 
-            memcpy(ODF_arg->data, &data->command[ODF_arg->offset],
+            memcpy(ODF_arg->data, &job->command[ODF_arg->offset],
                    ODF_arg->dataLength);
         } else { // writing
             uint32_t len;
@@ -156,57 +450,138 @@ OS_COMMAND_1023_ODF(CO_ODF_arg_t *ODF_arg) {
                 len = ODF_arg->dataLength + 1;
 
             if (ODF_arg->firstSegment) {
-                FREE(data->command);
-                data->command_len = len;
-                ODF_arg->offset   = 0;
-
-                // free reply buffer
-                FREE(data->reply_buf);
-                data->reply_buf_len = 0;
-                data->reply_buf     = 0;
-
-                if ((data->command = malloc(data->command_len)) == NULL)
+                // the command and the reply are in use until it is done
+                if (job->status == os_cmd_executing)
+                    return CO_SDO_AB_DATA_DEV_STATE;
+
+                FREE(job->command);
+                job->command_len    = len;
+                ODF_arg->offset     = 0;
+                job->reply_head     = 0; // the ring is kept for the next one
+                job->reply_tail     = 0;
+                job->reply_streamed = false;
+                job->cancel         = false;
+
+                if ((job->command = malloc(job->command_len)) == NULL)
                     return CO_SDO_AB_OUT_OF_MEM;
             }
 
-            memcpy(&data->command[ODF_arg->offset], ODF_arg->data,
+            memcpy(&job->command[ODF_arg->offset], ODF_arg->data,
                    ODF_arg->dataLength);
 
             if (ODF_arg->lastSegment) {
-                data->command[len - 1] = '\0';
-                OD_OSCommand.status    = os_cmd_executing;
+                job->command[len - 1] = '\0';
+                job->status           = os_cmd_executing;
+                if (job == &data->jobs[0])
+                    OD_OSCommand.status = os_cmd_executing;
             }
         }
 
         break;
 
+    case OD_1023_2_OSCommand_status: // uint8, readonly
+        CO_setUint8(ODF_arg->data, job->status);
+        break;
+
     case OD_1023_3_OSCommand_reply: // bash command reply, domain, readonly
         if (ODF_arg->reading) {
             if (ODF_arg->firstSegment) {
-                if (OD_OSCommand.status != os_cmd_no_error_reply
-                    && OD_OSCommand.status != os_cmd_error_reply)
+                // what was not streamed out, once done
+                if ((job->status != os_cmd_no_error_reply
+                     && job->status != os_cmd_error_reply)
+                    || job->reply_head == job->reply_tail)
                     return CO_SDO_AB_NO_DATA;
 
                 ODF_arg->offset          = 0;
-                ODF_arg->dataLengthTotal = data->reply_len;
+                ODF_arg->dataLengthTotal = job->reply_head - job->reply_tail;
             }
 
-            // Check if there are more segements needed
-            bytes_left = ODF_arg->dataLengthTotal - ODF_arg->offset;
-            if (bytes_left > SDO_BLOCK_LEN) { // more segements needed
-                ODF_arg->dataLength  = SDO_BLOCK_LEN;
-                ODF_arg->lastSegment = false;
-            } else { // last segement
-                ODF_arg->dataLength  = bytes_left;
-                ODF_arg->lastSegment = true;
-            }
+            os_command_segment(ODF_arg);
 
-            memcpy(ODF_arg->data, &data->reply_buf[ODF_arg->offset],
-                   ODF_arg->dataLength);
+            os_command_copy(job, ODF_arg->offset, ODF_arg->data,
+                            ODF_arg->dataLength);
+        } else {
+            return CO_SDO_AB_READONLY;
+        }
+
+        break;
+
+    case OD_1023_4_OSCommand_jobId: // uint8, readwrite
+        if (ODF_arg->reading) {
+            CO_setUint8(ODF_arg->data, data->job_id);
         } else {
+            if (CO_getUint8(ODF_arg->data) >= OS_COMMAND_JOBS)
+                return CO_SDO_AB_VALUE_HIGH; // no such job
+
+            data->job_id = CO_getUint8(ODF_arg->data);
+        }
+
+        break;
+
+    case OD_1023_5_OSCommand_exitCode: // int32, readonly
+        CO_setUint32(ODF_arg->data, (uint32_t)job->exit_code);
+        break;
+
+    case OD_1023_6_OSCommand_jobsRunning: // uint8, readonly
+        count = 0;
+        for (int i = 0; i < OS_COMMAND_JOBS; ++i) {
+            if (data->jobs[i].status == os_cmd_executing)
+                ++count;
+        }
+
+        CO_setUint8(ODF_arg->data, count);
+        break;
+
+    case OD_1023_7_OSCommand_freeJob: // uint8, readonly
+        // the first job not executing, so it can be selected for a command
+        count = 0;
+        while (count < OS_COMMAND_JOBS
+               && data->jobs[count].status == os_cmd_executing)
+            ++count;
+
+        CO_setUint8(ODF_arg->data, count < OS_COMMAND_JOBS ? count : 0xFF);
+        break;
+
+    case OD_1023_8_OSCommand_replyStream: // domain, readonly
+        // the reply so far, taken out of the ring, so it can be read while the
+        // command runs and the ring does not fill up
+        if (!ODF_arg->reading)
             return CO_SDO_AB_READONLY;
+
+        if (ODF_arg->firstSegment) {
+            if (job->reply_head == job->reply_tail)
+                return CO_SDO_AB_NO_DATA; // none yet, or all read if done
+
+            ODF_arg->offset          = 0;
+            ODF_arg->dataLengthTotal = job->reply_head - job->reply_tail;
         }
 
+        os_command_segment(ODF_arg);
+
+        os_command_copy(job, ODF_arg->offset, ODF_arg->data,
+                        ODF_arg->dataLength);
+
+        if (ODF_arg->lastSegment) {
+            job->reply_tail += ODF_arg->dataLengthTotal;
+            if (job->reply_paused && job->cmd.fd >= 0)
+                os_command_pause(data, job, false); // there is room now
+            job->reply_streamed = true; // so no more output is dropped
+        }
+
+        break;
+
+    case OD_1023_9_OSCommand_replyCursor: // uint32, readonly
+        CO_setUint32(ODF_arg->data, job->reply_tail);
+        break;
+
+    case OD_1023_10_OSCommand_cancel: // domain, writeonly
+        if (ODF_arg->reading)
+            return CO_SDO_AB_WRITEONLY;
+        if (job->status != os_cmd_executing)
+            return CO_SDO_AB_DATA_DEV_STATE; // nothing to cancel
+
+        // killed by the async thread, as it reads and reaps the command
+        job->cancel = true;
         break;
     }
 
@@ -13,25 +13,117 @@
 #define OS_COMMAND_H
 
 #include "CANopen.h"
+#include "olm_cmd.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+/**
+ * The number of command jobs. Job 0 is the default job, the one the CiA 301
+ * subindexes use until another is selected.
+ */
+#define OS_COMMAND_JOBS 4
+
+/** A command job, with its own command and reply. */
 typedef struct {
     /** Bash command buffer. */
     char *command;
     /** Lenght of the Bash command buffer. */
     int command_len;
-    /** Reply buffer. */
+    /** Reply ring buffer. */
     char *reply_buf;
-    /** Reply buffer length. */
+    /** Reply ring buffer length, a power of 2. */
     uint32_t reply_buf_len;
-    /** Reply length in the buffer. */
-    uint32_t reply_len;
+    /** Bytes of the reply put in the ring so far. */
+    uint32_t reply_head;
+    /**
+     * Bytes of the reply taken out of the ring so far by streaming reads, the
+     * read cursor. The ring has the reply from it to the head.
+     */
+    uint32_t reply_tail;
+    /**
+     * True if the ring is full and stdout is not read until there is room,
+     * so the command blocks on it.
+     */
+    bool reply_paused;
+    /**
+     * True once the reply was read with the stream subindex. Until then the
+     * default job drops output past a full ring instead of pausing, as a
+     * CiA 301 client only reads the reply once the command is done.
+     */
+    bool reply_streamed;
+    /**
+     * Bytes of the reply dropped past a full ring, by the default job only.
+     * If any were, the status is an error, so a client can tell it was cut
+     * short.
+     */
+    uint32_t reply_dropped;
+    /** Set by the cancel subindex, so the async thread kills the command. */
+    bool cancel;
+    /** The CiA 301 status of the job. */
+    uint8_t status;
+    /** The exit status, or the negative signal number if it was killed. */
+    int32_t exit_code;
+    /** The running command, if any. */
+    olm_cmd_t cmd;
+} os_command_job_t;
+
+#define OS_COMMAND_JOB_DEFAULT                                                 \
+    {                                                                          \
+        .command = NULL, .command_len = 0, .reply_buf = NULL,                  \
+        .reply_buf_len = 0, .reply_head = 0, .reply_tail = 0,                  \
+        .reply_paused = false, .reply_streamed = false, .reply_dropped = 0,    \
+        .cancel = false,                                                       \
+        .status = 0, .exit_code = 0, .cmd = OLM_CMD_INITIALIZER,               \
+    }
+
+typedef struct {
+    /** The jobs. */
+    os_command_job_t jobs[OS_COMMAND_JOBS];
+    /** The job the command, status, reply and exit code subindexes use. */
+    uint8_t job_id;
+    /** Epoll set of the running commands' stdout, -1 until the first one. */
+    int epoll_fd;
 } os_command_t;
 
+#define OS_COMMAND_DEFAULT                                                     \
+    {                                                                          \
+        .jobs = {OS_COMMAND_JOB_DEFAULT, OS_COMMAND_JOB_DEFAULT,               \
+                 OS_COMMAND_JOB_DEFAULT, OS_COMMAND_JOB_DEFAULT},              \
+        .job_id = 0, .epoll_fd = -1,                                           \
+    }
+
+/**
+ * @brief Kill the commands of the jobs that were canceled, start the jobs in
+ * the executing state, and take the output the running ones have so far, as
+ * much as their reply rings have room for. Never waits on the commands, so it
+ * can be called from a loop that has other work.
+ *
+ * @param data The OS command data.
+ */
 void
 co_command_async(os_command_t *data);
 
+/**
+ * @brief Wait for output from the running commands, or for one to exit, up
+ * to a timeout, so it is read as it comes. Sleeps for the timeout if there is
+ * no command running.
+ *
+ * @param data The OS command data.
+ * @param timeout_us The max time to wait, in microseconds.
+ */
+void
+os_command_wait(os_command_t *data, uint32_t timeout_us);
+
+/**
+ * @brief Kill the running commands, if any, and free all data in a
+ * @ref os_command_t object.
+ *
+ * @param data The OS command data.
+ */
+void
+os_command_free(os_command_t *data);
+
 CO_SDO_abortCode_t
 OS_COMMAND_1023_ODF(CO_ODF_arg_t *ODF_arg);
 
@@ -87,7 +87,7 @@ static CO_time_t CO_time; /* Object for current time */
 
 /* OLM globals  **************************************************************/
 static olm_configs_t     configs = OLM_CONFIGS_DEFAULT;
-static os_command_t      os_command_data;
+static os_command_t      os_command_data = OS_COMMAND_DEFAULT;
 static olm_file_cache_t *fread_cache  = NULL;
 static olm_file_cache_t *fwrite_cache = NULL;
 static system_info_t     system_info  = SYSTEM_INFO_DEFAULT;
@@ -115,6 +115,17 @@ static pthread_t async_thread_id;
 int
 make_daemon(const char *pid_file);
 
+/* file cache inotify watches */
+static void
+cache_watch_add(CO_epoll_t *ep, olm_file_cache_t *cache);
+static void
+cache_watch_process(CO_epoll_t *ep, olm_file_cache_t *cache);
+
+/* file cache budgets from the conf file */
+static void
+cache_configs_apply(olm_file_cache_t *   cache,
+                    olm_cache_configs_t *cache_configs);
+
 /* Signal handler */
 volatile sig_atomic_t CO_endProgram = 0;
 static void
@@ -299,19 +310,26 @@ main(int argc, char *argv[]) {
         != 0)
         log_printf(LOG_CRIT, "failed to make fwrite tmp dir " FWRITE_TMP_DIR);
 
-    // clean up any file in the tmp dirs
+    // clean up any file in the fread tmp dir, partial fwrites can be resumed
     clear_dir(FREAD_TMP_DIR);
-    clear_dir(FWRITE_TMP_DIR);
 
     // file transfer data
     olm_file_cache_new(FREAD_CACHE_DIR, &fread_cache);
     olm_file_cache_new(FWRITE_CACHE_DIR, &fwrite_cache);
-    CO_fstream_t CO_fread_data
-        = CO_FSTREAM_INITALIZER(FREAD_TMP_DIR, fread_cache);
-    CO_fstream_t CO_fwrite_data
-        = CO_FSTREAM_INITALIZER(FWRITE_TMP_DIR, fwrite_cache);
+    cache_configs_apply(fread_cache, &configs.fread_cache);
+    cache_configs_apply(fwrite_cache, &configs.fwrite_cache);
+    CO_fstreams_t CO_fread_data
+        = CO_FSTREAMS_INITALIZER(FREAD_TMP_DIR, fread_cache, NULL);
+    CO_fstreams_t CO_fwrite_data
+        = CO_FSTREAMS_INITALIZER(FWRITE_TMP_DIR, fwrite_cache, fread_cache);
     file_caches_t caches_odf_data
         = FILE_CACHES_INTIALIZER(fread_cache, fwrite_cache);
+    CO_fread_data.bulk.cob_id = configs.bulk_cob_id != 0
+                                    ? configs.bulk_cob_id
+                                    : CO_bulk_cob_id_default(configs.node_id);
+    if (CO_fread_data.bulk.cob_id == 0)
+        log_printf(LOG_NOTICE, "no bulk COB-ID for node 0x%X, set BulkCobId",
+                   configs.node_id);
 
     /* Run as daemon if needed */
     if (daemon_flag) {
@@ -333,6 +351,25 @@ main(int argc, char *argv[]) {
                 += configs.node_id + i / 4;
     }
 
+    // give the extra SDO servers the COB-IDs after the default SDO server's,
+    // while they are in the SDO range, past it they are other nodes' ones
+    for (unsigned int i = 1; i < CO_NO_SDO_SERVER; i++) {
+        if (OD_SDOServerParameter[i].COB_IDClientToServer != 0x80000000L
+            || OD_SDOServerParameter[i].COB_IDServerToClient != 0x80000000L)
+            continue;
+
+        if (configs.node_id + i > 0x7F) {
+            log_printf(LOG_NOTICE, "SDO server %u disabled, no COB-IDs left",
+                       i);
+            continue;
+        }
+
+        OD_SDOServerParameter[i].COB_IDClientToServer
+            = 0x600 + configs.node_id + i;
+        OD_SDOServerParameter[i].COB_IDServerToClient
+            = 0x580 + configs.node_id + i;
+    }
+
     log_printf(LOG_INFO, DBG_CAN_OPEN_INFO, configs.node_id, "starting");
 
     if (sd_bus_open_system(&system_bus) < 0)
@@ -373,6 +410,10 @@ main(int argc, char *argv[]) {
     }
     CANptr.epoll_fd = epRT.epoll_fd;
 
+    // keep the caches in sync with files other processes add or remove
+    cache_watch_add(&epMain, fread_cache);
+    cache_watch_add(&epMain, fwrite_cache);
+
     if (cpufreq_ctrl) {
         CO_LOCK_OD();
         OD_OLMControl.CPUFrequency = true;
@@ -485,7 +526,8 @@ main(int argc, char *argv[]) {
             firstRun = false;
 
             /* Create rt_thread and set priority */
-            if (pthread_create(&rt_thread_id, NULL, rt_thread, NULL) != 0) {
+            if (pthread_create(&rt_thread_id, NULL, rt_thread,
+                               &CO_fread_data.bulk) != 0) {
                 log_printf(LOG_CRIT, DBG_ERRNO, "pthread_create(rt_thread)");
                 programExit   = EXIT_FAILURE;
                 CO_endProgram = 1;
@@ -532,6 +574,8 @@ main(int argc, char *argv[]) {
             /* loop for normal program execution
              * ******************************************/
             CO_epoll_wait(&epMain);
+            cache_watch_process(&epMain, fread_cache);
+            cache_watch_process(&epMain, fwrite_cache);
             CO_epoll_processRT(&epMain, CO, false);
             CO_epoll_processMain(&epMain, CO, &reset);
             CO_epoll_processLast(&epMain);
@@ -548,13 +592,8 @@ main(int argc, char *argv[]) {
 
     // make sure the files are closed when ending program
     log_printf(LOG_DEBUG, "closing any opened files");
-    CO_fstream_reset(&CO_fread_data);
-    CO_fstream_reset(&CO_fwrite_data);
-
-    log_printf(LOG_DEBUG, "cleaning cache data");
-    file_caches_free(&caches_odf_data);
-    olm_file_cache_free(fread_cache);
-    olm_file_cache_free(fwrite_cache);
+    CO_fstreams_close(&CO_fread_data);
+    CO_fstreams_close(&CO_fwrite_data);
 
     if (!firstRun) {
         log_printf(LOG_DEBUG, "joining threads");
@@ -568,6 +607,15 @@ main(int argc, char *argv[]) {
             log_printf(LOG_CRIT, DBG_ERRNO, "pthread_join()");
     }
 
+    // after the threads are joined, as the async thread runs the command
+    os_command_free(&os_command_data);
+
+    // after the threads are joined, as they use the caches
+    log_printf(LOG_DEBUG, "cleaning cache data");
+    file_caches_free(&caches_odf_data);
+    olm_file_cache_free(fread_cache);
+    olm_file_cache_free(fwrite_cache);
+
     if (system_bus != NULL)
         sd_bus_unref(system_bus);
 
@@ -599,7 +647,7 @@ main(int argc, char *argv[]) {
  ******************************************************************************/
 static void *
 rt_thread(void *arg) {
-    (void)arg;
+    CO_bulk_t *bulk = arg;
     log_printf(LOG_DEBUG, "rt thread started");
 
     /* Endless loop */
@@ -607,6 +655,12 @@ rt_thread(void *arg) {
 
         CO_epoll_wait(&epRT);
         CO_epoll_processRT(&epRT, CO, true);
+
+        /* Send the fread bulk stream frames, not while the node is stopped. */
+        if (!CO->nodeIdUnconfigured && CO->CANmodule[0]->CANnormal
+            && CO_NMT_getInternalState(CO->NMT) != CO_NMT_STOPPED)
+            CO_bulk_process(bulk, CO->CANmodule[0]);
+
         CO_epoll_processLast(&epRT);
 
 #if (CO_CONFIG_TRACE) & CO_CONFIG_TRACE_ENABLE
@@ -645,20 +699,73 @@ app_thread(void *arg) {
 
 static void *
 async_thread(void *arg) {
+    struct timespec ts;
+    uint64_t        now, next_info = 0;
+
     (void)arg;
     log_printf(LOG_DEBUG, "async thread started");
 
     /* Endless loop */
     while (CO_endProgram == 0) {
-        system_info_async(&system_info);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+        // on its own schedule, as command output wakes the thread up early
+        if (now >= next_info) {
+            system_info_async(&system_info);
+            next_info = now + ASYNC_DELAY;
+        }
+
         co_command_async(&os_command_data);
-        usleep(ASYNC_DELAY);
+        os_command_wait(&os_command_data, next_info - now); // wakes on output
     }
 
     log_printf(LOG_DEBUG, "async thread ended");
     return NULL;
 }
 
+static void
+cache_watch_add(CO_epoll_t *ep, olm_file_cache_t *cache) {
+    struct epoll_event ev;
+
+    if (cache == NULL || cache->watch_fd < 0) {
+        log_printf(LOG_ERR, "file cache is not being watched");
+        return;
+    }
+
+    ev.events  = EPOLLIN;
+    ev.data.fd = cache->watch_fd;
+    if (epoll_ctl(ep->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+        log_printf(LOG_CRIT, DBG_ERRNO, "epoll_ctl(cache watch_fd)");
+}
+
+static void
+cache_watch_process(CO_epoll_t *ep, olm_file_cache_t *cache) {
+    int r;
+
+    if (!ep->epoll_new || cache == NULL || ep->ev.data.fd != cache->watch_fd)
+        return;
+
+    if ((r = olm_file_cache_sync(cache)) < 0)
+        log_printf(LOG_ERR, "olm_file_cache_sync() for %s failed: %d",
+                   cache->dir, r);
+
+    ep->epoll_new = false;
+}
+
+static void
+cache_configs_apply(olm_file_cache_t *   cache,
+                    olm_cache_configs_t *cache_configs) {
+    if (cache == NULL)
+        return;
+
+    for (uint8_t i = 0; i < cache_configs->keywords_len; ++i)
+        olm_file_cache_set_budget(cache, cache_configs->keywords[i].keyword,
+                                  &cache_configs->keywords[i].budget);
+    olm_file_cache_set_budget(cache, NULL, &cache_configs->budget);
+    olm_file_cache_set_eviction(cache, cache_configs->evict);
+}
+
 int
 make_daemon(const char *pid_file) {
     FILE *run_fp = NULL;
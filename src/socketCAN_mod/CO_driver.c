@@ -768,6 +768,35 @@ CO_ReturnError_t CO_CANsend(CO_CANmodule_t *CANmodule, CO_CANtx_t *buffer)
 #endif /* CO_DRIVER_MULTI_INTERFACE == 0 */
 
 
+/******************************************************************************/
+CO_ReturnError_t CO_CANtrySend(CO_CANmodule_t *CANmodule, CO_CANtx_t *buffer)
+{
+    CO_CANinterface_t *interface;
+    ssize_t n;
+
+    if (CANmodule==NULL || buffer==NULL || CANmodule->CANinterfaceCount==0) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    interface = &CANmodule->CANinterfaces[0];
+    if (interface->fd < 0) {
+        return CO_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    n = send(interface->fd, buffer, CAN_MTU, MSG_DONTWAIT);
+    if (n == CAN_MTU) {
+        return CO_ERROR_NO;
+    }
+    else if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == ENOBUFS)) {
+        /* the caller sends it again later */
+        return CO_ERROR_TX_BUSY;
+    }
+
+    log_printf(LOG_DEBUG, DBG_ERRNO, "send()");
+    return CO_ERROR_SYSCALL;
+}
+
+
 /******************************************************************************/
 void CO_CANclearPendingSyncPDOs(CO_CANmodule_t *CANmodule)
 {
@@ -447,6 +447,25 @@ CO_ReturnError_t CO_CANtxBuffer_setInterface(CO_CANmodule_t *CANmodule,
 #endif /* CO_DRIVER_MULTI_INTERFACE */
 
 
+/**
+ * Send CAN message now or not at all
+ *
+ * Unlike CO_CANsend(), the message does not have to be a buffer from
+ * CO_CANtxBufferInit(). A full socket queue is not counted as an overflow and
+ * the message is not re-sent by CO_CANmodule_process(), the caller keeps it
+ * and tries again later. It is for streams that pace themselves on the
+ * socket queue, like the fread bulk stream. The message is only sent on the
+ * first interface.
+ *
+ * @param CANmodule This object.
+ * @param buffer The message, with ident, DLC and data set.
+ *
+ * @return #CO_ReturnError_t: CO_ERROR_NO, CO_ERROR_ILLEGAL_ARGUMENT,
+ * CO_ERROR_TX_BUSY (socket queue is full) or CO_ERROR_SYSCALL.
+ */
+CO_ReturnError_t CO_CANtrySend(CO_CANmodule_t *CANmodule, CO_CANtx_t *buffer);
+
+
 /**
  * Receives CAN messages from matching epoll event
  *
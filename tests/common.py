@@ -2,8 +2,13 @@
 
 from string import ascii_letters
 from random import choice
+from time import sleep, time
+import struct
 import canopen
 
+# SDO abort code for a value not ready yet, like digests still being read
+SDO_AB_DATA_DEV_STATE = 0x08000022
+
 # python canopen require an eds file, even if it is not used
 EDS_FILE = "../src/boards/generic/object_dictionary/generic.eds"
 
@@ -20,6 +25,9 @@ FREAD_FILE2 = "test_read_456.txt"
 # file must not exist in fread cache
 FREAD_FILE3 = "test_read_789.txt"
 
+# file removed from the fread cache dir while it is being read
+FREAD_PIN_FILE = "test_pin_123.txt"
+
 # require files for file caches tests
 FCACHES_FREAD_VALID_FILES = [
     "test_foo_123.txt",
@@ -36,6 +44,24 @@ FCACHES_FREAD_INVALID_FILES = [
     ]
 FCACHES_FREAD_EMPTY_FILE = "test_foo_456"
 
+# file added to and removed from the fread cache dir while OLM is running
+FCACHES_FREAD_SYNC_FILE = "test_sync_123.txt"
+
+# files added to the fread cache dir to test eviction, oldest to newest
+FCACHES_FREAD_EVICT_FILES = [
+    "test_evict_123.txt",
+    "test_evict_456.txt",
+    "test_evict_789.txt",
+    ]
+
+# files added to the fread cache dir to test bulk deletes, oldest to newest
+FCACHES_FREAD_BULK_FILES = [
+    "test_bulk_100.txt",
+    "test_bulk_200.txt",
+    "test_bulk_300.txt",
+    "test_bulk_400.txt",
+    ]
+
 
 def connect_bus():
     """quick function to connect to can bus"""
@@ -49,7 +75,94 @@ def connect_bus():
     return network, node
 
 
+def read_when_ready(variable, timeout: float = 5.0):
+    """Read a subindex, trying again while the node aborts with
+    SDO_AB_DATA_DEV_STATE as the value is still being worked out"""
+
+    end = time() + timeout
+    while True:
+        try:
+            return variable.raw
+        except canopen.SdoAbortedError as exc:
+            if exc.code != SDO_AB_DATA_DEV_STATE or time() > end:
+                raise
+        sleep(0.01)
+
+
 def random_string_generator(str_size: int):
     "Generates a random str"
 
     return "".join(choice(ascii_letters) for x in range(str_size))
+
+
+def crc32c(data: bytes, crc: int = 0):
+    """CRC-32C (Castagnoli) of data, same as OLM's crc32c()"""
+
+    crc ^= 0xFFFFFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1))
+    return crc ^ 0xFFFFFFFF
+
+
+def make_delta(signatures: bytes, data: bytes):
+    """Make a fwrite delta of data from the signatures of a base file, see
+    olm_delta.h. Only full blocks are matched."""
+
+    block_len, _ = struct.unpack_from("<II", signatures)
+    blocks = {}
+    for i in range((len(signatures) - 8) // 8):
+        weak, strong = struct.unpack_from("<II", signatures, 8 + i * 8)
+        blocks.setdefault(weak, {}).setdefault(strong, i)
+
+    delta = b""
+    literal = b""
+    copy = None  # [first block, count]
+    pos = 0
+    a = b = None
+    while pos < len(data):
+        if pos + block_len > len(data):
+            literal += data[pos:]
+            break
+
+        if a is None:  # start the rolling checksum at pos
+            window = data[pos:pos + block_len]
+            a = sum(window) & 0xFFFF
+            b = sum((block_len - i) * x for i, x in enumerate(window)) & 0xFFFF
+
+        match = None
+        if (a | b << 16) in blocks:
+            match = blocks[a | b << 16].get(
+                crc32c(data[pos:pos + block_len]))
+
+        if match is None:  # roll on one byte
+            literal += data[pos:pos + 1]
+            if pos + block_len < len(data):
+                a = (a - data[pos] + data[pos + block_len]) & 0xFFFF
+                b = (b - block_len * data[pos] + a) & 0xFFFF
+            else:
+                a = None
+            pos += 1
+            continue
+
+        if literal:
+            if copy:
+                delta += struct.pack("<BII", 1, *copy)
+                copy = None
+            delta += struct.pack("<BI", 2, len(literal)) + literal
+            literal = b""
+        if copy and copy[0] + copy[1] == match:
+            copy[1] += 1
+        else:
+            if copy:
+                delta += struct.pack("<BII", 1, *copy)
+            copy = [match, 1]
+        pos += block_len
+        a = None
+
+    if copy:
+        delta += struct.pack("<BII", 1, *copy)
+    if literal:
+        delta += struct.pack("<BI", 2, len(literal)) + literal
+    return delta + struct.pack("<BI", 0, crc32c(data))
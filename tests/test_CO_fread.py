@@ -1,16 +1,59 @@
 """Test OLM CO fread ODF"""
 
+from os import remove
 from os.path import isfile
+from time import sleep
+import hashlib
 import pytest
+import zstandard
 from canopen import SdoAbortedError
 from common import connect_bus, FREAD_CACHE_DIR, FREAD_TMP_DIR, FREAD_FILE, \
-        FREAD_FILE2, FREAD_FILE3
+        FREAD_FILE2, FREAD_FILE3, FREAD_PIN_FILE, random_string_generator, \
+        crc32c, read_when_ready
 
 FREAD_INDEX = 0x3003
 NAME_SUBINDEX = 1
 DATA_SUBINDEX = 2
 RESET_SUBINDEX = 3
 DELETE_SUBINDEX = 4
+OFFSET_SUBINDEX = 5
+LENGTH_SUBINDEX = 6
+CODEC_SUBINDEX = 7
+CODEC_LEVEL_SUBINDEX = 8
+RAW_BYTES_SUBINDEX = 9
+WIRE_BYTES_SUBINDEX = 10
+CRC32C_SUBINDEX = 11
+SHA256_SUBINDEX = 12
+MAX_LATENCY_SUBINDEX = 13
+BULK_CONTROL_SUBINDEX = 14
+BULK_COB_ID_SUBINDEX = 15
+BULK_WINDOW_SUBINDEX = 16
+BULK_BURST_SUBINDEX = 17
+BULK_ACK_SUBINDEX = 18
+BULK_RESEND_SUBINDEX = 19
+BULK_SENT_SUBINDEX = 20
+BULK_RESENT_SUBINDEX = 21
+RANGE_LENGTH_SUBINDEX = 22
+BYTES_TOTAL_SUBINDEX = 23
+SEGMENTS_SUBINDEX = 24
+RATE_SUBINDEX = 25
+AVERAGE_RATE_SUBINDEX = 26
+IDLE_TIME_SUBINDEX = 27
+ABORTS_SUBINDEX = 28
+
+BULK_IDLE = 0
+BULK_STREAMING = 1
+BULK_DONE = 2
+
+FILE_CACHES_INDEX = 0x3002
+CACHES_SELECTOR_SUBINDEX = 3
+CACHES_FILTER_SUBINDEX = 4
+CACHES_LEN_SUBINDEX = 5
+CACHES_ITERATOR_SUBINDEX = 6
+CACHES_NAME_SUBINDEX = 7
+
+CODEC_NONE = 0
+CODEC_ZSTD = 2
 
 
 def test_fread_name():
@@ -65,6 +108,356 @@ def test_fread_data():
     with open(FREAD_CACHE_DIR + FREAD_FILE2, "r") as fptr:
         assert fptr.read() == file2_data
 
+    # a file is pinned once selected, so it can be read after it is removed
+    pin_data = random_string_generator(5000)
+    with open(FREAD_CACHE_DIR + FREAD_PIN_FILE, "w") as fptr:
+        fptr.write(pin_data)
+    sleep(0.5)
+    name_subindex.raw = FREAD_PIN_FILE.encode("utf-8")
+    remove(FREAD_CACHE_DIR + FREAD_PIN_FILE)
+    assert data_subindex.raw.decode("utf-8") == pin_data
+    assert data_subindex.raw.decode("utf-8") == pin_data
+
+    network.disconnect()
+
+
+def test_fread_offset():
+    """Test the offset (uint32, readwrite) and length (uint32, readonly)
+    subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FREAD_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FREAD_INDEX][DATA_SUBINDEX]
+    offset_subindex = node.sdo[FREAD_INDEX][OFFSET_SUBINDEX]
+    length_subindex = node.sdo[FREAD_INDEX][LENGTH_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        length_subindex.phys = 0
+
+    name_subindex.raw = FREAD_FILE2.encode("utf-8")
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "r") as fptr:
+        file_data = fptr.read()
+    assert length_subindex.phys == len(file_data)
+    assert offset_subindex.phys == 0
+
+    # resume a read from the middle of the file
+    offset_subindex.phys = len(file_data) // 2
+    assert data_subindex.raw.decode("utf-8") == \
+        file_data[len(file_data) // 2:]
+
+    # offset past the end of the file
+    with pytest.raises(SdoAbortedError):
+        offset_subindex.phys = len(file_data) + 1
+
+    # a new file starts from the start
+    name_subindex.raw = FREAD_FILE.encode("utf-8")
+    assert offset_subindex.phys == 0
+
+    network.disconnect()
+
+
+def test_fread_range():
+    """Test the range length subindex (uint32, readwrite)."""
+    network, node = connect_bus()
+    sdo = node.sdo[FREAD_INDEX]
+    caches = node.sdo[FILE_CACHES_INDEX]
+
+    # no file selected
+    sdo[RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        sdo[RANGE_LENGTH_SUBINDEX].phys = 10
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        file_data = fptr.read()
+
+    # pick the file from the fread cache listing of its keyword
+    caches[CACHES_SELECTOR_SUBINDEX].phys = 0
+    caches[CACHES_FILTER_SUBINDEX].raw = "read".encode("utf-8")
+    for i in range(caches[CACHES_LEN_SUBINDEX].phys):
+        caches[CACHES_ITERATOR_SUBINDEX].phys = i
+        name = caches[CACHES_NAME_SUBINDEX].raw.decode("utf-8")
+        if name.replace('\0', '') == FREAD_FILE2:
+            break
+    caches[CACHES_FILTER_SUBINDEX].raw = b'\00'  # clear filter
+    sdo[NAME_SUBINDEX].raw = name.encode("utf-8")
+    assert sdo[RANGE_LENGTH_SUBINDEX].phys == 0
+
+    # the head, a slice from the middle and the tail
+    sdo[RANGE_LENGTH_SUBINDEX].phys = 10
+    assert sdo[DATA_SUBINDEX].raw == file_data[:10]
+    sdo[OFFSET_SUBINDEX].phys = 100
+    sdo[RANGE_LENGTH_SUBINDEX].phys = 1000
+    assert sdo[DATA_SUBINDEX].raw == file_data[100:1100]
+    sdo[OFFSET_SUBINDEX].phys = len(file_data) - 50
+    assert sdo[DATA_SUBINDEX].raw == file_data[-50:]
+
+    # compressed slice
+    sdo[OFFSET_SUBINDEX].phys = 100
+    sdo[CODEC_SUBINDEX].phys = CODEC_ZSTD
+    data = zstandard.ZstdDecompressor().decompressobj().decompress(
+        sdo[DATA_SUBINDEX].raw)
+    assert data == file_data[100:1100]
+    assert sdo[RAW_BYTES_SUBINDEX].phys == 1000
+    sdo[CODEC_SUBINDEX].phys = CODEC_NONE
+
+    # 0 is the rest of the file, and a new file is read whole
+    sdo[RANGE_LENGTH_SUBINDEX].phys = 0
+    assert sdo[DATA_SUBINDEX].raw == file_data[100:]
+    sdo[RANGE_LENGTH_SUBINDEX].phys = 10
+    sdo[NAME_SUBINDEX].raw = FREAD_FILE2.encode("utf-8")
+    assert sdo[RANGE_LENGTH_SUBINDEX].phys == 0
+
+    network.disconnect()
+
+
+def test_fread_codec():
+    """Test the codec (uint8, readwrite), codec level (uint8, readwrite), raw
+    bytes (uint32, readonly) and wire bytes (uint32, readonly) subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FREAD_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FREAD_INDEX][DATA_SUBINDEX]
+    codec_subindex = node.sdo[FREAD_INDEX][CODEC_SUBINDEX]
+    level_subindex = node.sdo[FREAD_INDEX][CODEC_LEVEL_SUBINDEX]
+    raw_subindex = node.sdo[FREAD_INDEX][RAW_BYTES_SUBINDEX]
+    wire_subindex = node.sdo[FREAD_INDEX][WIRE_BYTES_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        raw_subindex.phys = 0
+    with pytest.raises(SdoAbortedError):
+        wire_subindex.phys = 0
+
+    # unknown codec and level
+    with pytest.raises(SdoAbortedError):
+        codec_subindex.phys = 3
+    with pytest.raises(SdoAbortedError):
+        level_subindex.phys = 20
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        file_data = fptr.read()
+
+    # read a compressed file
+    codec_subindex.phys = CODEC_ZSTD
+    level_subindex.phys = 3
+    name_subindex.raw = FREAD_FILE2.encode("utf-8")
+    wire_data = data_subindex.raw
+    dctx = zstandard.ZstdDecompressor()
+    assert dctx.decompressobj().decompress(wire_data) == file_data
+    assert raw_subindex.phys == len(file_data)
+    assert wire_subindex.phys == len(wire_data)
+
+    # the codec is kept for the next file, until a reset
+    name_subindex.raw = FREAD_FILE.encode("utf-8")
+    assert codec_subindex.phys == CODEC_ZSTD
+    node.sdo[FREAD_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    assert codec_subindex.phys == CODEC_NONE
+    assert level_subindex.phys == 0
+
+    # without a codec both counters are the file size
+    name_subindex.raw = FREAD_FILE2.encode("utf-8")
+    assert data_subindex.raw == file_data
+    assert raw_subindex.phys == len(file_data)
+    assert wire_subindex.phys == len(file_data)
+
+    network.disconnect()
+
+
+def test_fread_digest():
+    """Test the CRC-32C (uint32, readonly) and SHA-256 (DOMAIN, readonly)
+    subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FREAD_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FREAD_INDEX][DATA_SUBINDEX]
+    crc_subindex = node.sdo[FREAD_INDEX][CRC32C_SUBINDEX]
+    sha_subindex = node.sdo[FREAD_INDEX][SHA256_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        crc_subindex.phys = 0
+    with pytest.raises(SdoAbortedError):
+        sha_subindex.raw = bytes(32)
+
+    # no file selected
+    node.sdo[FREAD_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        crc_subindex.phys
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        file_data = fptr.read()
+
+    # before the file is read they are worked out on a worker thread, after
+    name_subindex.raw = FREAD_FILE2.encode("utf-8")
+    assert read_when_ready(crc_subindex) == crc32c(file_data)
+    assert sha_subindex.raw == hashlib.sha256(file_data).digest()
+    assert data_subindex.raw == file_data
+    assert crc_subindex.phys == crc32c(file_data)
+    assert sha_subindex.raw == hashlib.sha256(file_data).digest()
+
+    network.disconnect()
+
+
+def test_fread_max_latency():
+    """Test the max latency subindex (uint32, readonly)."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FREAD_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FREAD_INDEX][DATA_SUBINDEX]
+    subindex = node.sdo[FREAD_INDEX][MAX_LATENCY_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        subindex.phys = 0
+
+    # the file is read ahead, so no call waits long on the disk
+    name_subindex.raw = FREAD_FILE2.encode("utf-8")
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        assert data_subindex.raw == fptr.read()
+    assert subindex.phys < 100000  # us
+
+    network.disconnect()
+
+
+def test_fread_bulk():
+    """Test streaming a file as raw CAN frames with the bulk subindexes."""
+    network, node = connect_bus()
+    sdo = node.sdo[FREAD_INDEX]
+    frames = {}
+    acked = [0]
+
+    def on_frame(cob_id, data, timestamp):
+        # the sequence number is the frame number mod 256 past the ack
+        frames[acked[0] + ((data[0] - acked[0]) & 0xFF)] = bytes(data[1:])
+
+    # resend is writeonly, frame counters are readonly
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_RESEND_SUBINDEX].raw
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_SENT_SUBINDEX].phys = 0
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_WINDOW_SUBINDEX].phys = 0
+    # restricted, or in the predefined connection set
+    for cob_id in (0x000, 0x080, 0x181, 0x5FC, 0x67C, 0x6E0, 0x6FF, 0x800):
+        with pytest.raises(SdoAbortedError):
+            sdo[BULK_COB_ID_SUBINDEX].phys = cob_id
+
+    # bursts leave room in the CAN queue for the other frames
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_BURST_SUBINDEX].phys = 0
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_BURST_SUBINDEX].phys = 5
+    sdo[BULK_BURST_SUBINDEX].phys = 4
+
+    # no file to stream
+    sdo[RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        sdo[BULK_CONTROL_SUBINDEX].phys = 1
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        file_data = fptr.read()
+    total = (len(file_data) + 6) // 7
+
+    # only node ids up to 0x5F have a default, 0x6E0 and up are restricted
+    cob_id = sdo[BULK_COB_ID_SUBINDEX].phys
+    assert cob_id == (0x680 + node.id if node.id <= 0x5F else 0)
+    cob_id = 0x6C0
+    sdo[BULK_COB_ID_SUBINDEX].phys = cob_id
+    network.subscribe(cob_id, on_frame)
+    sdo[BULK_WINDOW_SUBINDEX].phys = 32
+    sdo[NAME_SUBINDEX].raw = FREAD_FILE2.encode("utf-8")
+    sdo[BULK_ACK_SUBINDEX].phys = 0
+    sdo[BULK_CONTROL_SUBINDEX].phys = 1
+
+    # acknowledge what came in order, asking for the first frames missed
+    data = b""
+    while acked[0] < total:
+        sleep(0.05)
+        while acked[0] in frames:
+            data += frames.pop(acked[0])
+            acked[0] += 1
+        sdo[BULK_ACK_SUBINDEX].phys = acked[0]
+        if acked[0] < total and frames:
+            missed = min(frames) - acked[0]
+            sdo[BULK_RESEND_SUBINDEX].raw = \
+                (missed << 32 | acked[0]).to_bytes(8, "little")
+
+    assert data == file_data
+    assert sdo[BULK_CONTROL_SUBINDEX].phys == BULK_DONE
+    assert sdo[BULK_SENT_SUBINDEX].phys >= total
+
+    # a stop keeps the ack, so a start carries on from it
+    sdo[BULK_ACK_SUBINDEX].phys = 1
+    sdo[BULK_CONTROL_SUBINDEX].phys = 1
+    sdo[BULK_CONTROL_SUBINDEX].phys = 0
+    assert sdo[BULK_CONTROL_SUBINDEX].phys == BULK_IDLE
+    assert sdo[BULK_ACK_SUBINDEX].phys == 1
+
+    network.unsubscribe(cob_id)
+    network.disconnect()
+
+
+def test_fread_progress():
+    """Test the progress subindexes (uint32, readonly)."""
+    network, node = connect_bus()
+    sdo = node.sdo[FREAD_INDEX]
+
+    # readonly
+    for subindex in range(BYTES_TOTAL_SUBINDEX, ABORTS_SUBINDEX + 1):
+        with pytest.raises(SdoAbortedError):
+            sdo[subindex].phys = 0
+
+    aborts = sdo[ABORTS_SUBINDEX].phys
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "rb") as fptr:
+        file_data = fptr.read()
+    sdo[NAME_SUBINDEX].raw = FREAD_FILE2.encode("utf-8")
+    assert sdo[DATA_SUBINDEX].raw == file_data
+    assert sdo[BYTES_TOTAL_SUBINDEX].phys == len(file_data)
+    assert sdo[SEGMENTS_SUBINDEX].phys > 1
+    assert sdo[AVERAGE_RATE_SUBINDEX].phys > 0
+    sleep(0.1)
+    assert sdo[IDLE_TIME_SUBINDEX].phys >= 100
+    assert sdo[ABORTS_SUBINDEX].phys == aborts
+
+    # a transfer with no file selected is aborted
+    sdo[RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        sdo[DATA_SUBINDEX].raw
+    assert sdo[ABORTS_SUBINDEX].phys == aborts + 1
+
+    network.disconnect()
+
+
+def test_fread_sessions():
+    """Test reading two files at the same time on two SDO servers."""
+    network, node = connect_bus()
+    sdo2 = node.add_sdo(0x600 + node.id + 1, 0x580 + node.id + 1)
+
+    node.sdo[FREAD_INDEX][NAME_SUBINDEX].raw = FREAD_FILE.encode("utf-8")
+    sdo2[FREAD_INDEX][NAME_SUBINDEX].raw = FREAD_FILE2.encode("utf-8")
+
+    # each SDO server has its own file selected
+    name = node.sdo[FREAD_INDEX][NAME_SUBINDEX].raw.decode("utf-8")
+    assert name == FREAD_FILE + '\0'
+    name = sdo2[FREAD_INDEX][NAME_SUBINDEX].raw.decode("utf-8")
+    assert name == FREAD_FILE2 + '\0'
+
+    # interleave the transfers
+    data = b""
+    data2 = b""
+    with node.sdo[FREAD_INDEX][DATA_SUBINDEX].open("rb") as fptr, \
+            sdo2[FREAD_INDEX][DATA_SUBINDEX].open("rb") as fptr2:
+        while True:
+            chunk = fptr.read(7)
+            chunk2 = fptr2.read(7)
+            if not chunk and not chunk2:
+                break
+            data += chunk
+            data2 += chunk2
+
+    with open(FREAD_CACHE_DIR + FREAD_FILE, "r") as fptr:
+        assert fptr.read() == data.decode("utf-8")
+    with open(FREAD_CACHE_DIR + FREAD_FILE2, "r") as fptr:
+        assert fptr.read() == data2.decode("utf-8")
+
     network.disconnect()
 
 
@@ -1,15 +1,47 @@
 """Test OLM CO fwrite ODF"""
 
+from os import mkdir, rmdir
 from os.path import isfile
+from time import sleep
+import hashlib
 import pytest
+import zstandard
 from canopen import SdoAbortedError
 from common import connect_bus, FWRITE_CACHE_DIR, FWRITE_TMP_DIR, \
-        random_string_generator
+        random_string_generator, make_delta, crc32c, read_when_ready
 
 FWRITE_INDEX = 0x3004
 NAME_SUBINDEX = 1
 DATA_SUBINDEX = 2
 RESET_SUBINDEX = 3
+OFFSET_SUBINDEX = 4
+LENGTH_SUBINDEX = 5
+CODEC_SUBINDEX = 6
+CODEC_LEVEL_SUBINDEX = 7
+RAW_BYTES_SUBINDEX = 8
+WIRE_BYTES_SUBINDEX = 9
+DELTA_BASE_SUBINDEX = 10
+DELTA_BLOCK_LEN_SUBINDEX = 11
+DELTA_SIGNATURES_SUBINDEX = 12
+CRC32C_SUBINDEX = 13
+SHA256_SUBINDEX = 14
+BYTES_TOTAL_SUBINDEX = 15
+SEGMENTS_SUBINDEX = 16
+RATE_SUBINDEX = 17
+AVERAGE_RATE_SUBINDEX = 18
+IDLE_TIME_SUBINDEX = 19
+ABORTS_SUBINDEX = 20
+
+FILE_CACHES_INDEX = 0x3002
+CACHE_SELECTOR_SUBINDEX = 3
+MAX_BYTES_SUBINDEX = 11
+EVICTION_POLICY_SUBINDEX = 14
+FWRITE_CACHE = 1
+EVICT_NONE = 0
+EVICT_OLDEST = 1
+
+CODEC_NONE = 0
+CODEC_ZSTD = 2
 
 
 def test_fwrite_name():
@@ -76,6 +108,278 @@ def test_fwrite_data():
     network.disconnect()
 
 
+def test_fwrite_resume():
+    """Test the offset (uint32, readwrite) and length (uint32, readonly)
+    subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FWRITE_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FWRITE_INDEX][DATA_SUBINDEX]
+    offset_subindex = node.sdo[FWRITE_INDEX][OFFSET_SUBINDEX]
+    length_subindex = node.sdo[FWRITE_INDEX][LENGTH_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        length_subindex.phys = 0
+
+    new_file = "test_resume_123.txt"
+    file_data = random_string_generator(2000)
+    name_subindex.raw = new_file.encode("utf-8")
+    assert length_subindex.phys == 0
+
+    # can not leave a hole
+    with pytest.raises(SdoAbortedError):
+        offset_subindex.phys = 1
+
+    # a partial file checkpointed before a restart, only the checkpointed
+    # part is kept
+    with open(FWRITE_TMP_DIR + new_file, "w") as fptr:
+        fptr.write(file_data[:1200])
+    with open(FWRITE_TMP_DIR + new_file + ".ckpt", "w") as fptr:
+        fptr.write("1000")
+    name_subindex.raw = new_file.encode("utf-8")
+    assert length_subindex.phys == 1000
+    assert offset_subindex.phys == 0
+
+    # resume it
+    offset = length_subindex.phys
+    offset_subindex.phys = offset
+    data_subindex.raw = file_data[offset:].encode("utf-8")
+    assert isfile(FWRITE_CACHE_DIR + new_file)
+    with open(FWRITE_CACHE_DIR + new_file, "r") as fptr:
+        assert fptr.read() == file_data
+
+    # a file that fails to be added to the cache (a directory is in the way)
+    # is aborted, and it is kept with its checkpoint to resume
+    new_file2 = "test_resume_456.txt"
+    with open(FWRITE_TMP_DIR + new_file2, "w") as fptr:
+        fptr.write(file_data[:1200])
+    with open(FWRITE_TMP_DIR + new_file2 + ".ckpt", "w") as fptr:
+        fptr.write("1000")
+    mkdir(FWRITE_CACHE_DIR + new_file2)
+    name_subindex.raw = new_file2.encode("utf-8")
+    offset_subindex.phys = length_subindex.phys
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = file_data[1000:].encode("utf-8")
+    rmdir(FWRITE_CACHE_DIR + new_file2)
+    assert isfile(FWRITE_TMP_DIR + new_file2 + ".ckpt")
+
+    name_subindex.raw = new_file2.encode("utf-8")
+    offset = length_subindex.phys
+    offset_subindex.phys = offset
+    data_subindex.raw = file_data[offset:].encode("utf-8")
+    assert not isfile(FWRITE_TMP_DIR + new_file2 + ".ckpt")
+    with open(FWRITE_CACHE_DIR + new_file2, "r") as fptr:
+        assert fptr.read() == file_data
+
+    network.disconnect()
+
+
+def test_fwrite_codec():
+    """Test the codec (uint8, readwrite), raw bytes (uint32, readonly) and
+    wire bytes (uint32, readonly) subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FWRITE_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FWRITE_INDEX][DATA_SUBINDEX]
+    codec_subindex = node.sdo[FWRITE_INDEX][CODEC_SUBINDEX]
+    raw_subindex = node.sdo[FWRITE_INDEX][RAW_BYTES_SUBINDEX]
+    wire_subindex = node.sdo[FWRITE_INDEX][WIRE_BYTES_SUBINDEX]
+
+    # unknown codec
+    with pytest.raises(SdoAbortedError):
+        codec_subindex.phys = 3
+
+    # write a compressed file
+    new_file = "test_codec_123.txt"
+    file_data = random_string_generator(100).encode("utf-8") * 50
+    wire_data = zstandard.ZstdCompressor().compress(file_data)
+    codec_subindex.phys = CODEC_ZSTD
+    name_subindex.raw = new_file.encode("utf-8")
+    data_subindex.raw = wire_data
+    assert isfile(FWRITE_CACHE_DIR + new_file)
+    with open(FWRITE_CACHE_DIR + new_file, "rb") as fptr:
+        assert fptr.read() == file_data
+    assert raw_subindex.phys == len(file_data)
+    assert wire_subindex.phys == len(wire_data)
+
+    # data that is not compressed, or cut short, is not added to the cache
+    new_file2 = "test_codec_456.txt"
+    name_subindex.raw = new_file2.encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = file_data
+    name_subindex.raw = new_file2.encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = wire_data[:-4]
+    assert not isfile(FWRITE_CACHE_DIR + new_file2)
+
+    # a frame with a window larger than OLM allows is not decompressed
+    params = zstandard.ZstdCompressionParameters(window_log=24)
+    compressor = zstandard.ZstdCompressor(
+        compression_params=params).compressobj()
+    big_window_data = compressor.compress(file_data) + compressor.flush()
+    name_subindex.raw = new_file2.encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = big_window_data
+    assert not isfile(FWRITE_CACHE_DIR + new_file2)
+
+    node.sdo[FWRITE_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    assert codec_subindex.phys == CODEC_NONE
+
+    network.disconnect()
+
+
+def test_fwrite_delta():
+    """Test the delta base (DOMAIN, readwrite), delta block length (uint32,
+    readwrite) and delta signatures (DOMAIN, readonly) subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FWRITE_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FWRITE_INDEX][DATA_SUBINDEX]
+    base_subindex = node.sdo[FWRITE_INDEX][DELTA_BASE_SUBINDEX]
+    block_len_subindex = node.sdo[FWRITE_INDEX][DELTA_BLOCK_LEN_SUBINDEX]
+    signatures_subindex = node.sdo[FWRITE_INDEX][DELTA_SIGNATURES_SUBINDEX]
+    wire_subindex = node.sdo[FWRITE_INDEX][WIRE_BYTES_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        signatures_subindex.raw = b"0"
+
+    # block length out of range
+    with pytest.raises(SdoAbortedError):
+        block_len_subindex.phys = 63
+    with pytest.raises(SdoAbortedError):
+        block_len_subindex.phys = 65537
+    block_len_subindex.phys = 256
+
+    # upload the base in full
+    base_file = "test_delta_123.txt"
+    base_data = random_string_generator(20000).encode("utf-8")
+    name_subindex.raw = base_file.encode("utf-8")
+    data_subindex.raw = base_data
+
+    # the base needs a file name to be selected first and must exist
+    new_file = "test_delta_456.txt"
+    with pytest.raises(SdoAbortedError):
+        base_subindex.raw = base_file.encode("utf-8")
+    name_subindex.raw = new_file.encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        base_subindex.raw = "test_delta_789.txt".encode("utf-8")
+    base_subindex.raw = base_file.encode("utf-8")
+    assert base_subindex.raw.decode("utf-8") == base_file + '\0'
+
+    # send only what changed
+    new_data = base_data[:5000] + b"changed" + base_data[6000:] + b"more"
+    delta = make_delta(signatures_subindex.raw, new_data)
+    assert len(delta) < len(new_data) // 4
+    data_subindex.raw = delta
+    with open(FWRITE_CACHE_DIR + new_file, "rb") as fptr:
+        assert fptr.read() == new_data
+    assert wire_subindex.phys == len(delta)
+
+    # a delta that does not make the right file is not added to the cache
+    new_file2 = "test_delta_789.txt"
+    name_subindex.raw = new_file2.encode("utf-8")
+    base_subindex.raw = base_file.encode("utf-8")
+    delta = make_delta(signatures_subindex.raw, new_data)
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = delta[:-1] + bytes([delta[-1] ^ 1])
+    assert not isfile(FWRITE_CACHE_DIR + new_file2)
+
+    # nothing can follow the end of the delta, compressed or not
+    name_subindex.raw = new_file2.encode("utf-8")
+    base_subindex.raw = base_file.encode("utf-8")
+    delta = make_delta(signatures_subindex.raw, new_data)
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = delta + b"junk"
+    assert not isfile(FWRITE_CACHE_DIR + new_file2)
+    name_subindex.raw = new_file2.encode("utf-8")
+    base_subindex.raw = base_file.encode("utf-8")
+    node.sdo[FWRITE_INDEX][CODEC_SUBINDEX].phys = CODEC_ZSTD
+    delta = make_delta(signatures_subindex.raw, new_data)
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = zstandard.ZstdCompressor().compress(
+            delta + b"junk")
+    assert not isfile(FWRITE_CACHE_DIR + new_file2)
+
+    node.sdo[FWRITE_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    assert block_len_subindex.phys == 1024
+
+    network.disconnect()
+
+
+def test_fwrite_digest():
+    """Test the CRC-32C (uint32, readonly) and SHA-256 (DOMAIN, readonly)
+    subindexes."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FWRITE_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FWRITE_INDEX][DATA_SUBINDEX]
+    offset_subindex = node.sdo[FWRITE_INDEX][OFFSET_SUBINDEX]
+    crc_subindex = node.sdo[FWRITE_INDEX][CRC32C_SUBINDEX]
+    sha_subindex = node.sdo[FWRITE_INDEX][SHA256_SUBINDEX]
+
+    # readonly
+    with pytest.raises(SdoAbortedError):
+        crc_subindex.phys = 0
+    with pytest.raises(SdoAbortedError):
+        sha_subindex.raw = bytes(32)
+
+    # nothing written
+    node.sdo[FWRITE_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        crc_subindex.phys
+
+    # a partial file checkpointed before a restart
+    new_file = "test_digest_123.txt"
+    file_data = random_string_generator(3000).encode("utf-8")
+    with open(FWRITE_TMP_DIR + new_file, "wb") as fptr:
+        fptr.write(file_data[:1000])
+    with open(FWRITE_TMP_DIR + new_file + ".ckpt", "w") as fptr:
+        fptr.write("1000")
+    name_subindex.raw = new_file.encode("utf-8")
+    assert read_when_ready(crc_subindex) == crc32c(file_data[:1000])
+    assert sha_subindex.raw == hashlib.sha256(file_data[:1000]).digest()
+
+    # resume it, the digests are of the whole file after
+    offset_subindex.phys = 1000
+    data_subindex.raw = file_data[1000:]
+    assert isfile(FWRITE_CACHE_DIR + new_file)
+    assert crc_subindex.phys == crc32c(file_data)
+    assert sha_subindex.raw == hashlib.sha256(file_data).digest()
+
+    network.disconnect()
+
+
+def test_fwrite_budget():
+    """Test a file over the fwrite cache budget is refused at the first
+    segment, before any of it is written."""
+    network, node = connect_bus()
+    name_subindex = node.sdo[FWRITE_INDEX][NAME_SUBINDEX]
+    data_subindex = node.sdo[FWRITE_INDEX][DATA_SUBINDEX]
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    max_bytes_subindex = node.sdo[FILE_CACHES_INDEX][MAX_BYTES_SUBINDEX]
+    policy_subindex = node.sdo[FILE_CACHES_INDEX][EVICTION_POLICY_SUBINDEX]
+
+    selector_subindex.phys = FWRITE_CACHE
+    max_bytes_subindex.phys = 1000
+    policy_subindex.phys = EVICT_OLDEST
+
+    # too big to ever be under the budget
+    new_file = "test_budget_123.txt"
+    name_subindex.raw = new_file.encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        data_subindex.raw = random_string_generator(2000).encode("utf-8")
+    assert not isfile(FWRITE_CACHE_DIR + new_file)
+
+    # fits
+    new_file = "test_budget_124.txt"
+    name_subindex.raw = new_file.encode("utf-8")
+    data_subindex.raw = random_string_generator(500).encode("utf-8")
+    assert isfile(FWRITE_CACHE_DIR + new_file)
+
+    policy_subindex.phys = EVICT_NONE
+    max_bytes_subindex.phys = 0
+    node.sdo[FWRITE_INDEX][RESET_SUBINDEX].raw = "0".encode("utf-8")
+    network.disconnect()
+
+
 def test_fwrite_reset():
     """Test if the reset subindex (DOMAIN, writeonly)"""
     network, node = connect_bus()
@@ -105,3 +409,34 @@ def test_fwrite_reset():
         node.sdo[FWRITE_INDEX][NAME_SUBINDEX].raw
 
     network.disconnect()
+
+
+def test_fwrite_progress():
+    """Test the progress subindexes (uint32, readonly)."""
+    network, node = connect_bus()
+    sdo = node.sdo[FWRITE_INDEX]
+
+    # readonly
+    for subindex in range(BYTES_TOTAL_SUBINDEX, ABORTS_SUBINDEX + 1):
+        with pytest.raises(SdoAbortedError):
+            sdo[subindex].phys = 0
+
+    aborts = sdo[ABORTS_SUBINDEX].phys
+
+    sdo[NAME_SUBINDEX].raw = "test_write_progress.txt".encode("utf-8")
+    file_data = random_string_generator(5000).encode("utf-8")
+    sdo[DATA_SUBINDEX].raw = file_data
+    assert sdo[BYTES_TOTAL_SUBINDEX].phys == len(file_data)
+    assert sdo[SEGMENTS_SUBINDEX].phys > 1
+    assert sdo[AVERAGE_RATE_SUBINDEX].phys > 0
+    sleep(0.1)
+    assert sdo[IDLE_TIME_SUBINDEX].phys >= 100
+    assert sdo[ABORTS_SUBINDEX].phys == aborts
+
+    # a transfer with no file selected is aborted
+    sdo[RESET_SUBINDEX].raw = "0".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        sdo[DATA_SUBINDEX].raw = file_data
+    assert sdo[ABORTS_SUBINDEX].phys == aborts + 1
+
+    network.disconnect()
@@ -1,9 +1,14 @@
 """Test OLM file caches ODF"""
 
+from os import remove, rename
+from time import sleep
 import pytest
 from canopen import SdoAbortedError
 from common import connect_bus, FCACHES_FREAD_VALID_FILES, \
-        FCACHES_FREAD_INVALID_FILES, FCACHES_FREAD_EMPTY_FILE
+        FCACHES_FREAD_INVALID_FILES, FCACHES_FREAD_EMPTY_FILE, \
+        FCACHES_FREAD_SYNC_FILE, FCACHES_FREAD_EVICT_FILES, \
+        FCACHES_FREAD_BULK_FILES, FREAD_CACHE_DIR, FILE_TRANSFER_DIR, \
+        random_string_generator
 
 FILE_CACHES_INDEX = 0x3002
 FREAD_CACHE_LEN_SUBINDEX = 1
@@ -15,11 +20,28 @@ ITERATOR_SUBINDEX = 6
 NAME_SUBINDEX = 7
 SIZE_SUBINDEX = 8
 DELETE_SUBINDEX = 9
+CACHE_BYTES_SUBINDEX = 10
+MAX_BYTES_SUBINDEX = 11
+MAX_FILES_SUBINDEX = 12
+KEYWORD_PRIORITY_SUBINDEX = 13
+EVICTION_POLICY_SUBINDEX = 14
+FREE_BYTES_SUBINDEX = 15
+DELETE_FILTERED_SUBINDEX = 16
+DELETE_BEFORE_SUBINDEX = 17
+KEEP_NEWEST_SUBINDEX = 18
+WINDOW_START_SUBINDEX = 19
+WINDOW_END_SUBINDEX = 20
 
 # valid cache selector inputs
 FREAD_CACHE = 0
 FWRITE_CACHE = 1
 
+# valid eviction policy inputs
+EVICT_NONE = 0
+EVICT_OLDEST = 1
+EVICT_PRIORITY = 2
+EVICT_LRU = 3
+
 
 def test_fread_cache_len():
     """Test the fread cache length subindex  (uint8, readonly)."""
@@ -250,3 +272,293 @@ def test_delete_file():
     selector_subindex.phys = FREAD_CACHE
 
     network.disconnect()
+
+
+def test_cache_sync():
+    """Test files added to or removed from the cache dir by other processes
+    are picked up without restarting OLM."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    len_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_LEN_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+    filter_subindex.raw = "sync".encode("utf-8")
+    assert len_subindex.phys == 0
+
+    # publish a file with a rename, like a daemon would
+    tmp_file = FILE_TRANSFER_DIR + FCACHES_FREAD_SYNC_FILE
+    with open(tmp_file, "w") as fptr:
+        fptr.write(random_string_generator(100))
+    rename(tmp_file, FREAD_CACHE_DIR + FCACHES_FREAD_SYNC_FILE)
+    sleep(0.5)
+    assert len_subindex.phys == 1
+
+    remove(FREAD_CACHE_DIR + FCACHES_FREAD_SYNC_FILE)
+    sleep(0.5)
+    assert len_subindex.phys == 0
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_cache_bytes():
+    """Test the cache bytes subindex (uint64, readonly)."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    bytes_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_BYTES_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+
+    # test readonly
+    total = bytes_subindex.phys
+    with pytest.raises(SdoAbortedError):
+        bytes_subindex.phys = 0
+
+    # a keyword is never bigger than the whole cache
+    filter_subindex.raw = "foo".encode("utf-8")
+    assert bytes_subindex.phys <= total
+    filter_subindex.raw = "not_a_keyword".encode("utf-8")
+    assert bytes_subindex.phys == 0
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_max_bytes():
+    """Test the max bytes subindex (uint64, readwrite)."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    subindex = node.sdo[FILE_CACHES_INDEX][MAX_BYTES_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+
+    # no eviction policy, so a budget does not delete anything
+    subindex.phys = 1
+    assert subindex.phys == 1
+    subindex.phys = 0  # no limit
+    assert subindex.phys == 0
+
+    # keyword budgets are separate from the cache budget
+    filter_subindex.raw = "foo".encode("utf-8")
+    subindex.phys = 1000000
+    assert subindex.phys == 1000000
+    filter_subindex.raw = b'\00'  # clear filter
+    assert subindex.phys == 0
+    filter_subindex.raw = "foo".encode("utf-8")
+    subindex.phys = 0
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_max_files():
+    """Test the max files subindex (uint32, readwrite) evicts the oldest files
+    over the budget."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    len_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_LEN_SUBINDEX]
+    iter_subindex = node.sdo[FILE_CACHES_INDEX][ITERATOR_SUBINDEX]
+    name_subindex = node.sdo[FILE_CACHES_INDEX][NAME_SUBINDEX]
+    policy_subindex = node.sdo[FILE_CACHES_INDEX][EVICTION_POLICY_SUBINDEX]
+    subindex = node.sdo[FILE_CACHES_INDEX][MAX_FILES_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+    filter_subindex.raw = "evict".encode("utf-8")
+
+    for name in FCACHES_FREAD_EVICT_FILES:
+        with open(FREAD_CACHE_DIR + name, "w") as fptr:
+            fptr.write(random_string_generator(100))
+    sleep(0.5)
+    assert len_subindex.phys == len(FCACHES_FREAD_EVICT_FILES)
+
+    subindex.phys = 1
+    assert subindex.phys == 1
+    assert len_subindex.phys == len(FCACHES_FREAD_EVICT_FILES)  # no policy
+
+    policy_subindex.phys = EVICT_OLDEST
+    assert len_subindex.phys == 1
+    iter_subindex.phys = 0
+    name = name_subindex.raw.decode("utf-8").replace('\0', '')
+    assert name == FCACHES_FREAD_EVICT_FILES[-1]
+
+    policy_subindex.phys = EVICT_NONE
+    subindex.phys = 0
+    remove(FREAD_CACHE_DIR + FCACHES_FREAD_EVICT_FILES[-1])
+    sleep(0.5)
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_keyword_priority():
+    """Test the keyword priority subindex (uint8, readwrite)."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    subindex = node.sdo[FILE_CACHES_INDEX][KEYWORD_PRIORITY_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+
+    # only keywords have a priority
+    with pytest.raises(SdoAbortedError):
+        subindex.phys
+    with pytest.raises(SdoAbortedError):
+        subindex.phys = 1
+
+    filter_subindex.raw = "foo".encode("utf-8")
+    assert subindex.phys == 0
+    subindex.phys = 200
+    assert subindex.phys == 200
+    subindex.phys = 0
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_eviction_policy():
+    """Test the eviction policy subindex (uint8, readwrite)."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    subindex = node.sdo[FILE_CACHES_INDEX][EVICTION_POLICY_SUBINDEX]
+
+    selector_subindex.phys = FWRITE_CACHE
+
+    # test write with valid inputs, no budgets so nothing is evicted
+    for policy in [EVICT_OLDEST, EVICT_PRIORITY, EVICT_LRU, EVICT_NONE]:
+        subindex.phys = policy
+        assert subindex.phys == policy
+
+    # test with invalid input
+    with pytest.raises(SdoAbortedError):
+        subindex.phys = 4
+
+    selector_subindex.phys = FREAD_CACHE
+    network.disconnect()
+
+
+def test_free_bytes():
+    """Test the free bytes subindex (uint64, readonly)."""
+    network, node = connect_bus()
+    subindex = node.sdo[FILE_CACHES_INDEX][FREE_BYTES_SUBINDEX]
+
+    # test read
+    assert subindex.phys > 0
+
+    # test readonly
+    with pytest.raises(SdoAbortedError):
+        subindex.phys = 0
+
+    network.disconnect()
+
+
+def test_bulk_delete():
+    """Test the delete filtered (DOMAIN, writeonly), delete before (uint32,
+    writeonly) and keep newest (uint32, writeonly) subindexes."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    len_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_LEN_SUBINDEX]
+    iter_subindex = node.sdo[FILE_CACHES_INDEX][ITERATOR_SUBINDEX]
+    name_subindex = node.sdo[FILE_CACHES_INDEX][NAME_SUBINDEX]
+    filtered_subindex = node.sdo[FILE_CACHES_INDEX][DELETE_FILTERED_SUBINDEX]
+    before_subindex = node.sdo[FILE_CACHES_INDEX][DELETE_BEFORE_SUBINDEX]
+    newest_subindex = node.sdo[FILE_CACHES_INDEX][KEEP_NEWEST_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+    filter_subindex.raw = "bulk".encode("utf-8")
+
+    # test writeonly
+    with pytest.raises(SdoAbortedError):
+        filtered_subindex.raw
+    with pytest.raises(SdoAbortedError):
+        before_subindex.phys
+    with pytest.raises(SdoAbortedError):
+        newest_subindex.phys
+
+    for name in FCACHES_FREAD_BULK_FILES:
+        with open(FREAD_CACHE_DIR + name, "w") as fptr:
+            fptr.write(random_string_generator(100))
+    sleep(0.5)
+    assert len_subindex.phys == len(FCACHES_FREAD_BULK_FILES)
+
+    # test_bulk_100.txt is the only file older than 200
+    before_subindex.phys = 200
+    assert len_subindex.phys == len(FCACHES_FREAD_BULK_FILES) - 1
+    assert iter_subindex.phys == 0
+
+    newest_subindex.phys = 1
+    assert len_subindex.phys == 1
+    iter_subindex.phys = 0
+    name = name_subindex.raw.decode("utf-8").replace('\0', '')
+    assert name == FCACHES_FREAD_BULK_FILES[-1]
+
+    filtered_subindex.raw = "0".encode("utf-8")
+    assert len_subindex.phys == 0
+
+    # the files are unlinked by a worker thread
+    sleep(0.5)
+    for name in FCACHES_FREAD_BULK_FILES:
+        with pytest.raises(FileNotFoundError):
+            remove(FREAD_CACHE_DIR + name)
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
+
+
+def test_time_window():
+    """Test the window start (uint32, readwrite) and window end (uint32,
+    readwrite) subindexes."""
+    network, node = connect_bus()
+    selector_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_SELECTOR_SUBINDEX]
+    filter_subindex = node.sdo[FILE_CACHES_INDEX][FILTER_SUBINDEX]
+    len_subindex = node.sdo[FILE_CACHES_INDEX][CACHE_LEN_SUBINDEX]
+    iter_subindex = node.sdo[FILE_CACHES_INDEX][ITERATOR_SUBINDEX]
+    name_subindex = node.sdo[FILE_CACHES_INDEX][NAME_SUBINDEX]
+    filtered_subindex = node.sdo[FILE_CACHES_INDEX][DELETE_FILTERED_SUBINDEX]
+    start_subindex = node.sdo[FILE_CACHES_INDEX][WINDOW_START_SUBINDEX]
+    end_subindex = node.sdo[FILE_CACHES_INDEX][WINDOW_END_SUBINDEX]
+
+    selector_subindex.phys = FREAD_CACHE
+    filter_subindex.raw = "bulk".encode("utf-8")
+
+    for name in FCACHES_FREAD_BULK_FILES:
+        with open(FREAD_CACHE_DIR + name, "w") as fptr:
+            fptr.write(random_string_generator(100))
+    sleep(0.5)
+    assert len_subindex.phys == len(FCACHES_FREAD_BULK_FILES)
+
+    # test_bulk_200.txt and test_bulk_300.txt are in the window
+    start_subindex.phys = 200
+    end_subindex.phys = 300
+    assert start_subindex.phys == 200
+    assert end_subindex.phys == 300
+    assert len_subindex.phys == 2
+    iter_subindex.phys = 0
+    name = name_subindex.raw.decode("utf-8").replace('\0', '')
+    assert name == FCACHES_FREAD_BULK_FILES[1]
+    iter_subindex.phys = 1
+    name = name_subindex.raw.decode("utf-8").replace('\0', '')
+    assert name == FCACHES_FREAD_BULK_FILES[2]
+    with pytest.raises(SdoAbortedError):
+        iter_subindex.phys = 2
+
+    # an end of 0 is no end
+    end_subindex.phys = 0
+    assert len_subindex.phys == len(FCACHES_FREAD_BULK_FILES) - 1
+
+    # only the files in the window are deleted
+    start_subindex.phys = 300
+    filtered_subindex.raw = "0".encode("utf-8")
+    assert len_subindex.phys == 0
+    start_subindex.phys = 0
+    assert len_subindex.phys == 2
+
+    filtered_subindex.raw = "0".encode("utf-8")
+    assert len_subindex.phys == 0
+
+    filter_subindex.raw = b'\00'  # clear filter
+    network.disconnect()
@@ -10,6 +10,15 @@ FWRITE_INDEX = 0x1023
 COMMAND_SUBINDEX = 1
 STATUS_SUBINDEX = 2
 REPLY_SUBINDEX = 3
+JOB_ID_SUBINDEX = 4
+EXIT_CODE_SUBINDEX = 5
+JOBS_RUNNING_SUBINDEX = 6
+FREE_JOB_SUBINDEX = 7
+REPLY_STREAM_SUBINDEX = 8
+REPLY_CURSOR_SUBINDEX = 9
+CANCEL_SUBINDEX = 10
+REPLY_RING_LEN = 1024 * 128
+JOBS = 4
 
 
 class OSCommandReply(Enum):
@@ -75,3 +84,204 @@ def test_os_command():
     assert reply_subindex.raw.decode("utf-8") == message+"\n"
 
     network.disconnect()
+
+
+def test_os_command_status():
+    """Test the OS command status follows the exit status of the command."""
+    network, node = connect_bus()
+    command_subindex = node.sdo[FWRITE_INDEX][COMMAND_SUBINDEX]
+    status_subindex = node.sdo[FWRITE_INDEX][STATUS_SUBINDEX]
+    reply_subindex = node.sdo[FWRITE_INDEX][REPLY_SUBINDEX]
+
+    # failed with no reply
+    command_subindex.raw = "exit 3".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.error_no_reply.value
+
+    # failed with a reply
+    command_subindex.raw = "echo \"abcd\"; false".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.error_reply.value
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+
+    # a new command while one is still running
+    command_subindex.raw = "sleep 1; echo \"abcd\"".encode("utf-8")
+    with pytest.raises(SdoAbortedError):
+        command_subindex.raw = "echo \"efgh\"".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.no_error_reply.value
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+
+    network.disconnect()
+
+
+def test_os_command_jobs():
+    """Test OS commands running at the same time as jobs."""
+    network, node = connect_bus()
+    command_subindex = node.sdo[FWRITE_INDEX][COMMAND_SUBINDEX]
+    status_subindex = node.sdo[FWRITE_INDEX][STATUS_SUBINDEX]
+    reply_subindex = node.sdo[FWRITE_INDEX][REPLY_SUBINDEX]
+    job_id_subindex = node.sdo[FWRITE_INDEX][JOB_ID_SUBINDEX]
+    exit_code_subindex = node.sdo[FWRITE_INDEX][EXIT_CODE_SUBINDEX]
+    jobs_running_subindex = node.sdo[FWRITE_INDEX][JOBS_RUNNING_SUBINDEX]
+    free_job_subindex = node.sdo[FWRITE_INDEX][FREE_JOB_SUBINDEX]
+
+    assert job_id_subindex.phys == 0
+    assert jobs_running_subindex.phys == 0
+    assert free_job_subindex.phys == 0
+
+    # no such job
+    with pytest.raises(SdoAbortedError):
+        job_id_subindex.phys = JOBS
+
+    # a long command in the default job
+    command_subindex.raw = "sleep 2; echo \"abcd\"".encode("utf-8")
+    assert jobs_running_subindex.phys == 1
+    assert free_job_subindex.phys == 1
+
+    # a short command in another job, while the default job runs
+    job_id_subindex.phys = free_job_subindex.phys
+    command_subindex.raw = "echo \"efgh\"; exit 4".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.error_reply.value
+    assert exit_code_subindex.phys == 4
+    assert reply_subindex.raw.decode("utf-8") == "efgh\n"
+    assert jobs_running_subindex.phys == 1
+
+    # the default job is not done yet
+    job_id_subindex.phys = 0
+    assert status_subindex.phys == OSCommandReply.excuting.value
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.no_error_reply.value
+    assert exit_code_subindex.phys == 0
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+    assert jobs_running_subindex.phys == 0
+
+    # all jobs busy
+    for i in range(JOBS):
+        job_id_subindex.phys = i
+        command_subindex.raw = "sleep 1".encode("utf-8")
+    assert jobs_running_subindex.phys == JOBS
+    assert free_job_subindex.phys == 0xFF
+    while jobs_running_subindex.phys != 0:
+        sleep(0.1)
+    job_id_subindex.phys = 0
+
+    network.disconnect()
+
+
+def test_os_command_stream():
+    """Test reading the OS command reply while the command runs."""
+    network, node = connect_bus()
+    command_subindex = node.sdo[FWRITE_INDEX][COMMAND_SUBINDEX]
+    status_subindex = node.sdo[FWRITE_INDEX][STATUS_SUBINDEX]
+    reply_subindex = node.sdo[FWRITE_INDEX][REPLY_SUBINDEX]
+    job_id_subindex = node.sdo[FWRITE_INDEX][JOB_ID_SUBINDEX]
+    stream_subindex = node.sdo[FWRITE_INDEX][REPLY_STREAM_SUBINDEX]
+    cursor_subindex = node.sdo[FWRITE_INDEX][REPLY_CURSOR_SUBINDEX]
+
+    # not the default job, it drops output past a full ring until streamed
+    job_id_subindex.phys = 1
+
+    # a reply longer than the ring, the command waits on it to be read
+    expected = "".join(str(i) + "\n" for i in range(1, 50001))
+    assert len(expected) > REPLY_RING_LEN
+    command_subindex.raw = "seq 1 50000".encode("utf-8")
+    sleep(1)
+    assert status_subindex.phys == OSCommandReply.excuting.value
+
+    reply = ""
+    while True:
+        status = status_subindex.phys
+        try:
+            reply += stream_subindex.raw.decode("utf-8")
+        except SdoAbortedError:  # nothing new
+            if status != OSCommandReply.excuting.value:
+                break
+            sleep(0.1)
+    assert status_subindex.phys in (OSCommandReply.no_error_reply.value,
+                                     OSCommandReply.no_error_no_reply.value)
+    assert reply == expected
+    assert cursor_subindex.phys == len(expected)
+
+    # all of it was streamed out
+    with pytest.raises(SdoAbortedError):
+        reply_subindex.raw
+
+    # the reply keeps what was not streamed out
+    command_subindex.raw = "echo \"abcd\"".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert cursor_subindex.phys == 0
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+    assert stream_subindex.raw.decode("utf-8") == "abcd\n"
+    assert cursor_subindex.phys == 5
+    job_id_subindex.phys = 0
+
+    network.disconnect()
+
+
+def test_os_command_long_reply():
+    """Test a reply longer than the ring for a client that only reads it once
+    the command is done."""
+    network, node = connect_bus()
+    command_subindex = node.sdo[FWRITE_INDEX][COMMAND_SUBINDEX]
+    status_subindex = node.sdo[FWRITE_INDEX][STATUS_SUBINDEX]
+    reply_subindex = node.sdo[FWRITE_INDEX][REPLY_SUBINDEX]
+    exit_code_subindex = node.sdo[FWRITE_INDEX][EXIT_CODE_SUBINDEX]
+
+    # the default job does not wait on reads, the reply is cut short and
+    # that is an error, even though the command did not fail
+    expected = "".join(str(i) + "\n" for i in range(1, 50001))
+    command_subindex.raw = "seq 1 50000".encode("utf-8")
+    for _ in range(50):
+        if status_subindex.phys != OSCommandReply.excuting.value:
+            break
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.error_reply.value
+    assert exit_code_subindex.phys == 0
+    assert reply_subindex.raw.decode("utf-8") == expected[:REPLY_RING_LEN]
+
+    network.disconnect()
+
+
+def test_os_command_cancel():
+    """Test canceling a running OS command."""
+    network, node = connect_bus()
+    command_subindex = node.sdo[FWRITE_INDEX][COMMAND_SUBINDEX]
+    status_subindex = node.sdo[FWRITE_INDEX][STATUS_SUBINDEX]
+    reply_subindex = node.sdo[FWRITE_INDEX][REPLY_SUBINDEX]
+    exit_code_subindex = node.sdo[FWRITE_INDEX][EXIT_CODE_SUBINDEX]
+    cancel_subindex = node.sdo[FWRITE_INDEX][CANCEL_SUBINDEX]
+
+    # nothing to cancel
+    with pytest.raises(SdoAbortedError):
+        cancel_subindex.raw = b"\x01"
+
+    # write only
+    with pytest.raises(SdoAbortedError):
+        cancel_subindex.raw
+
+    command_subindex.raw = "echo \"abcd\"; sleep 60".encode("utf-8")
+    sleep(0.5)
+    assert status_subindex.phys == OSCommandReply.excuting.value
+    cancel_subindex.raw = b"\x01"
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.error_reply.value
+    assert exit_code_subindex.phys == -9  # SIGKILL
+    assert reply_subindex.raw.decode("utf-8") == "abcd\n"
+
+    # the job can run a new command after
+    command_subindex.raw = "echo \"efgh\"".encode("utf-8")
+    while status_subindex.phys == OSCommandReply.excuting.value:
+        sleep(0.1)
+    assert status_subindex.phys == OSCommandReply.no_error_reply.value
+
+    network.disconnect()